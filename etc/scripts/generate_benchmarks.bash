@@ -40,6 +40,13 @@ fi
 NAME_PREFIX=$1
 NUM_BENCHMARKS=$2
 
+# the batch runner plays the games in parallel within a single process and
+# much faster than real time, only fall back to driving refbox processes
+if [ -x ${LLSF_REFBOX_DIR}/bin/rcll-refbox-batch ]
+	then
+		exec ${LLSF_REFBOX_DIR}/bin/rcll-refbox-batch -n ${NUM_BENCHMARKS} ${NAME_PREFIX}
+fi
+
 tmpconfig=$(mktemp ${LLSF_REFBOX_DIR}/cfg/store_to_report_generated_XXXXXX.yaml)
 
 TRAP_SIGNALS="SIGINT SIGTERM SIGPIPE EXIT"
@@ -0,0 +1,93 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_mpsc_queue.cpp - QA for the lock-free MPSC queue
+ *
+ *  Created: Sun Oct 18 16:51:02 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+/// @cond QA
+
+#include <core/utils/mpsc_queue.h>
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace fawkes;
+
+#define NUM_PRODUCERS 4
+#define NUM_ITEMS 200000
+
+int
+main(int argc, char **argv)
+{
+	MPSCQueue<std::pair<int, int>> queue;
+	std::atomic<int>               running(NUM_PRODUCERS);
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < NUM_PRODUCERS; ++p) {
+		producers.emplace_back([&queue, &running, p] {
+			for (int i = 0; i < NUM_ITEMS; ++i) {
+				queue.push(std::make_pair(p, i));
+			}
+			--running;
+		});
+	}
+
+	// per producer, items must arrive complete and in order
+	std::vector<int> next(NUM_PRODUCERS, 0);
+	size_t           batches = 0;
+	size_t           total   = 0;
+	bool             ok      = true;
+
+	auto check = [&](const std::pair<int, int> &item) {
+		if (item.second != next[item.first]) {
+			printf("Producer %d: expected %d, got %d\n", item.first, next[item.first], item.second);
+			ok = false;
+		}
+		next[item.first] = item.second + 1;
+	};
+	while (running > 0 || !queue.empty()) {
+		size_t n = queue.consume_all(check);
+		if (n > 0) {
+			batches += 1;
+			total += n;
+		}
+	}
+	for (auto &t : producers) {
+		t.join();
+	}
+	total += queue.consume_all(check);
+
+	if (total != NUM_PRODUCERS * NUM_ITEMS || queue.size() != 0) {
+		printf("Expected %d items, got %zu (size %zu)\n",
+		       NUM_PRODUCERS * NUM_ITEMS,
+		       total,
+		       queue.size());
+		ok = false;
+	}
+
+	printf("%s: %zu items in %zu batches\n", ok ? "OK" : "FAILED", total, batches);
+	return ok ? 0 : 1;
+}
+
+/// @endcond
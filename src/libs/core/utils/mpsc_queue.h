@@ -0,0 +1,165 @@
+/***************************************************************************
+ *  mpsc_queue.h - Lock-free multi-producer single-consumer queue
+ *
+ *  Created: Sun Oct 18 16:20:45 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version. A runtime exception applies to
+ *  this software (see LICENSE.GPL_WRE file mentioned below for details).
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL_WRE file in the doc directory.
+ */
+
+#ifndef __CORE_UTILS_MPSC_QUEUE_H_
+#define __CORE_UTILS_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace fawkes {
+
+/** @class MPSCQueue <core/utils/mpsc_queue.h>
+ * Lock-free multi-producer single-consumer queue.
+ * Any number of threads may push elements concurrently without taking a
+ * lock. A single consumer thread takes all queued elements at once with
+ * consume_all(), which processes them in the order they were pushed.
+ * Producers never wait for the consumer, even while it is processing a
+ * batch.
+ * @ingroup FCL
+ */
+template <typename Type>
+class MPSCQueue
+{
+public:
+	/** Constructor. */
+	MPSCQueue();
+
+	/** Destructor.
+   * Remaining elements are destroyed without being processed.
+   */
+	~MPSCQueue();
+
+	MPSCQueue(const MPSCQueue<Type> &)            = delete;
+	MPSCQueue &operator=(const MPSCQueue<Type> &) = delete;
+
+	/** Push element to queue.
+   * May be called from any thread.
+   * @param x element to add
+   * @return number of elements in the queue after adding @p x
+   */
+	size_t push(Type x);
+
+	/** Process and remove all queued elements.
+   * Must only be called from one thread at a time.
+   * @param f function called for each element in push order
+   * @return number of processed elements
+   */
+	template <typename F>
+	size_t consume_all(F &&f);
+
+	/** Get number of queued elements.
+   * @return number of elements, may be outdated when used
+   */
+	size_t
+	size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	/** Check if the queue is empty.
+   * @return true if no elements are queued
+   */
+	bool
+	empty() const
+	{
+		return head_.load(std::memory_order_relaxed) == nullptr;
+	}
+
+private:
+	struct Node
+	{
+		Type  value;
+		Node *next;
+	};
+
+	std::atomic<Node *> head_;
+	std::atomic<size_t> size_;
+};
+
+template <typename Type>
+MPSCQueue<Type>::MPSCQueue() : head_(nullptr), size_(0)
+{
+}
+
+template <typename Type>
+MPSCQueue<Type>::~MPSCQueue()
+{
+	Node *n = head_.exchange(nullptr, std::memory_order_acquire);
+	while (n) {
+		Node *next = n->next;
+		delete n;
+		n = next;
+	}
+}
+
+template <typename Type>
+size_t
+MPSCQueue<Type>::push(Type x)
+{
+	// count before linking, the consumer may take the element right away and
+	// must never decrement below zero
+	size_t size = size_.fetch_add(1, std::memory_order_relaxed) + 1;
+	Node  *n    = new Node{std::move(x), head_.load(std::memory_order_relaxed)};
+	while (!head_.compare_exchange_weak(n->next,
+	                                    n,
+	                                    std::memory_order_release,
+	                                    std::memory_order_relaxed)) {
+	}
+	return size;
+}
+
+template <typename Type>
+template <typename F>
+size_t
+MPSCQueue<Type>::consume_all(F &&f)
+{
+	Node *n = head_.exchange(nullptr, std::memory_order_acquire);
+	if (!n) {
+		return 0;
+	}
+
+	// elements are linked newest first, reverse to process in push order
+	Node *ordered = nullptr;
+	while (n) {
+		Node *next = n->next;
+		n->next    = ordered;
+		ordered    = n;
+		n          = next;
+	}
+
+	size_t count = 0;
+	while (ordered) {
+		Node *next = ordered->next;
+		f(ordered->value);
+		delete ordered;
+		ordered = next;
+		++count;
+	}
+	size_.fetch_sub(count, std::memory_order_relaxed);
+	return count;
+}
+
+} // end namespace fawkes
+
+#endif
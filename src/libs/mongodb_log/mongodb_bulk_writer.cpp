@@ -0,0 +1,248 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  mongodb_bulk_writer.cpp - asynchronous batched MongoDB writer
+ *
+ *  Created: Sun Oct 18 10:12:03 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <logging/logger.h>
+#include <mongodb_log/mongodb_bulk_writer.h>
+
+#include <mongocxx/model/insert_one.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/uri.hpp>
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <vector>
+
+/** @class MongoDBBulkWriter <mongodb_log/mongodb_bulk_writer.h>
+ * Asynchronous writer for MongoDB.
+ * Write operations are queued by the caller and executed by a dedicated
+ * writer thread that owns its own client connection. All operations
+ * pending when the writer wakes up are grouped by collection and sent
+ * as one ordered bulk write per collection, preserving the order of
+ * operations within each collection. The queue is bounded, a producer
+ * facing a full queue blocks until the writer caught up.
+ */
+
+/** Constructor.
+ * @param host_port host and port of the MongoDB instance
+ * @param database name of the database to write to
+ * @param logger logger for warnings, may be NULL
+ * @param max_queue_size maximum number of queued operations
+ * @param max_batch_size maximum number of operations per bulk write
+ */
+MongoDBBulkWriter::MongoDBBulkWriter(const std::string &host_port,
+                                     const std::string &database,
+                                     rcll::Logger      *logger,
+                                     size_t             max_queue_size,
+                                     size_t             max_batch_size)
+: logger_(logger),
+  client_(mongocxx::uri{"mongodb://" + host_port}),
+  database_(database),
+  max_queue_size_(std::max<size_t>(1, max_queue_size)),
+  max_batch_size_(std::max<size_t>(1, max_batch_size))
+{
+	writer_thread_ = std::thread(&MongoDBBulkWriter::run, this);
+}
+
+/** Destructor.
+ * Writes all pending operations before returning.
+ */
+MongoDBBulkWriter::~MongoDBBulkWriter()
+{
+	close();
+}
+
+/** Write all pending operations and stop the writer thread.
+ * Operations queued afterwards are dropped, logged, and counted. The
+ * counters remain available and include the final writes.
+ */
+void
+MongoDBBulkWriter::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		shutdown_ = true;
+	}
+	queue_cv_.notify_all();
+	if (writer_thread_.joinable()) {
+		writer_thread_.join();
+	}
+}
+
+/** Queue insertion of a document.
+ * @param collection collection to insert into
+ * @param doc document to insert
+ */
+void
+MongoDBBulkWriter::insert(const std::string &collection, bsoncxx::document::value doc)
+{
+	enqueue(Operation{collection, std::nullopt, std::move(doc), false, Clock::now()});
+}
+
+/** Queue an update of a single document.
+ * @param collection collection to update
+ * @param filter query selecting the document to update
+ * @param update update document, e.g., containing $set
+ * @param upsert true to insert the document if the filter does not match
+ */
+void
+MongoDBBulkWriter::update(const std::string       &collection,
+                          bsoncxx::document::value filter,
+                          bsoncxx::document::value update,
+                          bool                     upsert)
+{
+	enqueue(Operation{collection, std::move(filter), std::move(update), upsert, Clock::now()});
+}
+
+void
+MongoDBBulkWriter::enqueue(Operation &&op)
+{
+	std::unique_lock<std::mutex> lock(queue_mutex_);
+	if (queue_.size() >= max_queue_size_) {
+		stats_.producer_waits += 1;
+		if (logger_) {
+			logger_->log_warn("MongoDB",
+			                  "Write queue full (%zu operations), waiting for writer",
+			                  queue_.size());
+		}
+		space_cv_.wait(lock, [this] { return queue_.size() < max_queue_size_ || shutdown_; });
+	}
+	if (shutdown_) {
+		// the writer thread is gone, nobody would ever write the operation
+		stats_.dropped += 1;
+		if (logger_) {
+			logger_->log_warn("MongoDB",
+			                  "Writer closed, dropping operation on %s",
+			                  op.collection.c_str());
+		}
+		return;
+	}
+	queue_.push_back(std::move(op));
+	stats_.enqueued += 1;
+	stats_.queue_depth     = queue_.size();
+	stats_.max_queue_depth = std::max(stats_.max_queue_depth, queue_.size());
+	lock.unlock();
+	queue_cv_.notify_one();
+}
+
+/** Wait until all queued operations have been written.
+ * Call this before reading data that may still be in the queue.
+ */
+void
+MongoDBBulkWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(queue_mutex_);
+	idle_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+/** Get a snapshot of the writer counters.
+ * @return current statistics
+ */
+MongoDBBulkWriter::Stats
+MongoDBBulkWriter::stats()
+{
+	std::lock_guard<std::mutex> lock(queue_mutex_);
+	return stats_;
+}
+
+void
+MongoDBBulkWriter::run()
+{
+	std::unique_lock<std::mutex> lock(queue_mutex_);
+	while (true) {
+		queue_cv_.wait(lock, [this] { return !queue_.empty() || shutdown_; });
+		if (queue_.empty() && shutdown_) {
+			break;
+		}
+
+		std::deque<Operation> batch;
+		while (!queue_.empty() && batch.size() < max_batch_size_) {
+			batch.push_back(std::move(queue_.front()));
+			queue_.pop_front();
+		}
+		stats_.queue_depth = queue_.size();
+		busy_              = true;
+		lock.unlock();
+		space_cv_.notify_all();
+
+		write_batch(batch);
+
+		lock.lock();
+		busy_ = false;
+		if (queue_.empty()) {
+			idle_cv_.notify_all();
+		}
+	}
+}
+
+void
+MongoDBBulkWriter::write_batch(std::deque<Operation> &batch)
+{
+	// group by collection, std::map keeps the per-collection order stable
+	std::map<std::string, std::vector<Operation *>> by_collection;
+	for (auto &op : batch) {
+		by_collection[op.collection].push_back(&op);
+	}
+
+	uint64_t written = 0;
+	uint64_t failed  = 0;
+	uint64_t batches = 0;
+	for (auto &c : by_collection) {
+		try {
+			mongocxx::collection coll = client_[database_][c.first];
+			mongocxx::bulk_write bulk =
+			  coll.create_bulk_write(mongocxx::options::bulk_write{}.ordered(true));
+			for (Operation *op : c.second) {
+				if (op->filter) {
+					mongocxx::model::update_one model{op->filter->view(), op->doc.view()};
+					model.upsert(op->upsert);
+					bulk.append(model);
+				} else {
+					bulk.append(mongocxx::model::insert_one{op->doc.view()});
+				}
+			}
+			bulk.execute();
+			written += c.second.size();
+		} catch (std::exception &e) {
+			// includes bsoncxx and mongocxx logic errors, which must not end the writer thread
+			failed += c.second.size();
+			if (logger_) {
+				logger_->log_warn("MongoDB",
+				                  "Bulk write of %zu operations to %s failed: %s",
+				                  c.second.size(),
+				                  c.first.c_str(),
+				                  e.what());
+			}
+		}
+		batches += 1;
+	}
+
+	auto latency =
+	  std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - batch.front().enqueued_at);
+
+	std::lock_guard<std::mutex> lock(queue_mutex_);
+	stats_.written += written;
+	stats_.failed += failed;
+	stats_.batches += batches;
+	stats_.last_latency = latency;
+	stats_.max_latency  = std::max(stats_.max_latency, latency);
+}
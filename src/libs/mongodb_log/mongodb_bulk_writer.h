@@ -0,0 +1,110 @@
+
+/***************************************************************************
+ *  mongodb_bulk_writer.h - asynchronous batched MongoDB writer
+ *
+ *  Created: Sun Oct 18 10:12:03 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LIBS_MONGODB_LOG_MONGODB_BULK_WRITER_H_
+#define __LIBS_MONGODB_LOG_MONGODB_BULK_WRITER_H_
+
+#include <bsoncxx/document/value.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mongocxx/client.hpp>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace rcll {
+class Logger;
+}
+
+class MongoDBBulkWriter
+{
+public:
+	/** Counters describing the state of the write queue. */
+	struct Stats
+	{
+		size_t                    queue_depth;     ///< operations currently queued
+		size_t                    max_queue_depth; ///< highest queue depth observed
+		uint64_t                  enqueued;        ///< total number of operations queued
+		uint64_t                  written;         ///< operations acknowledged by the server
+		uint64_t                  failed;          ///< operations in failed bulk writes
+		uint64_t                  dropped;         ///< operations queued after close, not written
+		uint64_t                  batches;         ///< number of bulk writes issued
+		uint64_t                  producer_waits;  ///< times a producer blocked on a full queue
+		std::chrono::microseconds last_latency;    ///< enqueue-to-ack time of the last batch
+		std::chrono::microseconds max_latency;     ///< highest enqueue-to-ack time observed
+	};
+
+	MongoDBBulkWriter(const std::string &host_port,
+	                  const std::string &database,
+	                  rcll::Logger      *logger,
+	                  size_t             max_queue_size = 4096,
+	                  size_t             max_batch_size = 512);
+	~MongoDBBulkWriter();
+
+	void insert(const std::string &collection, bsoncxx::document::value doc);
+	void update(const std::string       &collection,
+	            bsoncxx::document::value filter,
+	            bsoncxx::document::value update,
+	            bool                     upsert);
+
+	void  flush();
+	void  close();
+	Stats stats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Operation
+	{
+		std::string                             collection;
+		std::optional<bsoncxx::document::value> filter;
+		bsoncxx::document::value                doc;
+		bool                                    upsert;
+		Clock::time_point                       enqueued_at;
+	};
+
+	void enqueue(Operation &&op);
+	void run();
+	void write_batch(std::deque<Operation> &batch);
+
+private:
+	rcll::Logger    *logger_;
+	mongocxx::client client_;
+	std::string      database_;
+	size_t           max_queue_size_;
+	size_t           max_batch_size_;
+
+	std::mutex              queue_mutex_;
+	std::condition_variable queue_cv_;
+	std::condition_variable space_cv_;
+	std::condition_variable idle_cv_;
+	std::deque<Operation>   queue_;
+	bool                    busy_     = false;
+	bool                    shutdown_ = false;
+	Stats                   stats_{};
+
+	std::thread writer_thread_;
+};
+
+#endif
@@ -23,166 +23,233 @@
  */
 
 #include <core/exception.h>
-#include <core/threading/mutex.h>
-#include <core/threading/mutex_locker.h>
 #include <google/protobuf/descriptor.h>
 #include <mongodb_log/mongodb_log_protobuf.h>
 
+#include <algorithm>
+#include <bsoncxx/builder/concatenate.hpp>
+#include <memory>
 #include <mongocxx/exception/operation_exception.hpp>
 
 using namespace google::protobuf;
 
 using bsoncxx::builder::basic::document;
 using bsoncxx::builder::basic::kvp;
-using bsoncxx::builder::basic::sub_document;
 using bsoncxx::document::view_or_value;
 
 /** @class MongoDBLogProtobuf <mongodb_log/mongodb_log_logger.h>
  * Thread that provides a logger writing to MongoDB.
  * This thread provides a logger, which writes log information to a
  * MongoDB collection.
+ * Calling write() only serializes the message and stores the raw bytes
+ * together with the meta data in a fixed-size ring buffer. A background
+ * thread converts buffered messages to BSON and inserts them in batches.
+ * If the buffer is full, the configured OverflowPolicy decides whether
+ * the new or the oldest message is dropped or the caller waits.
  * @author Tim Niemueller
  */
 
-/** Constructor. */
-MongoDBLogProtobuf::MongoDBLogProtobuf(std::string host_port, std::string collection)
+/** Constructor.
+ * @param host_port host and port of the MongoDB instance
+ * @param collection collection in the rcll database to write to
+ * @param buffer_size maximum number of buffered messages
+ * @param batch_size maximum number of messages per insert
+ * @param policy behavior when the buffer is full
+ */
+MongoDBLogProtobuf::MongoDBLogProtobuf(std::string    host_port,
+                                       std::string    collection,
+                                       size_t         buffer_size,
+                                       size_t         batch_size,
+                                       OverflowPolicy policy)
+: batch_size_(std::max<size_t>(1, batch_size)), policy_(policy)
 {
-	mutex_ = new fawkes::Mutex();
-
-	std::string uri{"mongodb://" + host_port};
 	client_     = mongocxx::client{mongocxx::uri{"mongodb://" + host_port}};
 	collection_ = client_["rcll"][collection];
+
+	ring_.resize(std::max<size_t>(1, buffer_size));
+	writer_thread_ = std::thread(&MongoDBLogProtobuf::run, this);
 }
 
-/** Destructor. */
+/** Destructor.
+ * Writes all buffered messages before returning.
+ */
 MongoDBLogProtobuf::~MongoDBLogProtobuf()
 {
-	delete mutex_;
+	close();
 }
 
+/** Write all buffered messages and stop the writer thread.
+ * Messages written afterwards are discarded. The counters remain available
+ * and include the final writes.
+ */
 void
-MongoDBLogProtobuf::add_field(const FieldDescriptor             *field,
-                              const ::google::protobuf::Message &m,
-                              document                          *doc)
+MongoDBLogProtobuf::close()
 {
-	const Reflection *refl = m.GetReflection();
-
-	int count = 0;
-	if (field->is_repeated()) {
-		count = refl->FieldSize(m, field);
-	} else if (refl->HasField(m, field)) {
-		count = 1;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		shutdown_ = true;
 	}
-
-	for (int j = 0; j < count; ++j) {
-		switch (field->type()) {
-#define HANDLE_PRIMITIVE_TYPE(TYPE, CPPTYPE, CPPTYPE_METHOD)                                    \
-	case FieldDescriptor::TYPE_##TYPE: {                                                          \
-		const CPPTYPE value = field->is_repeated() ? refl->GetRepeated##CPPTYPE_METHOD(m, field, j) \
-		                                           : refl->Get##CPPTYPE_METHOD(m, field);           \
-		doc->append(kvp(field->name(), value));                                                     \
-		break;                                                                                      \
+	data_cv_.notify_all();
+	space_cv_.notify_all();
+	if (writer_thread_.joinable()) {
+		writer_thread_.join();
 	}
+}
 
-			HANDLE_PRIMITIVE_TYPE(INT32, int, Int32);
-			HANDLE_PRIMITIVE_TYPE(INT64, long int, Int64);
-			HANDLE_PRIMITIVE_TYPE(SINT32, int, Int32);
-			HANDLE_PRIMITIVE_TYPE(SINT64, long int, Int64);
-			HANDLE_PRIMITIVE_TYPE(UINT32, long int, UInt32);
-			HANDLE_PRIMITIVE_TYPE(UINT64, long int, UInt64);
-
-			HANDLE_PRIMITIVE_TYPE(FIXED32, int, UInt32);
-			HANDLE_PRIMITIVE_TYPE(FIXED64, long int, UInt64);
-			HANDLE_PRIMITIVE_TYPE(SFIXED32, int, Int32);
-			HANDLE_PRIMITIVE_TYPE(SFIXED64, long int, Int64);
-
-			HANDLE_PRIMITIVE_TYPE(FLOAT, float, Float);
-			HANDLE_PRIMITIVE_TYPE(DOUBLE, double, Double);
+/** Parse overflow policy from its configuration name.
+ * @param policy one of drop-newest, drop-oldest, or block
+ * @return parsed policy
+ * @throw fawkes::Exception thrown if the name is unknown
+ */
+MongoDBLogProtobuf::OverflowPolicy
+MongoDBLogProtobuf::parse_overflow_policy(const std::string &policy)
+{
+	if (policy == "drop-newest") {
+		return DROP_NEWEST;
+	} else if (policy == "drop-oldest") {
+		return DROP_OLDEST;
+	} else if (policy == "block") {
+		return BLOCK;
+	} else {
+		throw fawkes::Exception("Unknown protobuf log overflow policy '%s'", policy.c_str());
+	}
+}
 
-			HANDLE_PRIMITIVE_TYPE(BOOL, bool, Bool);
-#undef HANDLE_PRIMITIVE_TYPE
+/** Get a snapshot of the capture counters.
+ * @return current statistics
+ */
+MongoDBLogProtobuf::Stats
+MongoDBLogProtobuf::stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
 
-		case FieldDescriptor::TYPE_MESSAGE: {
-			const google::protobuf::Message &sub_m =
-			  field->is_repeated() ? refl->GetRepeatedMessage(m, field, j) : refl->GetMessage(m, field);
-			doc->append(kvp(field->name(), add_message(sub_m)));
+void
+MongoDBLogProtobuf::capture(const google::protobuf::Message        &m,
+                            std::optional<bsoncxx::document::value> meta_data)
+{
+	Entry e{m.GetDescriptor(),
+	        m.GetReflection()->GetMessageFactory(),
+	        m.SerializeAsString(),
+	        std::move(meta_data),
+	        std::chrono::system_clock::now()};
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (shutdown_) {
+		return;
+	}
+	stats_.captured += 1;
+	if (count_ == ring_.size()) {
+		switch (policy_) {
+		case DROP_NEWEST: stats_.dropped += 1; return;
+		case DROP_OLDEST:
+			stats_.dropped += 1;
+			head_ = (head_ + 1) % ring_.size();
+			count_ -= 1;
+			break;
+		case BLOCK:
+			stats_.blocked += 1;
+			space_cv_.wait(lock, [this] { return count_ < ring_.size() || shutdown_; });
+			if (count_ == ring_.size()) {
+				stats_.dropped += 1;
+				return;
+			}
 			break;
 		}
+	}
+	ring_[(head_ + count_) % ring_.size()] = std::move(e);
+	count_ += 1;
+	stats_.max_depth = std::max(stats_.max_depth, count_);
+	lock.unlock();
+	data_cv_.notify_one();
+}
 
-		case FieldDescriptor::TYPE_GROUP: break;
+void
+MongoDBLogProtobuf::run()
+{
+	std::vector<Entry> batch;
+	batch.reserve(batch_size_);
 
-		case FieldDescriptor::TYPE_ENUM: {
-			const EnumValueDescriptor *value =
-			  field->is_repeated() ? refl->GetRepeatedEnum(m, field, j) : refl->GetEnum(m, field);
-			doc->append(kvp(field->name(), value->name()));
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		data_cv_.wait(lock, [this] { return count_ > 0 || shutdown_; });
+		if (count_ == 0 && shutdown_) {
 			break;
 		}
 
-		// Handle strings separately so that we can get string references
-		// instead of copying.
-		case FieldDescriptor::TYPE_STRING: {
-			string        scratch;
-			const string &value = field->is_repeated()
-			                        ? refl->GetRepeatedStringReference(m, field, j, &scratch)
-			                        : refl->GetStringReference(m, field, &scratch);
-			//VerifyUTF8String(value.data(), value.length(), SERIALIZE);
-			doc->append(kvp(field->name(), value));
-			break;
+		while (count_ > 0 && batch.size() < batch_size_) {
+			batch.push_back(std::move(ring_[head_]));
+			head_ = (head_ + 1) % ring_.size();
+			count_ -= 1;
 		}
+		lock.unlock();
+		space_cv_.notify_all();
 
-		case FieldDescriptor::TYPE_BYTES: {
-			string        scratch;
-			const string &value = field->is_repeated()
-			                        ? refl->GetRepeatedStringReference(m, field, j, &scratch)
-			                        : refl->GetStringReference(m, field, &scratch);
-			doc->append(kvp(field->name(), value));
-			break;
-		}
-		}
+		write_batch(batch);
+		batch.clear();
+
+		lock.lock();
 	}
 }
 
-document
-MongoDBLogProtobuf::add_message(const google::protobuf::Message &m)
+void
+MongoDBLogProtobuf::write_batch(std::vector<Entry> &batch)
 {
-	document doc{};
-	doc.append(kvp("_type", m.GetTypeName()));
+	std::vector<bsoncxx::document::value> docs;
+	docs.reserve(batch.size());
 
-	std::string data;
-	m.SerializeToString(&data);
-	doc.append(kvp("_protobuf", data));
-
-	const Reflection *refl = m.GetReflection();
-
-	std::vector<const FieldDescriptor *> fields;
-	refl->ListFields(m, &fields);
+	for (Entry &e : batch) {
+		const Message *prototype = e.factory ? e.factory->GetPrototype(e.descriptor) : nullptr;
+		if (!prototype) {
+			continue;
+		}
+		std::unique_ptr<Message> m(prototype->New());
+		if (!m->ParseFromString(e.data)) {
+			continue;
+		}
+		document doc{converter_.convert(*m, &e.data)};
+		doc.append(kvp("_time", bsoncxx::types::b_date(e.time)));
+		if (e.meta_data) {
+			doc.append(bsoncxx::builder::concatenate(e.meta_data->view()));
+		}
+		docs.push_back(doc.extract());
+	}
 
-	for (size_t i = 0; i < fields.size(); ++i) {
-		add_field(fields[i], m, &doc);
+	uint64_t written = 0;
+	uint64_t failed  = 0;
+	if (!docs.empty()) {
+		try {
+			collection_.insert_many(docs, mongocxx::options::insert{}.ordered(false));
+			written = docs.size();
+		} catch (mongocxx::operation_exception &) {
+			failed = docs.size();
+		}
 	}
-	return doc;
+	failed += batch.size() - docs.size();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	stats_.written += written;
+	stats_.failed += failed;
 }
 
+/** Log a message.
+ * The message is serialized immediately and written asynchronously.
+ * @param m message to log
+ */
 void
 MongoDBLogProtobuf::write(const google::protobuf::Message &m)
 {
-	fawkes::MutexLocker lock(mutex_);
-	document            doc{add_message(m)};
-	doc.append(kvp("_time", bsoncxx::types::b_date(std::chrono::system_clock::now())));
-	try {
-		collection_.insert_one(doc.view());
-	} catch (mongocxx::operation_exception &) {
-	} // ignored
+	capture(m, std::nullopt);
 }
 
+/** Log a message with additional meta data.
+ * The fields of the meta data document are added to the logged document.
+ * @param m message to log
+ * @param meta_data meta data, e.g., direction and peer of the message
+ */
 void
 MongoDBLogProtobuf::write(const google::protobuf::Message &m, const view_or_value &meta_data)
 {
-	fawkes::MutexLocker lock(mutex_);
-	document            doc{add_message(m)};
-	doc.append(kvp("_time", bsoncxx::types::b_date(std::chrono::system_clock::now())));
-	try {
-		collection_.insert_one(doc.view());
-	} catch (mongocxx::operation_exception &) {
-	} // ignored
+	capture(m, bsoncxx::document::value{meta_data.view()});
 }
@@ -23,35 +23,91 @@
 #define __LIBS_MONGODB_LOG_MONGODB_LOG_PROTOBUF_H_
 
 #include <google/protobuf/message.h>
+#include <mongodb_log/mongodb_protobuf_converter.h>
 
 #include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/document/value.hpp>
 #include <bsoncxx/document/view_or_value.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <mongocxx/client.hpp>
+#include <mutex>
+#include <optional>
 #include <string>
-
-namespace fawkes {
-class Mutex;
-}
+#include <thread>
+#include <vector>
 
 class MongoDBLogProtobuf
 {
 public:
-	MongoDBLogProtobuf(std::string host_port, std::string collection);
+	/** Behavior when the capture buffer is full. */
+	typedef enum {
+		DROP_NEWEST, ///< discard the message that is being captured
+		DROP_OLDEST, ///< overwrite the oldest message in the buffer
+		BLOCK        ///< wait until the writer made room
+	} OverflowPolicy;
+
+	/** Counters describing the capture buffer. */
+	struct Stats
+	{
+		uint64_t captured;  ///< messages captured
+		uint64_t written;   ///< messages inserted into the database
+		uint64_t dropped;   ///< messages discarded due to a full buffer
+		uint64_t failed;    ///< messages in failed inserts
+		size_t   max_depth; ///< highest number of buffered messages observed
+		uint64_t blocked;   ///< times a producer waited on a full buffer
+	};
+
+	MongoDBLogProtobuf(std::string    host_port,
+	                   std::string    collection,
+	                   size_t         buffer_size = 4096,
+	                   size_t         batch_size  = 256,
+	                   OverflowPolicy policy      = DROP_OLDEST);
 	virtual ~MongoDBLogProtobuf();
 
 	void write(const google::protobuf::Message &m);
 	void write(const google::protobuf::Message &m, const bsoncxx::document::view_or_value &meta_data);
 
+	void  close();
+	Stats stats();
+
+	static OverflowPolicy parse_overflow_policy(const std::string &policy);
+
 private:
-	void                              add_field(const ::google::protobuf::FieldDescriptor *field,
-	                                            const ::google::protobuf::Message         &m,
-	                                            bsoncxx::builder::basic::document         *doc);
-	bsoncxx::builder::basic::document add_message(const google::protobuf::Message &m);
+	/** Raw message captured on the calling thread. */
+	struct Entry
+	{
+		const google::protobuf::Descriptor     *descriptor;
+		google::protobuf::MessageFactory       *factory;
+		std::string                             data;
+		std::optional<bsoncxx::document::value> meta_data;
+		std::chrono::system_clock::time_point   time;
+	};
+
+	void capture(const google::protobuf::Message &m, std::optional<bsoncxx::document::value> meta_data);
+	void run();
+	void write_batch(std::vector<Entry> &batch);
 
 private:
-	fawkes::Mutex       *mutex_;
 	mongocxx::client     client_;
 	mongocxx::collection collection_;
+
+	MongoDBProtobufConverter converter_;
+
+	size_t         batch_size_;
+	OverflowPolicy policy_;
+
+	std::mutex              mutex_;
+	std::condition_variable data_cv_;
+	std::condition_variable space_cv_;
+	std::vector<Entry>      ring_;
+	size_t                  head_     = 0;
+	size_t                  count_    = 0;
+	bool                    shutdown_ = false;
+	Stats                   stats_{};
+
+	std::thread writer_thread_;
 };
 
 #endif
@@ -0,0 +1,289 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  mongodb_protobuf_converter.cpp - protobuf to BSON conversion
+ *
+ *  Created: Sun Oct 18 14:02:17 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <mongodb_log/mongodb_protobuf_converter.h>
+
+#include <algorithm>
+
+using namespace google::protobuf;
+
+using bsoncxx::builder::basic::document;
+using bsoncxx::builder::basic::kvp;
+
+/** @class MongoDBProtobufConverter <mongodb_log/mongodb_protobuf_converter.h>
+ * Convert protobuf messages to BSON documents.
+ * On first use of a message type, a plan is compiled from its descriptor.
+ * The plan is a flat list of the message's fields, each with its BSON key
+ * and a handler for the field's type. Subsequent conversions of the same
+ * type only run the handlers, the descriptor is not inspected again.
+ * The resulting document contains the type name as _type, the serialized
+ * message as _protobuf, and one entry per set field in field number order,
+ * as listed by Reflection::ListFields(). Repeated fields are added as one
+ * entry per element.
+ * This class is not thread-safe, use one instance per thread.
+ */
+
+/** Constructor. */
+MongoDBProtobufConverter::MongoDBProtobufConverter()
+{
+}
+
+/** Destructor. */
+MongoDBProtobufConverter::~MongoDBProtobufConverter()
+{
+}
+
+/** Get number of compiled conversion plans.
+ * @return number of message types seen so far
+ */
+size_t
+MongoDBProtobufConverter::num_plans() const
+{
+	return plans_.size();
+}
+
+const MongoDBProtobufConverter::MessagePlan &
+MongoDBProtobufConverter::plan(const Descriptor *desc)
+{
+	auto p = plans_.find(desc);
+	if (p != plans_.end()) {
+		return *p->second;
+	}
+
+	auto mplan       = std::make_unique<MessagePlan>();
+	mplan->type_name = desc->full_name();
+	mplan->fields.reserve(desc->field_count());
+	for (int i = 0; i < desc->field_count(); ++i) {
+		const FieldDescriptor *field   = desc->field(i);
+		FieldHandler           handler = nullptr;
+		switch (field->type()) {
+		case FieldDescriptor::TYPE_INT32:
+		case FieldDescriptor::TYPE_SINT32:
+		case FieldDescriptor::TYPE_SFIXED32: handler = &append_int32; break;
+		case FieldDescriptor::TYPE_INT64:
+		case FieldDescriptor::TYPE_SINT64:
+		case FieldDescriptor::TYPE_SFIXED64: handler = &append_int64; break;
+		case FieldDescriptor::TYPE_UINT32: handler = &append_uint32; break;
+		case FieldDescriptor::TYPE_FIXED32: handler = &append_fixed32; break;
+		case FieldDescriptor::TYPE_UINT64:
+		case FieldDescriptor::TYPE_FIXED64: handler = &append_uint64; break;
+		case FieldDescriptor::TYPE_FLOAT: handler = &append_float; break;
+		case FieldDescriptor::TYPE_DOUBLE: handler = &append_double; break;
+		case FieldDescriptor::TYPE_BOOL: handler = &append_bool; break;
+		case FieldDescriptor::TYPE_ENUM: handler = &append_enum; break;
+		case FieldDescriptor::TYPE_STRING:
+		case FieldDescriptor::TYPE_BYTES: handler = &append_string; break;
+		case FieldDescriptor::TYPE_MESSAGE: handler = &append_message; break;
+		case FieldDescriptor::TYPE_GROUP: break;
+		}
+		if (handler) {
+			mplan->fields.push_back(FieldPlan{field, field->name(), handler});
+		}
+	}
+	// ListFields() orders by field number, which may differ from declaration order
+	std::sort(mplan->fields.begin(),
+	          mplan->fields.end(),
+	          [](const FieldPlan &a, const FieldPlan &b) {
+		          return a.field->number() < b.field->number();
+	          });
+
+	const MessagePlan &rv = *mplan;
+	plans_[desc]          = std::move(mplan);
+	return rv;
+}
+
+/** Convert a message to a BSON document.
+ * @param m message to convert
+ * @param serialized serialized form of @p m if already available, it is
+ * stored in the _protobuf field instead of serializing the message again
+ * @return BSON document representing the message
+ */
+document
+MongoDBProtobufConverter::convert(const Message &m, const std::string *serialized)
+{
+	const MessagePlan &mplan = plan(m.GetDescriptor());
+
+	document doc{};
+	doc.append(kvp("_type", mplan.type_name));
+	if (serialized) {
+		doc.append(kvp("_protobuf", *serialized));
+	} else {
+		doc.append(kvp("_protobuf", m.SerializeAsString()));
+	}
+
+	for (const FieldPlan &f : mplan.fields) {
+		f.handler(this, f, m, &doc);
+	}
+	return doc;
+}
+
+template <typename BsonT, typename PbT>
+void
+MongoDBProtobufConverter::append_primitive(const FieldPlan &plan,
+                                           const Message   &m,
+                                           document        *doc,
+                                           PbT (Reflection::*get)(const Message &,
+                                                                  const FieldDescriptor *) const,
+                                           PbT (Reflection::*get_repeated)(const Message &,
+                                                                           const FieldDescriptor *,
+                                                                           int) const)
+{
+	const Reflection *refl = m.GetReflection();
+	if (plan.field->is_repeated()) {
+		int count = refl->FieldSize(m, plan.field);
+		for (int i = 0; i < count; ++i) {
+			const BsonT value = (refl->*get_repeated)(m, plan.field, i);
+			doc->append(kvp(plan.key, value));
+		}
+	} else if (refl->HasField(m, plan.field)) {
+		const BsonT value = (refl->*get)(m, plan.field);
+		doc->append(kvp(plan.key, value));
+	}
+}
+
+void
+MongoDBProtobufConverter::append_int32(MongoDBProtobufConverter *,
+                                       const FieldPlan &plan,
+                                       const Message   &m,
+                                       document        *doc)
+{
+	append_primitive<int>(plan, m, doc, &Reflection::GetInt32, &Reflection::GetRepeatedInt32);
+}
+
+void
+MongoDBProtobufConverter::append_int64(MongoDBProtobufConverter *,
+                                       const FieldPlan &plan,
+                                       const Message   &m,
+                                       document        *doc)
+{
+	append_primitive<long int>(plan, m, doc, &Reflection::GetInt64, &Reflection::GetRepeatedInt64);
+}
+
+void
+MongoDBProtobufConverter::append_uint32(MongoDBProtobufConverter *,
+                                        const FieldPlan &plan,
+                                        const Message   &m,
+                                        document        *doc)
+{
+	append_primitive<long int>(plan, m, doc, &Reflection::GetUInt32, &Reflection::GetRepeatedUInt32);
+}
+
+void
+MongoDBProtobufConverter::append_fixed32(MongoDBProtobufConverter *,
+                                         const FieldPlan &plan,
+                                         const Message   &m,
+                                         document        *doc)
+{
+	// stored as 32 bit integer for compatibility with existing logs
+	append_primitive<int>(plan, m, doc, &Reflection::GetUInt32, &Reflection::GetRepeatedUInt32);
+}
+
+void
+MongoDBProtobufConverter::append_uint64(MongoDBProtobufConverter *,
+                                        const FieldPlan &plan,
+                                        const Message   &m,
+                                        document        *doc)
+{
+	append_primitive<long int>(plan, m, doc, &Reflection::GetUInt64, &Reflection::GetRepeatedUInt64);
+}
+
+void
+MongoDBProtobufConverter::append_float(MongoDBProtobufConverter *,
+                                       const FieldPlan &plan,
+                                       const Message   &m,
+                                       document        *doc)
+{
+	append_primitive<float>(plan, m, doc, &Reflection::GetFloat, &Reflection::GetRepeatedFloat);
+}
+
+void
+MongoDBProtobufConverter::append_double(MongoDBProtobufConverter *,
+                                        const FieldPlan &plan,
+                                        const Message   &m,
+                                        document        *doc)
+{
+	append_primitive<double>(plan, m, doc, &Reflection::GetDouble, &Reflection::GetRepeatedDouble);
+}
+
+void
+MongoDBProtobufConverter::append_bool(MongoDBProtobufConverter *,
+                                      const FieldPlan &plan,
+                                      const Message   &m,
+                                      document        *doc)
+{
+	append_primitive<bool>(plan, m, doc, &Reflection::GetBool, &Reflection::GetRepeatedBool);
+}
+
+void
+MongoDBProtobufConverter::append_enum(MongoDBProtobufConverter *,
+                                      const FieldPlan &plan,
+                                      const Message   &m,
+                                      document        *doc)
+{
+	const Reflection *refl = m.GetReflection();
+	if (plan.field->is_repeated()) {
+		int count = refl->FieldSize(m, plan.field);
+		for (int i = 0; i < count; ++i) {
+			doc->append(kvp(plan.key, refl->GetRepeatedEnum(m, plan.field, i)->name()));
+		}
+	} else if (refl->HasField(m, plan.field)) {
+		doc->append(kvp(plan.key, refl->GetEnum(m, plan.field)->name()));
+	}
+}
+
+void
+MongoDBProtobufConverter::append_string(MongoDBProtobufConverter *,
+                                        const FieldPlan &plan,
+                                        const Message   &m,
+                                        document        *doc)
+{
+	const Reflection *refl = m.GetReflection();
+	std::string       scratch;
+	if (plan.field->is_repeated()) {
+		int count = refl->FieldSize(m, plan.field);
+		for (int i = 0; i < count; ++i) {
+			doc->append(
+			  kvp(plan.key, refl->GetRepeatedStringReference(m, plan.field, i, &scratch)));
+		}
+	} else if (refl->HasField(m, plan.field)) {
+		doc->append(kvp(plan.key, refl->GetStringReference(m, plan.field, &scratch)));
+	}
+}
+
+void
+MongoDBProtobufConverter::append_message(MongoDBProtobufConverter *converter,
+                                         const FieldPlan          &plan,
+                                         const Message            &m,
+                                         document                 *doc)
+{
+	const Reflection *refl = m.GetReflection();
+	if (plan.field->is_repeated()) {
+		int count = refl->FieldSize(m, plan.field);
+		for (int i = 0; i < count; ++i) {
+			doc->append(
+			  kvp(plan.key, converter->convert(refl->GetRepeatedMessage(m, plan.field, i))));
+		}
+	} else if (refl->HasField(m, plan.field)) {
+		doc->append(kvp(plan.key, converter->convert(refl->GetMessage(m, plan.field))));
+	}
+}
@@ -0,0 +1,130 @@
+
+/***************************************************************************
+ *  mongodb_protobuf_converter.h - protobuf to BSON conversion
+ *
+ *  Created: Sun Oct 18 14:02:17 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LIBS_MONGODB_LOG_MONGODB_PROTOBUF_CONVERTER_H_
+#define __LIBS_MONGODB_LOG_MONGODB_PROTOBUF_CONVERTER_H_
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <bsoncxx/builder/basic/document.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MongoDBProtobufConverter
+{
+public:
+	MongoDBProtobufConverter();
+	~MongoDBProtobufConverter();
+
+	bsoncxx::builder::basic::document convert(const google::protobuf::Message &m,
+	                                          const std::string               *serialized = nullptr);
+
+	size_t num_plans() const;
+
+private:
+	struct FieldPlan;
+	typedef void (*FieldHandler)(MongoDBProtobufConverter          *converter,
+	                             const FieldPlan                   &plan,
+	                             const google::protobuf::Message   &m,
+	                             bsoncxx::builder::basic::document *doc);
+
+	/** Conversion step for a single field. */
+	struct FieldPlan
+	{
+		const google::protobuf::FieldDescriptor *field;
+		std::string                              key;
+		FieldHandler                             handler;
+	};
+
+	/** Conversion steps for all fields of a message type. */
+	struct MessagePlan
+	{
+		std::string            type_name;
+		std::vector<FieldPlan> fields;
+	};
+
+	const MessagePlan &plan(const google::protobuf::Descriptor *desc);
+
+	template <typename BsonT, typename PbT>
+	static void append_primitive(const FieldPlan                   &plan,
+	                             const google::protobuf::Message   &m,
+	                             bsoncxx::builder::basic::document *doc,
+	                             PbT (google::protobuf::Reflection::*get)(
+	                               const google::protobuf::Message &,
+	                               const google::protobuf::FieldDescriptor *) const,
+	                             PbT (google::protobuf::Reflection::*get_repeated)(
+	                               const google::protobuf::Message &,
+	                               const google::protobuf::FieldDescriptor *,
+	                               int) const);
+
+	static void append_int32(MongoDBProtobufConverter          *converter,
+	                         const FieldPlan                   &plan,
+	                         const google::protobuf::Message   &m,
+	                         bsoncxx::builder::basic::document *doc);
+	static void append_int64(MongoDBProtobufConverter          *converter,
+	                         const FieldPlan                   &plan,
+	                         const google::protobuf::Message   &m,
+	                         bsoncxx::builder::basic::document *doc);
+	static void append_uint32(MongoDBProtobufConverter          *converter,
+	                          const FieldPlan                   &plan,
+	                          const google::protobuf::Message   &m,
+	                          bsoncxx::builder::basic::document *doc);
+	static void append_fixed32(MongoDBProtobufConverter          *converter,
+	                           const FieldPlan                   &plan,
+	                           const google::protobuf::Message   &m,
+	                           bsoncxx::builder::basic::document *doc);
+	static void append_uint64(MongoDBProtobufConverter          *converter,
+	                          const FieldPlan                   &plan,
+	                          const google::protobuf::Message   &m,
+	                          bsoncxx::builder::basic::document *doc);
+	static void append_float(MongoDBProtobufConverter          *converter,
+	                         const FieldPlan                   &plan,
+	                         const google::protobuf::Message   &m,
+	                         bsoncxx::builder::basic::document *doc);
+	static void append_double(MongoDBProtobufConverter          *converter,
+	                          const FieldPlan                   &plan,
+	                          const google::protobuf::Message   &m,
+	                          bsoncxx::builder::basic::document *doc);
+	static void append_bool(MongoDBProtobufConverter          *converter,
+	                        const FieldPlan                   &plan,
+	                        const google::protobuf::Message   &m,
+	                        bsoncxx::builder::basic::document *doc);
+	static void append_enum(MongoDBProtobufConverter          *converter,
+	                        const FieldPlan                   &plan,
+	                        const google::protobuf::Message   &m,
+	                        bsoncxx::builder::basic::document *doc);
+	static void append_string(MongoDBProtobufConverter          *converter,
+	                          const FieldPlan                   &plan,
+	                          const google::protobuf::Message   &m,
+	                          bsoncxx::builder::basic::document *doc);
+	static void append_message(MongoDBProtobufConverter          *converter,
+	                           const FieldPlan                   &plan,
+	                           const google::protobuf::Message   &m,
+	                           bsoncxx::builder::basic::document *doc);
+
+private:
+	std::unordered_map<const google::protobuf::Descriptor *, std::unique_ptr<MessagePlan>> plans_;
+};
+
+#endif
@@ -0,0 +1,348 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_protobuf_bson.cpp - check and benchmark protobuf to BSON conversion
+ *
+ *  Created: Sun Oct 18 14:41:09 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <mongodb_log/mongodb_protobuf_converter.h>
+#include <msgs/BeaconSignal.pb.h>
+#include <msgs/MachineInfo.pb.h>
+#include <msgs/OrderInfo.pb.h>
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+
+#include <bsoncxx/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+//  By default do not include examples in API documentation
+/// @cond EXAMPLES
+
+using namespace google::protobuf;
+using namespace llsf_msgs;
+
+using bsoncxx::builder::basic::document;
+using bsoncxx::builder::basic::kvp;
+
+static document baseline_add_message(const Message &m);
+
+/** Reference conversion, copied from the former MongoDBLogProtobuf::add_field(). */
+static void
+baseline_add_field(const FieldDescriptor *field, const Message &m, document *doc)
+{
+	const Reflection *refl = m.GetReflection();
+
+	int count = 0;
+	if (field->is_repeated()) {
+		count = refl->FieldSize(m, field);
+	} else if (refl->HasField(m, field)) {
+		count = 1;
+	}
+
+	for (int j = 0; j < count; ++j) {
+		switch (field->type()) {
+#define HANDLE_PRIMITIVE_TYPE(TYPE, CPPTYPE, CPPTYPE_METHOD)                                    \
+	case FieldDescriptor::TYPE_##TYPE: {                                                          \
+		const CPPTYPE value = field->is_repeated() ? refl->GetRepeated##CPPTYPE_METHOD(m, field, j) \
+		                                           : refl->Get##CPPTYPE_METHOD(m, field);           \
+		doc->append(kvp(field->name(), value));                                                     \
+		break;                                                                                      \
+	}
+
+			HANDLE_PRIMITIVE_TYPE(INT32, int, Int32);
+			HANDLE_PRIMITIVE_TYPE(INT64, long int, Int64);
+			HANDLE_PRIMITIVE_TYPE(SINT32, int, Int32);
+			HANDLE_PRIMITIVE_TYPE(SINT64, long int, Int64);
+			HANDLE_PRIMITIVE_TYPE(UINT32, long int, UInt32);
+			HANDLE_PRIMITIVE_TYPE(UINT64, long int, UInt64);
+
+			HANDLE_PRIMITIVE_TYPE(FIXED32, int, UInt32);
+			HANDLE_PRIMITIVE_TYPE(FIXED64, long int, UInt64);
+			HANDLE_PRIMITIVE_TYPE(SFIXED32, int, Int32);
+			HANDLE_PRIMITIVE_TYPE(SFIXED64, long int, Int64);
+
+			HANDLE_PRIMITIVE_TYPE(FLOAT, float, Float);
+			HANDLE_PRIMITIVE_TYPE(DOUBLE, double, Double);
+
+			HANDLE_PRIMITIVE_TYPE(BOOL, bool, Bool);
+#undef HANDLE_PRIMITIVE_TYPE
+
+		case FieldDescriptor::TYPE_MESSAGE: {
+			const Message &sub_m =
+			  field->is_repeated() ? refl->GetRepeatedMessage(m, field, j) : refl->GetMessage(m, field);
+			doc->append(kvp(field->name(), baseline_add_message(sub_m)));
+			break;
+		}
+
+		case FieldDescriptor::TYPE_GROUP: break;
+
+		case FieldDescriptor::TYPE_ENUM: {
+			const EnumValueDescriptor *value =
+			  field->is_repeated() ? refl->GetRepeatedEnum(m, field, j) : refl->GetEnum(m, field);
+			doc->append(kvp(field->name(), value->name()));
+			break;
+		}
+
+		case FieldDescriptor::TYPE_STRING:
+		case FieldDescriptor::TYPE_BYTES: {
+			std::string        scratch;
+			const std::string &value = field->is_repeated()
+			                             ? refl->GetRepeatedStringReference(m, field, j, &scratch)
+			                             : refl->GetStringReference(m, field, &scratch);
+			doc->append(kvp(field->name(), value));
+			break;
+		}
+		}
+	}
+}
+
+/** Reference conversion, copied from the former MongoDBLogProtobuf::add_message(). */
+static document
+baseline_add_message(const Message &m)
+{
+	document doc{};
+	doc.append(kvp("_type", m.GetTypeName()));
+
+	std::string serialized;
+	m.SerializeToString(&serialized);
+	doc.append(kvp("_protobuf", serialized));
+
+	const Reflection *refl = m.GetReflection();
+
+	std::vector<const FieldDescriptor *> fields;
+	refl->ListFields(m, &fields);
+
+	for (size_t i = 0; i < fields.size(); ++i) {
+		baseline_add_field(fields[i], m, &doc);
+	}
+	return doc;
+}
+
+static void
+fill_beacon(BeaconSignal &b)
+{
+	b.mutable_time()->set_sec(1700000000);
+	b.mutable_time()->set_nsec(123456);
+	b.set_seq(42);
+	b.set_number(1);
+	b.set_team_name("Carologistics");
+	b.set_peer_name("R-1");
+	b.set_team_color(CYAN);
+	b.mutable_pose()->set_x(1.0);
+	b.mutable_pose()->set_y(2.0);
+	b.mutable_pose()->set_ori(3.0);
+	b.mutable_pose()->mutable_timestamp()->set_sec(4);
+	b.mutable_pose()->mutable_timestamp()->set_nsec(5);
+}
+
+static void
+fill_machine_info(MachineInfo &mi)
+{
+	const char *types[] = {"BS", "DS", "SS", "RS", "RS", "CS", "CS"};
+	for (int t = 0; t < 2; ++t) {
+		for (int i = 0; i < 7; ++i) {
+			Machine *m = mi.add_machines();
+			m->set_name(std::string(t == 0 ? "C-" : "M-") + types[i] + std::to_string(i));
+			m->set_type(types[i]);
+			m->set_state("IDLE");
+			m->set_team_color(t == 0 ? CYAN : MAGENTA);
+			m->set_rotation(90);
+			m->mutable_pose()->set_x(0.5 * i);
+			m->mutable_pose()->set_y(-0.5 * i);
+			m->mutable_pose()->set_ori(1.57);
+		}
+	}
+}
+
+static void
+fill_order_info(OrderInfo &oi)
+{
+	for (int i = 1; i <= 9; ++i) {
+		Order *o = oi.add_orders();
+		o->set_id(i);
+		o->set_complexity(Order::C0);
+		o->set_base_color(BASE_RED);
+		o->set_cap_color(CAP_BLACK);
+		o->set_quantity_requested(1);
+		o->set_quantity_delivered_cyan(0);
+		o->set_quantity_delivered_magenta(0);
+		o->set_delivery_gate(1);
+		o->set_delivery_period_begin(60 * i);
+		o->set_delivery_period_end(60 * i + 120);
+		o->set_competitive(i % 3 == 0);
+	}
+}
+
+static void
+fill_beacon_partial(BeaconSignal &b)
+{
+	// no pose and no peer name, unset fields must be skipped
+	b.mutable_time()->set_sec(1700000000);
+	b.mutable_time()->set_nsec(0);
+	b.set_seq(0);
+	b.set_number(2);
+	b.set_team_name("Carologistics");
+	b.set_team_color(MAGENTA);
+}
+
+/** Message type covering FIXED32 and fields declared out of number order. */
+static const Descriptor *
+field_types_descriptor(DescriptorPool &pool)
+{
+	FileDescriptorProto file;
+	file.set_name("qa_field_types.proto");
+	file.set_package("qa");
+	DescriptorProto *msg = file.add_message_type();
+	msg->set_name("FieldTypes");
+	auto add_field = [msg](const char *name, int number, FieldDescriptorProto::Type type, bool rep) {
+		FieldDescriptorProto *f = msg->add_field();
+		f->set_name(name);
+		f->set_number(number);
+		f->set_type(type);
+		f->set_label(rep ? FieldDescriptorProto::LABEL_REPEATED : FieldDescriptorProto::LABEL_OPTIONAL);
+	};
+	add_field("fixed32_value", 4, FieldDescriptorProto::TYPE_FIXED32, false);
+	add_field("int32_value", 1, FieldDescriptorProto::TYPE_INT32, false);
+	add_field("uint32_values", 3, FieldDescriptorProto::TYPE_UINT32, true);
+	add_field("fixed64_value", 2, FieldDescriptorProto::TYPE_FIXED64, false);
+	add_field("sfixed32_value", 6, FieldDescriptorProto::TYPE_SFIXED32, false);
+	add_field("unset_string", 5, FieldDescriptorProto::TYPE_STRING, false);
+	add_field("fixed32_values", 7, FieldDescriptorProto::TYPE_FIXED32, true);
+	return pool.BuildFile(file)->message_type(0);
+}
+
+static void
+fill_field_types(Message &m)
+{
+	const Descriptor *d    = m.GetDescriptor();
+	const Reflection *refl = m.GetReflection();
+	refl->SetUInt32(&m, d->FindFieldByName("fixed32_value"), 4000000000u);
+	refl->SetInt32(&m, d->FindFieldByName("int32_value"), -7);
+	refl->AddUInt32(&m, d->FindFieldByName("uint32_values"), 1);
+	refl->AddUInt32(&m, d->FindFieldByName("uint32_values"), 3000000000u);
+	refl->SetUInt64(&m, d->FindFieldByName("fixed64_value"), 1ull << 40);
+	refl->SetInt32(&m, d->FindFieldByName("sfixed32_value"), -1);
+	refl->AddUInt32(&m, d->FindFieldByName("fixed32_values"), 17);
+}
+
+static bool
+check_message(const char *name, const Message &m)
+{
+	MongoDBProtobufConverter converter;
+	document                 expected = baseline_add_message(m);
+	document                 actual   = converter.convert(m);
+	std::string              serialized(m.SerializeAsString());
+	document                 actual_serialized = converter.convert(m, &serialized);
+
+	bsoncxx::document::view e = expected.view();
+	bool                    ok =
+	  e.length() == actual.view().length() && e.length() == actual_serialized.view().length()
+	  && memcmp(e.data(), actual.view().data(), e.length()) == 0
+	  && memcmp(e.data(), actual_serialized.view().data(), e.length()) == 0;
+	if (!ok) {
+		printf("%-14s MISMATCH\n  baseline: %s\n  plan:     %s\n",
+		       name,
+		       bsoncxx::to_json(e).c_str(),
+		       bsoncxx::to_json(actual.view()).c_str());
+	}
+	return ok;
+}
+
+template <typename F>
+static double
+bench_ns(unsigned int iterations, F &&f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < iterations; ++i) {
+		f();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static void
+bench_message(const char *name, const Message &m, unsigned int iterations)
+{
+	MongoDBProtobufConverter converter;
+	std::string              serialized = m.SerializeAsString();
+	size_t                   sink       = 0;
+
+	double t_reflect = bench_ns(iterations, [&] { sink += baseline_add_message(m).view().length(); });
+	double t_plan    = bench_ns(iterations, [&] { sink += converter.convert(m).view().length(); });
+	double t_plan_serialized =
+	  bench_ns(iterations, [&] { sink += converter.convert(m, &serialized).view().length(); });
+
+	printf("%-14s %6zu bytes  reflection %9.1f ns  plan %9.1f ns (%4.2fx)  "
+	       "plan+bytes %9.1f ns (%4.2fx)  [%zu]\n",
+	       name,
+	       serialized.size(),
+	       t_reflect,
+	       t_plan,
+	       t_reflect / t_plan,
+	       t_plan_serialized,
+	       t_reflect / t_plan_serialized,
+	       sink % 10);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+
+	BeaconSignal beacon;
+	fill_beacon(beacon);
+	BeaconSignal beacon_partial;
+	fill_beacon_partial(beacon_partial);
+	MachineInfo machine_info;
+	fill_machine_info(machine_info);
+	OrderInfo order_info;
+	fill_order_info(order_info);
+
+	DescriptorPool           pool;
+	DynamicMessageFactory    factory(&pool);
+	const Descriptor        *field_types_desc = field_types_descriptor(pool);
+	std::unique_ptr<Message> field_types(factory.GetPrototype(field_types_desc)->New());
+	fill_field_types(*field_types);
+
+	// the plan must produce exactly the documents of the former conversion
+	bool ok = check_message("BeaconSignal", beacon);
+	ok      = check_message("BeaconSignal", beacon_partial) && ok;
+	ok      = check_message("MachineInfo", machine_info) && ok;
+	ok      = check_message("OrderInfo", order_info) && ok;
+	ok      = check_message("FieldTypes", *field_types) && ok;
+	if (!ok) {
+		return 1;
+	}
+	printf("Plan output matches baseline for all messages\n");
+
+	printf("Converting each message %u times\n", iterations);
+	bench_message("BeaconSignal", beacon, iterations);
+	bench_message("MachineInfo", machine_info, iterations);
+	bench_message("OrderInfo", order_info, iterations);
+
+	return 0;
+}
+
+/// @endcond
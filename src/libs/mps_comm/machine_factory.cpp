@@ -37,7 +37,8 @@
 
 namespace rcll {
 namespace mps_comm {
-MachineFactory::MachineFactory(std::shared_ptr<Configuration> config) : config_(config) {};
+MachineFactory::MachineFactory(std::shared_ptr<Configuration> config, fawkes::VirtualClock *clock)
+: config_(config), clock_(clock) {};
 
 std::unique_ptr<Machine>
 MachineFactory::create_machine(const std::string &name,
@@ -84,15 +85,15 @@ MachineFactory::create_machine(const std::string &name,
 	if (connection_mode == "mockup") {
 		float exec_speed = config_->get_float_or_default("llsfrb/simulation/speedup", 1);
 		if (type == "BS") {
-			return std::make_unique<MockupBaseStation>(name, exec_speed);
+			return std::make_unique<MockupBaseStation>(name, exec_speed, clock_);
 		} else if (type == "CS") {
-			return std::make_unique<MockupCapStation>(name, exec_speed);
+			return std::make_unique<MockupCapStation>(name, exec_speed, clock_);
 		} else if (type == "DS") {
-			return std::make_unique<MockupDeliveryStation>(name, exec_speed);
+			return std::make_unique<MockupDeliveryStation>(name, exec_speed, clock_);
 		} else if (type == "RS") {
-			return std::make_unique<MockupRingStation>(name, exec_speed);
+			return std::make_unique<MockupRingStation>(name, exec_speed, clock_);
 		} else if (type == "SS") {
-			return std::make_unique<MockupStorageStation>(name, exec_speed);
+			return std::make_unique<MockupStorageStation>(name, exec_speed, clock_);
 		} else {
 			throw fawkes::Exception(
 			  "Unexpected machine type '%s' for machine '%s' and connection mode '%s'",
@@ -27,12 +27,16 @@
 #include <memory>
 #include <string>
 
+namespace fawkes {
+class VirtualClock;
+}
+
 namespace rcll {
 namespace mps_comm {
 class MachineFactory
 {
 public:
-	MachineFactory(std::shared_ptr<Configuration> config);
+	MachineFactory(std::shared_ptr<Configuration> config, fawkes::VirtualClock *clock = nullptr);
 
 	std::unique_ptr<Machine> create_machine(const std::string &name,
 	                                        const std::string &type,
@@ -43,6 +47,7 @@ public:
 
 private:
 	std::shared_ptr<Configuration> config_;
+	fawkes::VirtualClock          *clock_;
 };
 
 } // namespace mps_comm
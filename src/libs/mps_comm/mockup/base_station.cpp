@@ -26,8 +26,10 @@
 
 namespace rcll {
 namespace mps_comm {
-MockupBaseStation::MockupBaseStation(const std::string &name, float exec_speed)
-: MockupMachine(name, exec_speed)
+MockupBaseStation::MockupBaseStation(const std::string   &name,
+                                     float                 exec_speed,
+                                     fawkes::VirtualClock *clock)
+: MockupMachine(name, exec_speed, clock)
 {
 }
 
@@ -35,13 +37,7 @@ void
 MockupBaseStation::get_base(llsf_msgs::BaseColor color)
 {
 	callback_busy_(true);
-	std::lock_guard<std::mutex> lg(queue_mutex_);
-	queue_.push(std::make_tuple([this] { callback_busy_(false); },
-	                            std::chrono::system_clock::now()
-	                              + std::max(min_operation_duration_,
-	                                         std::chrono::round<std::chrono::milliseconds>(
-	                                           duration_base_dispense_ / exec_speed_))));
-	queue_condition_.notify_one();
+	schedule([this] { callback_busy_(false); }, duration_base_dispense_);
 }
 
 } // namespace mps_comm
@@ -28,7 +28,9 @@ namespace mps_comm {
 class MockupBaseStation : public virtual MockupMachine, public virtual BaseStation
 {
 public:
-	MockupBaseStation(const std::string &name, float exec_time);
+	MockupBaseStation(const std::string   &name,
+	                  float                 exec_time,
+	                  fawkes::VirtualClock *clock = nullptr);
 	void get_base(llsf_msgs::BaseColor slot) override;
 	void identify() override {};
 };
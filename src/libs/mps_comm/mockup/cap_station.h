@@ -28,7 +28,9 @@ namespace mps_comm {
 class MockupCapStation : public virtual MockupMachine, public virtual CapStation
 {
 public:
-	MockupCapStation(const std::string &name, float exec_speed);
+	MockupCapStation(const std::string   &name,
+	                 float                 exec_speed,
+	                 fawkes::VirtualClock *clock = nullptr);
 	void retrieve_cap() override;
 	void mount_cap() override;
 	void identify() override {};
@@ -29,8 +29,10 @@
 namespace rcll {
 namespace mps_comm {
 
-MockupDeliveryStation::MockupDeliveryStation(const std::string &name, float exec_speed)
-: MockupMachine(name, exec_speed)
+MockupDeliveryStation::MockupDeliveryStation(const std::string   &name,
+                                             float                 exec_speed,
+                                             fawkes::VirtualClock *clock)
+: MockupMachine(name, exec_speed, clock)
 {
 }
 
@@ -39,13 +41,7 @@ MockupDeliveryStation::deliver_product(int slot)
 {
 	assert(slot == 1 || slot == 2 || slot == 3);
 	callback_busy_(true);
-	std::lock_guard<std::mutex> lg(queue_mutex_);
-	queue_.push(std::make_tuple([this] { callback_busy_(false); },
-	                            std::chrono::system_clock::now()
-	                              + std::max(min_operation_duration_,
-	                                         std::chrono::round<std::chrono::milliseconds>(
-	                                           duration_ds_slots[slot - 1] / exec_speed_))));
-	queue_condition_.notify_one();
+	schedule([this] { callback_busy_(false); }, duration_ds_slots[slot - 1]);
 }
 
 } // namespace mps_comm
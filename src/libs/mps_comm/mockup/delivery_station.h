@@ -29,7 +29,9 @@ namespace mps_comm {
 class MockupDeliveryStation : public virtual MockupMachine, public virtual DeliveryStation
 {
 public:
-	MockupDeliveryStation(const std::string &name, float exec_speed);
+	MockupDeliveryStation(const std::string   &name,
+	                      float                 exec_speed,
+	                      fawkes::VirtualClock *clock = nullptr);
 	void deliver_product(int slot) override;
 	void identify() override {};
 };
@@ -32,10 +32,19 @@
 namespace rcll {
 namespace mps_comm {
 
-MockupMachine::MockupMachine(const std::string &name, float exec_speed)
-: Machine(name), exec_speed_(exec_speed), shutdown_(false)
+MockupMachine::MockupMachine(const std::string   &name,
+                             float                 exec_speed,
+                             fawkes::VirtualClock *clock)
+: Machine(name),
+  exec_speed_(exec_speed),
+  shutdown_(false),
+  clock_(clock && clock->enabled() ? clock : nullptr),
+  alive_(std::make_shared<bool>(true))
 {
-	worker_thread_ = std::thread(&MockupMachine::queue_worker, this);
+	// on virtual time, the clock runs the queued commands
+	if (!clock_) {
+		worker_thread_ = std::thread(&MockupMachine::queue_worker, this);
+	}
 }
 
 MockupMachine::~MockupMachine()
@@ -90,27 +99,47 @@ MockupMachine::queue_worker()
 	}
 }
 
+/** Execute a command after an operation has finished.
+ * The duration is scaled by the execution speed. Commands are executed in
+ * the order they have been scheduled in, either by the queue worker after
+ * the duration has elapsed in real time, or by the virtual clock after it
+ * has been advanced accordingly.
+ * @param cmd command to execute
+ * @param duration nominal duration of the operation
+ */
 void
-MockupMachine::conveyor_move(ConveyorDirection direction, MPSSensor sensor)
+MockupMachine::schedule(std::function<void()> cmd, std::chrono::milliseconds duration)
 {
 	using std::chrono::milliseconds;
 	using std::chrono::round;
 	using std::chrono::system_clock;
-	callback_busy_(true);
+	milliseconds delay =
+	  std::max(min_operation_duration_, round<milliseconds>(duration / exec_speed_));
+
 	std::lock_guard<std::mutex> lg(queue_mutex_);
-	queue_.push(
-	  std::make_tuple([this] { callback_busy_(false); },
-	                  system_clock::now()
-	                    + std::max(min_operation_duration_,
-	                               round<milliseconds>(duration_band_input_to_mid_ / exec_speed_))));
+	if (clock_) {
+		// never run a command before an earlier one, like the queue worker
+		last_scheduled_           = std::max(last_scheduled_, clock_->now() + delay);
+		std::weak_ptr<bool> alive = alive_;
+		clock_->schedule(last_scheduled_, [alive, cmd] {
+			if (alive.lock()) {
+				cmd();
+			}
+		});
+	} else {
+		queue_.push(std::make_tuple(cmd, system_clock::now() + delay));
+		queue_condition_.notify_one();
+	}
+}
+
+void
+MockupMachine::conveyor_move(ConveyorDirection direction, MPSSensor sensor)
+{
+	callback_busy_(true);
+	schedule([this] { callback_busy_(false); }, duration_band_input_to_mid_);
 	if (sensor == INPUT || sensor == OUTPUT) {
-		queue_.push(std::make_tuple([this] { callback_ready_(true); },
-		                            system_clock::now()
-		                              + std::max(min_operation_duration_,
-		                                         round<milliseconds>(duration_band_mid_to_output_
-		                                                             / exec_speed_))));
+		schedule([this] { callback_ready_(true); }, duration_band_mid_to_output_);
 	}
-	queue_condition_.notify_one();
 }
 } // namespace mps_comm
 } // namespace rcll
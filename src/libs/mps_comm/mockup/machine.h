@@ -22,9 +22,12 @@
 
 #include "../machine.h"
 
+#include <utils/time/virtual_clock.h>
+
 #include <chrono>
 #include <condition_variable>
 #include <future>
+#include <memory>
 #include <queue>
 
 namespace rcll {
@@ -33,7 +36,9 @@ namespace mps_comm {
 class MockupMachine : public virtual Machine
 {
 public:
-	MockupMachine(const std::string &name, float exec_speed);
+	MockupMachine(const std::string   &name,
+	              float                 exec_speed,
+	              fawkes::VirtualClock *clock = nullptr);
 	~MockupMachine() override;
 	void         set_light(llsf_msgs::LightColor color,
 	                       llsf_msgs::LightState state = llsf_msgs::ON,
@@ -47,7 +52,9 @@ public:
 	virtual void identify() = 0;
 
 protected:
-	void                    queue_worker();
+	void queue_worker();
+	void schedule(std::function<void()> cmd, std::chrono::milliseconds duration);
+
 	std::mutex              queue_mutex_;
 	float                   exec_speed_;
 	std::condition_variable queue_condition_;
@@ -58,6 +65,11 @@ protected:
 	std::function<void(bool)>          callback_busy_;
 	std::function<void(bool)>          callback_ready_;
 	std::function<void(unsigned long)> callback_barcode_;
+
+private:
+	fawkes::VirtualClock            *clock_;
+	fawkes::VirtualClock::time_point last_scheduled_;
+	std::shared_ptr<bool>            alive_;
 };
 
 } // namespace mps_comm
@@ -29,8 +29,10 @@
 namespace rcll {
 namespace mps_comm {
 
-MockupRingStation::MockupRingStation(const std::string &name, float exec_speed)
-: MockupMachine(name, exec_speed)
+MockupRingStation::MockupRingStation(const std::string   &name,
+                                     float                 exec_speed,
+                                     fawkes::VirtualClock *clock)
+: MockupMachine(name, exec_speed, clock)
 {
 }
 
@@ -38,13 +40,7 @@ void
 MockupRingStation::mount_ring(unsigned int, llsf_msgs::RingColor)
 {
 	callback_busy_(true);
-	std::lock_guard<std::mutex> lg(queue_mutex_);
-	queue_.push(std::make_tuple([this] { callback_busy_(false); },
-	                            std::chrono::system_clock::now()
-	                              + std::max(min_operation_duration_,
-	                                         std::chrono::round<std::chrono::milliseconds>(
-	                                           duration_ring_mount_ / exec_speed_))));
-	queue_condition_.notify_one();
+	schedule([this] { callback_busy_(false); }, duration_ring_mount_);
 }
 
 } // namespace mps_comm
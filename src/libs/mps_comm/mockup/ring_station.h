@@ -29,7 +29,9 @@ namespace mps_comm {
 class MockupRingStation : public virtual MockupMachine, public virtual RingStation
 {
 public:
-	MockupRingStation(const std::string &name, float exec_speed);
+	MockupRingStation(const std::string   &name,
+	                  float                 exec_speed,
+	                  fawkes::VirtualClock *clock = nullptr);
 	void mount_ring(unsigned int, llsf_msgs::RingColor) override;
 	void register_slide_callback(std::function<void(unsigned int)> callback) override {};
 	void identify() override {};
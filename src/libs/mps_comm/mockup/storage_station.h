@@ -29,7 +29,9 @@ namespace mps_comm {
 class MockupStorageStation : public virtual MockupMachine, public virtual StorageStation
 {
 public:
-	MockupStorageStation(const std::string &name, float exec_speed);
+	MockupStorageStation(const std::string   &name,
+	                     float                 exec_speed,
+	                     fawkes::VirtualClock *clock = nullptr);
 	void retrieve(unsigned int shelf, unsigned int slot) override;
 	void store(unsigned int shelf, unsigned int slot) override;
 	void relocate(unsigned int shelf,
@@ -43,13 +43,72 @@
 #include <protobuf_comm/client.h>
 #include <protobuf_comm/peer.h>
 #include <protobuf_comm/server.h>
+#include <utils/time/virtual_clock.h>
 
+#include <algorithm>
 #include <boost/format.hpp>
 
 using namespace google::protobuf;
 using namespace protobuf_comm;
 using namespace boost::placeholders;
 
+namespace {
+
+/** Deleter of messages on the message arena, which frees them in bulk. */
+struct ArenaOwned
+{
+	void
+	operator()(google::protobuf::Message *)
+	{
+	}
+};
+
+/** Allocator of the shared pointer control blocks of arena messages.
+ * Memory is freed with the arena. */
+template <typename T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	ArenaAllocator(Arena *arena) : arena(arena)
+	{
+	}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena)
+	{
+	}
+
+	T *
+	allocate(size_t n)
+	{
+		return reinterpret_cast<T *>(Arena::CreateArray<char>(arena, n * sizeof(T)));
+	}
+
+	void
+	deallocate(T *, size_t)
+	{
+	}
+
+	Arena *arena;
+};
+
+template <typename T, typename U>
+bool
+operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool
+operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+	return a.arena != b.arena;
+}
+
+} // namespace
+
 namespace protobuf_clips {
 
 /** @class ClipsProtobufCommunicator <protobuf_clips/communicator.h>
@@ -69,7 +128,15 @@ namespace protobuf_clips {
 ClipsProtobufCommunicator::ClipsProtobufCommunicator(CLIPS::Environment *env,
                                                      fawkes::Mutex      &env_mutex,
                                                      rcll::Logger       *logger)
-: clips_(env), clips_mutex_(env_mutex), logger_(logger), server_(NULL), next_client_id_(0)
+: clips_(env),
+  clips_mutex_(env_mutex),
+  logger_(logger),
+  clock_(NULL),
+  server_(NULL),
+  inbound_max_depth_(0),
+  inbound_stats_(),
+  next_client_id_(0),
+  arena_active_(false)
 {
 	message_register_ = new MessageRegister();
 	setup_clips();
@@ -85,7 +152,15 @@ ClipsProtobufCommunicator::ClipsProtobufCommunicator(CLIPS::Environment       *e
                                                      fawkes::Mutex            &env_mutex,
                                                      std::vector<std::string> &proto_path,
                                                      rcll::Logger             *logger)
-: clips_(env), clips_mutex_(env_mutex), logger_(logger), server_(NULL), next_client_id_(0)
+: clips_(env),
+  clips_mutex_(env_mutex),
+  logger_(logger),
+  clock_(NULL),
+  server_(NULL),
+  inbound_max_depth_(0),
+  inbound_stats_(),
+  next_client_id_(0),
+  arena_active_(false)
 {
 	message_register_ = new MessageRegister(proto_path);
 	setup_clips();
@@ -144,6 +219,9 @@ ClipsProtobufCommunicator::setup_clips()
 	ADD_FUNCTION("pb-field-value",
 	             (sigc::slot<CLIPS::Value, void *, std::string>(
 	               sigc::mem_fun(*this, &ClipsProtobufCommunicator::clips_pb_field_value))));
+	ADD_FUNCTION("pb-field-values",
+	             (sigc::slot<CLIPS::Values, void *, CLIPS::Values>(
+	               sigc::mem_fun(*this, &ClipsProtobufCommunicator::clips_pb_field_values))));
 	ADD_FUNCTION("pb-field-list",
 	             (sigc::slot<CLIPS::Values, void *, std::string>(
 	               sigc::mem_fun(*this, &ClipsProtobufCommunicator::clips_pb_field_list))));
@@ -369,8 +447,11 @@ CLIPS::Value
 ClipsProtobufCommunicator::clips_pb_create(std::string full_name)
 {
 	try {
-		std::shared_ptr<google::protobuf::Message> m = message_register_->new_message_for(full_name);
-		return CLIPS::Value(new std::shared_ptr<google::protobuf::Message>(m));
+		std::shared_ptr<google::protobuf::Message> &prototype = prototypes_[full_name];
+		if (!prototype) {
+			prototype = message_register_->new_message_for(full_name);
+		}
+		return CLIPS::Value(new_message_ptr(*prototype));
 	} catch (std::runtime_error &e) {
 		if (logger_) {
 			logger_->log_warn("CLIPS-Protobuf",
@@ -382,6 +463,15 @@ ClipsProtobufCommunicator::clips_pb_create(std::string full_name)
 	}
 }
 
+/** Get another reference to a message.
+ * On the heap, the reference shares the message, so changes made through
+ * one pointer are visible through the other. A message on the arena is
+ * freed with the arena, so pb-ref instead returns a detached copy on the
+ * heap that outlives the arena. Later changes to the original or the copy
+ * are not visible in the other.
+ * @param msgptr message to reference
+ * @return new pointer to pass to CLIPS, which must be destroyed separately
+ */
 CLIPS::Value
 ClipsProtobufCommunicator::clips_pb_ref(void *msgptr)
 {
@@ -390,18 +480,28 @@ ClipsProtobufCommunicator::clips_pb_ref(void *msgptr)
 	if (!*m)
 		return new std::shared_ptr<google::protobuf::Message>();
 
+	if (std::get_deleter<ArenaOwned>(*m)) {
+		// pinned messages must outlive the arena
+		google::protobuf::Message *copy = (*m)->New();
+		copy->CopyFrom(**m);
+		return CLIPS::Value(new std::shared_ptr<google::protobuf::Message>(copy));
+	}
 	return CLIPS::Value(new std::shared_ptr<google::protobuf::Message>(*m));
 }
 
 void
 ClipsProtobufCommunicator::clips_pb_destroy(void *msgptr)
 {
+	// received messages are released when their fact is gone
+	if (msg_tracker_ && msg_tracker_->tracks(msgptr))
+		return;
+
 	std::shared_ptr<google::protobuf::Message> *m =
 	  static_cast<std::shared_ptr<google::protobuf::Message> *>(msgptr);
 	if (!*m)
 		return;
 
-	delete m;
+	destroy_message_ptr(m);
 }
 
 CLIPS::Values
@@ -430,7 +530,7 @@ ClipsProtobufCommunicator::clips_pb_field_type(void *msgptr, std::string field_n
 		return CLIPS::Value("INVALID-MESSAGE", CLIPS::TYPE_SYMBOL);
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field) {
 		return CLIPS::Value("DOES-NOT-EXIST", CLIPS::TYPE_SYMBOL);
 	}
@@ -465,7 +565,7 @@ ClipsProtobufCommunicator::clips_pb_has_field(void *msgptr, std::string field_na
 		return CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL);
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field)
 		return CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL);
 
@@ -487,7 +587,7 @@ ClipsProtobufCommunicator::clips_pb_field_label(void *msgptr, std::string field_
 		return CLIPS::Value("INVALID-MESSAGE", CLIPS::TYPE_SYMBOL);
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field) {
 		return CLIPS::Value("DOES-NOT-EXIST", CLIPS::TYPE_SYMBOL);
 	}
@@ -499,6 +599,26 @@ ClipsProtobufCommunicator::clips_pb_field_label(void *msgptr, std::string field_
 	}
 }
 
+/** Find a field of a message type.
+ * Fields are looked up once per message type and name, the same few fields
+ * of the received messages are accessed over and over by the rules.
+ * @param desc message type
+ * @param field_name name of the field
+ * @return field descriptor or NULL if there is no such field
+ */
+const FieldDescriptor *
+ClipsProtobufCommunicator::find_field(const Descriptor *desc, const std::string &field_name)
+{
+	FieldMap &fields = fields_[desc];
+	auto      f      = fields.find(field_name);
+	if (f != fields.end()) {
+		return f->second;
+	}
+	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	fields.emplace(field_name, field);
+	return field;
+}
+
 CLIPS::Value
 ClipsProtobufCommunicator::clips_pb_field_value(void *msgptr, std::string field_name)
 {
@@ -511,58 +631,115 @@ ClipsProtobufCommunicator::clips_pb_field_value(void *msgptr, std::string field_
 		return CLIPS::Value("INVALID-MESSAGE", CLIPS::TYPE_SYMBOL);
 	}
 
-	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	return field_value(**m, find_field((*m)->GetDescriptor(), field_name), field_name);
+}
+
+/** Get the values of multiple fields at once.
+ * Field names may be paths into nested messages separated by dots, e.g.,
+ * "pose.timestamp.sec", which avoids copying the nested messages to CLIPS.
+ * For each field the same value is returned as by pb-field-value, e.g.,
+ * NOT-SET for unset fields.
+ * @param msgptr message to read from
+ * @param field_names names of the fields
+ * @return values of the fields in the order of the names
+ */
+CLIPS::Values
+ClipsProtobufCommunicator::clips_pb_field_values(void *msgptr, CLIPS::Values field_names)
+{
+	std::shared_ptr<google::protobuf::Message> *m =
+	  static_cast<std::shared_ptr<google::protobuf::Message> *>(msgptr);
+	if (!(m && *m)) {
+		if (logger_) {
+			logger_->log_warn("CLIPS-Protobuf", "Invalid message when getting field values");
+		}
+		return CLIPS::Values(field_names.size(), CLIPS::Value("INVALID-MESSAGE", CLIPS::TYPE_SYMBOL));
+	}
+
+	CLIPS::Values rv;
+	rv.reserve(field_names.size());
+	for (const CLIPS::Value &name : field_names) {
+		const std::string                path  = name.as_string();
+		const google::protobuf::Message *msg   = m->get();
+		size_t                           begin = 0;
+		size_t                           dot;
+		while ((dot = path.find('.', begin)) != std::string::npos) {
+			const FieldDescriptor *field =
+			  find_field(msg->GetDescriptor(), path.substr(begin, dot - begin));
+			if (!field || field->type() != FieldDescriptor::TYPE_MESSAGE || field->is_repeated()) {
+				msg = NULL;
+				break;
+			}
+			msg   = &msg->GetReflection()->GetMessage(*msg, field);
+			begin = dot + 1;
+		}
+		if (!msg) {
+			if (logger_) {
+				logger_->log_warn("CLIPS-Protobuf",
+				                  "Field %s of %s does not exist",
+				                  path.c_str(),
+				                  (*m)->GetTypeName().c_str());
+			}
+			rv.push_back(CLIPS::Value("DOES-NOT-EXIST", CLIPS::TYPE_SYMBOL));
+			continue;
+		}
+		const std::string field_name = path.substr(begin);
+		rv.push_back(field_value(*msg, find_field(msg->GetDescriptor(), field_name), field_name));
+	}
+	return rv;
+}
+
+CLIPS::Value
+ClipsProtobufCommunicator::field_value(const google::protobuf::Message &msg,
+                                       const FieldDescriptor           *field,
+                                       const std::string               &field_name)
+{
 	if (!field) {
 		if (logger_) {
 			logger_->log_warn("CLIPS-Protobuf",
 			                  "Field %s of %s does not exist",
 			                  field_name.c_str(),
-			                  (*m)->GetTypeName().c_str());
+			                  msg.GetTypeName().c_str());
 		}
 		return CLIPS::Value("DOES-NOT-EXIST", CLIPS::TYPE_SYMBOL);
 	}
-	const Reflection *refl = (*m)->GetReflection();
-	if (field->type() != FieldDescriptor::TYPE_MESSAGE && !refl->HasField(**m, field)) {
+	const Reflection *refl = msg.GetReflection();
+	if (field->type() != FieldDescriptor::TYPE_MESSAGE && !refl->HasField(msg, field)) {
 		if (logger_) {
 			logger_->log_warn("CLIPS-Protobuf",
 			                  "Field %s of %s not set",
 			                  field_name.c_str(),
-			                  (*m)->GetTypeName().c_str());
+			                  msg.GetTypeName().c_str());
 		}
 		return CLIPS::Value("NOT-SET", CLIPS::TYPE_SYMBOL);
 	}
 	switch (field->type()) {
-	case FieldDescriptor::TYPE_DOUBLE: return CLIPS::Value(refl->GetDouble(**m, field));
-	case FieldDescriptor::TYPE_FLOAT: return CLIPS::Value(refl->GetFloat(**m, field));
-	case FieldDescriptor::TYPE_INT64: return CLIPS::Value(refl->GetInt64(**m, field));
-	case FieldDescriptor::TYPE_UINT64: return CLIPS::Value((long int)refl->GetUInt64(**m, field));
-	case FieldDescriptor::TYPE_INT32: return CLIPS::Value(refl->GetInt32(**m, field));
-	case FieldDescriptor::TYPE_FIXED64: return CLIPS::Value((long int)refl->GetUInt64(**m, field));
-	case FieldDescriptor::TYPE_FIXED32: return CLIPS::Value(refl->GetUInt32(**m, field));
+	case FieldDescriptor::TYPE_DOUBLE: return CLIPS::Value(refl->GetDouble(msg, field));
+	case FieldDescriptor::TYPE_FLOAT: return CLIPS::Value(refl->GetFloat(msg, field));
+	case FieldDescriptor::TYPE_INT64: return CLIPS::Value(refl->GetInt64(msg, field));
+	case FieldDescriptor::TYPE_UINT64: return CLIPS::Value((long int)refl->GetUInt64(msg, field));
+	case FieldDescriptor::TYPE_INT32: return CLIPS::Value(refl->GetInt32(msg, field));
+	case FieldDescriptor::TYPE_FIXED64: return CLIPS::Value((long int)refl->GetUInt64(msg, field));
+	case FieldDescriptor::TYPE_FIXED32: return CLIPS::Value(refl->GetUInt32(msg, field));
 	case FieldDescriptor::TYPE_BOOL:
 		//Booleans are represented as Symbols in CLIPS
-		if (refl->GetBool(**m, field)) {
+		if (refl->GetBool(msg, field)) {
 			return CLIPS::Value("TRUE", CLIPS::TYPE_SYMBOL);
 		} else {
 			return CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL);
 		}
-	case FieldDescriptor::TYPE_STRING: return CLIPS::Value(refl->GetString(**m, field));
+	case FieldDescriptor::TYPE_STRING: return CLIPS::Value(refl->GetString(msg, field));
 	case FieldDescriptor::TYPE_MESSAGE: {
-		const google::protobuf::Message &mfield = refl->GetMessage(**m, field);
-		google::protobuf::Message       *mcopy  = mfield.New();
-		mcopy->CopyFrom(mfield);
-		void *ptr = new std::shared_ptr<google::protobuf::Message>(mcopy);
-		return CLIPS::Value(ptr);
+		const google::protobuf::Message &mfield = refl->GetMessage(msg, field);
+		return CLIPS::Value(new_message_ptr(mfield, &mfield));
 	}
 	case FieldDescriptor::TYPE_BYTES: return CLIPS::Value((char *)"bytes");
-	case FieldDescriptor::TYPE_UINT32: return CLIPS::Value(refl->GetUInt32(**m, field));
+	case FieldDescriptor::TYPE_UINT32: return CLIPS::Value(refl->GetUInt32(msg, field));
 	case FieldDescriptor::TYPE_ENUM:
-		return CLIPS::Value(refl->GetEnum(**m, field)->name(), CLIPS::TYPE_SYMBOL);
-	case FieldDescriptor::TYPE_SFIXED32: return CLIPS::Value(refl->GetInt32(**m, field));
-	case FieldDescriptor::TYPE_SFIXED64: return CLIPS::Value(refl->GetInt64(**m, field));
-	case FieldDescriptor::TYPE_SINT32: return CLIPS::Value(refl->GetInt32(**m, field));
-	case FieldDescriptor::TYPE_SINT64: return CLIPS::Value(refl->GetInt64(**m, field));
+		return CLIPS::Value(refl->GetEnum(msg, field)->name(), CLIPS::TYPE_SYMBOL);
+	case FieldDescriptor::TYPE_SFIXED32: return CLIPS::Value(refl->GetInt32(msg, field));
+	case FieldDescriptor::TYPE_SFIXED64: return CLIPS::Value(refl->GetInt64(msg, field));
+	case FieldDescriptor::TYPE_SINT32: return CLIPS::Value(refl->GetInt32(msg, field));
+	case FieldDescriptor::TYPE_SINT64: return CLIPS::Value(refl->GetInt64(msg, field));
 	default: throw std::logic_error("Unknown protobuf field type encountered");
 	}
 }
@@ -578,7 +755,7 @@ ClipsProtobufCommunicator::clips_pb_set_field(void        *msgptr,
 		return;
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field) {
 		if (logger_) {
 			logger_->log_warn("CLIPS-Protobuf", "Could not find field %s", field_name.c_str());
@@ -606,7 +783,7 @@ ClipsProtobufCommunicator::clips_pb_set_field(void        *msgptr,
 			  static_cast<std::shared_ptr<google::protobuf::Message> *>(value.as_address());
 			Message *mut_msg = refl->MutableMessage(m->get(), field);
 			mut_msg->CopyFrom(**mfrom);
-			delete mfrom;
+			destroy_message_ptr(mfrom);
 		} break;
 		case FieldDescriptor::TYPE_BYTES: break;
 		case FieldDescriptor::TYPE_FIXED32:
@@ -654,7 +831,7 @@ ClipsProtobufCommunicator::clips_pb_add_list(void        *msgptr,
 		return;
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field) {
 		if (logger_) {
 			logger_->log_warn("CLIPS-Protobuf", "Could not find field %s", field_name.c_str());
@@ -682,7 +859,7 @@ ClipsProtobufCommunicator::clips_pb_add_list(void        *msgptr,
 			  static_cast<std::shared_ptr<google::protobuf::Message> *>(value.as_address());
 			Message *new_msg = refl->AddMessage(m->get(), field);
 			new_msg->CopyFrom(**mfrom);
-			delete mfrom;
+			destroy_message_ptr(mfrom);
 		} break;
 		case FieldDescriptor::TYPE_BYTES: break;
 		case FieldDescriptor::TYPE_FIXED32:
@@ -889,7 +1066,7 @@ ClipsProtobufCommunicator::clips_pb_field_list(void *msgptr, std::string field_n
 		return CLIPS::Values(1, CLIPS::Value("INVALID-MESSAGE", CLIPS::TYPE_SYMBOL));
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field) {
 		return CLIPS::Values(1, CLIPS::Value("DOES-NOT-EXIST", CLIPS::TYPE_SYMBOL));
 	}
@@ -931,11 +1108,8 @@ ClipsProtobufCommunicator::clips_pb_field_list(void *msgptr, std::string field_n
 			rv[i] = CLIPS::Value(refl->GetRepeatedString(**m, field, i));
 			break;
 		case FieldDescriptor::TYPE_MESSAGE: {
-			const google::protobuf::Message &msg   = refl->GetRepeatedMessage(**m, field, i);
-			google::protobuf::Message       *mcopy = msg.New();
-			mcopy->CopyFrom(msg);
-			void *ptr = new std::shared_ptr<google::protobuf::Message>(mcopy);
-			rv[i]     = CLIPS::Value(ptr);
+			const google::protobuf::Message &msg = refl->GetRepeatedMessage(**m, field, i);
+			rv[i]                                = CLIPS::Value(new_message_ptr(msg, &msg));
 		} break;
 		case FieldDescriptor::TYPE_BYTES:
 			rv[i] = CLIPS::Value((char *)"BYTES", CLIPS::TYPE_SYMBOL);
@@ -969,7 +1143,7 @@ ClipsProtobufCommunicator::clips_pb_field_is_list(void *msgptr, std::string fiel
 		return CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL);
 
 	const Descriptor      *desc  = (*m)->GetDescriptor();
-	const FieldDescriptor *field = desc->FindFieldByName(field_name);
+	const FieldDescriptor *field = find_field(desc, field_name);
 	if (!field)
 		return CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL);
 	return CLIPS::Value(field->is_repeated() ? "TRUE" : "FALSE", CLIPS::TYPE_SYMBOL);
@@ -983,42 +1157,245 @@ ClipsProtobufCommunicator::clips_assert_message(std::pair<std::string, unsigned
                                                 ClipsProtobufCommunicator::ClientType       ct,
                                                 long int client_id)
 {
-	CLIPS::Template::pointer temp = clips_->get_template("protobuf-msg");
-	if (temp) {
-		struct timeval tv;
-		gettimeofday(&tv, 0);
-		void                *ptr  = new std::shared_ptr<google::protobuf::Message>(msg);
-		CLIPS::Fact::pointer fact = CLIPS::Fact::create(*clips_, temp);
-		fact->set_slot("type", msg->GetTypeName());
-		fact->set_slot("comp-id", comp_id);
-		fact->set_slot("msg-type", msg_type);
-		fact->set_slot("rcvd-via",
-		               CLIPS::Value((ct == CT_PEER) ? "BROADCAST" : "STREAM", CLIPS::TYPE_SYMBOL));
-		CLIPS::Values rcvd_at(2, CLIPS::Value(CLIPS::TYPE_INTEGER));
-		rcvd_at[0] = tv.tv_sec;
-		rcvd_at[1] = tv.tv_usec;
-		fact->set_slot("rcvd-at", rcvd_at);
-		CLIPS::Values host_port(2, CLIPS::Value(CLIPS::TYPE_STRING));
-		host_port[0] = endpoint.first;
-		host_port[1] = CLIPS::Value(endpoint.second);
-		fact->set_slot("rcvd-from", host_port);
-		fact->set_slot("client-type",
-		               CLIPS::Value(ct == CT_CLIENT ? "CLIENT" : (ct == CT_SERVER ? "SERVER" : "PEER"),
-		                            CLIPS::TYPE_SYMBOL));
-		fact->set_slot("client-id", client_id);
-		fact->set_slot("ptr", CLIPS::Value(ptr));
-		CLIPS::Fact::pointer new_fact = clips_->assert_fact(fact);
-
-		if (!new_fact) {
+	InboundMessage m;
+	m.endpoint    = endpoint;
+	m.comp_id     = comp_id;
+	m.msg_type    = msg_type;
+	m.msg         = msg;
+	m.client_type = ct;
+	m.client_id   = client_id;
+	if (clock_) {
+		clock_->get_time(&m.rcvd_at);
+	} else {
+		gettimeofday(&m.rcvd_at, 0);
+	}
+	assert_message(m);
+}
+
+/** Assert a protobuf-msg fact for a message.
+ * Received messages are asserted by process_inbound_events(), this allows to
+ * feed messages from other sources, e.g., when replaying recorded inputs.
+ * Must be called with the CLIPS mutex locked.
+ * @param m message to assert
+ */
+void
+ClipsProtobufCommunicator::assert_message(const InboundMessage &m)
+{
+	if (!msg_fact_) {
+		try {
+			msg_fact_.reset(new ClipsFactBuilder(clips_, "protobuf-msg"));
+		} catch (fawkes::Exception &e) {
 			if (logger_) {
-				logger_->log_warn("CLIPS-Protobuf", "Asserting protobuf-msg fact failed");
+				logger_->log_warn("CLIPS-Protobuf", "Did not get template, did you load protobuf.clp?");
 			}
-			delete static_cast<std::shared_ptr<google::protobuf::Message> *>(ptr);
+			return;
 		}
-	} else {
+		msg_slots_.type        = msg_fact_->slot("type");
+		msg_slots_.comp_id     = msg_fact_->slot("comp-id");
+		msg_slots_.msg_type    = msg_fact_->slot("msg-type");
+		msg_slots_.rcvd_via    = msg_fact_->slot("rcvd-via");
+		msg_slots_.rcvd_at     = msg_fact_->slot("rcvd-at");
+		msg_slots_.rcvd_from   = msg_fact_->slot("rcvd-from");
+		msg_slots_.client_type = msg_fact_->slot("client-type");
+		msg_slots_.client_id   = msg_fact_->slot("client-id");
+		msg_slots_.ptr         = msg_fact_->slot("ptr");
+	}
+
+	sig_inbound_message_(m);
+
+	if (!msg_tracker_) {
+		msg_tracker_.reset(new ClipsMessageTracker(clips_));
+	}
+
+	ClientType ct  = m.client_type;
+	void      *ptr = msg_tracker_->track(m.msg);
+	msg_fact_->set_string(msg_slots_.type, m.msg->GetTypeName())
+	  .set_integer(msg_slots_.comp_id, m.comp_id)
+	  .set_integer(msg_slots_.msg_type, m.msg_type)
+	  .set_symbol(msg_slots_.rcvd_via, (ct == CT_PEER) ? "BROADCAST" : "STREAM")
+	  .set_multifield(msg_slots_.rcvd_at,
+	                  {ClipsFactBuilder::Atom::integer(m.rcvd_at.tv_sec),
+	                   ClipsFactBuilder::Atom::integer(m.rcvd_at.tv_usec)})
+	  .set_multifield(msg_slots_.rcvd_from,
+	                  {ClipsFactBuilder::Atom::string(m.endpoint.first.c_str()),
+	                   ClipsFactBuilder::Atom::integer(m.endpoint.second)})
+	  .set_symbol(msg_slots_.client_type,
+	              ct == CT_CLIENT ? "CLIENT" : (ct == CT_SERVER ? "SERVER" : "PEER"))
+	  .set_integer(msg_slots_.client_id, m.client_id)
+	  .set_address(msg_slots_.ptr, ptr, msg_tracker_->address_type());
+
+	// the message is released by the tracker, even if asserting failed
+	if (!msg_fact_->assert_fact()) {
 		if (logger_) {
-			logger_->log_warn("CLIPS-Protobuf", "Did not get template, did you load protobuf.clp?");
+			logger_->log_warn("CLIPS-Protobuf", "Asserting protobuf-msg fact failed");
+		}
+	}
+}
+
+/** Assert a fact for an inbound event other than a message.
+ * @param fact fact to assert
+ */
+void
+ClipsProtobufCommunicator::clips_assert_inbound_fact(const std::string &fact)
+{
+	sig_inbound_fact_(fact);
+	clips_->assert_fact(fact);
+}
+
+void
+ClipsProtobufCommunicator::queue_inbound(std::function<void()> &&assert_facts)
+{
+	size_t depth = inbound_.push(InboundEvent{std::move(assert_facts), InboundClock::now()});
+	size_t max   = inbound_max_depth_.load(std::memory_order_relaxed);
+	while (depth > max && !inbound_max_depth_.compare_exchange_weak(max, depth)) {
+	}
+	sig_inbound_event_();
+}
+
+/** Assert facts for all queued inbound events.
+ * Network handlers do not access the CLIPS environment directly, but queue
+ * events which are turned into facts by this method. Call it from the
+ * thread running the CLIPS engine, e.g., before each run.
+ * @return number of processed events
+ */
+size_t
+ClipsProtobufCommunicator::process_inbound_events()
+{
+	if (inbound_.empty()) {
+		return 0;
+	}
+
+	fawkes::MutexLocker lock(&clips_mutex_);
+	InboundClock::time_point now = InboundClock::now();
+	return inbound_.consume_all([this, &now](InboundEvent &ev) {
+		ev.assert_facts();
+		auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - ev.enqueued);
+		inbound_stats_.processed += 1;
+		inbound_stats_.last_latency = latency;
+		inbound_stats_.max_latency  = std::max(inbound_stats_.max_latency, latency);
+	});
+}
+
+/** Get counters of the inbound event queue.
+ * @return current statistics, latencies are from enqueuing an event to
+ * the start of the batch asserting it
+ */
+ClipsProtobufCommunicator::InboundStats
+ClipsProtobufCommunicator::inbound_stats()
+{
+	fawkes::MutexLocker lock(&clips_mutex_);
+	InboundStats        stats = inbound_stats_;
+	stats.queue_depth         = inbound_.size();
+	stats.max_queue_depth     = inbound_max_depth_.load(std::memory_order_relaxed);
+	stats.live_messages       = msg_tracker_ ? msg_tracker_->live() : 0;
+	stats.max_live_messages   = msg_tracker_ ? msg_tracker_->peak() : 0;
+	return stats;
+}
+
+/** Allocate messages created by the rules on an arena.
+ * Rules create messages with pb-create and get copies of nested messages
+ * from pb-field-value and pb-field-list, several thousands per second when
+ * broadcasting. With the arena enabled, messages created between
+ * begin_message_arena() and release_message_arena() are allocated on the
+ * arena and freed in bulk on release. They must not be used afterwards.
+ * pb-ref returns a detached copy that outlives the arena, see
+ * clips_pb_ref(). pb-destroy is a no-op for messages on the arena.
+ * Use MessageArenaScope to release the arena on every path.
+ * @param initial_block_size size of the arena's first block in bytes, which
+ * is reused after each release
+ */
+void
+ClipsProtobufCommunicator::enable_message_arena(size_t initial_block_size)
+{
+	fawkes::MutexLocker lock(&clips_mutex_);
+	arena_block_.resize(std::max(initial_block_size, (size_t)256));
+	ArenaOptions options;
+	options.initial_block      = arena_block_.data();
+	options.initial_block_size = arena_block_.size();
+	arena_                     = std::make_unique<Arena>(options);
+}
+
+/** Start allocating messages on the arena.
+ * Does nothing if the arena is not enabled. Call with the CLIPS mutex
+ * locked before running the rule engine.
+ */
+void
+ClipsProtobufCommunicator::begin_message_arena()
+{
+	arena_active_ = (bool)arena_;
+}
+
+/** Free all messages allocated on the arena.
+ * Call with the CLIPS mutex locked after running the rule engine.
+ */
+void
+ClipsProtobufCommunicator::release_message_arena()
+{
+	if (arena_active_) {
+		arena_active_ = false;
+		arena_->Reset();
+	}
+}
+
+/** @class MessageArenaScope <protobuf_clips/communicator.h>
+ * Allocate the messages created by the rules on the arena while in scope.
+ * The arena is released when the scope is left, also by an exception.
+ */
+
+/** Constructor.
+ * Calls begin_message_arena().
+ * @param comm communicator whose arena to use, the CLIPS mutex must be
+ * locked during the lifetime of the scope
+ */
+MessageArenaScope::MessageArenaScope(ClipsProtobufCommunicator *comm) : comm_(comm)
+{
+	comm_->begin_message_arena();
+}
+
+/** Destructor.
+ * Calls release_message_arena(). */
+MessageArenaScope::~MessageArenaScope()
+{
+	comm_->release_message_arena();
+}
+
+/** Create a message for CLIPS.
+ * The message is allocated on the arena if it is active, on the heap
+ * otherwise.
+ * @param prototype message of the type to create
+ * @param from message to copy from, NULL to create an empty message
+ * @return pointer to pass to CLIPS
+ */
+void *
+ClipsProtobufCommunicator::new_message_ptr(const Message &prototype, const Message *from)
+{
+	if (!arena_active_) {
+		Message *m = prototype.New();
+		if (from) {
+			m->CopyFrom(*from);
 		}
+		return new std::shared_ptr<Message>(m);
+	}
+
+	Message *m = prototype.New(arena_.get());
+	if (from) {
+		m->CopyFrom(*from);
+	}
+	return Arena::Create<std::shared_ptr<Message>>(arena_.get(),
+	                                               m,
+	                                               ArenaOwned(),
+	                                               ArenaAllocator<char>(arena_.get()));
+}
+
+/** Release a message pointer passed to CLIPS.
+ * Pointers to messages on the arena are freed with the arena.
+ * @param m pointer to release
+ */
+void
+ClipsProtobufCommunicator::destroy_message_ptr(std::shared_ptr<Message> *m)
+{
+	if (!std::get_deleter<ArenaOwned>(*m)) {
+		delete m;
 	}
 }
 
@@ -1035,11 +1412,12 @@ ClipsProtobufCommunicator::handle_server_client_connected(ProtobufStreamServer::
 		rev_server_clients_[client]  = client_id;
 	}
 
-	fawkes::MutexLocker lock(&clips_mutex_);
-	clips_->assert_fact_f("(protobuf-server-client-connected %li %s %u)",
-	                      client_id,
-	                      endpoint.address().to_string().c_str(),
-	                      endpoint.port());
+	std::string    host = endpoint.address().to_string();
+	unsigned short port = endpoint.port();
+	queue_inbound([this, client_id, host, port] {
+		clips_assert_inbound_fact(boost::str(
+		  boost::format("(protobuf-server-client-connected %li %s %u)") % client_id % host % port));
+	});
 }
 
 void
@@ -1058,8 +1436,10 @@ ClipsProtobufCommunicator::handle_server_client_disconnected(ProtobufStreamServe
 	}
 
 	if (client_id >= 0) {
-		fawkes::MutexLocker lock(&clips_mutex_);
-		clips_->assert_fact_f("(protobuf-server-client-disconnected %li)", client_id);
+		queue_inbound([this, client_id] {
+			clips_assert_inbound_fact(
+			  boost::str(boost::format("(protobuf-server-client-disconnected %li)") % client_id));
+		});
 	}
 }
 
@@ -1075,12 +1455,21 @@ ClipsProtobufCommunicator::handle_server_client_msg(ProtobufStreamServer::Client
                                                     uint16_t                       msg_type,
                                                     std::shared_ptr<google::protobuf::Message> msg)
 {
-	fawkes::MutexLocker          lock(&clips_mutex_);
-	fawkes::MutexLocker          lock2(&map_mutex_);
-	RevServerClientMap::iterator c;
-	if ((c = rev_server_clients_.find(client)) != rev_server_clients_.end()) {
-		clips_assert_message(
-		  client_endpoints_[c->second], component_id, msg_type, msg, CT_SERVER, c->second);
+	long int                               client_id = -1;
+	std::pair<std::string, unsigned short> endpp;
+	{
+		fawkes::MutexLocker          lock(&map_mutex_);
+		RevServerClientMap::iterator c;
+		if ((c = rev_server_clients_.find(client)) != rev_server_clients_.end()) {
+			client_id = c->second;
+			endpp     = client_endpoints_[c->second];
+		}
+	}
+
+	if (client_id >= 0) {
+		queue_inbound([this, endpp, component_id, msg_type, msg, client_id]() mutable {
+			clips_assert_message(endpp, component_id, msg_type, msg, CT_SERVER, client_id);
+		});
 	}
 }
 
@@ -1096,19 +1485,25 @@ ClipsProtobufCommunicator::handle_server_client_fail(ProtobufStreamServer::Clien
                                                      uint16_t                       msg_type,
                                                      std::string                    msg)
 {
-	fawkes::MutexLocker          lock(&map_mutex_);
-	RevServerClientMap::iterator c;
-	if ((c = rev_server_clients_.find(client)) != rev_server_clients_.end()) {
-		fawkes::MutexLocker lock(&clips_mutex_);
-		clips_->assert_fact_f("(protobuf-server-receive-failed (comp-id %u) (msg-type %u) "
-		                      "(rcvd-via STREAM) (client-id %li) (message \"%s\") "
-		                      "(rcvd-from (\"%s\" %u)))",
-		                      component_id,
-		                      msg_type,
-		                      c->second,
-		                      msg.c_str(),
-		                      client_endpoints_[c->second].first.c_str(),
-		                      client_endpoints_[c->second].second);
+	long int                               client_id = -1;
+	std::pair<std::string, unsigned short> endpp;
+	{
+		fawkes::MutexLocker          lock(&map_mutex_);
+		RevServerClientMap::iterator c;
+		if ((c = rev_server_clients_.find(client)) != rev_server_clients_.end()) {
+			client_id = c->second;
+			endpp     = client_endpoints_[c->second];
+		}
+	}
+
+	if (client_id >= 0) {
+		queue_inbound([this, component_id, msg_type, client_id, msg, endpp] {
+			clips_assert_inbound_fact(
+			  boost::str(boost::format("(protobuf-server-receive-failed (comp-id %u) (msg-type %u) "
+			                           "(rcvd-via STREAM) (client-id %li) (message \"%s\") "
+			                           "(rcvd-from (\"%s\" %u)))")
+			             % component_id % msg_type % client_id % msg % endpp.first % endpp.second));
+		});
 	}
 }
 
@@ -1125,10 +1520,11 @@ ClipsProtobufCommunicator::handle_peer_msg(long int
                                            uint16_t                                   msg_type,
                                            std::shared_ptr<google::protobuf::Message> msg)
 {
-	fawkes::MutexLocker                    lock(&clips_mutex_);
 	std::pair<std::string, unsigned short> endpp =
 	  std::make_pair(endpoint.address().to_string(), endpoint.port());
-	clips_assert_message(endpp, component_id, msg_type, msg, CT_PEER, peer_id);
+	queue_inbound([this, endpp, component_id, msg_type, msg, peer_id]() mutable {
+		clips_assert_message(endpp, component_id, msg_type, msg, CT_PEER, peer_id);
+	});
 }
 
 /** Handle error during peer message processing.
@@ -1163,16 +1559,20 @@ ClipsProtobufCommunicator::handle_peer_send_error(long int peer_id, std::string
 void
 ClipsProtobufCommunicator::handle_client_connected(long int client_id)
 {
-	fawkes::MutexLocker lock(&clips_mutex_);
-	clips_->assert_fact_f("(protobuf-client-connected %li)", client_id);
+	queue_inbound([this, client_id] {
+		clips_assert_inbound_fact(
+		  boost::str(boost::format("(protobuf-client-connected %li)") % client_id));
+	});
 }
 
 void
 ClipsProtobufCommunicator::handle_client_disconnected(long int                         client_id,
                                                       const boost::system::error_code &error)
 {
-	fawkes::MutexLocker lock(&clips_mutex_);
-	clips_->assert_fact_f("(protobuf-client-disconnected %li)", client_id);
+	queue_inbound([this, client_id] {
+		clips_assert_inbound_fact(
+		  boost::str(boost::format("(protobuf-client-disconnected %li)") % client_id));
+	});
 }
 
 void
@@ -1181,9 +1581,10 @@ ClipsProtobufCommunicator::handle_client_msg(long int
                                              uint16_t                                   msg_type,
                                              std::shared_ptr<google::protobuf::Message> msg)
 {
-	fawkes::MutexLocker                    lock(&clips_mutex_);
-	std::pair<std::string, unsigned short> endpp = std::make_pair(std::string(), 0);
-	clips_assert_message(endpp, comp_id, msg_type, msg, CT_CLIENT, client_id);
+	queue_inbound([this, comp_id, msg_type, msg, client_id]() mutable {
+		std::pair<std::string, unsigned short> endpp = std::make_pair(std::string(), 0);
+		clips_assert_message(endpp, comp_id, msg_type, msg, CT_CLIENT, client_id);
+	});
 }
 
 void
@@ -1192,13 +1593,12 @@ ClipsProtobufCommunicator::handle_client_receive_fail(long int    client_id,
                                                       uint16_t    msg_type,
                                                       std::string msg)
 {
-	fawkes::MutexLocker lock(&clips_mutex_);
-	clips_->assert_fact_f("(protobuf-receive-failed (client-id %li) (rcvd-via STREAM) "
-	                      "(comp-id %u) (msg-type %u) (message \"%s\"))",
-	                      client_id,
-	                      comp_id,
-	                      msg_type,
-	                      msg.c_str());
+	queue_inbound([this, client_id, comp_id, msg_type, msg] {
+		clips_assert_inbound_fact(
+		  boost::str(boost::format("(protobuf-receive-failed (client-id %li) (rcvd-via STREAM) "
+		                           "(comp-id %u) (msg-type %u) (message \"%s\"))")
+		             % client_id % comp_id % msg_type % msg));
+	});
 }
 
 std::string
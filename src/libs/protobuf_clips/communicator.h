@@ -38,11 +38,25 @@
 #define _PROTOBUF_CLIPS_COMMUNICATOR_H_
 
 #include <core/threading/mutex.h>
+#include <core/utils/mpsc_queue.h>
+#include <google/protobuf/arena.h>
+#include <protobuf_clips/fact_builder.h>
+#include <protobuf_clips/message_tracker.h>
 #include <protobuf_comm/server.h>
+#include <sys/time.h>
 
+#include <atomic>
+#include <chrono>
 #include <clipsmm.h>
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace fawkes {
+class VirtualClock;
+}
 
 namespace protobuf_comm {
 class ProtobufStreamClient;
@@ -119,6 +133,84 @@ public:
 		return sig_peer_sent_;
 	}
 
+	/** Signal invoked after an incoming event has been queued.
+   * This includes received messages and connection changes. The signal is
+   * emitted from network threads without the CLIPS mutex held, call
+   * process_inbound_events() from the CLIPS thread to assert the facts.
+   * @return signal
+   */
+	boost::signals2::signal<void()> &
+	signal_inbound_event()
+	{
+		return sig_inbound_event_;
+	}
+
+	/** Counters of the inbound event queue. */
+	struct InboundStats
+	{
+		size_t                    queue_depth;       ///< events currently queued
+		size_t                    max_queue_depth;   ///< maximum number of queued events
+		uint64_t                  processed;         ///< events asserted as facts
+		std::chrono::microseconds last_latency;      ///< queueing delay of the last event
+		std::chrono::microseconds max_latency;       ///< maximum queueing delay
+		size_t                    live_messages;     ///< received messages still referenced
+		size_t                    max_live_messages; ///< maximum of referenced received messages
+	};
+
+	size_t       process_inbound_events();
+	InboundStats inbound_stats();
+
+	void enable_message_arena(size_t initial_block_size);
+	void begin_message_arena();
+	void release_message_arena();
+
+	/** Kind of the sender of a message. */
+	typedef enum { CT_SERVER, CT_CLIENT, CT_PEER } ClientType;
+
+	/** Received message as asserted as protobuf-msg fact. */
+	struct InboundMessage
+	{
+		std::pair<std::string, unsigned short>     endpoint;    ///< sender host and port
+		uint16_t                                   comp_id;     ///< component ID
+		uint16_t                                   msg_type;    ///< message type
+		std::shared_ptr<google::protobuf::Message> msg;         ///< the message
+		ClientType                                 client_type; ///< kind of sender
+		long int                                   client_id;   ///< server client or peer ID
+		struct timeval                             rcvd_at;     ///< time of reception
+	};
+
+	void assert_message(const InboundMessage &m);
+
+	/** Signal invoked for each received message when it is asserted.
+	 * Emitted with the CLIPS mutex held, e.g., to record the inputs of the
+	 * rule engine.
+	 * @return signal
+	 */
+	boost::signals2::signal<void(const InboundMessage &)> &
+	signal_inbound_message()
+	{
+		return sig_inbound_message_;
+	}
+
+	/** Signal invoked for each fact asserted for other inbound events.
+	 * These are connection changes and reception failures. Emitted with the
+	 * CLIPS mutex held.
+	 * @return signal
+	 */
+	boost::signals2::signal<void(const std::string &)> &
+	signal_inbound_fact()
+	{
+		return sig_inbound_fact_;
+	}
+
+	/** Set clock to take the receive time of messages from.
+	 * @param clock clock to use, NULL to use the system time */
+	void
+	set_clock(fawkes::VirtualClock *clock)
+	{
+		clock_ = clock;
+	}
+
 private:
 	void setup_clips();
 
@@ -126,6 +218,7 @@ private:
 	CLIPS::Values clips_pb_field_names(void *msgptr);
 	CLIPS::Value  clips_pb_has_field(void *msgptr, std::string field_name);
 	CLIPS::Value  clips_pb_field_value(void *msgptr, std::string field_name);
+	CLIPS::Values clips_pb_field_values(void *msgptr, CLIPS::Values field_names);
 	CLIPS::Value  clips_pb_field_type(void *msgptr, std::string field_name);
 	CLIPS::Value  clips_pb_field_label(void *msgptr, std::string field_name);
 	CLIPS::Values clips_pb_field_list(void *msgptr, std::string field_name);
@@ -156,7 +249,7 @@ private:
 	void     clips_pb_peer_destroy(long int peer_id);
 	void     clips_pb_peer_setup_crypto(long int peer_id, std::string crypto_key, std::string cipher);
 
-	typedef enum { CT_SERVER, CT_CLIENT, CT_PEER } ClientType;
+	void clips_assert_inbound_fact(const std::string &fact);
 	void clips_assert_message(std::pair<std::string, unsigned short>     &endpoint,
 	                          uint16_t                                    comp_id,
 	                          uint16_t                                    msg_type,
@@ -201,11 +294,30 @@ private:
 
 	static std::string to_string(const CLIPS::Value &v);
 
+	void *new_message_ptr(const google::protobuf::Message &prototype,
+	                      const google::protobuf::Message *from = NULL);
+	void  destroy_message_ptr(std::shared_ptr<google::protobuf::Message> *m);
+
+	const google::protobuf::FieldDescriptor *
+	find_field(const google::protobuf::Descriptor *desc, const std::string &field_name);
+	CLIPS::Value field_value(const google::protobuf::Message         &msg,
+	                         const google::protobuf::FieldDescriptor *field,
+	                         const std::string                       &field_name);
+
+	typedef std::chrono::steady_clock InboundClock;
+	struct InboundEvent
+	{
+		std::function<void()>    assert_facts;
+		InboundClock::time_point enqueued;
+	};
+	void queue_inbound(std::function<void()> &&assert_facts);
+
 private:
 	CLIPS::Environment *clips_;
 	fawkes::Mutex      &clips_mutex_;
 
-	rcll::Logger *logger_;
+	rcll::Logger         *logger_;
+	fawkes::VirtualClock *clock_;
 
 	protobuf_comm::MessageRegister      *message_register_;
 	protobuf_comm::ProtobufStreamServer *server_;
@@ -218,6 +330,30 @@ private:
 	  sig_client_sent_;
 	boost::signals2::signal<void(long int, std::shared_ptr<google::protobuf::Message>)>
 	  sig_peer_sent_;
+	boost::signals2::signal<void()>                       sig_inbound_event_;
+	boost::signals2::signal<void(const InboundMessage &)> sig_inbound_message_;
+	boost::signals2::signal<void(const std::string &)>    sig_inbound_fact_;
+
+	fawkes::MPSCQueue<InboundEvent> inbound_;
+	std::atomic<size_t>             inbound_max_depth_;
+	InboundStats                    inbound_stats_;
+
+	/** Slot indexes of protobuf-msg facts. */
+	struct MsgFactSlots
+	{
+		int type;
+		int comp_id;
+		int msg_type;
+		int rcvd_via;
+		int rcvd_at;
+		int rcvd_from;
+		int client_type;
+		int client_id;
+		int ptr;
+	};
+	std::unique_ptr<ClipsFactBuilder>    msg_fact_;
+	MsgFactSlots                         msg_slots_;
+	std::unique_ptr<ClipsMessageTracker> msg_tracker_;
 
 	fawkes::Mutex map_mutex_;
 	long int      next_client_id_;
@@ -232,6 +368,24 @@ private:
 
 	std::list<std::string> functions_;
 	CLIPS::Fact::pointer   avail_fact_;
+
+	typedef std::unordered_map<std::string, const google::protobuf::FieldDescriptor *> FieldMap;
+	std::unordered_map<const google::protobuf::Descriptor *, FieldMap> fields_;
+
+	std::unordered_map<std::string, std::shared_ptr<google::protobuf::Message>> prototypes_;
+	std::unique_ptr<google::protobuf::Arena>                                    arena_;
+	std::vector<char>                                                           arena_block_;
+	bool                                                                        arena_active_;
+};
+
+class MessageArenaScope
+{
+public:
+	MessageArenaScope(ClipsProtobufCommunicator *comm);
+	~MessageArenaScope();
+
+private:
+	ClipsProtobufCommunicator *comm_;
 };
 
 } // end namespace protobuf_clips
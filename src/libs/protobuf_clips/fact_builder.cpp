@@ -0,0 +1,315 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  fact_builder.cpp - assert CLIPS facts without parsing
+ *
+ *  Created: Sun Oct 18 19:12:40 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <clips/clips.h>
+#include <core/exception.h>
+#include <protobuf_clips/fact_builder.h>
+
+#include <cstdio>
+
+namespace protobuf_clips {
+
+/** @class ClipsFactBuilder <protobuf_clips/fact_builder.h>
+ * Assert facts of a deftemplate without formatting and parsing them.
+ * The deftemplate and its slots are looked up once on construction. Slots
+ * are then referenced by index, see slot(), and filled directly from C++
+ * values. Slots that have not been set when the fact is asserted get their
+ * default value. Ordered facts are filled with set_fields().
+ *
+ * The builder must only be used with the environment's mutex locked and
+ * must not outlive the deftemplate.
+ */
+
+/** Get the atom in CLIPS syntax.
+ * @return value as written in a fact, strings are quoted and escaped
+ */
+std::string
+ClipsFactBuilder::Atom::to_string() const
+{
+	switch (type_) {
+	case CLIPS::TYPE_INTEGER: return std::to_string(integer_);
+	case CLIPS::TYPE_FLOAT: {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.17g", float_);
+		std::string rv = buf;
+		if (rv.find_first_of(".einf") == std::string::npos) {
+			rv += ".0";
+		}
+		return rv;
+	}
+	case CLIPS::TYPE_STRING: {
+		std::string rv = "\"";
+		for (const char *c = string_; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				rv += '\\';
+			}
+			rv += *c;
+		}
+		return rv + "\"";
+	}
+	default: return string_;
+	}
+}
+
+/** Constructor.
+ * @param env CLIPS environment
+ * @param tmpl_name name of the deftemplate, for ordered facts the relation name
+ * @exception Exception thrown if the deftemplate does not exist
+ */
+ClipsFactBuilder::ClipsFactBuilder(CLIPS::Environment *env, const std::string &tmpl_name)
+: env_(env), fact_(NULL)
+{
+	tmpl_ = static_cast<struct deftemplate *>(EnvFindDeftemplate(env_->cobj(), tmpl_name.c_str()));
+	if (!tmpl_) {
+		throw fawkes::Exception("Deftemplate '%s' does not exist", tmpl_name.c_str());
+	}
+	for (struct templateSlot *s = tmpl_->slotList; s != NULL; s = s->next) {
+		slot_names_.push_back(ValueToString(s->slotName));
+	}
+}
+
+/** Destructor. */
+ClipsFactBuilder::~ClipsFactBuilder()
+{
+	if (fact_) {
+		ReturnFact(env_->cobj(), fact_);
+	}
+}
+
+/** Get index of a slot.
+ * Look up slot indexes once and keep them for subsequent facts.
+ * @param slot_name name of the slot
+ * @return slot index
+ * @exception Exception thrown if the deftemplate has no such slot
+ */
+int
+ClipsFactBuilder::slot(const std::string &slot_name) const
+{
+	for (size_t i = 0; i < slot_names_.size(); ++i) {
+		if (slot_names_[i] == slot_name) {
+			return i;
+		}
+	}
+	throw fawkes::Exception("Deftemplate '%s' has no slot '%s'",
+	                        ValueToString(tmpl_->header.name),
+	                        slot_name.c_str());
+}
+
+/** Get the fact being built, create it if necessary.
+ * @return fact
+ */
+struct fact *
+ClipsFactBuilder::current_fact()
+{
+	if (!fact_) {
+		fact_ = static_cast<struct fact *>(EnvCreateFact(env_->cobj(), tmpl_));
+	}
+	return fact_;
+}
+
+/** Get the CLIPS value of an atom.
+ * @param atom atom to convert
+ * @return hashed value owned by the environment
+ */
+void *
+ClipsFactBuilder::atom_value(const Atom &atom)
+{
+	switch (atom.type_) {
+	case CLIPS::TYPE_INTEGER: return EnvAddLong(env_->cobj(), atom.integer_);
+	case CLIPS::TYPE_FLOAT: return EnvAddDouble(env_->cobj(), atom.float_);
+	default: return EnvAddSymbol(env_->cobj(), atom.string_);
+	}
+}
+
+/** Check that a slot index is valid.
+ * @param slot slot index
+ * @exception Exception thrown if the deftemplate has no slot with the given index
+ */
+void
+ClipsFactBuilder::check_slot(int slot) const
+{
+	if (slot < 0 || (size_t)slot >= slot_names_.size()) {
+		throw fawkes::Exception("Invalid slot %i for deftemplate '%s'",
+		                        slot,
+		                        ValueToString(tmpl_->header.name));
+	}
+}
+
+/** Set a single field slot.
+ * @param slot slot index
+ * @param type CLIPS type of the value
+ * @param value hashed value
+ */
+void
+ClipsFactBuilder::put(int slot, unsigned short type, void *value)
+{
+	check_slot(slot);
+	struct field &field = current_fact()->theProposition.theFields[slot];
+	if (field.type == MULTIFIELD) {
+		ReturnMultifield(env_->cobj(), static_cast<struct multifield *>(field.value));
+	}
+	field.type  = type;
+	field.value = value;
+}
+
+/** Set integer slot.
+ * @param slot slot index
+ * @param value value to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_integer(int slot, long long value)
+{
+	put(slot, INTEGER, EnvAddLong(env_->cobj(), value));
+	return *this;
+}
+
+/** Set float slot.
+ * @param slot slot index
+ * @param value value to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_float(int slot, double value)
+{
+	put(slot, FLOAT, EnvAddDouble(env_->cobj(), value));
+	return *this;
+}
+
+/** Set symbol slot.
+ * @param slot slot index
+ * @param value value to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_symbol(int slot, const char *value)
+{
+	put(slot, SYMBOL, EnvAddSymbol(env_->cobj(), value));
+	return *this;
+}
+
+/** Set string slot.
+ * @param slot slot index
+ * @param value value to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_string(int slot, const std::string &value)
+{
+	put(slot, STRING, EnvAddSymbol(env_->cobj(), value.c_str()));
+	return *this;
+}
+
+/** Set external address slot.
+ * @param slot slot index
+ * @param value value to set
+ * @param address_type external address type installed in the environment,
+ * -1 for a plain C pointer
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_address(int slot, void *value, int address_type)
+{
+	if (address_type < 0) {
+		address_type = C_POINTER_EXTERNAL_ADDRESS;
+	}
+	put(slot, EXTERNAL_ADDRESS, EnvAddExternalAddress(env_->cobj(), value, address_type));
+	return *this;
+}
+
+/** Set multifield slot.
+ * @param slot slot index
+ * @param values values to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_multifield(int slot, std::initializer_list<Atom> values)
+{
+	check_slot(slot);
+	put_multifield(slot, values);
+	return *this;
+}
+
+/** Set the fields of an ordered fact.
+ * @param values values to set
+ * @return reference to this builder
+ */
+ClipsFactBuilder &
+ClipsFactBuilder::set_fields(std::initializer_list<Atom> values)
+{
+	if (!tmpl_->implied) {
+		throw fawkes::Exception("Deftemplate '%s' is not an ordered fact",
+		                        ValueToString(tmpl_->header.name));
+	}
+	put_multifield(0, values);
+	return *this;
+}
+
+/** Fill a multifield field of the current fact.
+ * @param field_index index of the field
+ * @param values values to set
+ */
+void
+ClipsFactBuilder::put_multifield(int field_index, std::initializer_list<Atom> values)
+{
+	struct multifield *mf =
+	  static_cast<struct multifield *>(EnvCreateMultifield(env_->cobj(), values.size()));
+	long i = 1;
+	for (const Atom &atom : values) {
+		switch (atom.type_) {
+		case CLIPS::TYPE_INTEGER: SetMFType(mf, i, INTEGER); break;
+		case CLIPS::TYPE_FLOAT: SetMFType(mf, i, FLOAT); break;
+		case CLIPS::TYPE_STRING: SetMFType(mf, i, STRING); break;
+		default: SetMFType(mf, i, SYMBOL); break;
+		}
+		SetMFValue(mf, i, atom_value(atom));
+		i += 1;
+	}
+
+	struct field &field = current_fact()->theProposition.theFields[field_index];
+	if (field.type == MULTIFIELD) {
+		ReturnMultifield(env_->cobj(), static_cast<struct multifield *>(field.value));
+	}
+	field.type  = MULTIFIELD;
+	field.value = mf;
+}
+
+/** Assert the fact.
+ * Slots that have not been set get their default value. Afterwards, the
+ * builder starts with a new fact.
+ * @return pointer to the asserted fact, NULL if asserting the fact failed
+ */
+void *
+ClipsFactBuilder::assert_fact()
+{
+	struct fact *f = current_fact();
+	fact_          = NULL;
+	if (!EnvAssignFactSlotDefaults(env_->cobj(), f)) {
+		ReturnFact(env_->cobj(), f);
+		return NULL;
+	}
+	return EnvAssert(env_->cobj(), f);
+}
+
+} // end namespace protobuf_clips
@@ -0,0 +1,130 @@
+
+/***************************************************************************
+ *  fact_builder.h - assert CLIPS facts without parsing
+ *
+ *  Created: Sun Oct 18 19:12:40 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _PROTOBUF_CLIPS_FACT_BUILDER_H_
+#define _PROTOBUF_CLIPS_FACT_BUILDER_H_
+
+#include <clipsmm.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+struct fact;
+struct deftemplate;
+
+namespace protobuf_clips {
+
+class ClipsFactBuilder
+{
+public:
+	/** Single field value of a multifield slot. */
+	class Atom
+	{
+	public:
+		/** Integer value.
+		 * @param v value
+		 * @return atom */
+		static Atom
+		integer(long long v)
+		{
+			Atom a(CLIPS::TYPE_INTEGER);
+			a.integer_ = v;
+			return a;
+		}
+		/** Float value.
+		 * @param v value
+		 * @return atom */
+		static Atom
+		floating(double v)
+		{
+			Atom a(CLIPS::TYPE_FLOAT);
+			a.float_ = v;
+			return a;
+		}
+		/** Symbol value.
+		 * @param v value, must remain valid until the atom is set
+		 * @return atom */
+		static Atom
+		symbol(const char *v)
+		{
+			Atom a(CLIPS::TYPE_SYMBOL);
+			a.string_ = v;
+			return a;
+		}
+		/** String value.
+		 * @param v value, must remain valid until the atom is set
+		 * @return atom */
+		static Atom
+		string(const char *v)
+		{
+			Atom a(CLIPS::TYPE_STRING);
+			a.string_ = v;
+			return a;
+		}
+
+		std::string to_string() const;
+
+	private:
+		friend class ClipsFactBuilder;
+		explicit Atom(CLIPS::Type type) : type_(type)
+		{
+		}
+
+		CLIPS::Type type_;
+		union {
+			long long   integer_;
+			double      float_;
+			const char *string_;
+		};
+	};
+
+	ClipsFactBuilder(CLIPS::Environment *env, const std::string &tmpl_name);
+	~ClipsFactBuilder();
+
+	int slot(const std::string &slot_name) const;
+
+	ClipsFactBuilder &set_integer(int slot, long long value);
+	ClipsFactBuilder &set_float(int slot, double value);
+	ClipsFactBuilder &set_symbol(int slot, const char *value);
+	ClipsFactBuilder &set_string(int slot, const std::string &value);
+	ClipsFactBuilder &set_address(int slot, void *value, int address_type = -1);
+	ClipsFactBuilder &set_multifield(int slot, std::initializer_list<Atom> values);
+	ClipsFactBuilder &set_fields(std::initializer_list<Atom> values);
+
+	void *assert_fact();
+
+private:
+	void         check_slot(int slot) const;
+	struct fact *current_fact();
+	void        *atom_value(const Atom &atom);
+	void         put(int slot, unsigned short type, void *value);
+	void         put_multifield(int field_index, std::initializer_list<Atom> values);
+
+	CLIPS::Environment      *env_;
+	struct deftemplate      *tmpl_;
+	std::vector<std::string> slot_names_;
+	struct fact             *fact_;
+};
+
+} // end namespace protobuf_clips
+
+#endif
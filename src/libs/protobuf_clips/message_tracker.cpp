@@ -0,0 +1,147 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  message_tracker.cpp - release received messages with their CLIPS facts
+ *
+ *  Created: Sun Oct 18 23:59:31 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <protobuf_clips/message_tracker.h>
+
+#include <clips/clips.h>
+#include <core/exception.h>
+
+#include <algorithm>
+#include <cstdio>
+
+// Environment data holding the tracker of an environment. CLIPS leaves the
+// positions from USER_ENVIRONMENT_DATA up to MAXIMUM_ENVIRONMENT_POSITIONS to
+// applications. Neither clipsmm nor the refbox allocate any of them, the
+// CLIPS logger uses the environment context instead. The position is
+// reserved for the tracker, new users must pick another one.
+#define MESSAGE_TRACKER_DATA (USER_ENVIRONMENT_DATA + 1)
+
+namespace protobuf_clips {
+
+static ClipsMessageTracker **
+tracker_data(void *env)
+{
+	return static_cast<ClipsMessageTracker **>(GetEnvironmentData(env, MESSAGE_TRACKER_DATA));
+}
+
+static void
+print_message_address(void *env, const char *logical_name, void *address)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "<Pointer-protobuf-%p>", ValueToExternalAddress(address));
+	EnvPrintRouter(env, logical_name, buf);
+}
+
+static intBool
+discard_message_address(void *env, void *ptr)
+{
+	ClipsMessageTracker *tracker = *tracker_data(env);
+	if (tracker) {
+		tracker->release(ptr);
+	} else {
+		delete static_cast<std::shared_ptr<google::protobuf::Message> *>(ptr);
+	}
+	return TRUE;
+}
+
+static struct externalAddressType message_address_type = {"protobuf-message",
+                                                          print_message_address,
+                                                          print_message_address,
+                                                          discard_message_address,
+                                                          NULL,
+                                                          NULL};
+
+/** @class ClipsMessageTracker <protobuf_clips/message_tracker.h>
+ * Release received messages once CLIPS no longer references them.
+ * Received messages are passed to the rules as external address in the ptr
+ * slot of protobuf-msg facts. Tracked messages are stored with an external
+ * address type of their own, for which CLIPS calls back when the address is
+ * garbage collected, i.e., when the fact has been retracted and no variable
+ * binding refers to it anymore. The message is released right then, instead
+ * of scanning all message facts for ones that are no longer referenced.
+ * Tracked messages must not be passed to pb-destroy.
+ */
+
+/** Constructor.
+ * There must be at most one tracker per environment at a time.
+ * @param env CLIPS environment
+ * @exception Exception thrown if the environment data cannot be allocated
+ */
+ClipsMessageTracker::ClipsMessageTracker(CLIPS::Environment *env) : env_(env), peak_(0)
+{
+	void *cenv = env_->cobj();
+	if (!GetEnvironmentData(cenv, MESSAGE_TRACKER_DATA)
+	    && !AllocateEnvironmentData(
+	      cenv, MESSAGE_TRACKER_DATA, sizeof(ClipsMessageTracker *), NULL)) {
+		throw fawkes::Exception("Failed to allocate CLIPS environment data for message tracking");
+	}
+	*tracker_data(cenv) = this;
+	address_type_       = InstallExternalAddressType(cenv, &message_address_type);
+}
+
+/** Destructor.
+ * Messages that are still referenced by CLIPS are released by the
+ * environment without being counted. The tracker must be destroyed before
+ * the environment, since it detaches itself from the environment data.
+ */
+ClipsMessageTracker::~ClipsMessageTracker()
+{
+	*tracker_data(env_->cobj()) = NULL;
+}
+
+/** Track a message passed to CLIPS.
+ * @param msg message
+ * @return pointer to store as external address of address_type()
+ */
+void *
+ClipsMessageTracker::track(std::shared_ptr<google::protobuf::Message> msg)
+{
+	void *ptr = new std::shared_ptr<google::protobuf::Message>(msg);
+	live_.insert(ptr);
+	peak_ = std::max(peak_, live_.size());
+	return ptr;
+}
+
+/** Check if a pointer refers to a tracked message.
+ * @param ptr pointer passed to CLIPS
+ * @return true if the message is tracked and still referenced by CLIPS
+ */
+bool
+ClipsMessageTracker::tracks(void *ptr) const
+{
+	return live_.count(ptr) > 0;
+}
+
+/** Release a tracked message.
+ * Called when CLIPS garbage collects the message's external address.
+ * @param ptr pointer passed to CLIPS
+ */
+void
+ClipsMessageTracker::release(void *ptr)
+{
+	live_.erase(ptr);
+	delete static_cast<std::shared_ptr<google::protobuf::Message> *>(ptr);
+}
+
+} // end namespace protobuf_clips
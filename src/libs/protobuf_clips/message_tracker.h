@@ -0,0 +1,76 @@
+/***************************************************************************
+ *  message_tracker.h - release received messages with their CLIPS facts
+ *
+ *  Created: Sun Oct 18 23:59:31 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _PROTOBUF_CLIPS_MESSAGE_TRACKER_H_
+#define _PROTOBUF_CLIPS_MESSAGE_TRACKER_H_
+
+#include <google/protobuf/message.h>
+
+#include <clipsmm.h>
+#include <memory>
+#include <unordered_set>
+
+namespace protobuf_clips {
+
+class ClipsMessageTracker
+{
+public:
+	ClipsMessageTracker(CLIPS::Environment *env);
+	~ClipsMessageTracker();
+
+	void *track(std::shared_ptr<google::protobuf::Message> msg);
+	bool  tracks(void *ptr) const;
+	void  release(void *ptr);
+
+	/** Get the CLIPS external address type to store tracked messages with.
+	 * @return external address type */
+	int
+	address_type() const
+	{
+		return address_type_;
+	}
+
+	/** Get the number of tracked messages that are still referenced.
+	 * @return number of live messages */
+	size_t
+	live() const
+	{
+		return live_.size();
+	}
+
+	/** Get the maximum number of live messages.
+	 * @return peak number of live messages */
+	size_t
+	peak() const
+	{
+		return peak_;
+	}
+
+private:
+	CLIPS::Environment        *env_;
+	int                        address_type_;
+	std::unordered_set<void *> live_;
+	size_t                     peak_;
+};
+
+} // end namespace protobuf_clips
+
+#endif
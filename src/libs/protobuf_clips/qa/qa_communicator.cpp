@@ -0,0 +1,268 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_communicator.cpp - QA for the CLIPS protobuf message functions
+ *
+ *  Created: Sun Oct 18 17:12:44 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <core/threading/mutex.h>
+#include <protobuf_clips/communicator.h>
+#include <unistd.h>
+
+#include <clipsmm.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// @cond QA
+
+static bool ok = true;
+
+static const char *PROTO = "syntax = \"proto2\";\n"
+                           "package qa;\n"
+                           "message Time {\n"
+                           "  required int64 sec = 1;\n"
+                           "  required int64 nsec = 2;\n"
+                           "}\n"
+                           "message Pose {\n"
+                           "  optional Time  timestamp = 1;\n"
+                           "  optional float x = 2;\n"
+                           "  optional float y = 3;\n"
+                           "}\n"
+                           "message Robot {\n"
+                           "  enum CompType {\n"
+                           "    COMP_ID  = 9000;\n"
+                           "    MSG_TYPE = 1;\n"
+                           "  }\n"
+                           "  optional string name = 1;\n"
+                           "  optional uint32 number = 2;\n"
+                           "  optional Pose   pose = 3;\n"
+                           "  repeated Pose   waypoints = 4;\n"
+                           "  optional bool   active = 5;\n"
+                           "  optional string host = 6;\n"
+                           "}\n";
+
+static const char *FUNCTIONS[] = {
+  "(defglobal ?*ROBOT* = nil ?*EMPTY* = nil ?*INVALID* = nil)",
+  "(deffunction qa-create-robot ()"
+  "  (bind ?t (pb-create \"qa.Time\"))"
+  "  (pb-set-field ?t \"sec\" 10)"
+  "  (pb-set-field ?t \"nsec\" 20)"
+  "  (bind ?p (pb-create \"qa.Pose\"))"
+  "  (pb-set-field ?p \"timestamp\" ?t)"
+  "  (pb-set-field ?p \"x\" 1.5)"
+  "  (bind ?w (pb-create \"qa.Pose\"))"
+  "  (pb-set-field ?w \"x\" 2.5)"
+  "  (bind ?r (pb-create \"qa.Robot\"))"
+  "  (pb-set-field ?r \"name\" \"R-1\")"
+  "  (pb-set-field ?r \"number\" 3)"
+  "  (pb-set-field ?r \"pose\" ?p)"
+  "  (pb-add-list ?r \"waypoints\" ?w)"
+  "  (pb-set-field ?r \"active\" TRUE)"
+  "  (return ?r))"};
+
+/** Render a value like CLIPS prints it. */
+static std::string
+to_string(const CLIPS::Value &v)
+{
+	char buf[32];
+	switch (v.type()) {
+	case CLIPS::TYPE_SYMBOL: return v.as_string();
+	case CLIPS::TYPE_STRING: return "\"" + v.as_string() + "\"";
+	case CLIPS::TYPE_INTEGER: return std::to_string(v.as_integer());
+	case CLIPS::TYPE_FLOAT: snprintf(buf, sizeof(buf), "%g", v.as_float()); return buf;
+	default: return "?";
+	}
+}
+
+static std::string
+to_string(const CLIPS::Values &values)
+{
+	std::string s;
+	for (const CLIPS::Value &v : values) {
+		s += (s.empty() ? "" : " ") + to_string(v);
+	}
+	return s;
+}
+
+static void
+expect(CLIPS::Environment &env, const std::string &expr, const std::string &expected)
+{
+	std::string result = to_string(env.evaluate(expr));
+	if (result != expected) {
+		printf("FAILED: %s\n  expected: %s\n  got:      %s\n",
+		       expr.c_str(),
+		       expected.c_str(),
+		       result.c_str());
+		ok = false;
+	}
+}
+
+static void
+test_field_values(CLIPS::Environment &env)
+{
+	env.evaluate("(bind ?*ROBOT* (qa-create-robot))");
+	env.evaluate("(bind ?*EMPTY* (pb-create \"qa.Robot\"))");
+	env.evaluate("(bind ?*INVALID* (pb-create \"qa.DoesNotExist\"))");
+
+	// top-level fields and dotted paths into nested messages
+	expect(env,
+	       "(pb-field-values ?*ROBOT* (create$ \"name\" \"number\" \"active\" \"pose.x\""
+	       "  \"pose.timestamp.sec\" \"pose.timestamp.nsec\"))",
+	       "\"R-1\" 3 TRUE 1.5 10 20");
+	expect(env, "(pb-field-values ?*ROBOT* (create$ name pose.x))", "\"R-1\" 1.5");
+	expect(env, "(pb-field-values ?*ROBOT* (create$))", "");
+
+	// same values as pb-field-value
+	for (const char *field : {"name", "number", "active", "host"}) {
+		std::string single = to_string(
+		  env.evaluate(std::string("(pb-field-value ?*ROBOT* \"") + field + "\")"));
+		expect(env, std::string("(pb-field-values ?*ROBOT* (create$ \"") + field + "\"))", single);
+	}
+
+	// unknown fields, at the end or in between, and paths through non-messages
+	expect(env,
+	       "(pb-field-values ?*ROBOT* (create$ \"nope\" \"pose.nope\" \"nope.x\" \"name.x\""
+	       "  \"pose.timestamp.sec.x\" \"pose.\" \".pose\"))",
+	       "DOES-NOT-EXIST DOES-NOT-EXIST DOES-NOT-EXIST DOES-NOT-EXIST DOES-NOT-EXIST"
+	       " DOES-NOT-EXIST DOES-NOT-EXIST");
+
+	// unset fields, an unknown field does not affect the others
+	expect(env,
+	       "(pb-field-values ?*ROBOT* (create$ \"host\" \"pose.y\" \"nope\" \"name\"))",
+	       "NOT-SET NOT-SET DOES-NOT-EXIST \"R-1\"");
+
+	// unset nested messages read as their defaults, which are not set
+	expect(env,
+	       "(pb-field-values ?*EMPTY* (create$ \"name\" \"pose.x\" \"pose.timestamp.sec\"))",
+	       "NOT-SET NOT-SET NOT-SET");
+
+	// paths do not index into repeated messages, even if there are elements
+	expect(env,
+	       "(pb-field-values ?*ROBOT* (create$ \"waypoints.x\" \"number\"))",
+	       "DOES-NOT-EXIST 3");
+	expect(env, "(pb-field-values ?*EMPTY* (create$ \"waypoints.x\"))", "DOES-NOT-EXIST");
+
+	// one value per name for an invalid message
+	expect(env,
+	       "(pb-field-values ?*INVALID* (create$ \"name\" \"pose.x\"))",
+	       "INVALID-MESSAGE INVALID-MESSAGE");
+
+	env.evaluate("(pb-destroy ?*ROBOT*)");
+	env.evaluate("(pb-destroy ?*EMPTY*)");
+	env.evaluate("(pb-destroy ?*INVALID*)");
+}
+
+static void
+test_arena(CLIPS::Environment &env, protobuf_clips::ClipsProtobufCommunicator &pb_comm)
+{
+	// without arena, pb-ref shares the message
+	env.evaluate("(bind ?*ROBOT* (qa-create-robot))");
+	env.evaluate("(bind ?*EMPTY* (pb-ref ?*ROBOT*))");
+	env.evaluate("(pb-set-field ?*ROBOT* \"name\" \"R-2\")");
+	expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-2\"");
+	env.evaluate("(pb-destroy ?*ROBOT*)");
+	expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-2\"");
+	env.evaluate("(pb-destroy ?*EMPTY*)");
+
+	// on the arena, pb-ref returns a detached copy that outlives the arena
+	pb_comm.enable_message_arena(1024);
+	pb_comm.begin_message_arena();
+	env.evaluate("(bind ?*ROBOT* (qa-create-robot))");
+	env.evaluate("(bind ?*EMPTY* (pb-ref ?*ROBOT*))");
+	env.evaluate("(pb-set-field ?*ROBOT* \"name\" \"R-2\")");
+	expect(env, "(pb-field-value ?*ROBOT* \"name\")", "\"R-2\"");
+	expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-1\"");
+	env.evaluate("(pb-set-field ?*EMPTY* \"number\" 4)");
+	expect(env, "(pb-field-value ?*ROBOT* \"number\")", "3");
+
+	// pb-destroy does not free messages on the arena
+	env.evaluate("(pb-destroy ?*ROBOT*)");
+	expect(env, "(pb-field-value ?*ROBOT* \"name\")", "\"R-2\"");
+	pb_comm.release_message_arena();
+	expect(env,
+	       "(pb-field-values ?*EMPTY* (create$ \"name\" \"number\" \"pose.x\""
+	       "  \"pose.timestamp.sec\" \"waypoints.x\"))",
+	       "\"R-1\" 4 1.5 10 DOES-NOT-EXIST");
+	expect(env, "(length$ (pb-field-list ?*EMPTY* \"waypoints\"))", "1");
+	env.evaluate("(pb-destroy ?*EMPTY*)");
+
+	// the scope allocates on the arena until it is left
+	{
+		protobuf_clips::MessageArenaScope arena(&pb_comm);
+		env.evaluate("(bind ?*ROBOT* (qa-create-robot))");
+		env.evaluate("(bind ?*EMPTY* (pb-ref ?*ROBOT*))");
+		env.evaluate("(pb-set-field ?*ROBOT* \"name\" \"R-2\")");
+		expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-1\"");
+	}
+	expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-1\"");
+	env.evaluate("(pb-destroy ?*EMPTY*)");
+
+	// after the scope, messages are on the heap again
+	env.evaluate("(bind ?*ROBOT* (qa-create-robot))");
+	env.evaluate("(bind ?*EMPTY* (pb-ref ?*ROBOT*))");
+	env.evaluate("(pb-set-field ?*ROBOT* \"name\" \"R-2\")");
+	expect(env, "(pb-field-value ?*EMPTY* \"name\")", "\"R-2\"");
+	env.evaluate("(pb-destroy ?*ROBOT*)");
+	env.evaluate("(pb-destroy ?*EMPTY*)");
+
+	// pb-create of an unknown type is invalid on the arena, too
+	{
+		protobuf_clips::MessageArenaScope arena(&pb_comm);
+		env.evaluate("(bind ?*INVALID* (pb-create \"qa.DoesNotExist\"))");
+		expect(env, "(pb-field-values ?*INVALID* (create$ \"name\"))", "INVALID-MESSAGE");
+		env.evaluate("(pb-destroy ?*INVALID*)");
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	char proto_dir[] = "/tmp/qa_protobuf_clips_XXXXXX";
+	if (!mkdtemp(proto_dir)) {
+		printf("FAILED: cannot create proto directory\n");
+		return 1;
+	}
+	std::string proto_file = std::string(proto_dir) + "/qa.proto";
+	std::ofstream(proto_file) << PROTO;
+
+	{
+		CLIPS::Environment                        env;
+		fawkes::Mutex                             env_mutex;
+		std::vector<std::string>                  proto_path = {proto_dir};
+		protobuf_clips::ClipsProtobufCommunicator pb_comm(&env, env_mutex, proto_path);
+		for (const char *function : FUNCTIONS) {
+			env.build(function);
+		}
+
+		test_field_values(env);
+		test_arena(env, pb_comm);
+	}
+
+	remove(proto_file.c_str());
+	rmdir(proto_dir);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/// @endcond
@@ -0,0 +1,195 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_fact_builder.cpp - benchmark fact assertion with and without parsing
+ *
+ *  Created: Sun Oct 18 19:58:23 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <clips/clips.h>
+#include <protobuf_clips/fact_builder.h>
+
+#include <chrono>
+#include <clipsmm.h>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+//  By default do not include examples in API documentation
+/// @cond EXAMPLES
+
+using namespace protobuf_clips;
+
+typedef ClipsFactBuilder::Atom Atom;
+
+/** Run an assertion function and report asserts per second.
+ * Every fact is retracted right away to keep the fact base small. */
+static double
+bench(const char *name, unsigned int n, std::function<void *(unsigned int)> assert_fact, void *env)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < n; ++i) {
+		void *fact = assert_fact(i);
+		if (!fact) {
+			printf("%s: asserting fact %u failed\n", name, i);
+			exit(1);
+		}
+		EnvRetract(env, fact);
+	}
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	double                        r = n / d.count();
+	printf("%-36s %10.0f asserts/sec\n", name, r);
+	return r;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int n = argc > 1 ? atoi(argv[1]) : 200000;
+
+	CLIPS::Environment env;
+	env.build("(deftemplate protobuf-msg"
+	          "  (slot type (type STRING))"
+	          "  (slot comp-id (type INTEGER))"
+	          "  (slot msg-type (type INTEGER))"
+	          "  (slot rcvd-via (type SYMBOL) (allowed-values STREAM BROADCAST))"
+	          "  (multislot rcvd-from (cardinality 2 2))"
+	          "  (multislot rcvd-at (type INTEGER) (cardinality 2 2))"
+	          "  (slot client-type (type SYMBOL) (allowed-values SERVER CLIENT PEER))"
+	          "  (slot client-id (type INTEGER))"
+	          "  (slot ptr (type EXTERNAL-ADDRESS)))");
+	env.build("(defrule feedback (mps-status-feedback ?m READY TRUE) =>)");
+	env.build("(defrule tick (time $?now) =>)");
+
+	// Ordered facts, e.g., (time (now)) or MPS feedback
+	bench(
+	  "time, string",
+	  n,
+	  [&env](unsigned int i) {
+		  CLIPS::Fact::pointer f = env.assert_fact_f("(time 1700000000 %u)", i);
+		  return f ? f->cobj() : NULL;
+	  },
+	  env.cobj());
+	ClipsFactBuilder time_fact(&env, "time");
+	bench(
+	  "time, builder",
+	  n,
+	  [&time_fact](unsigned int i) {
+		  return time_fact.set_fields({Atom::integer(1700000000), Atom::integer(i)}).assert_fact();
+	  },
+	  env.cobj());
+
+	bench(
+	  "mps-status-feedback, string",
+	  n,
+	  [&env](unsigned int i) {
+		  CLIPS::Fact::pointer f =
+		    env.assert_fact_f("(mps-status-feedback C-BS BARCODE %u)", i);
+		  return f ? f->cobj() : NULL;
+	  },
+	  env.cobj());
+	ClipsFactBuilder feedback_fact(&env, "mps-status-feedback");
+	bench(
+	  "mps-status-feedback, builder",
+	  n,
+	  [&feedback_fact](unsigned int i) {
+		  return feedback_fact
+		    .set_fields({Atom::symbol("C-BS"), Atom::symbol("BARCODE"), Atom::integer(i)})
+		    .assert_fact();
+	  },
+	  env.cobj());
+
+	// Template facts, the clipsmm path used to assert received messages
+	CLIPS::Template::pointer tmpl = env.get_template("protobuf-msg");
+	bench(
+	  "protobuf-msg, string",
+	  n,
+	  [&env](unsigned int i) {
+		  CLIPS::Fact::pointer f =
+		    env.assert_fact_f("(protobuf-msg (type \"llsf_msgs.BeaconSignal\") (comp-id 2000) "
+		                      "(msg-type 1) (rcvd-via BROADCAST) (rcvd-at 1700000000 %u) "
+		                      "(rcvd-from \"127.0.0.1\" 4444) (client-type PEER) (client-id 1))",
+		                      i);
+		  return f ? f->cobj() : NULL;
+	  },
+	  env.cobj());
+	bench(
+	  "protobuf-msg, clipsmm slots",
+	  n,
+	  [&env, &tmpl](unsigned int i) {
+		  CLIPS::Fact::pointer fact = CLIPS::Fact::create(env, tmpl);
+		  fact->set_slot("type", "llsf_msgs.BeaconSignal");
+		  fact->set_slot("comp-id", 2000);
+		  fact->set_slot("msg-type", 1);
+		  fact->set_slot("rcvd-via", CLIPS::Value("BROADCAST", CLIPS::TYPE_SYMBOL));
+		  CLIPS::Values rcvd_at(2, CLIPS::Value(CLIPS::TYPE_INTEGER));
+		  rcvd_at[0] = 1700000000;
+		  rcvd_at[1] = (long int)i;
+		  fact->set_slot("rcvd-at", rcvd_at);
+		  CLIPS::Values host_port(2, CLIPS::Value(CLIPS::TYPE_STRING));
+		  host_port[0] = "127.0.0.1";
+		  host_port[1] = CLIPS::Value(4444);
+		  fact->set_slot("rcvd-from", host_port);
+		  fact->set_slot("client-type", CLIPS::Value("PEER", CLIPS::TYPE_SYMBOL));
+		  fact->set_slot("client-id", 1);
+		  fact->set_slot("ptr", CLIPS::Value((void *)NULL));
+		  CLIPS::Fact::pointer f = env.assert_fact(fact);
+		  return f ? f->cobj() : NULL;
+	  },
+	  env.cobj());
+	ClipsFactBuilder msg_fact(&env, "protobuf-msg");
+	int              type        = msg_fact.slot("type");
+	int              comp_id     = msg_fact.slot("comp-id");
+	int              msg_type    = msg_fact.slot("msg-type");
+	int              rcvd_via    = msg_fact.slot("rcvd-via");
+	int              rcvd_at     = msg_fact.slot("rcvd-at");
+	int              rcvd_from   = msg_fact.slot("rcvd-from");
+	int              client_type = msg_fact.slot("client-type");
+	int              client_id   = msg_fact.slot("client-id");
+	int              ptr         = msg_fact.slot("ptr");
+	bench(
+	  "protobuf-msg, builder",
+	  n,
+	  [&](unsigned int i) {
+		  return msg_fact.set_string(type, "llsf_msgs.BeaconSignal")
+		    .set_integer(comp_id, 2000)
+		    .set_integer(msg_type, 1)
+		    .set_symbol(rcvd_via, "BROADCAST")
+		    .set_multifield(rcvd_at, {Atom::integer(1700000000), Atom::integer(i)})
+		    .set_multifield(rcvd_from, {Atom::string("127.0.0.1"), Atom::integer(4444)})
+		    .set_symbol(client_type, "PEER")
+		    .set_integer(client_id, 1)
+		    .set_address(ptr, NULL)
+		    .assert_fact();
+	  },
+	  env.cobj());
+
+	// built facts must match rule patterns like parsed ones
+	void *built =
+	  feedback_fact.set_fields({Atom::symbol("C-RS"), Atom::symbol("READY"), Atom::symbol("TRUE")})
+	    .assert_fact();
+	if (!built || env.run() != 1) {
+		printf("Built fact does not match rule\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/// @endcond
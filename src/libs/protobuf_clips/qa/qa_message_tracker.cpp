@@ -0,0 +1,168 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_message_tracker.cpp - QA for releasing messages with their facts
+ *
+ *  Created: Sun Oct 18 18:41:07 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <clips/clips.h>
+#include <google/protobuf/empty.pb.h>
+#include <protobuf_clips/fact_builder.h>
+#include <protobuf_clips/message_tracker.h>
+
+#include <clipsmm.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// @cond QA
+
+using namespace protobuf_clips;
+
+#define NUM_MESSAGES 10
+
+static bool ok = true;
+
+static void
+expect(bool condition, const char *what)
+{
+	if (!condition) {
+		printf("FAILED: %s\n", what);
+		ok = false;
+	}
+}
+
+/** Assert a msg fact holding a new tracked message.
+ * @return fact index */
+static long long
+assert_message(CLIPS::Environment                                    &env,
+               ClipsMessageTracker                                   &tracker,
+               std::vector<std::weak_ptr<google::protobuf::Message>> &messages)
+{
+	std::shared_ptr<google::protobuf::Message> msg = std::make_shared<google::protobuf::Empty>();
+	messages.push_back(msg);
+
+	ClipsFactBuilder fact(&env, "msg");
+	void            *ptr = tracker.track(msg);
+	void            *f =
+	  fact.set_address(fact.slot("ptr"), ptr, tracker.address_type()).assert_fact();
+	return f ? EnvFactIndex(env.cobj(), f) : -1;
+}
+
+/** Retract a fact and let CLIPS collect its garbage. */
+static void
+retract(CLIPS::Environment &env, long long index)
+{
+	env.evaluate("(retract " + std::to_string(index) + ")");
+	env.run();
+	env.evaluate("(progn)");
+}
+
+static size_t
+num_released(const std::vector<std::weak_ptr<google::protobuf::Message>> &messages)
+{
+	size_t n = 0;
+	for (const auto &m : messages) {
+		n += m.expired() ? 1 : 0;
+	}
+	return n;
+}
+
+static void
+test_release()
+{
+	std::vector<std::weak_ptr<google::protobuf::Message>> messages;
+
+	CLIPS::Environment env;
+	env.build("(deftemplate msg (slot ptr (type EXTERNAL-ADDRESS)))");
+	env.build("(defglobal ?*KEEP* = nil)");
+	{
+		ClipsMessageTracker    tracker(&env);
+		std::vector<long long> facts;
+		for (int i = 0; i < NUM_MESSAGES; ++i) {
+			facts.push_back(assert_message(env, tracker, messages));
+		}
+		expect(tracker.live() == NUM_MESSAGES && tracker.peak() == NUM_MESSAGES,
+		       "all asserted messages live");
+		expect(num_released(messages) == 0, "no message released while asserted");
+		expect(!tracker.tracks(NULL), "untracked pointer");
+
+		// retracting a fact releases its message
+		retract(env, facts[0]);
+		expect(tracker.live() == NUM_MESSAGES - 1, "retracted message not live");
+		expect(messages[0].expired(), "retracted message released");
+		expect(tracker.peak() == NUM_MESSAGES, "peak kept after release");
+
+		// a variable binding keeps the message until it is rebound
+		env.evaluate("(bind ?*KEEP* (fact-slot-value " + std::to_string(facts[1]) + " ptr))");
+		retract(env, facts[1]);
+		expect(tracker.live() == NUM_MESSAGES - 1 && !messages[1].expired(),
+		       "bound message kept after retract");
+		env.evaluate("(bind ?*KEEP* nil)");
+		env.evaluate("(progn)");
+		expect(tracker.live() == NUM_MESSAGES - 2 && messages[1].expired(),
+		       "bound message released after rebinding");
+
+		// the peak only grows once more messages are live than before
+		facts.push_back(assert_message(env, tracker, messages));
+		expect(tracker.live() == NUM_MESSAGES - 1 && tracker.peak() == NUM_MESSAGES,
+		       "peak not exceeded");
+		for (int i = 0; i < 2; ++i) {
+			facts.push_back(assert_message(env, tracker, messages));
+		}
+		expect(tracker.live() == NUM_MESSAGES + 1 && tracker.peak() == NUM_MESSAGES + 1,
+		       "peak raised");
+
+		for (size_t i = 2; i < facts.size(); ++i) {
+			retract(env, facts[i]);
+		}
+		expect(tracker.live() == 0 && num_released(messages) == messages.size(),
+		       "all messages released after retracting all facts");
+
+		// messages left to the environment when the tracker goes first
+		for (int i = 0; i < NUM_MESSAGES; ++i) {
+			assert_message(env, tracker, messages);
+		}
+	}
+	expect(num_released(messages) == messages.size() - NUM_MESSAGES,
+	       "remaining messages live after tracker destroyed");
+
+	// a new tracker on the same environment
+	ClipsMessageTracker tracker(&env);
+	long long           fact = assert_message(env, tracker, messages);
+	retract(env, fact);
+	expect(tracker.live() == 0 && tracker.peak() == 1 && messages.back().expired(),
+	       "second tracker releases messages");
+
+	env.clear();
+	expect(num_released(messages) == messages.size(), "environment releases remaining messages");
+}
+
+int
+main(int argc, char **argv)
+{
+	test_release();
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/// @endcond
@@ -0,0 +1,336 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  batched_socket.cpp - UDP socket sending and receiving datagrams in batches
+ *
+ *  Created: Sun Oct 18 23:12:05 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "batched_socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+using boost::asio::ip::udp;
+
+namespace rcll {
+
+/** @class BatchedDatagramSocket "batched_socket.h"
+ * UDP socket that receives and sends datagrams in batches.
+ * All datagrams that are available when the socket becomes readable are
+ * received with a single recvmmsg call per batch and passed to the handler
+ * at once. Datagrams passed to send() together are sent with a single
+ * sendmmsg call per batch. During message bursts, this replaces one system
+ * call per datagram by one per batch.
+ * Datagrams are received directly into frames of a pool. Forwarding a
+ * frame to several receivers shares the frame instead of copying it.
+ * Operations of a socket are serialized on a strand, the I/O service may be
+ * run by multiple threads.
+ * recvmmsg and sendmmsg are Linux specific, the socket is not available on
+ * other systems.
+ */
+
+/** Constructor.
+ * Binds the socket to the given port on all interfaces.
+ * @param io_service I/O service to wait for received datagrams
+ * @param pool pool to take frames from, larger datagrams are dropped
+ * @param port UDP port to bind to
+ * @param batch_size maximum number of datagrams per system call
+ */
+BatchedDatagramSocket::BatchedDatagramSocket(boost::asio::io_service   &io_service,
+                                             std::shared_ptr<FramePool> pool,
+                                             unsigned short             port,
+                                             size_t                     batch_size)
+: socket_(io_service),
+  strand_(io_service),
+  pool_(pool),
+  batch_size_(std::max<size_t>(batch_size, 1)),
+  recv_frames_(batch_size_),
+  recv_msgs_(batch_size_),
+  recv_iovs_(batch_size_),
+  recv_addrs_(batch_size_),
+  send_waiting_(false),
+  recv_calls_(0),
+  recv_datagrams_(0),
+  recv_truncated_(0),
+  send_calls_(0),
+  send_datagrams_(0),
+  send_bytes_(0),
+  send_dropped_(0),
+  total_latency_usec_(0),
+  max_latency_usec_(0)
+{
+	socket_.open(udp::v4());
+	socket_.set_option(udp::socket::reuse_address(true));
+	socket_.set_option(udp::socket::broadcast(true));
+	socket_.bind(udp::endpoint(udp::v4(), port));
+	socket_.non_blocking(true);
+
+	for (size_t i = 0; i < batch_size_; ++i) {
+		recv_frames_[i]                   = pool_->acquire();
+		recv_iovs_[i].iov_base            = recv_frames_[i]->data.get();
+		recv_iovs_[i].iov_len             = pool_->frame_size();
+		recv_msgs_[i].msg_hdr.msg_iov     = &recv_iovs_[i];
+		recv_msgs_[i].msg_hdr.msg_iovlen  = 1;
+		recv_msgs_[i].msg_hdr.msg_name    = &recv_addrs_[i];
+		recv_msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	}
+	recv_batch_.reserve(batch_size_);
+	send_msgs_.resize(batch_size_);
+	send_iovs_.resize(batch_size_);
+}
+
+/** Destructor.
+ * The socket must have been closed and the I/O service stopped.
+ */
+BatchedDatagramSocket::~BatchedDatagramSocket()
+{
+	boost::system::error_code ec;
+	socket_.close(ec);
+}
+
+/** Join a multicast group to receive datagrams sent to it.
+ * Must be called before start_receive().
+ * @param group multicast group address
+ */
+void
+BatchedDatagramSocket::join_multicast(const boost::asio::ip::address &group)
+{
+	socket_.set_option(boost::asio::ip::multicast::join_group(group));
+	socket_.set_option(boost::asio::ip::multicast::enable_loopback(true));
+}
+
+/** Start receiving datagrams.
+ * @param recv_handler handler called for each received batch, it may take
+ * the frames of the batch
+ * @param error_handler handler called on send and receive errors
+ */
+void
+BatchedDatagramSocket::start_receive(RecvHandler recv_handler, ErrorHandler error_handler)
+{
+	recv_handler_  = recv_handler;
+	error_handler_ = error_handler;
+	boost::asio::post(strand_, [this] { wait_receive(); });
+}
+
+/** Send datagrams.
+ * May be called from any thread, the datagrams are sent asynchronously on
+ * the socket's strand. If the send buffer is full, the datagrams are queued
+ * until the socket is writable again. A datagram that cannot be sent for
+ * another reason is dropped and reported to the error handler, the
+ * remaining ones are still sent.
+ * @param datagrams datagrams to send
+ */
+void
+BatchedDatagramSocket::send(std::vector<Outgoing> datagrams)
+{
+	boost::asio::post(strand_, [this, datagrams = std::move(datagrams)]() mutable {
+		if (send_queue_.empty()) {
+			send_queue_.swap(datagrams);
+		} else {
+			std::move(datagrams.begin(), datagrams.end(), std::back_inserter(send_queue_));
+		}
+		flush();
+	});
+}
+
+/** Close the socket.
+ * Pending receive operations are cancelled, queued datagrams are dropped.
+ */
+void
+BatchedDatagramSocket::close()
+{
+	boost::asio::post(strand_, [this] {
+		boost::system::error_code ec;
+		socket_.close(ec);
+		send_queue_.clear();
+	});
+}
+
+/** Get counters.
+ * @return current counters */
+BatchedDatagramSocket::Stats
+BatchedDatagramSocket::stats() const
+{
+	return Stats{recv_calls_.load(),
+	             recv_datagrams_.load(),
+	             recv_truncated_.load(),
+	             send_calls_.load(),
+	             send_datagrams_.load(),
+	             send_bytes_.load(),
+	             send_dropped_.load(),
+	             std::chrono::microseconds(total_latency_usec_.load()),
+	             std::chrono::microseconds(max_latency_usec_.load())};
+}
+
+void
+BatchedDatagramSocket::flush()
+{
+	if (!socket_.is_open()) {
+		send_queue_.clear();
+		return;
+	}
+	if (send_waiting_) {
+		// sent in order once the socket is writable
+		return;
+	}
+
+	size_t sent = 0;
+	while (sent < send_queue_.size()) {
+		size_t n = std::min(batch_size_, send_queue_.size() - sent);
+		for (size_t i = 0; i < n; ++i) {
+			Outgoing &o                       = send_queue_[sent + i];
+			send_iovs_[i].iov_base            = o.frame->data.get();
+			send_iovs_[i].iov_len             = o.frame->length;
+			send_msgs_[i].msg_hdr             = {};
+			send_msgs_[i].msg_hdr.msg_iov     = &send_iovs_[i];
+			send_msgs_[i].msg_hdr.msg_iovlen  = 1;
+			send_msgs_[i].msg_hdr.msg_name    = o.to.data();
+			send_msgs_[i].msg_hdr.msg_namelen = o.to.size();
+		}
+		int rv = sendmmsg(socket_.native_handle(), send_msgs_.data(), n, 0);
+		if (rv < 0) {
+			int err = errno;
+			if (err == EINTR) {
+				continue;
+			}
+			if (err == EAGAIN || err == EWOULDBLOCK) {
+				// the send buffer is full, keep the rest for when it drained
+				send_queue_.erase(send_queue_.begin(), send_queue_.begin() + sent);
+				wait_writable();
+				return;
+			}
+			// the first datagram failed, drop it and go on with the next
+			send_dropped_ += 1;
+			sent += 1;
+			if (error_handler_) {
+				error_handler_(strerror(err));
+			}
+			continue;
+		}
+
+		auto    now         = std::chrono::steady_clock::now();
+		int64_t max_latency = max_latency_usec_.load(std::memory_order_relaxed);
+		for (int i = 0; i < rv; ++i) {
+			const Frame              &f = *send_queue_[sent + i].frame;
+			std::chrono::microseconds latency =
+			  std::chrono::duration_cast<std::chrono::microseconds>(now - f.received);
+			send_bytes_ += f.length;
+			total_latency_usec_ += latency.count();
+			max_latency = std::max<int64_t>(max_latency, latency.count());
+		}
+		while (max_latency > max_latency_usec_.load(std::memory_order_relaxed)) {
+			int64_t prev = max_latency_usec_.load(std::memory_order_relaxed);
+			if (max_latency_usec_.compare_exchange_weak(prev, max_latency)) {
+				break;
+			}
+		}
+		send_calls_ += 1;
+		send_datagrams_ += rv;
+		sent += rv;
+	}
+	send_queue_.clear();
+}
+
+void
+BatchedDatagramSocket::wait_writable()
+{
+	send_waiting_ = true;
+	auto handler  = [this](const boost::system::error_code &ec) {
+		send_waiting_ = false;
+		if (ec == boost::asio::error::operation_aborted || !socket_.is_open()) {
+			send_queue_.clear();
+			return;
+		}
+		flush();
+	};
+	socket_.async_wait(udp::socket::wait_write, boost::asio::bind_executor(strand_, handler));
+}
+
+void
+BatchedDatagramSocket::wait_receive()
+{
+	auto handler = [this](const boost::system::error_code &ec) { handle_readable(ec); };
+	socket_.async_wait(udp::socket::wait_read, boost::asio::bind_executor(strand_, handler));
+}
+
+void
+BatchedDatagramSocket::handle_readable(const boost::system::error_code &ec)
+{
+	if (ec == boost::asio::error::operation_aborted || !socket_.is_open()) {
+		return;
+	}
+	if (ec) {
+		if (error_handler_) {
+			error_handler_(ec.message());
+		}
+		wait_receive();
+		return;
+	}
+
+	// drain the socket, a full batch indicates that more datagrams are waiting
+	int n;
+	do {
+		for (size_t i = 0; i < batch_size_; ++i) {
+			recv_msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+		}
+		n = recvmmsg(socket_.native_handle(), recv_msgs_.data(), batch_size_, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && error_handler_) {
+				error_handler_(strerror(errno));
+			}
+			break;
+		}
+		recv_calls_ += 1;
+		recv_datagrams_ += n;
+
+		auto now = std::chrono::steady_clock::now();
+		recv_batch_.clear();
+		for (int i = 0; i < n; ++i) {
+			const struct msghdr &h = recv_msgs_[i].msg_hdr;
+			if (h.msg_flags & MSG_TRUNC) {
+				recv_truncated_ += 1;
+				continue;
+			}
+			Datagram d;
+			memcpy(d.from.data(), h.msg_name, h.msg_namelen);
+			d.from.resize(h.msg_namelen);
+			d.frame           = std::move(recv_frames_[i]);
+			d.frame->length   = recv_msgs_[i].msg_len;
+			d.frame->received = now;
+			recv_batch_.push_back(std::move(d));
+
+			// the handler may keep the frame, receive the next one into a fresh frame
+			recv_frames_[i]        = pool_->acquire();
+			recv_iovs_[i].iov_base = recv_frames_[i]->data.get();
+		}
+		if (!recv_batch_.empty() && recv_handler_) {
+			recv_handler_(recv_batch_);
+		}
+		recv_batch_.clear();
+	} while ((size_t)n == batch_size_ && socket_.is_open());
+
+	if (socket_.is_open()) {
+		wait_receive();
+	}
+}
+
+} // end namespace rcll
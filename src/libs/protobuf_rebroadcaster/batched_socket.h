@@ -0,0 +1,130 @@
+
+/***************************************************************************
+ *  batched_socket.h - UDP socket sending and receiving datagrams in batches
+ *
+ *  Created: Sun Oct 18 23:12:05 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _PROTOBUF_REBROADCASTER_BATCHED_SOCKET_H_
+#define _PROTOBUF_REBROADCASTER_BATCHED_SOCKET_H_
+
+#include "frame_pool.h"
+
+#ifndef __linux__
+#	error "BatchedDatagramSocket requires recvmmsg and sendmmsg, which are only available on Linux"
+#endif
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rcll {
+
+class BatchedDatagramSocket
+{
+public:
+	/** Received datagram. */
+	struct Datagram
+	{
+		boost::asio::ip::udp::endpoint from;  ///< sender
+		std::shared_ptr<Frame>         frame; ///< pooled buffer holding the datagram
+	};
+
+	/** Datagram to send. */
+	struct Outgoing
+	{
+		boost::asio::ip::udp::endpoint to;    ///< receiver
+		std::shared_ptr<const Frame>   frame; ///< frame to send, shared among receivers
+	};
+
+	/** Handler called with all datagrams received in one batch. */
+	typedef std::function<void(std::vector<Datagram> &batch)> RecvHandler;
+	/** Handler called on send and receive errors. */
+	typedef std::function<void(const std::string &error)> ErrorHandler;
+
+	/** Counters of system calls, datagrams, and forwarding latency. */
+	struct Stats
+	{
+		uint64_t                  recv_calls;     ///< recvmmsg calls that returned datagrams
+		uint64_t                  recv_datagrams; ///< datagrams received
+		uint64_t                  recv_truncated; ///< datagrams dropped, exceeding the frame size
+		uint64_t                  send_calls;     ///< sendmmsg calls that sent datagrams
+		uint64_t                  send_datagrams; ///< datagrams sent
+		uint64_t                  send_bytes;     ///< bytes sent
+		uint64_t                  send_dropped;   ///< datagrams dropped on send errors
+		std::chrono::microseconds total_latency;  ///< sum of receive to send latencies
+		std::chrono::microseconds max_latency;    ///< maximum receive to send latency
+	};
+
+	BatchedDatagramSocket(boost::asio::io_service   &io_service,
+	                      std::shared_ptr<FramePool> pool,
+	                      unsigned short             port,
+	                      size_t                     batch_size);
+	~BatchedDatagramSocket();
+
+	void  join_multicast(const boost::asio::ip::address &group);
+	void  start_receive(RecvHandler recv_handler, ErrorHandler error_handler);
+	void  send(std::vector<Outgoing> datagrams);
+	void  close();
+	Stats stats() const;
+
+private:
+	void wait_receive();
+	void handle_readable(const boost::system::error_code &ec);
+	void flush();
+	void wait_writable();
+
+	boost::asio::ip::udp::socket    socket_;
+	boost::asio::io_service::strand strand_;
+	std::shared_ptr<FramePool>      pool_;
+	size_t                          batch_size_;
+	RecvHandler                     recv_handler_;
+	ErrorHandler                    error_handler_;
+
+	std::vector<std::shared_ptr<Frame>> recv_frames_;
+	std::vector<struct mmsghdr>         recv_msgs_;
+	std::vector<struct iovec>           recv_iovs_;
+	std::vector<sockaddr_storage>       recv_addrs_;
+	std::vector<Datagram>               recv_batch_;
+
+	std::vector<Outgoing>       send_queue_;
+	std::vector<struct mmsghdr> send_msgs_;
+	std::vector<struct iovec>   send_iovs_;
+	bool                        send_waiting_;
+
+	std::atomic<uint64_t> recv_calls_;
+	std::atomic<uint64_t> recv_datagrams_;
+	std::atomic<uint64_t> recv_truncated_;
+	std::atomic<uint64_t> send_calls_;
+	std::atomic<uint64_t> send_datagrams_;
+	std::atomic<uint64_t> send_bytes_;
+	std::atomic<uint64_t> send_dropped_;
+	std::atomic<int64_t>  total_latency_usec_;
+	std::atomic<int64_t>  max_latency_usec_;
+};
+
+} // end namespace rcll
+
+#endif
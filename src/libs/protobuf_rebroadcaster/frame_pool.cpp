@@ -0,0 +1,205 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  frame_pool.cpp - pool of reusable buffers for forwarded frames
+ *
+ *  Created: Sun Oct 18 23:37:44 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "frame_pool.h"
+
+namespace rcll {
+
+/** @class FramePool "frame_pool.h"
+ * Pool of reusable frame buffers.
+ * Frames are received directly into pooled buffers and the same buffer is
+ * sent to all peers the frame is forwarded to. Once the last reference is
+ * gone, the buffer returns to the pool instead of being freed. The control
+ * blocks of the shared pointers to frames are pooled as well, so
+ * forwarding does not allocate memory once the pool has warmed up.
+ * Frames keep the pool alive, it may be dropped before the frames.
+ * The pool is thread-safe.
+ */
+
+/// @cond INTERNALS
+/** Allocator of shared pointer control blocks, which reuses released ones.
+ * The allocator keeps the pool alive until the control block is freed.
+ */
+template <typename T>
+class FramePool::ControlBlockAllocator
+{
+public:
+	typedef T value_type;
+
+	ControlBlockAllocator(std::shared_ptr<FramePool> pool) : pool_(std::move(pool))
+	{
+	}
+
+	template <typename U>
+	ControlBlockAllocator(const ControlBlockAllocator<U> &other) : pool_(other.pool_)
+	{
+	}
+
+	T *
+	allocate(size_t n)
+	{
+		return static_cast<T *>(pool_->allocate_control_block(n * sizeof(T)));
+	}
+
+	void
+	deallocate(T *p, size_t n)
+	{
+		pool_->release_control_block(p, n * sizeof(T));
+	}
+
+	template <typename U>
+	bool
+	operator==(const ControlBlockAllocator<U> &other) const
+	{
+		return pool_ == other.pool_;
+	}
+
+	template <typename U>
+	bool
+	operator!=(const ControlBlockAllocator<U> &other) const
+	{
+		return pool_ != other.pool_;
+	}
+
+private:
+	template <typename U>
+	friend class ControlBlockAllocator;
+
+	std::shared_ptr<FramePool> pool_;
+};
+/// @endcond
+
+/** Create a pool.
+ * @param frame_size capacity of each frame in bytes
+ * @param max_free maximum number of free frames kept, more are freed
+ * @return pool
+ */
+std::shared_ptr<FramePool>
+FramePool::create(size_t frame_size, size_t max_free)
+{
+	return std::shared_ptr<FramePool>(new FramePool(frame_size, max_free));
+}
+
+FramePool::FramePool(size_t frame_size, size_t max_free)
+: frame_size_(frame_size),
+  max_free_(max_free),
+  control_block_size_(0),
+  allocated_(0),
+  reused_(0)
+{
+}
+
+/** Destructor. */
+FramePool::~FramePool()
+{
+	for (Frame *f : free_) {
+		delete f;
+	}
+	for (void *b : free_control_blocks_) {
+		::operator delete(b);
+	}
+}
+
+/** Get a frame.
+ * @return free frame, it returns to the pool once it is no longer referenced
+ */
+std::shared_ptr<Frame>
+FramePool::acquire()
+{
+	Frame *f = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!free_.empty()) {
+			f = free_.back();
+			free_.pop_back();
+			reused_ += 1;
+		} else {
+			allocated_ += 1;
+		}
+	}
+	if (!f) {
+		f       = new Frame();
+		f->data = std::unique_ptr<char[]>(new char[frame_size_]);
+	}
+	f->length = 0;
+
+	// the control block's allocator keeps the pool alive while the deleter runs
+	return std::shared_ptr<Frame>(f,
+	                              [this](Frame *f) { release(f); },
+	                              ControlBlockAllocator<Frame>(shared_from_this()));
+}
+
+/** Get counters of the pool.
+ * @return current counters */
+FramePool::Stats
+FramePool::stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return Stats{allocated_, reused_, free_.size()};
+}
+
+void
+FramePool::release(Frame *frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (free_.size() < max_free_) {
+			free_.push_back(frame);
+			return;
+		}
+	}
+	delete frame;
+}
+
+void *
+FramePool::allocate_control_block(size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (control_block_size_ == 0) {
+			control_block_size_ = size;
+		}
+		if (size == control_block_size_ && !free_control_blocks_.empty()) {
+			void *b = free_control_blocks_.back();
+			free_control_blocks_.pop_back();
+			return b;
+		}
+	}
+	return ::operator new(size);
+}
+
+void
+FramePool::release_control_block(void *block, size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (size == control_block_size_ && free_control_blocks_.size() < max_free_) {
+			free_control_blocks_.push_back(block);
+			return;
+		}
+	}
+	::operator delete(block);
+}
+
+} // end namespace rcll
@@ -0,0 +1,89 @@
+
+/***************************************************************************
+ *  frame_pool.h - pool of reusable buffers for forwarded frames
+ *
+ *  Created: Sun Oct 18 23:37:44 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _PROTOBUF_REBROADCASTER_FRAME_POOL_H_
+#define _PROTOBUF_REBROADCASTER_FRAME_POOL_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rcll {
+
+/** Buffer holding a single frame. */
+struct Frame
+{
+	std::unique_ptr<char[]>               data;     ///< frame data
+	size_t                                length;   ///< length of the frame in bytes
+	std::chrono::steady_clock::time_point received; ///< time the frame was received
+};
+
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+	static std::shared_ptr<FramePool> create(size_t frame_size, size_t max_free);
+	~FramePool();
+
+	std::shared_ptr<Frame> acquire();
+
+	/** Get the capacity of each frame.
+	 * @return frame size in bytes */
+	size_t
+	frame_size() const
+	{
+		return frame_size_;
+	}
+
+	/** Counters of the pool. */
+	struct Stats
+	{
+		uint64_t allocated; ///< frames allocated because no free one was available
+		uint64_t reused;    ///< frames taken from the pool
+		size_t   free;      ///< frames currently in the pool
+	};
+
+	Stats stats();
+
+private:
+	template <typename T>
+	class ControlBlockAllocator;
+
+	FramePool(size_t frame_size, size_t max_free);
+	void  release(Frame *frame);
+	void *allocate_control_block(size_t size);
+	void  release_control_block(void *block, size_t size);
+
+	size_t               frame_size_;
+	size_t               max_free_;
+	std::mutex           mutex_;
+	std::vector<Frame *> free_;
+	std::vector<void *>  free_control_blocks_;
+	size_t               control_block_size_;
+	uint64_t             allocated_;
+	uint64_t             reused_;
+};
+
+} // end namespace rcll
+
+#endif
@@ -0,0 +1,280 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  impairment.cpp - emulate network impairments when forwarding frames
+ *
+ *  Created: Sun Oct 18 23:52:16 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "impairment.h"
+
+#include <core/exception.h>
+
+#include <algorithm>
+#include <map>
+
+using namespace std::chrono;
+
+namespace rcll {
+
+/** Check if any impairment is configured.
+ * @return true if frames are impaired, false if they are forwarded as is
+ */
+bool
+NetworkImpairment::Params::enabled() const
+{
+	return latency_ms > 0. || jitter_ms > 0. || loss > 0. || reorder > 0. || duplicate > 0.
+	       || bandwidth_kbps > 0.;
+}
+
+/** @class NetworkImpairment "impairment.h"
+ * Emulate an impaired network between the peers of a group.
+ * Frames that are forwarded to the peers of a group are first lost for all
+ * receivers, like with the rebroadcaster's package loss. The others pass a
+ * shared medium of limited bandwidth. Frames that would queue longer than
+ * the queue limit are dropped. Each copy to a receiving peer is then
+ * duplicated, held back for reordering, and delayed by a latency drawn
+ * from the configured distribution, independently of the other copies.
+ * Copies with a different latency are reordered naturally. Copies without
+ * added delay are sent right away, the others are sent when due.
+ * All random decisions are drawn from a generator with the given seed,
+ * which allows to repeat an experiment with the same impairments for the
+ * same sequence of frames. The class is thread-safe.
+ */
+
+/** Constructor.
+ * @param io_service I/O service to run the timer of delayed frames on
+ * @param params impairment parameters
+ * @param seed seed of the random number generator
+ * @param send_handler handler to send delayed frames with
+ */
+NetworkImpairment::NetworkImpairment(boost::asio::io_service &io_service,
+                                     const Params            &params,
+                                     uint64_t                 seed,
+                                     SendHandler              send_handler)
+: params_(params),
+  send_handler_(send_handler),
+  strand_(io_service),
+  timer_(io_service),
+  rng_(seed),
+  link_free_at_(steady_clock::now()),
+  sequence_(0),
+  stats_(),
+  canceled_(false)
+{
+}
+
+/** Parse the name of a latency distribution.
+ * @param name name of the distribution, i.e., constant, uniform, normal, or
+ * exponential
+ * @return distribution
+ * @exception Exception thrown if the name is unknown
+ */
+NetworkImpairment::Distribution
+NetworkImpairment::parse_distribution(const std::string &name)
+{
+	if (name == "constant") {
+		return CONSTANT;
+	} else if (name == "uniform") {
+		return UNIFORM;
+	} else if (name == "normal") {
+		return NORMAL;
+	} else if (name == "exponential") {
+		return EXPONENTIAL;
+	}
+	throw fawkes::Exception("Unknown latency distribution '%s'", name.c_str());
+}
+
+/** Forward a frame to peers of the group.
+ * @param frame frame to forward
+ * @param peers indexes of the receiving peers
+ * @param receivers receivers of all peers of the group, by peer index
+ * @param immediate upon return contains the copies to send right away, by
+ * peer index, copies are appended
+ */
+void
+NetworkImpairment::forward(const std::shared_ptr<const Frame>                        &frame,
+                           const std::vector<unsigned int>                           &peers,
+                           const std::vector<boost::asio::ip::udp::endpoint>         &receivers,
+                           std::vector<std::vector<BatchedDatagramSocket::Outgoing>> &immediate)
+{
+	std::vector<Delayed>     delayed;
+	steady_clock::time_point now = steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.frames += 1;
+		if (chance(params_.loss)) {
+			stats_.lost += 1;
+			return;
+		}
+
+		// all copies share the group's medium, wait until it is free
+		steady_clock::time_point departure = now;
+		if (params_.bandwidth_kbps > 0.) {
+			auto tx_time = duration_cast<steady_clock::duration>(
+			  duration<double>(frame->length * 8. / (params_.bandwidth_kbps * 1000.)));
+			departure = std::max(now, link_free_at_) + tx_time;
+			if (departure - now > duration<double, std::milli>(params_.queue_limit_ms)) {
+				stats_.overflowed += 1;
+				return;
+			}
+			link_free_at_ = departure;
+		}
+
+		for (unsigned int peer : peers) {
+			int copies = 1;
+			if (chance(params_.duplicate)) {
+				stats_.duplicated += 1;
+				copies = 2;
+			}
+			for (int c = 0; c < copies; ++c) {
+				steady_clock::time_point due = departure + sample_latency();
+				if (chance(params_.reorder)) {
+					stats_.reordered += 1;
+					due += duration_cast<steady_clock::duration>(
+					  duration<double, std::milli>(params_.reorder_ms));
+				}
+				BatchedDatagramSocket::Outgoing datagram{receivers[peer], frame};
+				if (due <= now) {
+					immediate[peer].push_back(std::move(datagram));
+				} else {
+					stats_.delayed += 1;
+					stats_.total_delay += duration_cast<microseconds>(due - now);
+					delayed.push_back(Delayed{due, sequence_++, peer, std::move(datagram)});
+				}
+			}
+		}
+	}
+
+	if (!delayed.empty()) {
+		boost::asio::post(strand_, [this, delayed = std::move(delayed)]() mutable {
+			schedule(std::move(delayed));
+		});
+	}
+}
+
+/** Drop all delayed frames and stop sending.
+ * Must be called before the I/O service is stopped.
+ */
+void
+NetworkImpairment::cancel()
+{
+	boost::asio::post(strand_, [this] {
+		canceled_ = true;
+		pending_  = decltype(pending_)();
+		timer_.cancel();
+	});
+}
+
+/** Get counters of applied impairments.
+ * @return current counters
+ */
+NetworkImpairment::Stats
+NetworkImpairment::stats()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+std::chrono::microseconds
+NetworkImpairment::sample_latency()
+{
+	double latency_ms = params_.latency_ms;
+	switch (params_.distribution) {
+	case CONSTANT: break;
+	case UNIFORM: {
+		std::uniform_real_distribution<double> uniform(params_.latency_ms - params_.jitter_ms,
+		                                               params_.latency_ms + params_.jitter_ms);
+		latency_ms = uniform(rng_);
+		break;
+	}
+	case NORMAL:
+		if (params_.jitter_ms > 0.) {
+			latency_ms = std::normal_distribution<double>(params_.latency_ms, params_.jitter_ms)(rng_);
+		}
+		break;
+	case EXPONENTIAL:
+		if (params_.latency_ms > 0.) {
+			latency_ms = std::exponential_distribution<double>(1. / params_.latency_ms)(rng_);
+		}
+		break;
+	}
+	return microseconds((long long)(std::max(latency_ms, 0.) * 1000.));
+}
+
+bool
+NetworkImpairment::chance(double probability)
+{
+	return probability > 0. && std::uniform_real_distribution<double>(0., 1.)(rng_) < probability;
+}
+
+void
+NetworkImpairment::schedule(std::vector<Delayed> delayed)
+{
+	if (canceled_) {
+		return;
+	}
+	bool rearm = pending_.empty();
+	for (Delayed &d : delayed) {
+		rearm = rearm || d.due < pending_.top().due;
+		pending_.push(std::move(d));
+	}
+	if (rearm) {
+		wait_due();
+	}
+}
+
+void
+NetworkImpairment::wait_due()
+{
+	// cancels a pending wait, which then returns with operation_aborted
+	timer_.expires_at(pending_.top().due);
+	timer_.async_wait(
+	  boost::asio::bind_executor(strand_, [this](const boost::system::error_code &ec) {
+		  if (!ec) {
+			  send_due();
+		  }
+	  }));
+}
+
+void
+NetworkImpairment::send_due()
+{
+	if (canceled_) {
+		return;
+	}
+
+	// send all due copies at once, one batch per peer
+	steady_clock::time_point now = steady_clock::now();
+	std::map<unsigned int, std::vector<BatchedDatagramSocket::Outgoing>> due;
+	while (!pending_.empty() && pending_.top().due <= now) {
+		const Delayed &d = pending_.top();
+		due[d.peer].push_back(d.datagram);
+		pending_.pop();
+	}
+	for (auto &d : due) {
+		send_handler_(d.first, std::move(d.second));
+	}
+
+	if (!pending_.empty()) {
+		wait_due();
+	}
+}
+
+} // end namespace rcll
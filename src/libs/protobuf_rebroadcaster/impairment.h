@@ -0,0 +1,145 @@
+
+/***************************************************************************
+ *  impairment.h - emulate network impairments when forwarding frames
+ *
+ *  Created: Sun Oct 18 23:52:16 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _PROTOBUF_REBROADCASTER_IMPAIRMENT_H_
+#define _PROTOBUF_REBROADCASTER_IMPAIRMENT_H_
+
+#include "batched_socket.h"
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace rcll {
+
+class NetworkImpairment
+{
+public:
+	/** Distribution of the added latency. */
+	typedef enum {
+		CONSTANT,   ///< always the mean latency
+		UNIFORM,    ///< uniform within mean latency +/- jitter
+		NORMAL,     ///< normal with mean latency and jitter as standard deviation
+		EXPONENTIAL ///< exponential with mean latency, e.g., for retransmissions
+	} Distribution;
+
+	/** Impairment parameters of a peer group. */
+	struct Params
+	{
+		Distribution distribution;   ///< latency distribution
+		double       latency_ms;     ///< mean latency in ms
+		double       jitter_ms;      ///< jitter in ms, see Distribution
+		double       loss;           ///< probability to drop a frame for all receivers
+		double       reorder;        ///< probability to hold a frame back
+		double       reorder_ms;     ///< additional delay of held back frames in ms
+		double       duplicate;      ///< probability to send a frame twice
+		double       bandwidth_kbps; ///< bandwidth of the group's medium, 0 for unlimited
+		double       queue_limit_ms; ///< maximum queueing delay before frames are dropped
+
+		bool enabled() const;
+	};
+
+	/** Counters of applied impairments. */
+	struct Stats
+	{
+		uint64_t                  frames;      ///< frames passed to forward()
+		uint64_t                  lost;        ///< frames dropped by loss
+		uint64_t                  overflowed;  ///< frames dropped by the bandwidth limit
+		uint64_t                  duplicated;  ///< copies sent twice
+		uint64_t                  reordered;   ///< copies held back
+		uint64_t                  delayed;     ///< copies sent later than received
+		std::chrono::microseconds total_delay; ///< sum of added delays of delayed copies
+	};
+
+	/** Handler to send datagrams to a peer of the group. */
+	typedef std::function<void(unsigned int                                 peer,
+	                           std::vector<BatchedDatagramSocket::Outgoing> datagrams)>
+	  SendHandler;
+
+	NetworkImpairment(boost::asio::io_service &io_service,
+	                  const Params            &params,
+	                  uint64_t                 seed,
+	                  SendHandler              send_handler);
+
+	static Distribution parse_distribution(const std::string &name);
+
+	void  forward(const std::shared_ptr<const Frame>                        &frame,
+	              const std::vector<unsigned int>                           &peers,
+	              const std::vector<boost::asio::ip::udp::endpoint>         &receivers,
+	              std::vector<std::vector<BatchedDatagramSocket::Outgoing>> &immediate);
+	void  cancel();
+	Stats stats();
+
+private:
+	/** Frame copy waiting to be sent. */
+	struct Delayed
+	{
+		std::chrono::steady_clock::time_point due;      ///< time to send the copy
+		uint64_t                              sequence; ///< order of equally due copies
+		unsigned int                          peer;     ///< index of the receiving peer
+		BatchedDatagramSocket::Outgoing       datagram; ///< datagram to send
+	};
+
+	/** Order delayed copies by due time, earliest first. */
+	struct LaterDue
+	{
+		/** Compare two copies.
+		 * @param a first copy
+		 * @param b second copy
+		 * @return true if a is due after b */
+		bool
+		operator()(const Delayed &a, const Delayed &b) const
+		{
+			return a.due > b.due || (a.due == b.due && a.sequence > b.sequence);
+		}
+	};
+
+	std::chrono::microseconds sample_latency();
+	bool                      chance(double probability);
+	void                      schedule(std::vector<Delayed> delayed);
+	void                      wait_due();
+	void                      send_due();
+
+	Params                          params_;
+	SendHandler                     send_handler_;
+	boost::asio::io_service::strand strand_;
+	boost::asio::steady_timer       timer_;
+
+	std::mutex                            mutex_;
+	std::mt19937_64                       rng_;
+	std::chrono::steady_clock::time_point link_free_at_;
+	uint64_t                              sequence_;
+	Stats                                 stats_;
+
+	std::priority_queue<Delayed, std::vector<Delayed>, LaterDue> pending_;
+	bool                                                         canceled_;
+};
+
+} // end namespace rcll
+
+#endif
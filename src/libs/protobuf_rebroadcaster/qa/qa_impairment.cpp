@@ -0,0 +1,281 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_impairment.cpp - QA for the emulated network impairments
+ *
+ *  Created: Sun Oct 18 19:26:38 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+/// @cond QA
+
+#include "../impairment.h"
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+using namespace rcll;
+using boost::asio::ip::udp;
+
+#define NUM_PEERS 3
+#define NUM_FRAMES 100
+
+typedef std::vector<std::vector<BatchedDatagramSocket::Outgoing>> Batches;
+
+static bool ok = true;
+
+static void
+expect(bool condition, const char *what)
+{
+	if (!condition) {
+		printf("FAILED: %s\n", what);
+		ok = false;
+	}
+}
+
+/** Forwards frames through an impairment and records what each peer gets. */
+class Harness
+{
+public:
+	Harness(const NetworkImpairment::Params &params)
+	: pool_(FramePool::create(1024, NUM_FRAMES)),
+	  peers_({0, 1, 2}),
+	  impairment_(io_service_,
+	              params,
+	              42,
+	              [this](unsigned int peer, std::vector<BatchedDatagramSocket::Outgoing> datagrams) {
+		              for (auto &d : datagrams) {
+			              delayed_[peer].push_back(d.frame->data[0]);
+		              }
+	              }),
+	  immediate_(NUM_PEERS),
+	  delayed_(NUM_PEERS)
+	{
+		for (unsigned short i = 0; i < NUM_PEERS; ++i) {
+			receivers_.push_back(udp::endpoint(boost::asio::ip::address_v4::loopback(), 4444 + i));
+		}
+	}
+
+	/** Forward frames numbered from 0 with the given length. */
+	void
+	forward(int num_frames, size_t length)
+	{
+		for (int i = 0; i < num_frames; ++i) {
+			std::shared_ptr<Frame> f = pool_->acquire();
+			f->data[0]               = (char)i;
+			f->length                = length;
+			impairment_.forward(f, peers_, receivers_, immediate_);
+		}
+	}
+
+	/** Send all delayed copies, or drop them if canceled. */
+	void
+	run(bool cancel = false)
+	{
+		if (cancel) {
+			impairment_.cancel();
+		}
+		io_service_.run();
+		io_service_.restart();
+	}
+
+	/** Get the frame numbers sent right away to a peer.
+	 * @return frame numbers in order of sending */
+	std::vector<int>
+	immediate(unsigned int peer) const
+	{
+		std::vector<int> frames;
+		for (const auto &d : immediate_[peer]) {
+			frames.push_back(d.frame->data[0]);
+		}
+		return frames;
+	}
+
+	/** Get the frame numbers sent later to a peer.
+	 * @return frame numbers in order of sending */
+	const std::vector<int> &
+	delayed(unsigned int peer) const
+	{
+		return delayed_[peer];
+	}
+
+	NetworkImpairment::Stats
+	stats()
+	{
+		return impairment_.stats();
+	}
+
+private:
+	boost::asio::io_service       io_service_;
+	std::shared_ptr<FramePool>    pool_;
+	std::vector<unsigned int>     peers_;
+	std::vector<udp::endpoint>    receivers_;
+	NetworkImpairment             impairment_;
+	Batches                       immediate_;
+	std::vector<std::vector<int>> delayed_;
+};
+
+static NetworkImpairment::Params
+no_impairment()
+{
+	NetworkImpairment::Params p;
+	p.distribution   = NetworkImpairment::CONSTANT;
+	p.latency_ms     = 0.;
+	p.jitter_ms      = 0.;
+	p.loss           = 0.;
+	p.reorder        = 0.;
+	p.reorder_ms     = 0.;
+	p.duplicate      = 0.;
+	p.bandwidth_kbps = 0.;
+	p.queue_limit_ms = 100.;
+	return p;
+}
+
+static void
+test_loss()
+{
+	NetworkImpairment::Params p = no_impairment();
+	p.loss                      = 0.5;
+	Harness h(p);
+	h.forward(NUM_FRAMES, 100);
+	h.run();
+
+	NetworkImpairment::Stats s = h.stats();
+	expect(s.frames == NUM_FRAMES, "loss: all frames counted");
+	expect(s.lost > NUM_FRAMES / 4 && s.lost < 3 * NUM_FRAMES / 4, "loss: about half lost");
+
+	// a lost frame is lost for all receivers
+	bool same = true;
+	for (unsigned int peer = 1; peer < NUM_PEERS; ++peer) {
+		same = same && h.immediate(peer) == h.immediate(0);
+	}
+	expect(same, "loss: all receivers get the same frames");
+	expect(h.immediate(0).size() == NUM_FRAMES - s.lost, "loss: lost frames not sent");
+	expect(h.delayed(0).empty(), "loss: nothing delayed");
+
+	p.loss = 1.;
+	Harness all(p);
+	all.forward(NUM_FRAMES, 100);
+	expect(all.stats().lost == NUM_FRAMES && all.immediate(0).empty(), "loss: all lost");
+}
+
+static void
+test_duplicate()
+{
+	NetworkImpairment::Params p = no_impairment();
+	p.duplicate                 = 1.;
+	Harness h(p);
+	h.forward(NUM_FRAMES, 100);
+
+	NetworkImpairment::Stats s = h.stats();
+	expect(s.duplicated == NUM_FRAMES * NUM_PEERS, "duplicate: every copy duplicated");
+	bool twice = true;
+	for (unsigned int peer = 0; peer < NUM_PEERS; ++peer) {
+		std::vector<int> frames = h.immediate(peer);
+		twice                   = twice && frames.size() == 2 * NUM_FRAMES;
+		for (size_t i = 0; twice && i < frames.size(); ++i) {
+			twice = frames[i] == (char)(i / 2);
+		}
+	}
+	expect(twice, "duplicate: each frame sent twice in a row");
+}
+
+static void
+test_reorder()
+{
+	NetworkImpairment::Params p = no_impairment();
+	p.reorder                   = 0.5;
+	p.reorder_ms                = 20.;
+	Harness h(p);
+	h.forward(NUM_FRAMES, 100);
+	h.run();
+
+	NetworkImpairment::Stats s = h.stats();
+	expect(s.reordered > 0 && s.reordered < NUM_FRAMES * NUM_PEERS,
+	       "reorder: some copies held back");
+	expect(s.delayed == s.reordered, "reorder: held back copies delayed");
+	expect(s.total_delay.count() >= (long long)s.delayed * 19000,
+	       "reorder: delayed by reorder delay");
+
+	// every copy arrives once, either right away or held back
+	size_t delivered = 0;
+	for (unsigned int peer = 0; peer < NUM_PEERS; ++peer) {
+		delivered += h.immediate(peer).size() + h.delayed(peer).size();
+	}
+	expect(delivered == NUM_FRAMES * NUM_PEERS, "reorder: every copy delivered once");
+}
+
+static void
+test_delay_order()
+{
+	NetworkImpairment::Params p = no_impairment();
+	p.latency_ms                = 10.;
+	Harness h(p);
+	h.forward(NUM_FRAMES, 100);
+	h.run();
+
+	NetworkImpairment::Stats s = h.stats();
+	expect(s.delayed == NUM_FRAMES * NUM_PEERS, "delay: all copies delayed");
+	bool in_order = true;
+	for (unsigned int peer = 0; peer < NUM_PEERS; ++peer) {
+		const std::vector<int> &frames = h.delayed(peer);
+		in_order = in_order && h.immediate(peer).empty() && frames.size() == NUM_FRAMES;
+		for (size_t i = 0; in_order && i < frames.size(); ++i) {
+			in_order = frames[i] == (char)i;
+		}
+	}
+	expect(in_order, "delay: delayed copies sent in order of forwarding");
+
+	// canceled copies are dropped
+	Harness canceled(p);
+	canceled.forward(NUM_FRAMES, 100);
+	canceled.run(true);
+	expect(canceled.delayed(0).empty(), "delay: canceled copies dropped");
+}
+
+static void
+test_bandwidth()
+{
+	// 100 byte frames take 100 ms each at 8 kbit/s, four fit into the queue
+	NetworkImpairment::Params p = no_impairment();
+	p.bandwidth_kbps            = 8.;
+	p.queue_limit_ms            = 450.;
+	Harness h(p);
+	h.forward(10, 100);
+
+	NetworkImpairment::Stats s = h.stats();
+	expect(s.frames == 10 && s.overflowed == 6, "bandwidth: frames beyond the queue limit dropped");
+	expect(s.delayed == 4 * NUM_PEERS, "bandwidth: queued frames delayed");
+	h.run(true);
+}
+
+int
+main(int argc, char **argv)
+{
+	test_loss();
+	test_duplicate();
+	test_reorder();
+	test_delay_order();
+	test_bandwidth();
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/// @endcond
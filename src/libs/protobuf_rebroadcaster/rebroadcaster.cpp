@@ -24,17 +24,25 @@
 
 #include <logging/console.h>
 #include <logging/multi.h>
-#include <protobuf_comm/message_register.h>
-#include <protobuf_comm/peer.h>
+#include <protobuf_comm/frame_header.h>
 
 #include <algorithm>
+#include <chrono>
+#include <random>
 #include <stdlib.h>
 
 using namespace protobuf_comm;
-using namespace boost::placeholders;
+using boost::asio::ip::udp;
 
 namespace rcll {
-ProtoRebroadcaster::ProtoRebroadcaster(std::shared_ptr<Configuration> config) : config_(config)
+ProtoRebroadcaster::ProtoRebroadcaster(std::shared_ptr<Configuration> config)
+: io_work_(boost::asio::make_work_guard(io_service_)),
+  stats_timer_(io_service_),
+  stats_strand_(io_service_),
+  stats_stopping_(false),
+  last_stats_(),
+  last_stats_time_(std::chrono::steady_clock::now()),
+  config_(config)
 {
 	log_level_ = Logger::LL_INFO;
 	try {
@@ -54,7 +62,6 @@ ProtoRebroadcaster::ProtoRebroadcaster(std::shared_ptr<Configuration> config) :
 	logger_->add_logger(new ConsoleLogger(log_level_));
 
 	//read config values
-	proto_dirs_         = config_->get_strings("/llsfrb/comm/protobuf-dirs");
 	package_loss_       = config_->get_float("/llsfrb/comm/rebroadcaster/package-loss");
 	addresses_          = config_->get_strings("/llsfrb/comm/rebroadcaster/addresses");
 	send_ports_         = config_->get_uints("/llsfrb/comm/rebroadcaster/send-ports");
@@ -65,6 +72,14 @@ ProtoRebroadcaster::ProtoRebroadcaster(std::shared_ptr<Configuration> config) :
 	recv_ports_crypto1_ = config_->get_uints("/llsfrb/comm/rebroadcaster/recv-ports-crypto1");
 	send_ports_crypto2_ = config_->get_uints("/llsfrb/comm/rebroadcaster/send-ports-crypto2");
 	recv_ports_crypto2_ = config_->get_uints("/llsfrb/comm/rebroadcaster/recv-ports-crypto2");
+
+	batch_size_     = config_->get_uint_or_default("/llsfrb/comm/rebroadcaster/batch-size", 32);
+	num_io_threads_ = config_->get_uint_or_default("/llsfrb/comm/rebroadcaster/io-threads", 2);
+	stats_interval_ =
+	  config_->get_float_or_default("/llsfrb/comm/rebroadcaster/stats-interval", 0.);
+	max_datagram_size_ =
+	  config_->get_uint_or_default("/llsfrb/comm/rebroadcaster/max-datagram-size", 65536);
+
 	if (addresses_.size() != send_ports_.size() || addresses_.size() != recv_ports_.size()
 	    || (use_crypto1_ && addresses_.size() != send_ports_crypto1_.size())
 	    || (use_crypto1_ && addresses_.size() != recv_ports_crypto1_.size())
@@ -74,113 +89,306 @@ ProtoRebroadcaster::ProtoRebroadcaster(std::shared_ptr<Configuration> config) :
 		                  "/llsfrb/comm/rebroadcaster/ has an invalid configuration!");
 	}
 
-	//resolve proto paths
-	try {
-		for (size_t i = 0; i < proto_dirs_.size(); ++i) {
-			std::string::size_type pos;
-			if ((pos = proto_dirs_[i].find("@BASEDIR@")) != std::string::npos) {
-				proto_dirs_[i].replace(pos, 9, BASEDIR);
-			}
-			if ((pos = proto_dirs_[i].find("@RESDIR@")) != std::string::npos) {
-				proto_dirs_[i].replace(pos, 8, RESDIR);
-			}
-			if ((pos = proto_dirs_[i].find("@CONFDIR@")) != std::string::npos) {
-				proto_dirs_[i].replace(pos, 9, CONFDIR);
-			}
-			if (proto_dirs_[i][proto_dirs_.size() - 1] != '/') {
-				proto_dirs_[i] += "/";
-			}
+	// keep about one batch of frames per peer for reuse
+	frame_pool_ = FramePool::create(max_datagram_size_, batch_size_ * addresses_.size());
+
+	//create peer sockets, each group only forwards among its own peers
+	groups_.resize(1 + (use_crypto1_ ? 1 : 0) + (use_crypto2_ ? 1 : 0));
+	create_group(groups_[0], "plain", send_ports_, recv_ports_);
+	if (use_crypto1_) {
+		create_group(groups_[1], "crypto1", send_ports_crypto1_, recv_ports_crypto1_);
+	}
+	if (use_crypto2_) {
+		create_group(groups_.back(), "crypto2", send_ports_crypto2_, recv_ports_crypto2_);
+	}
+
+	//emulate an impaired network, all random decisions derive from one seed
+	uint64_t seed = config_->get_uint_or_default("/llsfrb/comm/rebroadcaster/impairment/seed", 0);
+	if (seed == 0) {
+		seed = std::random_device()();
+	}
+	for (size_t i = 0; i < groups_.size(); ++i) {
+		PeerGroup                &group  = groups_[i];
+		NetworkImpairment::Params params = impairment_params(group.name);
+		if (!params.enabled()) {
+			continue;
 		}
-	} catch (fawkes::Exception &e) {
-		logger_->log_warn("ProtoRebroadcaster",
-		                  "Failed to load proto paths from config, exception follows");
-		logger_->log_warn("ProtoRebroadcaster", e);
+		group.impairment = std::make_unique<NetworkImpairment>(
+		  io_service_,
+		  params,
+		  seed + i,
+		  [&group](unsigned int peer, std::vector<BatchedDatagramSocket::Outgoing> datagrams) {
+			  group.sockets[peer]->send(std::move(datagrams));
+		  });
+		logger_->log_info("ProtoRebroadcaster",
+		                  "Impairing %s peers (seed %llu): latency %.1f ms, jitter %.1f ms, "
+		                  "loss %.3f, reorder %.3f, duplicate %.3f, bandwidth %.0f kbit/s",
+		                  group.name.c_str(),
+		                  (unsigned long long)seed,
+		                  params.latency_ms,
+		                  params.jitter_ms,
+		                  params.loss,
+		                  params.reorder,
+		                  params.duplicate,
+		                  params.bandwidth_kbps);
+	}
+
+	if (stats_interval_ > 0.) {
+		start_stats_timer();
+	}
+
+	// operations of each socket are serialized on its own strand
+	for (unsigned int i = 0; i < std::max(num_io_threads_, 1u); ++i) {
+		io_threads_.emplace_back([this] { io_service_.run(); });
 	}
+}
 
-	//create peer connections
-	peers_.resize(addresses_.size());
-	peers_crypto1_.resize(addresses_.size());
-	peers_crypto2_.resize(addresses_.size());
-	for (unsigned int i = 0; i < addresses_.size(); i++) {
-		peers_[i] =
-		  new ProtobufBroadcastPeer(addresses_[i], send_ports_[i], recv_ports_[i], proto_dirs_);
-		peers_[i]->signal_received_raw().connect(
-		  boost::bind(&ProtoRebroadcaster::receive_raw_msg, this, _1, _2, _3, _4));
-		peers_[i]->signal_send_error().connect(
-		  boost::bind(&ProtoRebroadcaster::peer_send_error, this, addresses_[i], send_ports_[i], _1));
-		if (use_crypto1_) {
-			peers_crypto1_[i] = new ProtobufBroadcastPeer(addresses_[i],
-			                                              send_ports_crypto1_[i],
-			                                              recv_ports_crypto1_[i],
-			                                              proto_dirs_);
-			peers_crypto1_[i]->signal_received_raw().connect(
-			  boost::bind(&ProtoRebroadcaster::receive_raw_msg, this, _1, _2, _3, _4));
-			peers_crypto1_[i]->signal_send_error().connect(boost::bind(
-			  &ProtoRebroadcaster::peer_send_error, this, addresses_[i], send_ports_crypto1_[i], _1));
+ProtoRebroadcaster::~ProtoRebroadcaster()
+{
+	// on the timer's strand, a cancel cannot slip in before the timer is re-armed
+	boost::asio::post(stats_strand_, [this] {
+		stats_stopping_ = true;
+		stats_timer_.cancel();
+	});
+	for (PeerGroup &g : groups_) {
+		if (g.impairment) {
+			g.impairment->cancel();
+		}
+		for (auto &s : g.sockets) {
+			s->close();
 		}
-		if (use_crypto2_) {
-			peers_crypto2_[i] = new ProtobufBroadcastPeer(addresses_[i],
-			                                              send_ports_crypto2_[i],
-			                                              recv_ports_crypto2_[i],
-			                                              proto_dirs_);
-			peers_crypto2_[i]->signal_received_raw().connect(
-			  boost::bind(&ProtoRebroadcaster::receive_raw_msg, this, _1, _2, _3, _4));
-			peers_crypto2_[i]->signal_send_error().connect(boost::bind(
-			  &ProtoRebroadcaster::peer_send_error, this, addresses_[i], send_ports_crypto2_[i], _1));
+	}
+	io_work_.reset();
+	for (std::thread &t : io_threads_) {
+		t.join();
+	}
+	log_stats();
+}
+
+/**
+ * Create the sockets of a group of peers.
+ * Each peer receives on its receive port and is sent to on its send port.
+ * @param group group to create the sockets for
+ * @param name name of the group, e.g., to configure its impairment
+ * @param send_ports send ports of the peers
+ * @param recv_ports receive ports of the peers
+ */
+void
+ProtoRebroadcaster::create_group(PeerGroup                       &group,
+                                 const std::string               &name,
+                                 const std::vector<unsigned int> &send_ports,
+                                 const std::vector<unsigned int> &recv_ports)
+{
+	group.name = name;
+
+	size_t num_peers = std::min({addresses_.size(), send_ports.size(), recv_ports.size()});
+	group.send_ports.assign(send_ports.begin(), send_ports.begin() + num_peers);
+	for (size_t i = 0; i < num_peers; ++i) {
+		try {
+			boost::asio::ip::address addr = boost::asio::ip::address::from_string(addresses_[i]);
+			group.receivers.push_back(udp::endpoint(addr, send_ports[i]));
+			group.sockets.push_back(std::make_unique<BatchedDatagramSocket>(io_service_,
+			                                                                frame_pool_,
+			                                                                recv_ports[i],
+			                                                                batch_size_));
+			if (addr.is_multicast()) {
+				group.sockets.back()->join_multicast(addr);
+			}
+		} catch (boost::system::system_error &e) {
+			logger_->log_warn("ProtoRebroadcaster",
+			                  "Failed to create peer %s:%u/%u: %s",
+			                  addresses_[i].c_str(),
+			                  send_ports[i],
+			                  recv_ports[i],
+			                  e.what());
+			throw;
 		}
+		std::string  address = addresses_[i];
+		unsigned int port    = send_ports[i];
+		group.sockets.back()->start_receive(
+		  [this, &group](std::vector<BatchedDatagramSocket::Datagram> &batch) {
+			  receive_batch(group, batch);
+		  },
+		  [this, address, port](const std::string &err) { peer_send_error(address, port, err); });
 	}
 }
 
 /**
- * Receive and forward raw msg
- * @param endpoint port msg received from
- * @param header header of the msg
- * @param data data stream
- * @param length length of the data stream
+ * Get the impairment parameters of a group of peers.
+ * Parameters in the impairment section apply to all groups, a subsection
+ * named after the group overrides them. Frames are lost with the
+ * package-loss probability, unless a loss is configured.
+ * @param group name of the group
+ * @return impairment parameters
+ */
+NetworkImpairment::Params
+ProtoRebroadcaster::impairment_params(const std::string &group)
+{
+	std::string prefix       = "/llsfrb/comm/rebroadcaster/impairment/";
+	std::string group_prefix = prefix + group + "/";
+
+	auto get_float = [&](const char *key, float default_val) {
+		float val = config_->get_float_or_default((prefix + key).c_str(), default_val);
+		return config_->get_float_or_default((group_prefix + key).c_str(), val);
+	};
+	std::string distribution =
+	  config_->get_string_or_default((prefix + "latency-distribution").c_str(), "constant");
+	distribution =
+	  config_->get_string_or_default((group_prefix + "latency-distribution").c_str(), distribution);
+
+	NetworkImpairment::Params params;
+	params.distribution   = NetworkImpairment::parse_distribution(distribution);
+	params.latency_ms     = get_float("latency", 0.);
+	params.jitter_ms      = get_float("jitter", 0.);
+	params.loss           = get_float("loss", package_loss_);
+	params.reorder        = get_float("reorder", 0.);
+	params.reorder_ms     = get_float("reorder-delay", 10.);
+	params.duplicate      = get_float("duplicate", 0.);
+	params.bandwidth_kbps = get_float("bandwidth", 0.);
+	params.queue_limit_ms = get_float("queue-limit", 100.);
+	return params;
+}
+
+/**
+ * Forward received frames to all other peers of the group.
+ * Frames are forwarded verbatim without decoding or decrypting them. Groups
+ * only forward among their own peers, which share the same key, so frames
+ * never need to be re-encrypted. The frame buffer is shared by all receivers
+ * and all frames of the batch are sent to a peer at once.
+ * Called on the strand of the receiving socket.
+ * @param group group of the peer that received the batch
+ * @param batch received datagrams
  */
 void
-ProtoRebroadcaster::receive_raw_msg(boost::asio::ip::udp::endpoint &endpoint,
-                                    protobuf_comm::frame_header_t  &header,
-                                    void                           *data,
-                                    size_t                          length)
+ProtoRebroadcaster::receive_batch(PeerGroup                                   &group,
+                                  std::vector<BatchedDatagramSocket::Datagram> &batch)
 {
-	//logger_->log_info(name(), "Got raw Message from port %d", endpoint.port());
-	unsigned int incoming_peer_port = endpoint.port(); //this is suprisingly the send-port
+	std::vector<std::vector<BatchedDatagramSocket::Outgoing>> outgoing(group.sockets.size());
+	std::vector<unsigned int>                                 peers;
+	for (BatchedDatagramSocket::Datagram &d : batch) {
+		if (d.frame->length < sizeof(frame_header_t)) {
+			continue;
+		}
+		unsigned int incoming_peer_port = d.from.port(); //this is suprisingly the send-port
+
+		//only forward messages of known peers
+		if (std::find(group.send_ports.begin(), group.send_ports.end(), incoming_peer_port)
+		    == group.send_ports.end()) {
+			continue;
+		}
+
+		//send message to all other peers
+		peers.clear();
+		for (unsigned int i = 0; i < group.sockets.size(); i++) {
+			if (group.send_ports[i] != incoming_peer_port) {
+				peers.push_back(i);
+			}
+		}
+		if (group.impairment) {
+			group.impairment->forward(d.frame, peers, group.receivers, outgoing);
+		} else {
+			for (unsigned int i : peers) {
+				outgoing[i].push_back(BatchedDatagramSocket::Outgoing{group.receivers[i], d.frame});
+			}
+		}
+	}
 
-	//simulate package loss
-	double rnd = ((double)rand()) / ((double)RAND_MAX); //0.0 <= rnd <= 1.0
-	if (rnd < package_loss_) {
-		return;
+	for (unsigned int i = 0; i < group.sockets.size(); i++) {
+		if (!outgoing[i].empty()) {
+			group.sockets[i]->send(std::move(outgoing[i]));
+		}
 	}
+}
+
+void
+ProtoRebroadcaster::start_stats_timer()
+{
+	stats_timer_.expires_after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	  std::chrono::duration<float>(stats_interval_)));
+	stats_timer_.async_wait(
+	  boost::asio::bind_executor(stats_strand_, [this](const boost::system::error_code &ec) {
+		  if (ec || stats_stopping_) {
+			  return;
+		  }
+		  log_stats();
+		  start_stats_timer();
+	  }));
+}
 
-	//check which set of peers the message comes from
-	std::vector<protobuf_comm::ProtobufBroadcastPeer *> peers;
-	std::vector<unsigned int>                           send_ports;
-	if (std::find(send_ports_.begin(), send_ports_.end(), incoming_peer_port) != send_ports_.end()) {
-		peers      = peers_;
-		send_ports = send_ports_;
-	} else if (use_crypto1_
-	           && std::find(send_ports_crypto1_.begin(),
-	                        send_ports_crypto1_.end(),
-	                        incoming_peer_port)
-	                != send_ports_crypto1_.end()) {
-		peers      = peers_crypto1_;
-		send_ports = send_ports_crypto1_;
-	} else if (use_crypto2_
-	           && std::find(send_ports_crypto2_.begin(),
-	                        send_ports_crypto2_.end(),
-	                        incoming_peer_port)
-	                != send_ports_crypto2_.end()) {
-		peers      = peers_crypto2_;
-		send_ports = send_ports_crypto2_;
+/**
+ * Log forwarding counters.
+ * Rates are computed over the time since the last call.
+ */
+void
+ProtoRebroadcaster::log_stats()
+{
+	BatchedDatagramSocket::Stats total = {};
+	for (PeerGroup &g : groups_) {
+		for (auto &s : g.sockets) {
+			BatchedDatagramSocket::Stats st = s->stats();
+			total.recv_calls += st.recv_calls;
+			total.recv_datagrams += st.recv_datagrams;
+			total.recv_truncated += st.recv_truncated;
+			total.send_calls += st.send_calls;
+			total.send_datagrams += st.send_datagrams;
+			total.send_bytes += st.send_bytes;
+			total.send_dropped += st.send_dropped;
+			total.total_latency += st.total_latency;
+			total.max_latency = std::max(total.max_latency, st.max_latency);
+		}
 	}
 
-	//send message to all other peers
-	for (unsigned int i = 0; i < peers.size(); i++) {
-		if (send_ports[i] != incoming_peer_port) {
-			peers[i]->send_raw(header, data, length);
+	std::lock_guard<std::mutex> lock(stats_mutex_);
+	auto      now       = std::chrono::steady_clock::now();
+	double    interval  = std::chrono::duration<double>(now - last_stats_time_).count();
+	uint64_t  datagrams = total.send_datagrams - last_stats_.send_datagrams;
+	uint64_t  bytes     = total.send_bytes - last_stats_.send_bytes;
+	long long avg_latency =
+	  total.send_datagrams > 0 ? total.total_latency.count() / (long long)total.send_datagrams : 0;
+
+	logger_->log_info("ProtoRebroadcaster",
+	                  "Received %llu datagrams in %llu calls (%llu truncated), "
+	                  "sent %llu in %llu calls (%llu dropped)",
+	                  (unsigned long long)total.recv_datagrams,
+	                  (unsigned long long)total.recv_calls,
+	                  (unsigned long long)total.recv_truncated,
+	                  (unsigned long long)total.send_datagrams,
+	                  (unsigned long long)total.send_calls,
+	                  (unsigned long long)total.send_dropped);
+	logger_->log_info("ProtoRebroadcaster",
+	                  "Forwarding latency avg %lld us, max %lld us, %.1f datagrams/s, %.1f KB/s",
+	                  avg_latency,
+	                  (long long)total.max_latency.count(),
+	                  interval > 0. ? datagrams / interval : 0.,
+	                  interval > 0. ? bytes / interval / 1024. : 0.);
+	FramePool::Stats ps = frame_pool_->stats();
+	logger_->log_debug("ProtoRebroadcaster",
+	                   "Frame pool: %llu allocated, %llu reused, %zu free",
+	                   (unsigned long long)ps.allocated,
+	                   (unsigned long long)ps.reused,
+	                   ps.free);
+	for (PeerGroup &g : groups_) {
+		if (!g.impairment) {
+			continue;
 		}
+		NetworkImpairment::Stats is = g.impairment->stats();
+		long long                avg_delay =
+		  is.delayed > 0 ? is.total_delay.count() / (long long)is.delayed : 0;
+		logger_->log_info("ProtoRebroadcaster",
+		                  "Impaired %s: %llu frames, %llu lost, %llu overflowed, %llu duplicated, "
+		                  "%llu reordered, %llu delayed by avg %lld us",
+		                  g.name.c_str(),
+		                  (unsigned long long)is.frames,
+		                  (unsigned long long)is.lost,
+		                  (unsigned long long)is.overflowed,
+		                  (unsigned long long)is.duplicated,
+		                  (unsigned long long)is.reordered,
+		                  (unsigned long long)is.delayed,
+		                  avg_delay);
 	}
+
+	last_stats_      = total;
+	last_stats_time_ = now;
 }
 
 void
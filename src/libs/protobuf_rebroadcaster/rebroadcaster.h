@@ -23,20 +23,21 @@
 #ifndef _PLUGINS_GAZSIM_COMM_COMM_THREAD_H_
 #define _PLUGINS_GAZSIM_COMM_COMM_THREAD_H_
 
+#include "batched_socket.h"
+#include "frame_pool.h"
+#include "impairment.h"
+
 #include <config/config.h>
 #include <config/yaml.h>
-#include <google/protobuf/message.h>
 #include <logging/logger.h>
 #include <logging/multi.h>
-#include <protobuf_comm/message_register.h>
-#include <protobuf_comm/peer.h>
 
 #include <boost/asio.hpp>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-namespace protobuf_comm {
-class ProtobufStreamClient;
-}
 namespace rcll {
 class Configuration;
 class MultiLogger;
@@ -44,18 +45,43 @@ class ProtoRebroadcaster
 {
 public:
 	ProtoRebroadcaster(std::shared_ptr<Configuration> config);
+	~ProtoRebroadcaster();
 
 private:
+	/** Peers that forward to each other, i.e., that use the same ports set. */
+	struct PeerGroup
+	{
+		std::string                                         name;       ///< name of the group
+		std::vector<unsigned int>                           send_ports; ///< send ports of the peers
+		std::vector<std::unique_ptr<BatchedDatagramSocket>> sockets;    ///< sockets of the peers
+		std::vector<boost::asio::ip::udp::endpoint>         receivers;  ///< where peers send to
+		std::unique_ptr<NetworkImpairment> impairment; ///< impairment, NULL to forward as is
+	};
+
+	void create_group(PeerGroup                       &group,
+	                  const std::string               &name,
+	                  const std::vector<unsigned int> &send_ports,
+	                  const std::vector<unsigned int> &recv_ports);
+	NetworkImpairment::Params impairment_params(const std::string &group);
 	void peer_send_error(std::string address, unsigned int port, std::string err);
-	void receive_raw_msg(boost::asio::ip::udp::endpoint &endpoint,
-	                     protobuf_comm::frame_header_t  &header,
-	                     void                           *data,
-	                     size_t                          length);
+	void receive_batch(PeerGroup &group, std::vector<BatchedDatagramSocket::Datagram> &batch);
+	void start_stats_timer();
+	void log_stats();
 
 private:
-	std::vector<protobuf_comm::ProtobufBroadcastPeer *> peers_;
-	std::vector<protobuf_comm::ProtobufBroadcastPeer *> peers_crypto1_;
-	std::vector<protobuf_comm::ProtobufBroadcastPeer *> peers_crypto2_;
+	boost::asio::io_service                                                  io_service_;
+	boost::asio::executor_work_guard<boost::asio::io_service::executor_type> io_work_;
+	std::vector<std::thread>                                                 io_threads_;
+	boost::asio::steady_timer                                                stats_timer_;
+	boost::asio::io_service::strand                                          stats_strand_;
+	bool                                                                     stats_stopping_;
+
+	std::shared_ptr<FramePool> frame_pool_;
+	std::vector<PeerGroup>     groups_;
+
+	std::mutex                            stats_mutex_;
+	BatchedDatagramSocket::Stats          last_stats_;
+	std::chrono::steady_clock::time_point last_stats_time_;
 
 	//config values
 	std::vector<std::string>  addresses_;
@@ -68,8 +94,11 @@ private:
 
 	bool use_crypto1_, use_crypto2_;
 
-	std::vector<std::string> proto_dirs_;
-	double                   package_loss_;
+	double       package_loss_;
+	unsigned int batch_size_;
+	unsigned int max_datagram_size_;
+	unsigned int num_io_threads_;
+	float        stats_interval_;
 
 	std::shared_ptr<Configuration> config_;
 	std::unique_ptr<MultiLogger>   logger_;
@@ -0,0 +1,150 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  virtual_clock.cpp - logical clock for faster than real time simulation
+ *
+ *  Created: Sun Oct 18 21:04:52 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include <core/exception.h>
+#include <utils/time/virtual_clock.h>
+
+#include <algorithm>
+
+namespace fawkes {
+
+/** @class VirtualClock <utils/time/virtual_clock.h>
+ * Logical clock shared by all components of a simulation.
+ * If the clock is disabled, it simply follows the system clock. If it is
+ * enabled, time starts at the system time of construction and only elapses
+ * when the owner calls advance(), e.g., once per main loop iteration.
+ * Components that would otherwise sleep for a duration schedule a task
+ * instead, which is run by advance() once the clock reaches its time. This
+ * way, a headless simulation runs as fast as the computation allows and
+ * independent of the load of the machine.
+ */
+
+/** Constructor.
+ * @param enabled true to run on virtual time, false to follow the system clock
+ * @param start initial time of the virtual clock, e.g., to replay a game
+ */
+VirtualClock::VirtualClock(bool enabled, time_point start)
+: enabled_(enabled), now_(start), seq_(0)
+{
+}
+
+/** Get the current time.
+ * @return current time
+ */
+VirtualClock::time_point
+VirtualClock::now() const
+{
+	if (!enabled_) {
+		return std::chrono::system_clock::now();
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	return now_;
+}
+
+/** Get the current time as timeval.
+ * @param tv upon return contains the current time
+ */
+void
+VirtualClock::get_time(struct timeval *tv) const
+{
+	to_timeval(now(), tv);
+}
+
+/** Convert a time point to timeval.
+ * @param time time point to convert
+ * @param tv upon return contains the given time
+ */
+void
+VirtualClock::to_timeval(time_point time, struct timeval *tv)
+{
+	long long usec =
+	  std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+	tv->tv_sec  = usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+/** Advance the virtual time.
+ * Runs all tasks that become due, in order of their time, with the clock set
+ * to the time of the respective task. Tasks may schedule further tasks, which
+ * are run in the same call if they are due within the step.
+ * @param step duration to advance the clock by
+ */
+void
+VirtualClock::advance(duration step)
+{
+	time_point until;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		until = now_ + step;
+	}
+	advance_to(until);
+}
+
+/** Advance the virtual time to a given time.
+ * Like advance(), but with an absolute time. The clock never goes back, if
+ * the given time has already passed, only tasks that are due are run.
+ * @param until time to advance the clock to
+ */
+void
+VirtualClock::advance_to(time_point until)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!tasks_.empty() && tasks_.top().time <= until) {
+		Task task = tasks_.top();
+		tasks_.pop();
+		now_ = std::max(now_, task.time);
+		lock.unlock();
+		task.run();
+		lock.lock();
+	}
+	now_ = std::max(now_, until);
+}
+
+/** Schedule a task.
+ * @param time time at which to run the task, tasks scheduled for the past
+ * are run on the next call to advance()
+ * @param task task to run
+ * @exception Exception thrown if the clock is not virtual
+ */
+void
+VirtualClock::schedule(time_point time, std::function<void()> task)
+{
+	if (!enabled_) {
+		throw Exception("Cannot schedule tasks on a disabled virtual clock");
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	tasks_.push(Task{time, seq_++, std::move(task)});
+}
+
+/** Get the number of pending tasks.
+ * @return number of tasks that have been scheduled but not run, yet
+ */
+size_t
+VirtualClock::num_scheduled() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return tasks_.size();
+}
+
+} // end namespace fawkes
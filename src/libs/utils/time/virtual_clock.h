@@ -0,0 +1,93 @@
+
+/***************************************************************************
+ *  virtual_clock.h - logical clock for faster than real time simulation
+ *
+ *  Created: Sun Oct 18 21:04:52 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef _UTILS_TIME_VIRTUAL_CLOCK_H_
+#define _UTILS_TIME_VIRTUAL_CLOCK_H_
+
+#include <sys/time.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace fawkes {
+
+class VirtualClock
+{
+public:
+	/** Time point type of the clock. */
+	typedef std::chrono::system_clock::time_point time_point;
+	/** Duration type of the clock. */
+	typedef std::chrono::system_clock::duration duration;
+
+	VirtualClock(bool enabled, time_point start = std::chrono::system_clock::now());
+
+	/** Check if the clock is virtual.
+	 * @return true if time only elapses by advance(), false if the clock
+	 * follows the system clock */
+	bool
+	enabled() const
+	{
+		return enabled_;
+	}
+
+	time_point now() const;
+	void       get_time(struct timeval *tv) const;
+
+	void   advance(duration step);
+	void   advance_to(time_point time);
+	void   schedule(time_point time, std::function<void()> task);
+	size_t num_scheduled() const;
+
+	static void to_timeval(time_point time, struct timeval *tv);
+
+private:
+	/** Task waiting for the clock to reach its time. */
+	struct Task
+	{
+		time_point            time;
+		uint64_t              seq;
+		std::function<void()> run;
+	};
+	/** Order tasks by time, tasks due at the same time in scheduling order. */
+	struct TaskLater
+	{
+		bool
+		operator()(const Task &a, const Task &b) const
+		{
+			return a.time > b.time || (a.time == b.time && a.seq > b.seq);
+		}
+	};
+
+	const bool                                              enabled_;
+	mutable std::mutex                                      mutex_;
+	time_point                                              now_;
+	uint64_t                                                seq_;
+	std::priority_queue<Task, std::vector<Task>, TaskLater> tasks_;
+};
+
+} // end namespace fawkes
+
+#endif
@@ -24,7 +24,9 @@
 
 #include "server.h"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
 #include <thread>
 
@@ -38,24 +40,46 @@ namespace rcll::websocket {
  * @param logger_ logger used by the backend
  * @param env_ clips environment for callbacks
  * @param env_mutex mutext to coordinate env access
- * @param io_service io_service to use
  * @param port tcp port of the websocket server
  * @param ws_mode true if websocket only mode is activated
  * @param allow_control_all if this is set, devices with not local host ip addresses can send control commands
+ * @param max_client_queue maximum number of queued outgoing messages per client, slower clients are dropped
+ * @param delta_updates send only changed fields of entity updates, tagged with per-entity sequence numbers
+ * @param max_update_rate maximum number of updates per second sent for a single entity, pending
+ *        updates are coalesced to the newest one; 0 to send every update immediately
  */
 Backend::Backend(Logger                             *logger,
                  std::shared_ptr<CLIPS::Environment> env,
                  fawkes::Mutex                      &env_mutex,
-                 boost::asio::io_service            &io_service,
                  uint                                port,
                  bool                                ws_mode,
-                 bool                                allow_control_all)
+                 bool                                allow_control_all,
+                 size_t                              max_client_queue,
+                 bool                                delta_updates,
+                 float                               max_update_rate)
 : logger_(logger),
-  data_(std::make_shared<Data>(logger_, env, env_mutex)),
-  server_(data_, logger_, io_service, port, ws_mode, allow_control_all)
+  data_(std::make_shared<Data>(logger_, env, env_mutex, delta_updates, max_update_rate > 0.)),
+  io_work_(boost::asio::make_work_guard(io_service_)),
+  command_work_(boost::asio::make_work_guard(command_service_)),
+  server_(data_,
+          logger_,
+          io_service_,
+          command_service_,
+          port,
+          ws_mode,
+          allow_control_all,
+          max_client_queue),
+  update_interval_(std::chrono::steady_clock::duration::zero())
 {
-	// launch server thread
-	server_t_ = std::thread(std::bind(&Server::operator(), &server_));
+	if (max_update_rate > 0.) {
+		update_interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		  std::chrono::duration<float>(1. / max_update_rate));
+	}
+	// all client I/O runs asynchronously in a single thread, commands of all
+	// clients wait for the CLIPS environment in another one
+	server_();
+	io_t_      = std::thread([this] { io_service_.run(); });
+	command_t_ = std::thread([this] { command_service_.run(); });
 	logger_->log_info("Websocket", "(web-)socket-server started");
 	// launch backend thread
 	backend_t_ = std::thread(&Backend::operator(), this);
@@ -66,12 +90,26 @@ Backend::~Backend()
 {
 	shutdown_ = true;
 	data_->shutdown();
-	server_.shutdown();
 	if (backend_t_.joinable()) {
 		backend_t_.join();
 	}
-	if (server_t_.joinable()) {
-		server_t_.join();
+	command_work_.reset();
+	if (command_t_.joinable()) {
+		command_t_.join();
+	}
+	if (num_coalesced_ > 0) {
+		logger_->log_info("Websocket",
+		                  "coalesced %zu of %zu entity updates",
+		                  num_coalesced_,
+		                  num_updates_);
+	}
+	boost::asio::post(io_service_, [this] {
+		server_.shutdown();
+		data_->reset_clients();
+	});
+	io_work_.reset();
+	if (io_t_.joinable()) {
+		io_t_.join();
 	}
 	data_.reset();
 }
@@ -80,25 +118,72 @@ Backend::~Backend()
  * @brief Operator runs the backend in the current thread
  *
  *  This operator runs the webfrontend backend; works
- *  through the message queue.
+ *  through the message queue. Entity updates are coalesced per entity,
+ *  only the newest pending update is sent and at most one update per
+ *  entity and update interval.
  *
  */
 void
 Backend::operator()()
 {
+	using clock = std::chrono::steady_clock;
+
+	/** Newest pending update of an entity. */
+	struct PendingUpdate
+	{
+		clock::time_point   due;
+		rapidjson::Document doc;
+	};
+	std::map<std::string, PendingUpdate>     pending;
+	std::map<std::string, clock::time_point> last_sent;
+
 	// message queue handler -> consumer
-	bool msgs_running = true;
-	while (!shutdown_ && msgs_running) {
-		// block until new message available
-		data_->log_wait();
+	while (!shutdown_) {
+		// block until new message available or the next pending update is due
+		if (pending.empty()) {
+			data_->log_wait();
+		} else {
+			clock::time_point next = pending.begin()->second.due;
+			for (const auto &p : pending) {
+				next = std::min(next, p.second.due);
+			}
+			data_->log_wait_until(next);
+		}
 		if (shutdown_) {
 			break;
 		}
 
-		// notified -> get current value from the queue
-		std::string log = data_->log_pop();
-		// send to clients
-		data_->clients_send_all(log);
+		std::queue<Data::LogEntry> logs = data_->log_pop_all();
+		for (; !logs.empty(); logs.pop()) {
+			Data::LogEntry &log = logs.front();
+			if (log.key.empty()) {
+				data_->clients_send_all(log.msg);
+				continue;
+			}
+			num_updates_ += 1;
+			auto p = pending.find(log.key);
+			if (p != pending.end()) {
+				// replace the older update that has not been sent, yet
+				p->second.doc.Swap(log.doc);
+				num_coalesced_ += 1;
+			} else {
+				auto              l   = last_sent.find(log.key);
+				clock::time_point due = l != last_sent.end() ? l->second + update_interval_
+				                                             : clock::time_point::min();
+				pending.emplace(log.key, PendingUpdate{due, std::move(log.doc)});
+			}
+		}
+
+		clock::time_point now = clock::now();
+		for (auto p = pending.begin(); p != pending.end();) {
+			if (p->second.due <= now) {
+				data_->send_update(p->second.doc);
+				last_sent[p->first] = now;
+				p                   = pending.erase(p);
+			} else {
+				++p;
+			}
+		}
 	}
 }
 
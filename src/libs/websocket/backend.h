@@ -27,6 +27,8 @@
 
 #include <clipsmm.h>
 
+#include <chrono>
+
 using namespace fawkes;
 namespace rcll::websocket {
 
@@ -36,10 +38,12 @@ public:
 	Backend(Logger                             *logger,
 	        std::shared_ptr<CLIPS::Environment> env,
 	        fawkes::Mutex                      &env_mutex,
-	        boost::asio::io_service            &io_service,
 	        uint                                port,
 	        bool                                ws_mode           = true,
-	        bool                                allow_control_all = false);
+	        bool                                allow_control_all = false,
+	        size_t                              max_client_queue  = 1024,
+	        bool                                delta_updates     = false,
+	        float                               max_update_rate   = 0.);
 
 	~Backend();
 
@@ -47,12 +51,20 @@ public:
 	std::shared_ptr<Data> get_data();
 
 private:
-	std::shared_ptr<Logger> logger_;
-	std::shared_ptr<Data>   data_;
-	Server                  server_;
-	std::thread             backend_t_;
-	std::thread             server_t_;
-	bool                    shutdown_ = false;
+	std::shared_ptr<Logger>                                                  logger_;
+	std::shared_ptr<Data>                                                    data_;
+	boost::asio::io_service                                                  io_service_;
+	boost::asio::executor_work_guard<boost::asio::io_service::executor_type> io_work_;
+	boost::asio::io_service                                                  command_service_;
+	boost::asio::executor_work_guard<boost::asio::io_service::executor_type> command_work_;
+	Server                                                                   server_;
+	std::thread                                                              backend_t_;
+	std::thread                                                              io_t_;
+	std::thread                                                              command_t_;
+	std::chrono::steady_clock::duration                                      update_interval_;
+	size_t                                                                   num_updates_   = 0;
+	size_t                                                                   num_coalesced_ = 0;
+	bool                                                                     shutdown_      = false;
 };
 
 } // namespace rcll::websocket
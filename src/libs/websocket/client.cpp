@@ -29,99 +29,132 @@
 
 #include <boost/asio.hpp>
 #include <boost/asio/dispatch.hpp>
-#include <boost/asio/strand.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
-#include <chrono>
-#include <condition_variable>
 #include <iostream>
-#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 
 using boost::asio::ip::tcp;
 
 namespace rcll::websocket {
 
+/**
+ * @brief Construct a new Client::Client object
+ *
+ * @param executor executor all socket operations of this client run on
+ * @param commands executor received commands are processed on, it must not run socket operations
+ * @param logger Logger instance to be used
+ * @param data Data instance to be used
+ * @param can_send sets if the connected client's incoming commands are processed
+ * @param max_queue_size maximum number of queued outgoing messages before the client is dropped
+ */
+Client::Client(tcp::socket::executor_type             executor,
+               boost::asio::io_service::executor_type commands,
+               std::shared_ptr<Logger>                logger,
+               std::shared_ptr<Data>                  data,
+               bool                                   can_send,
+               size_t                                 max_queue_size)
+: executor_(executor),
+  commands_(commands),
+  logger_(logger),
+  data_(data),
+  can_send_(can_send),
+  max_queue_size_(max_queue_size)
+{
+	// Check for existence of rcll-prepare-machine tool for websocket prepare
+	std::string prepare_machine_loc = std::string(BINDIR) + "/rcll-prepare-machine";
+	prepare_machine_supported_      = access(prepare_machine_loc.c_str(), X_OK) == 0;
+	prepare_machine_command_        = std::string(BINDIR) + "/./rcll-prepare-machine ";
+	if (!prepare_machine_supported_) {
+		logger_->log_error(
+		  "Websocket",
+		  "Could not find rcll-prepare-machine at %s, machine instructions per websocket ar disabled",
+		  prepare_machine_loc.c_str());
+	}
+}
+
+/**
+ * @brief Destroy the Client::Client object
+ *
+ */
+Client::~Client()
+{
+}
+
 /**
  * @brief Construct a new ClientWS::ClientWS object
  *
  * @param socket Established WebSocket socket shared pointer user for this client
+ * @param commands executor received commands are processed on
+ * @param logger Logger instance to be used
+ * @param data Data instance to be used
+ * @param can_send sets if the connected client's incoming commands are processed
+ * @param max_queue_size maximum number of queued outgoing messages before the client is dropped
  */
 ClientWS::ClientWS(std::shared_ptr<boost::beast::websocket::stream<tcp::socket>> socket,
+                   boost::asio::io_service::executor_type                        commands,
                    std::shared_ptr<Logger>                                       logger,
                    std::shared_ptr<Data>                                         data,
-                   bool                                                          can_send)
-: socket(socket)
+                   bool                                                          can_send,
+                   size_t                                                        max_queue_size)
+: Client(socket->get_executor(), commands, logger, data, can_send, max_queue_size),
+  socket(socket)
 {
-	logger_   = logger;
-	data_     = data;
-	can_send_ = can_send;
-
-	socket->accept();
-	client_t = std::thread(&Client::receive_thread, this);
-	logger_->log_info("Websocket", "client receive thread started");
-	on_connect_update();
 }
 
 /**
- * @brief Destroy the ClientWS:: ClientWS object
+ * @brief Start handling the client
  *
+ *  Performs the WebSocket handshake, queues the on connect update and starts receiving.
+ *  Must be called once the client is owned by a shared pointer.
  */
-ClientWS::~ClientWS()
+void
+ClientWS::start()
 {
-	disconnect();
-	client_t.join();
+	std::shared_ptr<Client> self = shared_from_this();
+	socket->async_accept([this, self](const boost::system::error_code &error) {
+		if (error) {
+			logger_->log_warn("Websocket", "WebSocket handshake failed: %s", error.message().c_str());
+			disconnect();
+			return;
+		}
+		logger_->log_info("Websocket", "client connected");
+		boost::asio::post(commands_, [self] { self->on_connect_update(); });
+		async_read();
+	});
 }
 
 /**
- * @brief Send string message to client
+ * @brief Write the first queued message to the client
  *
- *  Thread-safe WebSocket send function, sends a given string message with a trailing newline to the client.
- *
- * @param msg
- * @return true send successful
- * @return false send unsuccessful (connection probably broken)
- * @param logger_ Logger instance to be used
  */
-bool
-ClientWS::send(std::string msg)
+void
+ClientWS::async_write_front()
 {
-	const std::lock_guard<std::mutex> lock(wr_mu);
-
-	// Split the input string into individual messages
-	std::istringstream iss(msg);
-	std::string        singleMsg;
-
-	while (std::getline(iss, singleMsg, '\n')) {
-		// Send each message separately
-		boost::system::error_code error;
-		socket->write(boost::asio::buffer(singleMsg + "\n"), error);
-
-		if (error && error != boost::asio::error::eof) {
-			return false;
-		}
-	}
-
-	return true;
+	// each line is sent as a separate WebSocket message
+	std::shared_ptr<Client> self = shared_from_this();
+	socket->async_write(outbound_.front()->line(outbound_lines_written_),
+	                    [this, self](const boost::system::error_code &error, size_t) {
+		                    handle_write(error, 1);
+	                    });
 }
 
 /**
- * @brief Blocking receive function, returns received message
- *
- *  Function waits for incoming string message and returns it once it is received.
+ * @brief Receive the next message from the client
  *
- * @return std::string received message
  */
-std::string
-ClientWS::read()
+void
+ClientWS::async_read()
 {
-	const std::lock_guard<std::mutex> lock(rd_mu);
-
-	boost::asio::streambuf buf;
-	socket->read(buf);
-	std::string data = boost::asio::buffer_cast<const char *>(buf.data());
-
-	return data;
+	std::shared_ptr<Client> self = shared_from_this();
+	socket->async_read(read_buf_, [this, self](const boost::system::error_code &error, size_t) {
+		std::string input = boost::beast::buffers_to_string(read_buf_.data());
+		read_buf_.consume(read_buf_.size());
+		handle_read(error, input);
+	});
 }
 
 /**
@@ -131,316 +164,424 @@ ClientWS::read()
 void
 ClientWS::close()
 {
-	socket->next_layer().close();
+	boost::system::error_code error;
+	socket->next_layer().close(error);
 }
 
 /**
  * @brief Construct a new ClientS::ClientS object
  *
  * @param socket TCP socket over which client communication happens
+ * @param commands executor received commands are processed on
  * @param logger Logger instance to be used
  * @param data Data instance to be used
  * @param can_send sets if the connected client's incoming commands are processed
+ * @param max_queue_size maximum number of queued outgoing messages before the client is dropped
  */
-ClientS::ClientS(std::shared_ptr<tcp::socket> socket,
-                 std::shared_ptr<Logger>      logger,
-                 std::shared_ptr<Data>        data,
-                 bool                         can_send)
-: socket(socket)
+ClientS::ClientS(std::shared_ptr<tcp::socket>           socket,
+                 boost::asio::io_service::executor_type commands,
+                 std::shared_ptr<Logger>                logger,
+                 std::shared_ptr<Data>                  data,
+                 bool                                   can_send,
+                 size_t                                 max_queue_size)
+: Client(socket->get_executor(), commands, logger, data, can_send, max_queue_size),
+  socket(socket)
 {
-	logger_   = logger;
-	data_     = data;
-	can_send_ = can_send;
-	client_t  = std::thread(&Client::receive_thread, this);
-	logger_->log_info("Websocket", "TCP-socket client receive thread started");
-	on_connect_update();
 }
 
 /**
- * @brief Destroy the ClientS::ClientS object
+ * @brief Start handling the client
  *
+ *  Queues the on connect update and starts receiving.
+ *  Must be called once the client is owned by a shared pointer.
  */
-ClientS::~ClientS()
+void
+ClientS::start()
 {
-	disconnect();
-	client_t.join();
+	logger_->log_info("Websocket", "TCP-socket client connected");
+	std::shared_ptr<Client> self = shared_from_this();
+	boost::asio::post(commands_, [self] { self->on_connect_update(); });
+	async_read();
 }
 
 /**
- * @brief Send string message to client
- *
- *  Thread-safe TCP socket send function, sends a given string message with a trailing newline to the client.
+ * @brief Write the first queued message to the client
  *
- * @param msg message to be sent
- * @return true send was successful
- * @return false send was unsuccessful
  */
-bool
-ClientS::send(std::string msg)
+void
+ClientS::async_write_front()
 {
-	const std::lock_guard<std::mutex> lock(wr_mu);
+	// the framed lines form the byte stream, write all of them at once
+	std::shared_ptr<Client> self = shared_from_this();
+	size_t                  lines = outbound_.front()->num_lines();
+	boost::asio::async_write(*socket,
+	                         boost::asio::buffer(outbound_.front()->data()),
+	                         [this, self, lines](const boost::system::error_code &error, size_t) {
+		                         handle_write(error, lines);
+	                         });
+}
 
-	// Split the input string into individual messages
-	std::istringstream iss(msg);
-	std::string        singleMsg;
+/**
+ * @brief Receive the next newline terminated message from the client
+ *
+ */
+void
+ClientS::async_read()
+{
+	std::shared_ptr<Client> self = shared_from_this();
+	boost::asio::async_read_until(
+	  *socket, read_buf_, "\n", [this, self](const boost::system::error_code &error, size_t n) {
+		  std::string input;
+		  if (!error) {
+			  input.assign(boost::asio::buffers_begin(read_buf_.data()),
+			               boost::asio::buffers_begin(read_buf_.data()) + n);
+			  read_buf_.consume(n);
+		  }
+		  handle_read(error, input);
+	  });
+}
 
-	while (std::getline(iss, singleMsg, '\n')) {
-		// Send each message separately
-		boost::system::error_code error;
-		boost::asio::write(*socket, boost::asio::buffer(singleMsg + "\n"), error);
+/**
+ * @brief TCP-Socket implementation for close
+ *
+ */
+void
+ClientS::close()
+{
+	boost::system::error_code error;
+	socket->close(error);
+}
 
-		if (error && error != boost::asio::error::eof) {
-			return false;
+/**
+ * @brief Split a message into newline terminated lines
+ *
+ *  The lines are stored consecutively in a single buffer, so that the message
+ *  can be shared by any number of clients without further copies.
+ *
+ * @param msg message to be framed
+ * @return immutable framed message
+ */
+std::shared_ptr<const FramedMessage>
+FramedMessage::frame(const std::string &msg)
+{
+	std::shared_ptr<FramedMessage> framed = std::make_shared<FramedMessage>();
+	framed->data_.reserve(msg.size() + 1);
+
+	size_t begin = 0;
+	while (begin < msg.size()) {
+		size_t end = msg.find('\n', begin);
+		if (end == std::string::npos) {
+			end = msg.size();
 		}
+		framed->lines_.emplace_back(framed->data_.size(), end - begin + 1);
+		framed->data_.append(msg, begin, end - begin);
+		framed->data_.push_back('\n');
+		begin = end + 1;
 	}
+	return framed;
+}
+
+/**
+ * @brief Get a single line of the message
+ *
+ * @param i index of the line
+ * @return buffer referencing the line including its trailing newline
+ */
+boost::asio::const_buffer
+FramedMessage::line(size_t i) const
+{
+	return boost::asio::buffer(data_.data() + lines_[i].first, lines_[i].second);
+}
 
-	return true;
+/**
+ * @brief Queue string message to be sent to the client
+ *
+ *  Convenience wrapper that frames the message for this client only.
+ *
+ * @param msg message to be sent
+ */
+void
+Client::send(const std::string &msg)
+{
+	send(FramedMessage::frame(msg));
 }
 
 /**
- * @brief Blocking receive function, returns received message
+ * @brief Queue framed message to be sent to the client
  *
- *  Function waits for incoming string message and returns it once it is received.
+ *  Thread-safe and non-blocking, each line of the message is sent with a
+ *  trailing newline. The message is shared, not copied. Writing happens
+ *  asynchronously on the client's executor. If more than the configured
+ *  number of messages are waiting to be written, the client is considered
+ *  too slow and disconnected so that it cannot hold back updates for other
+ *  clients.
  *
- * @return std::string received message
+ * @param msg message to be sent
  */
-std::string
-ClientS::read()
+void
+Client::send(std::shared_ptr<const FramedMessage> msg)
 {
-	const std::lock_guard<std::mutex> lock(rd_mu);
+	if (!active || msg->num_lines() == 0) {
+		return;
+	}
 
-	boost::asio::streambuf buf;
-	boost::asio::read_until(*socket, buf, "\n");
-	std::string data = boost::asio::buffer_cast<const char *>(buf.data());
+	std::shared_ptr<Client> self = shared_from_this();
+	boost::asio::post(executor_, [this, self, msg = std::move(msg)]() mutable {
+		if (!active) {
+			return;
+		}
+		if (outbound_.size() >= max_queue_size_) {
+			logger_->log_warn("Websocket",
+			                  "client does not keep up, %zu messages queued, disconnecting",
+			                  outbound_.size());
+			disconnect();
+			return;
+		}
 
-	return data;
+		outbound_.push_back(std::move(msg));
+		if (outbound_.size() == 1) {
+			outbound_lines_written_ = 0;
+			async_write_front();
+		}
+	});
 }
 
 /**
- * @brief TCP-Socket implementation for close
+ * @brief Handle completion of a write operation
+ *
+ *  Removes the message from the queue once all of its lines have been written
+ *  and starts writing the next one.
  *
+ * @param error error code of the write operation
+ * @param lines number of lines of the first queued message that have been written
  */
 void
-ClientS::close()
+Client::handle_write(const boost::system::error_code &error, size_t lines)
 {
-	socket->close();
+	if (error) {
+		outbound_.clear();
+		disconnect();
+		return;
+	}
+	outbound_lines_written_ += lines;
+	if (outbound_lines_written_ >= outbound_.front()->num_lines()) {
+		outbound_.pop_front();
+		outbound_lines_written_ = 0;
+	}
+	if (active && !outbound_.empty()) {
+		async_write_front();
+	}
 }
 
 /**
- * @brief Handles incoming message requests
+ * @brief Handle completion of a read operation
+ *
+ *  Queues the received message for processing and waits for the next one.
+ *  Commands wait for the CLIPS environment, they are processed in order on
+ *  the command executor so that they do not hold back socket operations.
  *
+ * @param error error code of the read operation
+ * @param input received message
  */
 void
-Client::receive_thread()
+Client::handle_read(const boost::system::error_code &error, std::string input)
 {
-	rapidjson::Document msgs;
-	// Check for existence of rcll-prepare-machine tool for websocket prepare
-	std::string prepare_machine_loc       = std::string(BINDIR) + "/rcll-prepare-machine";
-	bool        prepare_machine_supported = access(prepare_machine_loc.c_str(), X_OK) == 0;
-	std::string prepare_machine_command   = std::string(BINDIR) + "/./rcll-prepare-machine ";
-	if (!prepare_machine_supported) {
-		logger_->log_error(
-		  "Websocket",
-		  "Could not find rcll-prepare-machine at %s, machine instructions per websocket ar disabled");
+	if (error) {
+		if (active) {
+			logger_->log_debug("Websocket", "error while receiving. %s", error.message().c_str());
+		}
+		disconnect();
+		return;
 	}
+	std::shared_ptr<Client> self = shared_from_this();
+	boost::asio::post(commands_, [self, input = std::move(input)] { self->handle_command(input); });
+	if (active) {
+		async_read();
+	}
+}
 
-	while (active) {
-		try {
-			std::string input = read();
-			msgs.Parse(input.c_str());
-
-			//check incoming message type and call corresponding CLIPS function
-			if (!msgs.IsObject()) {
-				logger_->log_error("Websocket", "non JSON message received, won't process");
-			} else if (!can_send_) {
-				logger_->log_error("Websocket", "non localhost client tried to send command");
-			} else if (msgs.HasMember("command")) {
-				std::string                command = msgs["command"].GetString();
-				rapidjson::SchemaValidator validator(*(data_->command_schema_map[command]));
-				if (!msgs.Accept(validator)) {
-					logger_->log_error("Websocket", "input JSON is invalid!");
-				} else {
-					if (strcmp(msgs["command"].GetString(), "set_gamestate") == 0) {
-						data_->clips_set_gamestate(msgs["state"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_confval") == 0) {
-						data_->clips_set_confval(msgs["path"].GetString(), msgs["value"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "reset") == 0) {
-						kill(getpid(), SIGUSR1);
-					}
-					if (strcmp(msgs["command"].GetString(), "set_gamephase") == 0) {
-						data_->clips_set_gamephase(msgs["phase"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "randomize_field") == 0) {
-						data_->clips_randomize_field();
-					}
-					if (strcmp(msgs["command"].GetString(), "set_teamname") == 0) {
-						data_->clips_set_teamname(msgs["color"].GetString(), msgs["name"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "confirm_delivery") == 0) {
-						data_->clips_confirm_delivery(msgs["delivery_id"].GetInt(),
-						                              msgs["correctness"].GetBool(),
-						                              msgs["order_id"].GetInt(),
-						                              msgs["color"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_order_delivered") == 0) {
-						data_->clips_set_order_delivered(msgs["color"].GetString(), msgs["order_id"].GetInt());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_preset") == 0) {
-						data_->clips_set_cfg_preset(msgs["category"].GetString(), msgs["preset"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_machine_state") == 0) {
-						data_->clips_production_set_machine_state(msgs["mname"].GetString(),
-						                                          msgs["state"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_machine_work_status") == 0) {
-						data_->clips_production_set_machine_work_status(msgs["name"].GetString(),
-						                                                msgs["busy"].GetBool(),
-						                                                msgs["ready"].GetBool());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_machine_pose") == 0) {
-						data_->clips_set_machine_pose(msgs["name"].GetString(),
-						                              msgs["rotation"].GetInt(),
-						                              msgs["zone"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "add_payment_rs") == 0) {
-						data_->clips_production_machine_add_base(msgs["machine"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "set_robot_maintenance") == 0) {
-						data_->clips_robot_set_robot_maintenance(msgs["robot_number"].GetInt(),
-						                                         msgs["team_color"].GetString(),
-						                                         msgs["maintenance"].GetBool());
-					}
-					if (strcmp(msgs["command"].GetString(), "reset_machine_by_team") == 0) {
-						data_->clips_production_reset_machine_by_team(msgs["machine_name"].GetString(),
-						                                              msgs["team_color"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "add_points_team") == 0) {
-						data_->clips_add_points_team(msgs["points"].GetInt(),
-						                             msgs["team_color"].GetString(),
-						                             msgs["game_time"].GetFloat(),
-						                             msgs["phase"].GetString(),
-						                             msgs["reason"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "break_machine") == 0) {
-						data_->clips_reset_machine(msgs["machine"].GetString());
-					}
-					if (strcmp(msgs["command"].GetString(), "instruct_bs") == 0) {
-						if (prepare_machine_supported) {
-							std::ostringstream command;
-							command << prepare_machine_command << msgs["team_name"].GetString() << " "
-							        << msgs["machine"].GetString() << " " << msgs["side"].GetString() << " "
-							        << msgs["base_color"].GetString();
-							int result = std::system(command.str().c_str());
-							// Check the result
-							if (result != 0) {
-								logger_->log_error("Websocket",
-								                   "Command %s failed with code %i",
-								                   command.str().c_str(),
-								                   result);
-							}
-						} else {
-							logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
-						}
-					}
-					if (strcmp(msgs["command"].GetString(), "instruct_rs") == 0) {
-						if (prepare_machine_supported) {
-							std::ostringstream command;
-							command << prepare_machine_command << msgs["team_name"].GetString() << " "
-							        << msgs["machine"].GetString() << " " << msgs["ring_color"].GetString();
-							int result = std::system(command.str().c_str());
-							// Check the result
-							if (result != 0) {
-								logger_->log_error("Websocket",
-								                   "Command %s failed with code %i",
-								                   command.str().c_str(),
-								                   result);
-							}
-						} else {
-							logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
-						}
-					}
-					if (strcmp(msgs["command"].GetString(), "instruct_cs") == 0) {
-						if (prepare_machine_supported) {
-							std::ostringstream command;
-							command << prepare_machine_command << msgs["team_name"].GetString() << " "
-							        << msgs["machine"].GetString() << " " << msgs["operation"].GetString();
-							int result = std::system(command.str().c_str());
-							// Check the result
-							if (result != 0) {
-								logger_->log_error("Websocket",
-								                   "Command %s failed with code %i",
-								                   command.str().c_str(),
-								                   result);
-							}
-						} else {
-							logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
-						}
-					}
-					if (strcmp(msgs["command"].GetString(), "instruct_ds") == 0) {
-						if (prepare_machine_supported) {
-							std::ostringstream command;
-							command << prepare_machine_command << msgs["team_name"].GetString() << " "
-							        << msgs["machine"].GetString() << " " << msgs["order"].GetInt();
-							int result = std::system(command.str().c_str());
-							// Check the result
-							if (result != 0) {
-								logger_->log_error("Websocket",
-								                   "Command %s failed with code %i",
-								                   command.str().c_str(),
-								                   result);
-							}
-						} else {
-							logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
-						}
-					}
-					if (strcmp(msgs["command"].GetString(), "instruct_ss") == 0) {
-						if (prepare_machine_supported) {
-							std::ostringstream command;
-							command << prepare_machine_command << msgs["team_name"].GetString() << " "
-							        << msgs["machine"].GetString() << " " << msgs["operation"].GetString() << " "
-							        << msgs["shelf"].GetInt() << " " << msgs["slot"].GetInt();
-							int result = std::system(command.str().c_str());
-							// Check the result
-							if (result != 0) {
-								logger_->log_error("Websocket",
-								                   "Command %s failed with code %i",
-								                   command.str().c_str(),
-								                   result);
-							}
-						} else {
-							logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
-						}
-					}
-					logger_->log_debug("Websocket", "got %s", msgs["command"].GetString());
-				}
+/**
+ * @brief Handles incoming message requests
+ *
+ * @param input received message
+ */
+void
+Client::handle_command(const std::string &input)
+{
+	rapidjson::Document msgs;
+	try {
+		msgs.Parse(input.c_str());
+
+		//check incoming message type and call corresponding CLIPS function
+		if (!msgs.IsObject()) {
+			logger_->log_error("Websocket", "non JSON message received, won't process");
+		} else if (msgs.HasMember("command") && msgs["command"] == "snapshot") {
+			// read-only, allowed for all clients, e.g., to resync after missing a delta update
+			rapidjson::SchemaValidator validator(*(data_->command_schema_map["snapshot"]));
+			if (!msgs.Accept(validator)) {
+				logger_->log_error("Websocket", "input JSON is invalid!");
 			} else {
-				logger_->log_error("Websocket", "malformed message received, won't be processed");
+				on_connect_update();
 			}
-
-		} catch (std::exception &e) {
-			logger_->log_debug("Websocket", "caught exception while receiving. %s", e.what());
-			disconnect();
-		} catch (...) {
-			logger_->log_debug("Websocket", "caught unknown exception while receiving");
-			disconnect();
+		} else if (!can_send_) {
+			logger_->log_error("Websocket", "non localhost client tried to send command");
+		} else if (msgs.HasMember("command")) {
+			std::string                command = msgs["command"].GetString();
+			rapidjson::SchemaValidator validator(*(data_->command_schema_map[command]));
+			if (!msgs.Accept(validator)) {
+				logger_->log_error("Websocket", "input JSON is invalid!");
+			} else {
+				if (strcmp(msgs["command"].GetString(), "set_gamestate") == 0) {
+					data_->clips_set_gamestate(msgs["state"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_confval") == 0) {
+					data_->clips_set_confval(msgs["path"].GetString(), msgs["value"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "reset") == 0) {
+					kill(getpid(), SIGUSR1);
+				}
+				if (strcmp(msgs["command"].GetString(), "set_gamephase") == 0) {
+					data_->clips_set_gamephase(msgs["phase"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "randomize_field") == 0) {
+					data_->clips_randomize_field();
+				}
+				if (strcmp(msgs["command"].GetString(), "set_teamname") == 0) {
+					data_->clips_set_teamname(msgs["color"].GetString(), msgs["name"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "confirm_delivery") == 0) {
+					data_->clips_confirm_delivery(msgs["delivery_id"].GetInt(),
+					                              msgs["correctness"].GetBool(),
+					                              msgs["order_id"].GetInt(),
+					                              msgs["color"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_order_delivered") == 0) {
+					data_->clips_set_order_delivered(msgs["color"].GetString(), msgs["order_id"].GetInt());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_preset") == 0) {
+					data_->clips_set_cfg_preset(msgs["category"].GetString(), msgs["preset"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_machine_state") == 0) {
+					data_->clips_production_set_machine_state(msgs["mname"].GetString(),
+					                                          msgs["state"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_machine_work_status") == 0) {
+					data_->clips_production_set_machine_work_status(msgs["name"].GetString(),
+					                                                msgs["busy"].GetBool(),
+					                                                msgs["ready"].GetBool());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_machine_pose") == 0) {
+					data_->clips_set_machine_pose(msgs["name"].GetString(),
+					                              msgs["rotation"].GetInt(),
+					                              msgs["zone"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "add_payment_rs") == 0) {
+					data_->clips_production_machine_add_base(msgs["machine"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "set_robot_maintenance") == 0) {
+					data_->clips_robot_set_robot_maintenance(msgs["robot_number"].GetInt(),
+					                                         msgs["team_color"].GetString(),
+					                                         msgs["maintenance"].GetBool());
+				}
+				if (strcmp(msgs["command"].GetString(), "reset_machine_by_team") == 0) {
+					data_->clips_production_reset_machine_by_team(msgs["machine_name"].GetString(),
+					                                              msgs["team_color"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "add_points_team") == 0) {
+					data_->clips_add_points_team(msgs["points"].GetInt(),
+					                             msgs["team_color"].GetString(),
+					                             msgs["game_time"].GetFloat(),
+					                             msgs["phase"].GetString(),
+					                             msgs["reason"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "break_machine") == 0) {
+					data_->clips_reset_machine(msgs["machine"].GetString());
+				}
+				if (strcmp(msgs["command"].GetString(), "instruct_bs") == 0) {
+					std::ostringstream args;
+					args << msgs["team_name"].GetString() << " "
+					     << msgs["machine"].GetString() << " " << msgs["side"].GetString() << " "
+					     << msgs["base_color"].GetString();
+					prepare_machine(args.str());
+				}
+				if (strcmp(msgs["command"].GetString(), "instruct_rs") == 0) {
+					std::ostringstream args;
+					args << msgs["team_name"].GetString() << " "
+					     << msgs["machine"].GetString() << " " << msgs["ring_color"].GetString();
+					prepare_machine(args.str());
+				}
+				if (strcmp(msgs["command"].GetString(), "instruct_cs") == 0) {
+					std::ostringstream args;
+					args << msgs["team_name"].GetString() << " "
+					     << msgs["machine"].GetString() << " " << msgs["operation"].GetString();
+					prepare_machine(args.str());
+				}
+				if (strcmp(msgs["command"].GetString(), "instruct_ds") == 0) {
+					std::ostringstream args;
+					args << msgs["team_name"].GetString() << " "
+					     << msgs["machine"].GetString() << " " << msgs["order"].GetInt();
+					prepare_machine(args.str());
+				}
+				if (strcmp(msgs["command"].GetString(), "instruct_ss") == 0) {
+					std::ostringstream args;
+					args << msgs["team_name"].GetString() << " "
+					     << msgs["machine"].GetString() << " " << msgs["operation"].GetString() << " "
+					     << msgs["shelf"].GetInt() << " " << msgs["slot"].GetInt();
+					prepare_machine(args.str());
+				}
+				logger_->log_debug("Websocket", "got %s", msgs["command"].GetString());
+			}
+		} else {
+			logger_->log_error("Websocket", "malformed message received, won't be processed");
 		}
+	} catch (std::exception &e) {
+		logger_->log_debug("Websocket", "caught exception while processing command. %s", e.what());
+		disconnect();
+	} catch (...) {
+		logger_->log_debug("Websocket", "caught unknown exception while processing command");
+		disconnect();
+	}
+}
+
+/**
+ * @brief Instruct a machine using the rcll-prepare-machine tool
+ *
+ *  The tool runs in the background, commands of all clients are processed
+ *  while it waits for the machine.
+ *
+ * @param args arguments passed to the tool
+ */
+void
+Client::prepare_machine(const std::string &args)
+{
+	if (!prepare_machine_supported_) {
+		logger_->log_warn("Websocket", "Machine instructions per websocket ar disabled");
+		return;
 	}
+	std::string             command = prepare_machine_command_ + args;
+	std::shared_ptr<Logger> logger  = logger_;
+	std::thread([logger, command]() {
+		int result = std::system(command.c_str());
+		// Check the result
+		if (result != 0) {
+			logger->log_error("Websocket", "Command %s failed with code %i", command.c_str(), result);
+		}
+	}).detach();
 }
 
 /**
- * @brief Disconnects client by closing connection and stopping receive thread
+ * @brief Disconnects client by closing connection
  *
+ *  Thread-safe, pending operations are aborted and release the client.
  */
 void
 Client::disconnect()
 {
-	if (active) {
-		active = false;
+	if (active.exchange(false)) {
+		std::shared_ptr<Client> self = shared_from_this();
+		boost::asio::post(executor_, [self] { self->close(); });
+		logger_->log_info("Websocket", "client disconnected");
 	}
-	close();
-	logger_->log_info("Websocket", "client disconnected");
 }
 
 /**
@@ -29,63 +29,122 @@
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
+#include <atomic>
+#include <deque>
 #include <iostream>
-#include <mutex>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace rcll::websocket {
 class Data; // forward declaration
 
-class Client
+class FramedMessage
 {
 public:
-	virtual bool        send(std::string msg) = 0;
-	virtual std::string read()                = 0;
-	virtual void        close()               = 0;
-	void                receive_thread();
-	void                disconnect();
-	void                on_connect_update();
-	bool                active = true;
+	static std::shared_ptr<const FramedMessage> frame(const std::string &msg);
+
+	/** Get all lines of the message as one buffer.
+   * @return newline terminated lines */
+	const std::string &
+	data() const
+	{
+		return data_;
+	}
+
+	/** Get number of lines.
+   * @return number of lines */
+	size_t
+	num_lines() const
+	{
+		return lines_.size();
+	}
+
+	boost::asio::const_buffer line(size_t i) const;
+
+private:
+	std::string                            data_;
+	std::vector<std::pair<size_t, size_t>> lines_;
+};
+
+class Client : public std::enable_shared_from_this<Client>
+{
+public:
+	virtual ~Client();
+	virtual void      start() = 0;
+	void              send(const std::string &msg);
+	void              send(std::shared_ptr<const FramedMessage> msg);
+	void              disconnect();
+	void              on_connect_update();
+	std::atomic<bool> active{true};
 
 protected:
-	std::mutex              rd_mu;
-	std::mutex              wr_mu;
-	std::thread             client_t;
-	std::shared_ptr<Logger> logger_;
-	std::shared_ptr<Data>   data_;
-	bool                    can_send_;
+	Client(boost::asio::ip::tcp::socket::executor_type executor,
+	       boost::asio::io_service::executor_type      commands,
+	       std::shared_ptr<Logger>                     logger,
+	       std::shared_ptr<Data>                       data,
+	       bool                                        can_send,
+	       size_t                                      max_queue_size);
+
+	virtual void async_write_front() = 0;
+	virtual void async_read()        = 0;
+	virtual void close()             = 0;
+	void         handle_write(const boost::system::error_code &error, size_t lines);
+	void         handle_read(const boost::system::error_code &error, std::string input);
+	void         handle_command(const std::string &input);
+	void         prepare_machine(const std::string &args);
+
+	boost::asio::ip::tcp::socket::executor_type      executor_;
+	boost::asio::io_service::executor_type           commands_;
+	std::shared_ptr<Logger>                          logger_;
+	std::shared_ptr<Data>                            data_;
+	bool                                             can_send_;
+	size_t                                           max_queue_size_;
+	std::deque<std::shared_ptr<const FramedMessage>> outbound_;
+	size_t                                           outbound_lines_written_ = 0;
+	bool                                             prepare_machine_supported_;
+	std::string                                      prepare_machine_command_;
 };
 
 class ClientWS : public Client
 {
 public:
 	ClientWS(std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> socket,
+	         boost::asio::io_service::executor_type                                         commands,
 	         std::shared_ptr<Logger>                                                        logger,
 	         std::shared_ptr<Data>                                                          data,
-	         bool                                                                           can_send);
-	~ClientWS();
-	bool        send(std::string msg);
-	std::string read();
-	void        close();
+	         bool                                                                           can_send,
+	         size_t max_queue_size);
+	void start();
 
 private:
+	void async_write_front();
+	void async_read();
+	void close();
+
 	std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> socket;
+	boost::beast::flat_buffer                                                      read_buf_;
 };
 
 class ClientS : public Client
 {
 public:
 	ClientS(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+	        boost::asio::io_service::executor_type        commands,
 	        std::shared_ptr<Logger>                       logger,
 	        std::shared_ptr<Data>                         data,
-	        bool                                          can_send);
-	~ClientS();
-	bool        send(std::string msg);
-	std::string read();
-	void        close();
+	        bool                                          can_send,
+	        size_t                                        max_queue_size);
+	void start();
 
 private:
+	void async_write_front();
+	void async_read();
+	void close();
+
 	std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+	boost::asio::streambuf                        read_buf_;
 };
 } // namespace rcll::websocket
 #endif
@@ -22,6 +22,7 @@
 
 #include "data.h"
 
+#include <clips/clips.h>
 #include <core/threading/mutex_locker.h>
 #include <rapidjson/document.h>
 #include <rapidjson/filereadstream.h>
@@ -29,11 +30,16 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <condition_variable>
 #include <cstdio>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <queue>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -48,11 +54,21 @@ Data::~Data()
  * @brief Construct a new Data:: Data object
  *
  * @param logger_ logger to be used
+ * @param env CLIPS environment to read facts from
+ * @param env_mutex mutex to lock when accessing the CLIPS environment
+ * @param delta_updates send only changed fields of entity updates
+ * @param coalesce_updates queue entity updates unserialized with their entity key,
+ *        the consumer coalesces them and sends them with send_update()
  */
 Data::Data(std::shared_ptr<Logger>             logger,
            std::shared_ptr<CLIPS::Environment> env,
-           fawkes::Mutex                      &env_mutex)
-: logger_(logger), env_mutex_(env_mutex)
+           fawkes::Mutex                      &env_mutex,
+           bool                                delta_updates,
+           bool                                coalesce_updates)
+: logger_(logger),
+  env_mutex_(env_mutex),
+  delta_updates_(delta_updates),
+  coalesce_updates_(coalesce_updates)
 {
 	env_ = env;
 
@@ -80,7 +96,8 @@ Data::Data(std::shared_ptr<Logger>             logger,
 	                              "set_preset",
 	                              "reset",
 	                              "reset_machine_by_team",
-	                              "add_points_team"};
+	                              "add_points_team",
+	                              "snapshot"};
 
 	for (const std::string &schema_name : schema_names) {
 		std::shared_ptr<rapidjson::SchemaDocument> sd =
@@ -122,19 +139,20 @@ Data::load_schema(std::string path)
 }
 
 /**
- * @brief get first element from log queue
+ * @brief take all elements from log queue
  *
- *  This thread-safe function returns the first element from the log message queue and removes it.
+ *  This thread-safe function removes all elements from the log message queue
+ *  and returns them in order.
  *
- * @return std::string first element from log queue
+ * @return std::queue<LogEntry> elements of the log queue
  */
-std::string
-Data::log_pop()
+std::queue<Data::LogEntry>
+Data::log_pop_all()
 {
+	std::queue<LogEntry>              entries;
 	const std::lock_guard<std::mutex> lock(log_mu);
-	std::string                       log = logs.front();
-	logs.pop();
-	return log;
+	entries.swap(logs);
+	return entries;
 }
 
 /**
@@ -148,7 +166,7 @@ void
 Data::log_push(std::string log)
 {
 	const std::lock_guard<std::mutex> lock(log_mu);
-	logs.push(log);
+	logs.push(LogEntry{"", std::move(log), rapidjson::Document()});
 	log_cv.notify_one();
 }
 
@@ -167,15 +185,207 @@ Data::log_push(rapidjson::Document &d)
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 	d.Accept(writer);
 
-	logs.push(buffer.GetString());
+	logs.push(LogEntry{"", buffer.GetString(), rapidjson::Document()});
 	log_cv.notify_one();
 }
 
+/**
+ * @brief Determine the entity a message is about
+ *
+ *  Entities are identified by the message type and the values of the key
+ *  fields of that type, e.g., the name of a machine or the id of an order.
+ *
+ * @param type message type
+ * @param content content object of the message
+ * @param key set to the entity key on success
+ * @return true if messages of the given type describe a single entity
+ */
+bool
+Data::entity_key(const std::string &type, const rapidjson::Value &content, std::string &key)
+{
+	static const std::map<std::string, std::vector<const char *>> key_fields = {
+	  {"machine", {"name"}},
+	  {"order", {"id"}},
+	  {"robot", {"team_color", "number"}},
+	  {"agent-task", {"team_color", "robot_id", "task_id"}},
+	  {"workpiece", {"id"}},
+	  {"confval", {"path"}},
+	  {"cfg-preset", {"category", "preset"}},
+	  {"cfg-prefix", {"category", "preset"}},
+	  {"gamestate", {}},
+	  {"time-info", {}}};
+
+	auto k = key_fields.find(type);
+	if (k == key_fields.end() || !content.IsObject()) {
+		return false;
+	}
+	key.clear();
+	for (const char *field : k->second) {
+		auto m = content.FindMember(field);
+		if (m == content.MemberEnd()) {
+			return false;
+		}
+		if (!key.empty()) {
+			key += "/";
+		}
+		if (m->value.IsString()) {
+			key.append(m->value.GetString(), m->value.GetStringLength());
+		} else {
+			rapidjson::StringBuffer                    buffer;
+			rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+			m->value.Accept(writer);
+			key += buffer.GetString();
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief add entity update to log queue
+ *
+ *  If delta updates are enabled, messages about a single entity carry the
+ *  entity key and a sequence number per entity. Only content fields that
+ *  changed since the previous update of the entity are sent, updates without
+ *  changes are dropped. The first update of an entity, and updates that
+ *  remove fields, contain the full content and are marked with delta false.
+ *  Clients that miss a sequence number request a new snapshot.
+ *  With coalescing enabled, entity updates are queued unserialized with
+ *  their entity key, the deltas are computed once they are sent.
+ *  Without delta updates and coalescing, this is the same as log_push().
+ *
+ * @param d element (rapidjson::Document) to be added
+ */
+void
+Data::log_push_update(rapidjson::Document &d)
+{
+	std::string key;
+	if (coalesce_updates_ && d.HasMember("content")
+	    && entity_key(d["type"].GetString(), d["content"], key)) {
+		const std::lock_guard<std::mutex> lock(log_mu);
+		logs.push(LogEntry{std::string(d["type"].GetString()) + "/" + key, "", std::move(d)});
+		log_cv.notify_one();
+	} else if (prepare_update(d)) {
+		log_push(d);
+	}
+}
+
+/**
+ * @brief send coalesced entity update to all clients
+ *
+ *  Sends an update queued by log_push_update() with coalescing enabled.
+ *
+ * @param d entity update
+ */
+void
+Data::send_update(rapidjson::Document &d)
+{
+	if (prepare_update(d)) {
+		clients_send_all(d);
+	}
+}
+
+/**
+ * @brief Turn an entity update into a delta update
+ *
+ *  Replaces the content by the fields that changed since the last update of
+ *  the entity and adds key and sequence number, if delta updates are enabled.
+ *
+ * @param d entity update
+ * @return false if the update does not change anything and must be dropped
+ */
+bool
+Data::prepare_update(rapidjson::Document &d)
+{
+	std::string key;
+	if (!delta_updates_ || !d.HasMember("content")
+	    || !entity_key(d["type"].GetString(), d["content"], key)) {
+		return true;
+	}
+
+	std::string                         entity  = std::string(d["type"].GetString()) + "/" + key;
+	rapidjson::Document::AllocatorType &alloc   = d.GetAllocator();
+	rapidjson::Value                   &content = d["content"];
+
+	const std::lock_guard<std::mutex> lock(delta_mu);
+	EntityState                      &state = entity_states_[entity];
+
+	bool             full = state.seq == 0;
+	rapidjson::Value delta(rapidjson::kObjectType);
+	if (!full) {
+		rapidjson::SizeType kept = 0;
+		for (auto m = content.MemberBegin(); m != content.MemberEnd(); ++m) {
+			auto prev = state.content.FindMember(m->name);
+			if (prev != state.content.MemberEnd()) {
+				kept += 1;
+				if (prev->value == m->value) {
+					continue;
+				}
+			}
+			delta.AddMember(rapidjson::Value(m->name, alloc), rapidjson::Value(m->value, alloc), alloc);
+		}
+		if (kept != state.content.MemberCount()) {
+			// fields have been removed, which a delta cannot express
+			full = true;
+		} else if (delta.ObjectEmpty()) {
+			return false;
+		}
+	}
+
+	// swap in a fresh document, the memory pool of the old one is released
+	rapidjson::Document last;
+	last.CopyFrom(content, last.GetAllocator());
+	state.content.Swap(last);
+	state.seq += 1;
+	if (!full) {
+		content = delta;
+	}
+	d.AddMember("key", rapidjson::Value(key.c_str(), alloc), alloc);
+	d.AddMember("seq", rapidjson::Value(state.seq), alloc);
+	d.AddMember("delta", rapidjson::Value(!full), alloc);
+	return true;
+}
+
+/**
+ * @brief Append a message to a snapshot
+ *
+ *  With delta updates enabled, messages about a single entity are tagged
+ *  with the entity key and its current sequence number, so that clients can
+ *  discard older deltas still in flight.
+ *
+ * @param messages snapshot to append to, one message per line
+ * @param doc message to append
+ */
+void
+Data::append_snapshot(std::ostringstream &messages, rapidjson::Document &doc)
+{
+	std::string key;
+	if (delta_updates_ && doc.HasMember("content")
+	    && entity_key(doc["type"].GetString(), doc["content"], key)) {
+		uint64_t seq = 0;
+		{
+			const std::lock_guard<std::mutex> lock(delta_mu);
+			auto state = entity_states_.find(std::string(doc["type"].GetString()) + "/" + key);
+			if (state != entity_states_.end()) {
+				seq = state->second.seq;
+			}
+		}
+		doc.AddMember("key", rapidjson::Value(key.c_str(), doc.GetAllocator()), doc.GetAllocator());
+		doc.AddMember("seq", rapidjson::Value(seq), doc.GetAllocator());
+		doc.AddMember("delta", false, doc.GetAllocator());
+	}
+
+	rapidjson::StringBuffer                    buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	doc.Accept(writer);
+	messages << buffer.GetString() << "\n";
+}
+
 void
 Data::reset_clients()
 {
+	const std::lock_guard<std::mutex> lock(cli_mu);
 	for (auto &client : clients) {
-		client.reset();
+		client->disconnect();
 	}
 	clients.clear();
 }
@@ -212,6 +422,22 @@ Data::log_wait()
 	}
 }
 
+/**
+ * @brief blocks calling thread until log queue is not-empty or deadline passed
+ *
+ * @param deadline point in time at which to return at the latest
+ */
+void
+Data::log_wait_until(std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(log_mu);
+	while (!shutdown_ && log_empty()) {
+		if (log_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+			break;
+		}
+	}
+}
+
 /**
  * @brief add client for handling
  *
@@ -230,34 +456,40 @@ Data::clients_add(std::shared_ptr<Client> client)
 /**
  * @brief send one message to all clients
  *
- *  Sends the given message to all connected clients.
- *  Handles disconnects and removes the respective clients.
+ *  Queues the given message for all connected clients without blocking,
+ *  the clients write it asynchronously. The message is split into lines
+ *  once and the resulting buffer is shared by all clients.
+ *  Removes clients that disconnected in the meantime.
  *
  * @param msg message to be sent
  */
 void
-Data::clients_send_all(std::string msg)
+Data::clients_send_all(const std::string &msg)
 {
 	const std::lock_guard<std::mutex> lock(cli_mu);
 
-	std::vector<std::shared_ptr<Client>> unfailed_clients;
+	clients.erase(std::remove_if(clients.begin(),
+	                             clients.end(),
+	                             [](const std::shared_ptr<Client> &client) {
+		                             return !client->active;
+	                             }),
+	              clients.end());
+
+	if (clients.empty()) {
+		return;
+	}
 
+	// frame once, all clients share the same buffer
+	std::shared_ptr<const FramedMessage> framed = FramedMessage::frame(msg);
 	for (auto const &client : clients) {
-		if (client->active) {
-			if (client->send(msg)) {
-				unfailed_clients.push_back(client);
-			} else {
-				client->disconnect();
-			}
-		}
+		client->send(framed);
 	}
-	clients = unfailed_clients;
 }
 
 /**
  * @brief send one JSON document to all clients
  *
- *  Converts given JSON document to string and calls clients_send_all(std::string msg).
+ *  Converts given JSON document to string and calls clients_send_all(const std::string &msg).
  *
  * @param d JSON document to be sent
  */
@@ -437,6 +669,37 @@ Data::match(CLIPS::Fact::pointer &fact, std::string tmpl_name)
 	return true;
 }
 
+/**
+ * @brief Get all facts of the given template
+ *
+ *  CLIPS keeps a list of facts per deftemplate which is updated on every
+ *  assert and retract. Walking this list only visits facts of the template
+ *  instead of the whole fact base. Must be called with the env mutex held.
+ *
+ * @param tmpl_name name of the deftemplate
+ * @return facts of the template, empty if the template does not exist
+ */
+std::vector<CLIPS::Fact::pointer>
+Data::template_facts(const std::string &tmpl_name)
+{
+	std::vector<CLIPS::Fact::pointer> facts;
+
+	// looked up on every call, a cached pointer would dangle once the
+	// environment is cleared or the template is redefined
+	void *env  = env_->cobj();
+	void *tmpl = EnvFindDeftemplate(env, tmpl_name.c_str());
+	if (!tmpl) {
+		return facts;
+	}
+
+	void *f = EnvGetNextFactInTemplate(env, tmpl, NULL);
+	while (f) {
+		facts.push_back(CLIPS::Fact::create(*env_, f));
+		f = EnvGetNextFactInTemplate(env, tmpl, f);
+	}
+	return facts;
+}
+
 /**
  * @brief Gets specific machine-info fact from CLIPS and pushes it to the send queue
  *
@@ -446,21 +709,17 @@ Data::log_push_machine_info(std::string name)
 {
 	MutexLocker                       lock(&env_mutex_);
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "machine")) {
-			try {
-				if (get_value<std::string>(fact, "name") == name) {
-					facts.push_back(fact);
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type machine");
+	for (const CLIPS::Fact::pointer &fact : template_facts("machine")) {
+		try {
+			if (get_value<std::string>(fact, "name") == name) {
+				facts.push_back(fact);
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type machine");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("machine", facts, &Data::get_machine_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -472,21 +731,17 @@ Data::log_push_config(std::string path)
 {
 	MutexLocker                       lock(&env_mutex_);
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "confval")) {
-			try {
-				if (get_value<std::string>(fact, "path") == path) {
-					facts.push_back(fact);
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type confval");
+	for (const CLIPS::Fact::pointer &fact : template_facts("confval")) {
+		try {
+			if (get_value<std::string>(fact, "path") == path) {
+				facts.push_back(fact);
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type confval");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("confval", facts, &Data::get_config_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -499,21 +754,17 @@ Data::log_push_order_info(int id)
 	MutexLocker lock(&env_mutex_);
 
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "order")) {
-			try {
-				if (get_value<int64_t>(fact, "id") == id) {
-					facts.push_back(fact);
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type order");
+	for (const CLIPS::Fact::pointer &fact : template_facts("order")) {
+		try {
+			if (get_value<int64_t>(fact, "id") == id) {
+				facts.push_back(fact);
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type order");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("order", facts, &Data::get_order_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -527,29 +778,21 @@ Data::log_push_order_info_via_delivery(int delivery_id)
 	MutexLocker lock(&env_mutex_);
 
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "product-processed")) {
-			try {
-				if (get_value<int64_t>(fact, "id") == delivery_id) {
-					CLIPS::Fact::pointer order = env_->get_facts();
-					while (order) {
-						if (match(fact, "order")) {
-							if (get_value<int64_t>(fact, "order") == get_value<int64_t>(order, "id")) {
-								facts.push_back(order);
-							}
-						}
-						order = order->next();
+	for (const CLIPS::Fact::pointer &fact : template_facts("product-processed")) {
+		try {
+			if (get_value<int64_t>(fact, "id") == delivery_id) {
+				for (const CLIPS::Fact::pointer &order : template_facts("order")) {
+					if (get_value<int64_t>(fact, "order") == get_value<int64_t>(order, "id")) {
+						facts.push_back(order);
 					}
 				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type order");
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type order");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("order", facts, &Data::get_order_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -562,22 +805,18 @@ Data::log_push_robot_info(int number, std::string name)
 	MutexLocker lock(&env_mutex_);
 
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "robot")) {
-			try {
-				if (get_value<int64_t>(fact, "number") == number
-				    && get_value<std::string>(fact, "name") == name) {
-					facts.push_back(fact);
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
+	for (const CLIPS::Fact::pointer &fact : template_facts("robot")) {
+		try {
+			if (get_value<int64_t>(fact, "number") == number
+			    && get_value<std::string>(fact, "name") == name) {
+				facts.push_back(fact);
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("robot", facts, &Data::get_robot_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /*
@@ -590,23 +829,19 @@ Data::log_push_agent_task_info(int tid, int rid)
 	MutexLocker lock(&env_mutex_);
 
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "agent-task")) {
-			try {
-				if (get_value<int64_t>(fact, "task-id") == tid
-				    && get_value<int64_t>(fact, "robot-id") == rid) {
-					facts.push_back(fact);
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
+	for (const CLIPS::Fact::pointer &fact : template_facts("agent-task")) {
+		try {
+			if (get_value<int64_t>(fact, "task-id") == tid
+			    && get_value<int64_t>(fact, "robot-id") == rid) {
+				facts.push_back(fact);
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
 		}
-		fact = fact->next();
 	}
 	auto doc =
 	  pack_facts_to_doc("agent-task", facts, &Data::get_agent_task_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -616,7 +851,8 @@ Data::log_push_agent_task_info(int tid, int rid)
 void
 Data::log_push_game_state()
 {
-	log_push(on_connect_game_state());
+	auto doc = pack_facts_to_doc("gamestate", &Data::get_game_state_fact<rapidjson::Value>);
+	log_push_update(doc);
 }
 
 /**
@@ -629,23 +865,19 @@ Data::log_push_cfg_preset(const std::string &category, const std::string &preset
 	MutexLocker lock(&env_mutex_);
 
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	CLIPS::Fact::pointer              fact  = env_->get_facts();
-	while (fact) {
-		if (match(fact, "cfg-preset")) {
-			try {
-				if (get_value<std::string>(fact, "category") == category
-				    && get_value<std::string>(fact, "preset") == preset) {
-					facts.push_back(fact);
-					break;
-				}
-			} catch (Exception &e) {
-				logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
+	for (const CLIPS::Fact::pointer &fact : template_facts("cfg-preset")) {
+		try {
+			if (get_value<std::string>(fact, "category") == category
+			    && get_value<std::string>(fact, "preset") == preset) {
+				facts.push_back(fact);
+				break;
 			}
+		} catch (Exception &e) {
+			logger_->log_error("Websocket", "can't access value(s) of fact of type robot");
 		}
-		fact = fact->next();
 	}
 	auto doc = pack_facts_to_doc("cfg-prefix", facts, &Data::get_cfg_preset_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -656,7 +888,7 @@ void
 Data::log_push_time_info()
 {
 	auto doc = pack_facts_to_doc("time-info", &Data::get_time_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -688,18 +920,15 @@ Data::log_push_workpiece_info(int fact_index)
 {
 	MutexLocker                       lock(&env_mutex_);
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	// get machine facts pointers
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
+	for (const CLIPS::Fact::pointer &fact : template_facts("workpiece")) {
 		if (fact->index() == fact_index) {
 			facts.push_back(fact);
 			break;
 		}
-		fact = fact->next();
 	}
 	auto doc =
 	  pack_facts_to_doc("workpiece", facts, &Data::get_workpiece_info_fact<rapidjson::Value>);
-	log_push(doc);
+	log_push_update(doc);
 }
 
 /**
@@ -731,10 +960,8 @@ Data::on_connect_agent_task_info()
 	// Map to store the highest task-id for each robot-id
 	std::unordered_map<int, CLIPS::Fact::pointer> highest_task_ids;
 
-	// get machine facts pointers
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, "agent-task") && get_value<bool>(fact, "processed")) {
+	for (const CLIPS::Fact::pointer &fact : template_facts("agent-task")) {
+		if (get_value<bool>(fact, "processed")) {
 			int robot_id = get_value<int>(fact, "robot-id");
 			int task_id  = get_value<int>(fact, "task-id");
 
@@ -745,18 +972,13 @@ Data::on_connect_agent_task_info()
 				highest_task_ids[robot_id] = fact;
 			}
 		}
-		fact = fact->next();
 	}
 	std::ostringstream messages;
 	for (const auto &entry : highest_task_ids) {
 		auto doc = pack_facts_to_doc("agent-task",
 		                             {entry.second},
 		                             &Data::get_agent_task_info_fact<rapidjson::Value>);
-		;
-		rapidjson::StringBuffer                    buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-		doc.Accept(writer);
-		messages << buffer.GetString() << "\n";
+		append_snapshot(messages, doc);
 	}
 	// Return the accumulated messages as a single string
 	return messages.str();
@@ -772,23 +994,16 @@ Data::on_connect_workpiece_info()
 {
 	MutexLocker                       lock(&env_mutex_);
 	std::vector<CLIPS::Fact::pointer> facts = {};
-	// get machine facts pointers
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, "workpiece") && get_value<bool>(fact, "latest-data")) {
+	for (const CLIPS::Fact::pointer &fact : template_facts("workpiece")) {
+		if (get_value<bool>(fact, "latest-data")) {
 			facts.push_back(fact);
 		}
-		fact = fact->next();
 	}
 	std::ostringstream messages;
 	for (const auto &f : facts) {
 		auto doc =
 		  pack_facts_to_doc("workpiece", {f}, &Data::get_workpiece_info_fact<rapidjson::Value>);
-		;
-		rapidjson::StringBuffer                    buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-		doc.Accept(writer);
-		messages << buffer.GetString() << "\n";
+		append_snapshot(messages, doc);
 	}
 	// Return the accumulated messages as a single string
 	return messages.str();
@@ -803,23 +1018,11 @@ std::string
 Data::on_connect_cfg_preset()
 {
 	MutexLocker                       lock(&env_mutex_);
-	std::vector<CLIPS::Fact::pointer> facts = {};
-	// get machine facts pointers
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, "cfg-preset")) {
-			facts.push_back(fact);
-		}
-		fact = fact->next();
-	}
+	std::vector<CLIPS::Fact::pointer> facts = template_facts("cfg-preset");
 	std::ostringstream messages;
 	for (const auto &f : facts) {
 		auto doc = pack_facts_to_doc("cfg-preset", {f}, &Data::get_cfg_preset_fact<rapidjson::Value>);
-		;
-		rapidjson::StringBuffer                    buffer;
-		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-		doc.Accept(writer);
-		messages << buffer.GetString() << "\n";
+		append_snapshot(messages, doc);
 	}
 	// Return the accumulated messages as a single string
 	return messages.str();
@@ -973,15 +1176,7 @@ Data::pack_facts_to_doc(std::string tmpl_name,
 	root.AddMember("type", tmpl_name, root.GetAllocator());
 	rapidjson::Value contentArray(rapidjson::kArrayType);
 
-	std::vector<CLIPS::Fact::pointer> facts = {};
-	// get machine facts pointers
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, tmpl_name)) {
-			facts.push_back(fact);
-		}
-		fact = fact->next();
-	}
+	std::vector<CLIPS::Fact::pointer> facts = template_facts(tmpl_name);
 
 	// get facts and pack into json array
 	for (CLIPS::Fact::pointer fact : facts) {
@@ -1020,21 +1215,11 @@ Data::on_connect_info(std::string tmpl_name,
                                                   rapidjson::Document::AllocatorType &,
                                                   CLIPS::Fact::pointer))
 {
-	std::ostringstream   messages;
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, tmpl_name.c_str())) {
-			// Perform the string buffer operations for each matching fact
-			auto doc = pack_facts_to_doc(tmpl_name, {fact}, get_info_fact);
-
-			// Write to string and append to messages
-			rapidjson::StringBuffer                    buffer;
-			rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-			doc.Accept(writer);
-
-			messages << buffer.GetString() << "\n";
-		}
-		fact = fact->next();
+	MutexLocker        lock(&env_mutex_);
+	std::ostringstream messages;
+	for (const CLIPS::Fact::pointer &fact : template_facts(tmpl_name)) {
+		auto doc = pack_facts_to_doc(tmpl_name, {fact}, get_info_fact);
+		append_snapshot(messages, doc);
 	}
 	// Return the accumulated messages as a single string
 	return messages.str();
@@ -1102,18 +1287,21 @@ Data::get_machine_info_fact(T                                  *o,
 	clips_to_json(fact, "referee-required", json_string, alloc);
 	(*o).AddMember("referee_required", json_string, alloc);
 
-	CLIPS::Fact::pointer meta_fact = env_->get_facts();
-	while (meta_fact) {
-		if (match(meta_fact, "cs-meta")
-		    && get_value<std::string>(fact, "name") == get_value<std::string>(meta_fact, "name")) {
+	std::string name  = get_value<std::string>(fact, "name");
+	std::string mtype = get_value<std::string>(fact, "mtype");
+	std::string meta_tmpl(mtype.size(), ' ');
+	std::transform(mtype.begin(), mtype.end(), meta_tmpl.begin(), ::tolower);
+	meta_tmpl += "-meta";
+	for (const CLIPS::Fact::pointer &meta_fact : template_facts(meta_tmpl)) {
+		if (get_value<std::string>(meta_fact, "name") != name) {
+			continue;
+		}
+		if (mtype == "CS") {
 			clips_to_json(meta_fact, "operation-mode", json_string, alloc);
 			(*o).AddMember("operation_mode", json_string, alloc);
 			clips_to_json(meta_fact, "has-retrieved", json_string, alloc);
 			(*o).AddMember("has_retrieved", json_string, alloc);
-			break;
-		}
-		if (match(meta_fact, "rs-meta")
-		    && get_value<std::string>(fact, "name") == get_value<std::string>(meta_fact, "name")) {
+		} else if (mtype == "RS") {
 			clips_to_json(meta_fact, "current-ring-color", json_string, alloc);
 			(*o).AddMember("current_ring_color", json_string, alloc);
 			rapidjson::Value ring_array(rapidjson::kArrayType);
@@ -1128,28 +1316,19 @@ Data::get_machine_info_fact(T                                  *o,
 			(*o).AddMember("bases_added", json_string, alloc);
 			clips_to_json(meta_fact, "bases-used", json_string, alloc);
 			(*o).AddMember("bases_used", json_string, alloc);
-			break;
-		}
-		if (match(meta_fact, "bs-meta")
-		    && get_value<std::string>(fact, "name") == get_value<std::string>(meta_fact, "name")) {
+		} else if (mtype == "BS") {
 			clips_to_json(meta_fact, "current-side", json_string, alloc);
 			(*o).AddMember("current_side", json_string, alloc);
 			clips_to_json(meta_fact, "current-base-color", json_string, alloc);
 			(*o).AddMember("current_base_color", json_string, alloc);
-			break;
-		}
-		if (match(meta_fact, "ds-meta")
-		    && get_value<std::string>(fact, "name") == get_value<std::string>(meta_fact, "name")) {
+		} else if (mtype == "DS") {
 			clips_to_json(meta_fact, "order-id", json_string, alloc);
 			(*o).AddMember("order_id", json_string, alloc);
-			break;
 		}
-		meta_fact = meta_fact->next();
+		break;
 	}
-	CLIPS::Fact::pointer lights_fact = env_->get_facts();
-	while (lights_fact) {
-		if (match(lights_fact, "machine-lights")
-		    && get_value<std::string>(fact, "name") == get_value<std::string>(lights_fact, "name")) {
+	for (const CLIPS::Fact::pointer &lights_fact : template_facts("machine-lights")) {
+		if (get_value<std::string>(lights_fact, "name") == name) {
 			rapidjson::Value lights_array(rapidjson::kArrayType);
 			lights_array.Reserve(get_values(fact, "actual-lights").size(), alloc);
 			for (const auto &e : get_values(fact, "actual-lights")) {
@@ -1160,7 +1339,6 @@ Data::get_machine_info_fact(T                                  *o,
 			(*o).AddMember("actual_lights", lights_array, alloc);
 			break;
 		}
-		lights_fact = lights_fact->next();
 	}
 }
 
@@ -1241,34 +1419,31 @@ Data::get_unconfirmed_delivery_fact(rapidjson::Document::AllocatorType &alloc, i
 	rapidjson::Value unconfirmed_delivery(rapidjson::kArrayType);
 	rapidjson::Value json_string;
 
-	CLIPS::Fact::pointer delivery = env_->get_facts();
-	while (delivery) {
-		if (match(delivery, "product-processed")) {
-			if (get_value<std::string>(delivery, "confirmed") == "FALSE"
-			    && get_value<int64_t>(delivery, "order") == id
-			    && get_value<std::string>(delivery, "mtype") == "DS") {
-				CLIPS::Fact::pointer referee_confirmation = env_->get_facts();
-				while (referee_confirmation) {
-					if (match(referee_confirmation, "referee-confirmation")
-					    && get_value<int64_t>(delivery, "id")
-					         == get_value<int64_t>(referee_confirmation, "process-id")
-					    && get_value<std::string>(referee_confirmation, "state") == "REQUIRED") {
-						rapidjson::Value o;
-						o.SetObject();
-						json_string.SetInt((get_value<int64_t>(delivery, "id")));
-						o.AddMember("delivery_id", json_string, alloc);
-						json_string.SetString((get_value<std::string>(delivery, "team")).c_str(), alloc);
-						o.AddMember("team", json_string, alloc);
-						json_string.SetFloat((get_value<float>(delivery, "game-time")));
-						o.AddMember("game_time", json_string, alloc);
-
-						unconfirmed_delivery.PushBack(o, alloc);
-					}
-					referee_confirmation = referee_confirmation->next();
+	std::vector<CLIPS::Fact::pointer> referee_confirmations;
+	for (const CLIPS::Fact::pointer &delivery : template_facts("product-processed")) {
+		if (get_value<std::string>(delivery, "confirmed") == "FALSE"
+		    && get_value<int64_t>(delivery, "order") == id
+		    && get_value<std::string>(delivery, "mtype") == "DS") {
+			if (referee_confirmations.empty()) {
+				referee_confirmations = template_facts("referee-confirmation");
+			}
+			for (const CLIPS::Fact::pointer &referee_confirmation : referee_confirmations) {
+				if (get_value<int64_t>(delivery, "id")
+				      == get_value<int64_t>(referee_confirmation, "process-id")
+				    && get_value<std::string>(referee_confirmation, "state") == "REQUIRED") {
+					rapidjson::Value o;
+					o.SetObject();
+					json_string.SetInt((get_value<int64_t>(delivery, "id")));
+					o.AddMember("delivery_id", json_string, alloc);
+					json_string.SetString((get_value<std::string>(delivery, "team")).c_str(), alloc);
+					o.AddMember("team", json_string, alloc);
+					json_string.SetFloat((get_value<float>(delivery, "game-time")));
+					o.AddMember("game_time", json_string, alloc);
+
+					unconfirmed_delivery.PushBack(o, alloc);
 				}
 			}
 		}
-		delivery = delivery->next();
 	}
 
 	return unconfirmed_delivery;
@@ -1630,14 +1805,9 @@ std::string
 Data::get_gamephase()
 {
 	MutexLocker                       lock(&env_mutex_);
-	std::vector<CLIPS::Fact::pointer> facts = {};
-
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, "gamestate")) {
-			return get_value<std::string>(fact, "phase");
-		}
-		fact = fact->next();
+	std::vector<CLIPS::Fact::pointer> facts = template_facts("gamestate");
+	if (!facts.empty()) {
+		return get_value<std::string>(facts.front(), "phase");
 	}
 	return "";
 }
@@ -1651,14 +1821,9 @@ std::string
 Data::get_gamestate()
 {
 	MutexLocker                       lock(&env_mutex_);
-	std::vector<CLIPS::Fact::pointer> facts = {};
-
-	CLIPS::Fact::pointer fact = env_->get_facts();
-	while (fact) {
-		if (match(fact, "gamestate")) {
-			return get_value<std::string>(fact, "state");
-		}
-		fact = fact->next();
+	std::vector<CLIPS::Fact::pointer> facts = template_facts("gamestate");
+	if (!facts.empty()) {
+		return get_value<std::string>(facts.front(), "state");
 	}
 	return "";
 }
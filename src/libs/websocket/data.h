@@ -30,11 +30,15 @@
 #include <rapidjson/document.h>
 #include <rapidjson/schema.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <map>
 #include <mutex>
 #include <queue>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace fawkes;
@@ -46,15 +50,32 @@ class Data
 public:
 	Data(std::shared_ptr<Logger>             logger,
 	     std::shared_ptr<CLIPS::Environment> env,
-	     fawkes::Mutex                      &env_mutex);
+	     fawkes::Mutex                      &env_mutex,
+	     bool                                delta_updates    = false,
+	     bool                                coalesce_updates = false);
 	~Data();
-	std::string                                   log_pop();
+
+	/** Queued outgoing message.
+	 * Entity updates to be coalesced carry the entity key and the unserialized
+	 * document, all other messages are serialized and have an empty key. */
+	struct LogEntry
+	{
+		std::string         key;
+		std::string         msg;
+		rapidjson::Document doc;
+	};
+
+	std::queue<LogEntry>                          log_pop_all();
 	void                                          log_push(std::string log);
 	void                                          log_push(rapidjson::Document &d);
+	void                                          log_push_update(rapidjson::Document &d);
+	void                                          send_update(rapidjson::Document &d);
 	bool                                          log_empty();
 	void                                          log_wait();
+	void
+	log_wait_until(std::chrono::steady_clock::time_point deadline);
 	void                                          clients_add(std::shared_ptr<Client> client);
-	void                                          clients_send_all(std::string msg);
+	void                                          clients_send_all(const std::string &msg);
 	void                                          clients_send_all(rapidjson::Document &d);
 	void                                          log_push_attention_message(std::string text,
 	                                                                         std::string team,
@@ -168,11 +189,27 @@ private:
 	std::mutex                                 log_mu;
 	std::mutex                                 cli_mu;
 	std::condition_variable                    log_cv;
-	std::queue<std::string>                    logs;
+	std::queue<LogEntry>                       logs;
 	std::vector<std::shared_ptr<Client>>       clients;
 	std::shared_ptr<CLIPS::Environment>        env_;
 	fawkes::Mutex                             &env_mutex_;
 	std::shared_ptr<rapidjson::SchemaDocument> load_schema(std::string path);
+	std::vector<CLIPS::Fact::pointer>          template_facts(const std::string &tmpl_name);
+
+	/** Last sent state of an entity for delta updates. */
+	struct EntityState
+	{
+		uint64_t            seq = 0;
+		rapidjson::Document content;
+	};
+	bool entity_key(const std::string &type, const rapidjson::Value &content, std::string &key);
+	void append_snapshot(std::ostringstream &messages, rapidjson::Document &doc);
+	bool prepare_update(rapidjson::Document &d);
+
+	bool                               delta_updates_;
+	bool                               coalesce_updates_;
+	std::mutex                         delta_mu;
+	std::map<std::string, EntityState> entity_states_;
 
 	bool shutdown_ = false;
 };
@@ -44,19 +44,26 @@ namespace rcll::websocket {
  *
  * @param data_ptr pointer to Data object that is used for this session
  * @param logger_ logger used by the backend
+ * @param io_service I/O service running all socket operations
+ * @param command_service I/O service processing received commands
+ * @param max_client_queue maximum number of queued outgoing messages per client
  */
 Server::Server(std::shared_ptr<Data>    data,
                std::shared_ptr<Logger>  logger,
                boost::asio::io_service &io_service,
+               boost::asio::io_service &command_service,
                uint                     port,
                bool                     ws_mode,
-               bool                     allow_control_all)
+               bool                     allow_control_all,
+               size_t                   max_client_queue)
 : data_(data),
   logger_(logger),
+  command_service_(command_service),
   socket_(io_service),
   acceptor_(io_service, tcp::endpoint(tcp::v4(), port_)),
   ws_mode_(ws_mode),
-  allow_control_all_(allow_control_all)
+  allow_control_all_(allow_control_all),
+  max_client_queue_(max_client_queue)
 {
 }
 
@@ -80,14 +87,25 @@ Server::handle_accept(const boost::system::error_code &error, boost::asio::ip::t
 				// websocket approach
 				std::shared_ptr<boost::beast::websocket::stream<tcp::socket>> web_socket =
 				  std::make_shared<boost::beast::websocket::stream<tcp::socket>>(std::move(socket));
-				std::shared_ptr<Client> client =
-				  std::make_shared<ClientWS>(web_socket, logger_, data_, client_can_send);
+				std::shared_ptr<Client> client = std::make_shared<ClientWS>(web_socket,
+				                                                            command_service_.get_executor(),
+				                                                            logger_,
+				                                                            data_,
+				                                                            client_can_send,
+				                                                            max_client_queue_);
 				data_->clients_add(client);
+				client->start();
 			} else {
 				// socket approach
-				std::shared_ptr<Client> client = std::make_shared<ClientS>(
-				  std::make_shared<tcp::socket>(std::move(socket)), logger_, data_, client_can_send);
+				std::shared_ptr<Client> client =
+				  std::make_shared<ClientS>(std::make_shared<tcp::socket>(std::move(socket)),
+				                            command_service_.get_executor(),
+				                            logger_,
+				                            data_,
+				                            client_can_send,
+				                            max_client_queue_);
 				data_->clients_add(client);
+				client->start();
 			}
 
 			logger_->log_info("Websocket", "new client connected");
@@ -107,6 +125,8 @@ Server::do_accept()
 	acceptor_.async_accept(endpoint,
 	                       [&](const boost::system::error_code &error,
 	                           boost::asio::ip::tcp::socket     peer) {
+		                       if (shutdown_)
+			                       return;
 		                       if (!error)
 			                       handle_accept(error, peer);
 		                       do_accept();
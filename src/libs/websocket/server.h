@@ -34,9 +34,11 @@ public:
 	Server(std::shared_ptr<Data>    data,
 	       std::shared_ptr<Logger>  logger,
 	       boost::asio::io_service &io_service,
+	       boost::asio::io_service &command_service,
 	       uint                     port,
 	       bool                     ws_mode,
-	       bool                     allow_control_all);
+	       bool                     allow_control_all,
+	       size_t                   max_client_queue);
 
 	void shutdown();
 
@@ -48,12 +50,14 @@ private:
 
 	std::shared_ptr<Data>          data_;
 	std::shared_ptr<Logger>        logger_;
+	boost::asio::io_service       &command_service_;
 	uint                           port_ = 1234;
 	boost::asio::ip::tcp::socket   socket_;
 	boost::asio::ip::tcp::acceptor acceptor_;
 	bool                           ws_mode_           = true;
 	bool                           allow_control_all_ = false;
-	bool                           shutdown_          = false;
+	size_t                         max_client_queue_;
+	bool                           shutdown_ = false;
 };
 
 } // namespace rcll::websocket
@@ -0,0 +1,287 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  batch.cpp - LLSF RefBox batch runner for headless games
+ *
+ *  Created: Sun Oct 18 22:12:40 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "refbox.h"
+
+#include <config/yaml.h>
+#include <core/exception.h>
+#include <utils/system/argparser.h>
+
+#include <atomic>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <chrono>
+#include <clipsmm.h>
+#include <cstdio>
+#include <cstdlib>
+#include <mongocxx/client.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/uri.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace rcll;
+using namespace fawkes;
+
+/** Options of a batch run. */
+struct BatchOptions
+{
+	std::string  prefix;
+	unsigned int num_games;
+	unsigned int num_threads;
+	unsigned int num_attempts;
+	std::string  team;
+	std::string  custom_cfg;
+	std::string  log_level;
+	std::string  mongodb_hostport;
+};
+
+// Creating and destroying CLIPS environments is not thread-safe, hence
+// refbox instances are set up and torn down one at a time.
+static std::mutex lifecycle_mutex;
+
+static void
+print_usage(const char *program_name)
+{
+	printf("Usage: %s [-n games] [-j threads] [-a attempts] [-c team] [-C yaml-file] [-l level]\n"
+	       "       <report name>\n"
+	       "Runs headless games on mockup machines and virtual time, several in parallel,\n"
+	       "and stores the reports <report name>_<i> where i in [1...games].\n"
+	       " -n games      number of reports to generate (default: 1)\n"
+	       " -j threads    number of games to run in parallel (default: number of CPUs)\n"
+	       " -a attempts   number of attempts per report (default: 3)\n"
+	       " -c team       name of the cyan team (default: Carologistics)\n"
+	       " -C yaml-file  additional configuration file, loaded last\n"
+	       " -l level      log level of the games (default: warn)\n"
+	       " -h            print this help\n",
+	       program_name);
+}
+
+/** Create the configuration of a single game.
+ * Loads the default configuration with mockup machines, virtual time, and
+ * MongoDB reports, and detaches the game from the network. Every game gets
+ * its own configuration and log files.
+ */
+static std::shared_ptr<Configuration>
+game_config(const BatchOptions &opts, const std::string &report_name)
+{
+	std::map<std::string, std::string> cfg_files = LLSFRefBox::default_config_files();
+	cfg_files["cfg-mps"]                        = "mps/mockup_mps.yaml";
+	cfg_files["cfg-simulation"]                 = "simulation/headless_simulation.yaml";
+	cfg_files["cfg-mongodb"]                    = "mongodb/enable_mongodb.yaml";
+
+	std::shared_ptr<Configuration> config = std::make_shared<YamlConfiguration>(CONFDIR);
+	for (const auto &cfg_file : cfg_files) {
+		config->load(cfg_file.second.c_str());
+	}
+	if (!opts.custom_cfg.empty()) {
+		config->load(opts.custom_cfg.c_str());
+	}
+
+	config->set_string("/llsfrb/game/store-to-report", report_name.c_str());
+	config->set_string("/llsfrb/log/level", opts.log_level.c_str());
+	config->set_bool("/llsfrb/simulation/virtual-time/enable", true);
+	config->set_bool("/llsfrb/clips/event-driven", false);
+
+	LLSFRefBox::detach_from_network(*config);
+
+	for (const char *log : {"/llsfrb/log/general",
+	                        "/llsfrb/log/clips",
+	                        "/llsfrb/log/game",
+	                        "/llsfrb/mongodb/history-store/spill-file"}) {
+		if (config->exists(log)) {
+			std::string logfile = config->get_string(log);
+			size_t      pos     = logfile.find("$time");
+			if (pos != std::string::npos) {
+				logfile.replace(pos, 5, report_name);
+				config->set_string(log, logfile);
+			}
+		}
+	}
+	return config;
+}
+
+static bool
+is_true(LLSFRefBox &refbox, const std::string &expression)
+{
+	CLIPS::Values rv = refbox.evaluate(expression);
+	return rv.size() == 1 && rv[0].type() == CLIPS::TYPE_SYMBOL && rv[0].as_string() == "TRUE";
+}
+
+static void
+run_for(LLSFRefBox &refbox, unsigned int sec, unsigned int timer_interval)
+{
+	for (unsigned int i = 0; i < sec * 1000 / timer_interval; ++i) {
+		refbox.tick();
+	}
+}
+
+/** Play a single game.
+ * Follows the same script as the former generate_benchmarks.bash, but on
+ * virtual time, i.e., it only takes as long as the computation does.
+ * @return true if the game reached the post game phase
+ */
+static bool
+run_game(const BatchOptions &opts, const std::string &report_name)
+{
+	std::shared_ptr<Configuration> config         = game_config(opts, report_name);
+	unsigned int                   timer_interval = config->get_uint("/llsfrb/clips/timer-interval");
+
+	std::unique_ptr<LLSFRefBox> refbox;
+	{
+		std::lock_guard<std::mutex> lock(lifecycle_mutex);
+		refbox = std::make_unique<LLSFRefBox>(config);
+	}
+
+	refbox->evaluate("(assert (net-SetTeamName CYAN \"" + opts.team + "\"))");
+	refbox->evaluate("(assert (net-SetGamePhase PRE_GAME))");
+	refbox->evaluate("(assert (net-SetGameState RUNNING))");
+
+	// the field is generated in a separate thread, wait in real time
+	bool parameterized = false;
+	auto deadline      = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+	while (std::chrono::steady_clock::now() < deadline) {
+		refbox->tick();
+		if (is_true(*refbox,
+		            "(any-factp ((?gp game-parameters)) (eq ?gp:is-parameterized TRUE))")) {
+			parameterized = true;
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	bool post_game = false;
+	if (parameterized) {
+		run_for(*refbox, 5, timer_interval);
+		refbox->evaluate("(assert (net-SetGamePhase PRODUCTION))");
+		run_for(*refbox, 3, timer_interval);
+		refbox->evaluate("(assert (net-SetGamePhase POST_GAME))");
+		run_for(*refbox, 1, timer_interval);
+		post_game = is_true(*refbox, "(any-factp ((?gs gamestate)) (eq ?gs:phase POST_GAME))");
+	}
+
+	// the report is completely written on destruction
+	{
+		std::lock_guard<std::mutex> lock(lifecycle_mutex);
+		refbox.reset();
+	}
+	return post_game;
+}
+
+static bool
+report_exists(mongocxx::client &client, const std::string &report_name)
+{
+	using bsoncxx::builder::basic::kvp;
+	using bsoncxx::builder::basic::make_document;
+	return client["rcll"]["game_report"].count_documents(
+	         make_document(kvp("report_name", report_name)))
+	       > 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	ArgumentParser argp(argc, argv, "hn:j:a:c:C:l:");
+	if (argp.has_arg("h") || argp.num_items() != 1) {
+		print_usage(argp.program_name());
+		return argp.has_arg("h") ? 0 : 1;
+	}
+
+	BatchOptions opts;
+	opts.prefix       = argp.items()[0];
+	opts.num_games    = argp.has_arg("n") ? argp.parse_int("n") : 1;
+	opts.num_threads  = argp.has_arg("j") ? argp.parse_int("j") : std::thread::hardware_concurrency();
+	opts.num_attempts = argp.has_arg("a") ? argp.parse_int("a") : 3;
+	opts.team         = argp.has_arg("c") ? argp.arg("c") : "Carologistics";
+	opts.custom_cfg   = argp.has_arg("C") ? argp.arg("C") : "";
+	opts.log_level    = argp.has_arg("l") ? argp.arg("l") : "warn";
+	if (opts.num_threads == 0) {
+		opts.num_threads = 1;
+	}
+
+	CLIPS::init();
+	mongocxx::instance mongodb_instance{};
+	try {
+		opts.mongodb_hostport = game_config(opts, opts.prefix)->get_string("/llsfrb/mongodb/hostport");
+	} catch (Exception &e) {
+		printf("Failed to read configuration: %s\n", e.what_no_backtrace());
+		return 1;
+	}
+
+	std::atomic<unsigned int> next_game(1);
+	std::atomic<unsigned int> num_created(0);
+	std::atomic<unsigned int> num_skipped(0);
+	std::atomic<unsigned int> num_failed(0);
+
+	auto worker = [&]() {
+		mongocxx::client client{mongocxx::uri{"mongodb://" + opts.mongodb_hostport}};
+		for (unsigned int i = next_game++; i <= opts.num_games; i = next_game++) {
+			std::string report_name = opts.prefix + "_" + std::to_string(i);
+			try {
+				if (report_exists(client, report_name)) {
+					printf("Skipping %s as a report already exists\n", report_name.c_str());
+					++num_skipped;
+					continue;
+				}
+				// in rare occasions the generation fails, hence retry
+				bool created = false;
+				for (unsigned int a = 0; a < opts.num_attempts && !created; ++a) {
+					created = run_game(opts, report_name) && report_exists(client, report_name);
+				}
+				if (created) {
+					printf("Created report for %s\n", report_name.c_str());
+					++num_created;
+				} else {
+					printf("Failed to create report for %s\n", report_name.c_str());
+					++num_failed;
+				}
+			} catch (Exception &e) {
+				printf("Failed to create report for %s: %s\n",
+				       report_name.c_str(),
+				       e.what_no_backtrace());
+				++num_failed;
+			} catch (std::exception &e) {
+				printf("Failed to create report for %s: %s\n", report_name.c_str(), e.what());
+				++num_failed;
+			}
+		}
+	};
+
+	auto                     start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < std::min(opts.num_threads, opts.num_games); ++t) {
+		workers.emplace_back(worker);
+	}
+	for (std::thread &t : workers) {
+		t.join();
+	}
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+	printf("%u created, %u skipped, %u failed in %.1f sec\n",
+	       num_created.load(),
+	       num_skipped.load(),
+	       num_failed.load(),
+	       d.count());
+	return num_failed > 0 ? 1 : 0;
+}
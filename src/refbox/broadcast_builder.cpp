@@ -0,0 +1,913 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  broadcast_builder.cpp - LLSF RefBox native builders of periodic messages
+ *
+ *  Created: Sun Oct 18 23:58:12 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "broadcast_builder.h"
+
+#include <clips/clips.h>
+#include <core/exception.h>
+#include <msgs/GameState.pb.h>
+#include <msgs/MachineInfo.pb.h>
+#include <msgs/OrderInfo.pb.h>
+#include <msgs/Pose2D.pb.h>
+#include <msgs/RingInfo.pb.h>
+#include <msgs/RobotInfo.pb.h>
+#include <msgs/Time.pb.h>
+
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace google::protobuf;
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+// Slots read per deftemplate, in the order passed to resolve_template()
+enum { GS_STATE, GS_PHASE, GS_POINTS, GS_TEAMS };
+enum { TI_GAME_TIME };
+enum {
+	R_NUMBER,
+	R_STATE,
+	R_TEAM,
+	R_TEAM_COLOR,
+	R_NAME,
+	R_HOST,
+	R_LAST_SEEN,
+	R_POSE,
+	R_POSE_TIME,
+	R_MAINTENANCE_START_TIME,
+	R_MAINTENANCE_CYCLES
+};
+enum { M_NAME, M_TEAM, M_MTYPE, M_STATE, M_POSE, M_POSE_TIME, M_ZONE, M_ROTATION };
+enum { ML_NAME, ML_ACTUAL_LIGHTS };
+enum { BS_NAME, BS_CURRENT_SIDE, BS_CURRENT_BASE_COLOR };
+enum { CS_NAME, CS_OPERATION_MODE, CS_HAS_RETRIEVED };
+enum { RS_NAME, RS_CURRENT_RING_COLOR, RS_AVAILABLE_COLORS, RS_BASES_ADDED, RS_BASES_USED };
+enum { DS_NAME, DS_GATE, DS_ORDER_ID };
+enum { SS_NAME, SS_CURRENT_OPERATION, SS_CURRENT_SHELF_SLOT };
+enum { SSS_NAME, SSS_POSITION, SSS_IS_FILLED, SSS_DESCRIPTION };
+enum { ER_RTYPE, ER_NAME, ER_CORRECTLY_REPORTED, ER_ZONE_STATE, ER_ROTATION_STATE };
+enum { SMP_PHASES };
+enum { RSP_COLOR, RSP_REQ_BASES };
+enum {
+	O_ID,
+	O_COMPLEXITY,
+	O_COMPETITIVE,
+	O_BASE_COLOR,
+	O_RING_COLORS,
+	O_CAP_COLOR,
+	O_QUANTITY_REQUESTED,
+	O_QUANTITY_DELIVERED,
+	O_DELIVERY_PERIOD,
+	O_DELIVERY_GATE,
+	O_ACTIVE
+};
+enum { PP_ID, PP_GAME_TIME, PP_TEAM, PP_MTYPE, PP_CONFIRMED, PP_ORDER };
+enum { RC_PROCESS_ID, RC_STATE };
+
+static long long
+to_integer(const struct field &v)
+{
+	switch (v.type) {
+	case INTEGER: return ValueToLong(v.value);
+	case FLOAT: return (long long)ValueToDouble(v.value);
+	default: return 0;
+	}
+}
+
+static double
+to_float(const struct field &v)
+{
+	switch (v.type) {
+	case INTEGER: return ValueToLong(v.value);
+	case FLOAT: return ValueToDouble(v.value);
+	default: return 0.;
+	}
+}
+
+static const char *
+to_string(const struct field &v)
+{
+	switch (v.type) {
+	case SYMBOL:
+	case STRING:
+	case INSTANCE_NAME: return ValueToString(v.value);
+	default: return "";
+	}
+}
+
+static bool
+is_symbol(const struct field &v, const char *symbol)
+{
+	return v.type == SYMBOL && strcmp(ValueToString(v.value), symbol) == 0;
+}
+
+static long
+mf_length(const struct field &v)
+{
+	return v.type == MULTIFIELD ? static_cast<struct multifield *>(v.value)->multifieldLength : 0;
+}
+
+static const struct field &
+mf_nth(const struct field &v, long i)
+{
+	return static_cast<struct multifield *>(v.value)->theFields[i];
+}
+
+static bool
+non_zero_pose(const struct field &pose)
+{
+	for (long i = 0; i < mf_length(pose); ++i) {
+		if (to_float(mf_nth(pose, i)) != 0.) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+is_string(const struct field &v)
+{
+	return v.type == SYMBOL || v.type == STRING || v.type == INSTANCE_NAME;
+}
+
+/** Set an enum field by the name of the value.
+ * Like pb-set-field, invalid enum values leave the field unset.
+ * @param m message to set the field of
+ * @param setter setter of a field or adder of a repeated field
+ * @param name name of the enum value
+ */
+template <typename M, typename Enum>
+static void
+set_enum(M *m, void (M::*setter)(Enum), const char *name)
+{
+	if (const EnumValueDescriptor *e = GetEnumDescriptor<Enum>()->FindValueByName(name)) {
+		(m->*setter)(static_cast<Enum>(e->number()));
+	}
+}
+
+template <typename M, typename Enum>
+static void
+set_enum(M *m, void (M::*setter)(Enum), const struct field &v)
+{
+	if (is_string(v)) {
+		set_enum(m, setter, ValueToString(v.value));
+	}
+}
+
+/** Set a numeric field, like pb-set-field leave it unset for non-numbers. */
+template <typename M, typename T>
+static void
+set_number(M *m, void (M::*setter)(T), const struct field &v)
+{
+	if (v.type == INTEGER || v.type == FLOAT) {
+		(m->*setter)(std::is_floating_point<T>::value ? static_cast<T>(to_float(v))
+		                                              : static_cast<T>(to_integer(v)));
+	}
+}
+
+/** Set a boolean field, given as TRUE or FALSE like for pb-set-field. */
+template <typename M>
+static void
+set_bool(M *m, void (M::*setter)(bool), const struct field &v)
+{
+	if (is_string(v)) {
+		(m->*setter)(strcmp(ValueToString(v.value), "TRUE") == 0);
+	}
+}
+
+static void
+set_time(llsf_msgs::Time *t, long long sec, long long usec)
+{
+	t->set_sec(sec);
+	t->set_nsec(usec * 1000);
+}
+
+static void
+set_game_time(llsf_msgs::Time *t, double game_time)
+{
+	long long sec = (long long)game_time;
+	set_time(t, sec, (long long)((game_time - sec) * 1000000.));
+}
+
+static void
+set_pose(llsf_msgs::Pose2D *p, const struct field &pose, const struct field &pose_time)
+{
+	if (mf_length(pose_time) == 2) {
+		set_time(p->mutable_timestamp(),
+		         to_integer(mf_nth(pose_time, 0)),
+		         to_integer(mf_nth(pose_time, 1)));
+	}
+	if (mf_length(pose) == 3) {
+		set_number(p, &llsf_msgs::Pose2D::set_x, mf_nth(pose, 0));
+		set_number(p, &llsf_msgs::Pose2D::set_y, mf_nth(pose, 1));
+		set_number(p, &llsf_msgs::Pose2D::set_ori, mf_nth(pose, 2));
+	}
+}
+
+/** @class BroadcastBuilder "broadcast_builder.h"
+ * Build the periodic messages of the refbox directly from the fact base.
+ * The rule-based net-create-* functions they replace, kept for comparison
+ * in qa/net_reference.clp, build messages field by field with pb-create,
+ * pb-set-field, and pb-add-list, each of which is a call from CLIPS to C++
+ * that looks up the field by name, and read facts slot by slot.
+ * The builders produce the same messages in a single call. Deftemplates and
+ * slots are looked up once on first use, facts are then read by slot index
+ * and the fields are set on the generated message classes.
+ *
+ * Except for the GameState, which contains the game time, messages are
+ * cached. A message is only rebuilt if one of the facts it is built from was
+ * asserted, modified, or retracted since it was last built, otherwise the
+ * same message is returned. Callers must therefore not modify the messages.
+ * Defglobals and the tag IDs of the machines are assumed to not change
+ * during the game.
+ *
+ * The builders must only be called with the environment's mutex locked and
+ * must not outlive the deftemplates.
+ */
+
+/** Constructor.
+ * @param env CLIPS environment to read the facts from
+ */
+BroadcastBuilder::BroadcastBuilder(CLIPS::Environment *env)
+: env_(env), resolved_(false), cache_enabled_(true), cache_hits_(0), cache_misses_(0)
+{
+}
+
+/** Enable or disable caching of messages.
+ * Disabling the cache drops all cached messages.
+ * @param enabled true to cache messages, false to build them on every call
+ */
+void
+BroadcastBuilder::set_cache_enabled(bool enabled)
+{
+	cache_enabled_ = enabled;
+	if (!enabled) {
+		clear_cache();
+	}
+}
+
+/** Drop all cached messages. */
+void
+BroadcastBuilder::clear_cache()
+{
+	cache_.clear();
+}
+
+/** Look up deftemplates and slots.
+ * Called on first use, as the game's deftemplates are only defined once
+ * the CLIPS files have been loaded.
+ * @exception Exception thrown if a deftemplate or slot does not exist
+ */
+void
+BroadcastBuilder::resolve()
+{
+	if (resolved_) {
+		return;
+	}
+
+	resolve_template(gamestate_, "gamestate", {"state", "phase", "points", "teams"});
+	resolve_template(time_info_, "time-info", {"game-time"});
+	resolve_template(robot_,
+	                 "robot",
+	                 {"number",
+	                  "state",
+	                  "team",
+	                  "team-color",
+	                  "name",
+	                  "host",
+	                  "last-seen",
+	                  "pose",
+	                  "pose-time",
+	                  "maintenance-start-time",
+	                  "maintenance-cycles"});
+	resolve_template(machine_,
+	                 "machine",
+	                 {"name", "team", "mtype", "state", "pose", "pose-time", "zone", "rotation"});
+	resolve_template(machine_lights_, "machine-lights", {"name", "actual-lights"});
+	resolve_template(bs_meta_, "bs-meta", {"name", "current-side", "current-base-color"});
+	resolve_template(cs_meta_, "cs-meta", {"name", "operation-mode", "has-retrieved"});
+	resolve_template(rs_meta_,
+	                 "rs-meta",
+	                 {"name", "current-ring-color", "available-colors", "bases-added", "bases-used"});
+	resolve_template(ds_meta_, "ds-meta", {"name", "gate", "order-id"});
+	resolve_template(ss_meta_, "ss-meta", {"name", "current-operation", "current-shelf-slot"});
+	resolve_template(shelf_slot_,
+	                 "machine-ss-shelf-slot",
+	                 {"name", "position", "is-filled", "description"});
+	resolve_template(exploration_report_,
+	                 "exploration-report",
+	                 {"rtype", "name", "correctly-reported", "zone-state", "rotation-state"});
+	resolve_template(send_mps_positions_, "send-mps-positions", {"phases"});
+	resolve_template(ring_spec_, "ring-spec", {"color", "req-bases"});
+	resolve_template(order_,
+	                 "order",
+	                 {"id",
+	                  "complexity",
+	                  "competitive",
+	                  "base-color",
+	                  "ring-colors",
+	                  "cap-color",
+	                  "quantity-requested",
+	                  "quantity-delivered",
+	                  "delivery-period",
+	                  "delivery-gate",
+	                  "active"});
+	resolve_template(product_processed_,
+	                 "product-processed",
+	                 {"id", "game-time", "team", "mtype", "confirmed", "order"});
+	resolve_template(referee_confirmation_, "referee-confirmation", {"process-id", "state"});
+
+	resolved_ = true;
+}
+
+void
+BroadcastBuilder::resolve_template(Template                           &t,
+                                   const char                         *name,
+                                   std::initializer_list<const char *> slots)
+{
+	t.tmpl = static_cast<struct deftemplate *>(EnvFindDeftemplate(env_->cobj(), name));
+	if (!t.tmpl) {
+		throw fawkes::Exception("Deftemplate '%s' does not exist", name);
+	}
+	t.slots.clear();
+	for (const char *slot_name : slots) {
+		int index = 0;
+		for (struct templateSlot *s = t.tmpl->slotList; s != NULL; s = s->next, ++index) {
+			if (strcmp(ValueToString(s->slotName), slot_name) == 0) {
+				break;
+			}
+		}
+		if (index == (int)t.tmpl->numberOfSlots) {
+			throw fawkes::Exception("Deftemplate '%s' has no slot '%s'", name, slot_name);
+		}
+		t.slots.push_back(index);
+	}
+}
+
+struct fact *
+BroadcastBuilder::first_fact(const Template &t) const
+{
+	return static_cast<struct fact *>(EnvGetNextFactInTemplate(env_->cobj(), t.tmpl, NULL));
+}
+
+struct fact *
+BroadcastBuilder::next_fact(const Template &t, struct fact *f) const
+{
+	return static_cast<struct fact *>(EnvGetNextFactInTemplate(env_->cobj(), t.tmpl, f));
+}
+
+const struct field &
+BroadcastBuilder::slot(struct fact *f, const Template &t, int s) const
+{
+	return f->theProposition.theFields[t.slots[s]];
+}
+
+bool
+BroadcastBuilder::global(const char *name, struct field &value) const
+{
+	DATA_OBJECT v;
+	if (!EnvGetDefglobalValue(env_->cobj(), name, &v)) {
+		return false;
+	}
+	value.type  = GetType(v);
+	value.value = GetValue(v);
+	return true;
+}
+
+/** Get the tag IDs of a machine.
+ * The IDs are taken from tag-ids-from-machine-name on first use of a
+ * machine name and then kept.
+ * @param name name of the machine
+ * @return input and output tag ID, empty if the machine has no tags
+ */
+const std::vector<long long> &
+BroadcastBuilder::machine_tags(const char *name)
+{
+	auto t = machine_tags_.find(name);
+	if (t != machine_tags_.end()) {
+		return t->second;
+	}
+	std::vector<long long> &tags = machine_tags_[name];
+	DATA_OBJECT             result;
+	if (!EnvFunctionCall(env_->cobj(), "tag-ids-from-machine-name", name, &result)
+	    && GetType(result) == MULTIFIELD && GetDOLength(result) == 2) {
+		for (long i = GetDOBegin(result); i <= GetDOEnd(result); ++i) {
+			tags.push_back(ValueToLong(GetMFValue(GetValue(result), i)));
+		}
+	}
+	return tags;
+}
+
+/** Add the version of the facts of a deftemplate.
+ * CLIPS has no change counter per deftemplate, but every asserted fact gets
+ * a new fact index, higher than all before, and modify retracts the fact and
+ * asserts it with a new index. Hence, the number of facts or the sum of
+ * their indexes changes on any assert, modify, or retract. This only reads
+ * the fact list, not the slots.
+ * @param versions versions to append to
+ * @param t deftemplate of the facts
+ */
+void
+BroadcastBuilder::add_version(std::vector<long long> &versions, const Template &t) const
+{
+	long long count   = 0;
+	long long indexes = 0;
+	for (struct fact *f = first_fact(t); f; f = next_fact(t, f)) {
+		count += 1;
+		indexes += f->factIndex;
+	}
+	versions.push_back(count);
+	versions.push_back(indexes);
+}
+
+/** Get a message from the cache or build it.
+ * @param key key of the message, e.g., its type and builder arguments
+ * @param versions versions of the facts the message is built from
+ * @param build function to build the message if it is not cached for the
+ * given versions
+ * @return message
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::cached(const std::string                         &key,
+                         const std::vector<long long>              &versions,
+                         std::function<std::shared_ptr<Message>()> build)
+{
+	if (!cache_enabled_) {
+		return build();
+	}
+	CacheEntry &e = cache_[key];
+	if (e.msg && e.versions == versions) {
+		cache_hits_ += 1;
+		return e.msg;
+	}
+	cache_misses_ += 1;
+	e.msg.reset();
+	e.msg      = build();
+	e.versions = versions;
+	return e.msg;
+}
+
+/** Build a GameState message, like net-create-GameState.
+ * @return message
+ * @exception Exception thrown if there is no gamestate or time-info fact
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::game_state()
+{
+	resolve();
+	struct fact *gs = first_fact(gamestate_);
+	struct fact *ti = first_fact(time_info_);
+	if (!gs || !ti) {
+		throw fawkes::Exception("No gamestate or time-info fact");
+	}
+
+	std::shared_ptr<llsf_msgs::GameState> m = std::make_shared<llsf_msgs::GameState>();
+
+	set_game_time(m->mutable_game_time(), to_float(slot(ti, time_info_, TI_GAME_TIME)));
+	set_enum(m.get(), &llsf_msgs::GameState::set_state, slot(gs, gamestate_, GS_STATE));
+	set_enum(m.get(), &llsf_msgs::GameState::set_phase, slot(gs, gamestate_, GS_PHASE));
+	const struct field &points = slot(gs, gamestate_, GS_POINTS);
+	if (mf_length(points) == 2) {
+		set_number(m.get(), &llsf_msgs::GameState::set_points_cyan, mf_nth(points, 0));
+		set_number(m.get(), &llsf_msgs::GameState::set_points_magenta, mf_nth(points, 1));
+	}
+	const struct field &teams = slot(gs, gamestate_, GS_TEAMS);
+	if (mf_length(teams) == 2) {
+		if (*to_string(mf_nth(teams, 0))) {
+			m->set_team_cyan(to_string(mf_nth(teams, 0)));
+		}
+		if (*to_string(mf_nth(teams, 1))) {
+			m->set_team_magenta(to_string(mf_nth(teams, 1)));
+		}
+	}
+
+	struct field value;
+	if (global("FIELD-WIDTH", value)) {
+		set_number(m.get(), &llsf_msgs::GameState::set_field_width, value);
+	}
+	if (global("FIELD-HEIGHT", value)) {
+		set_number(m.get(), &llsf_msgs::GameState::set_field_height, value);
+	}
+	if (global("FIELD-MIRRORED", value)) {
+		set_bool(m.get(), &llsf_msgs::GameState::set_field_mirrored, value);
+	}
+	return m;
+}
+
+/** Build a RobotInfo message, like net-create-RobotInfo.
+ * @param time current time in seconds, used for the remaining maintenance time
+ * @param pub_pose true to include the robot poses
+ * @return message
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::robot_info(double time, bool pub_pose)
+{
+	resolve();
+	std::vector<long long> versions;
+	add_version(versions, robot_);
+	// the remaining maintenance time changes with the time
+	for (struct fact *rf = first_fact(robot_); rf; rf = next_fact(robot_, rf)) {
+		if (is_symbol(slot(rf, robot_, R_STATE), "MAINTENANCE")) {
+			long long time_bits;
+			memcpy(&time_bits, &time, sizeof(time_bits));
+			versions.push_back(time_bits);
+			break;
+		}
+	}
+	return cached(pub_pose ? "RobotInfo pose" : "RobotInfo", versions, [this, time, pub_pose]() {
+		return build_robot_info(time, pub_pose);
+	});
+}
+
+std::shared_ptr<Message>
+BroadcastBuilder::build_robot_info(double time, bool pub_pose)
+{
+	std::shared_ptr<llsf_msgs::RobotInfo> ri = std::make_shared<llsf_msgs::RobotInfo>();
+
+	struct field maintenance_allowed_time = {INTEGER, NULL};
+	if (!global("MAINTENANCE-ALLOWED-TIME", maintenance_allowed_time)) {
+		maintenance_allowed_time.type = SYMBOL;
+	}
+
+	for (struct fact *rf = first_fact(robot_); rf; rf = next_fact(robot_, rf)) {
+		if (is_symbol(slot(rf, robot_, R_TEAM_COLOR), "nil")) {
+			continue;
+		}
+		llsf_msgs::Robot *r = ri->add_robots();
+
+		const struct field &last_seen = slot(rf, robot_, R_LAST_SEEN);
+		if (mf_length(last_seen) == 2) {
+			set_time(r->mutable_last_seen(),
+			         to_integer(mf_nth(last_seen, 0)),
+			         to_integer(mf_nth(last_seen, 1)));
+		}
+		const struct field &pose = slot(rf, robot_, R_POSE);
+		if (pub_pose && non_zero_pose(pose)) {
+			set_pose(r->mutable_pose(), pose, slot(rf, robot_, R_POSE_TIME));
+		}
+
+		r->set_name(to_string(slot(rf, robot_, R_NAME)));
+		r->set_team(to_string(slot(rf, robot_, R_TEAM)));
+		set_enum(r, &llsf_msgs::Robot::set_team_color, slot(rf, robot_, R_TEAM_COLOR));
+		set_number(r, &llsf_msgs::Robot::set_number, slot(rf, robot_, R_NUMBER));
+		set_enum(r, &llsf_msgs::Robot::set_state, slot(rf, robot_, R_STATE));
+		r->set_host(to_string(slot(rf, robot_, R_HOST)));
+		if (is_symbol(slot(rf, robot_, R_STATE), "MAINTENANCE")) {
+			double start = to_float(slot(rf, robot_, R_MAINTENANCE_START_TIME));
+			r->set_maintenance_time_remaining(to_float(maintenance_allowed_time) - (time - start));
+		}
+		set_number(r,
+		           &llsf_msgs::Robot::set_maintenance_cycles,
+		           slot(rf, robot_, R_MAINTENANCE_CYCLES));
+	}
+	return ri;
+}
+
+/** Build a MachineInfo message, like net-create-Machine for each machine.
+ * @param team_color team color of the machines to include, empty for all
+ * machines, in which case the team color of the message is not set
+ * @param add_restricted_info true to include information that is only sent
+ * to clients, e.g., the lights and the prepared instructions
+ * @return message
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::machine_info(const std::string &team_color, bool add_restricted_info)
+{
+	resolve();
+	std::vector<long long> versions;
+	for (const Template *t : {&gamestate_,
+	                          &send_mps_positions_,
+	                          &machine_,
+	                          &machine_lights_,
+	                          &bs_meta_,
+	                          &cs_meta_,
+	                          &rs_meta_,
+	                          &ds_meta_,
+	                          &ss_meta_,
+	                          &shelf_slot_,
+	                          &exploration_report_}) {
+		add_version(versions, *t);
+	}
+	std::string key = "MachineInfo " + team_color + (add_restricted_info ? " restricted" : "");
+	return cached(key, versions, [this, &team_color, add_restricted_info]() {
+		return build_machine_info(team_color, add_restricted_info);
+	});
+}
+
+std::shared_ptr<Message>
+BroadcastBuilder::build_machine_info(const std::string &team_color, bool add_restricted_info)
+{
+	std::shared_ptr<llsf_msgs::MachineInfo> mi = std::make_shared<llsf_msgs::MachineInfo>();
+	if (!team_color.empty()) {
+		set_enum(mi.get(), &llsf_msgs::MachineInfo::set_team_color, team_color.c_str());
+	}
+
+	struct fact *gs    = first_fact(gamestate_);
+	const char  *phase = gs ? to_string(slot(gs, gamestate_, GS_PHASE)) : "";
+	bool send_positions = false;
+	for (struct fact *s = first_fact(send_mps_positions_); s; s = next_fact(send_mps_positions_, s)) {
+		const struct field &phases = slot(s, send_mps_positions_, SMP_PHASES);
+		for (long i = 0; i < mf_length(phases); ++i) {
+			send_positions |= strcmp(to_string(mf_nth(phases, i)), phase) == 0;
+		}
+	}
+	bool production = strcmp(phase, "SETUP") == 0 || strcmp(phase, "PRODUCTION") == 0;
+	bool exploration = strcmp(phase, "EXPLORATION") == 0;
+
+	// facts are joined on the machine name by the symbol's hash node, CLIPS
+	// keeps a single node per symbol
+	std::unordered_map<void *, struct fact *> lights;
+	for (struct fact *l = first_fact(machine_lights_); l; l = next_fact(machine_lights_, l)) {
+		lights.emplace(slot(l, machine_lights_, ML_NAME).value, l);
+	}
+	std::unordered_map<void *, struct fact *> metas;
+	for (const Template *t : {&bs_meta_, &cs_meta_, &rs_meta_, &ds_meta_, &ss_meta_}) {
+		for (struct fact *mf = first_fact(*t); mf; mf = next_fact(*t, mf)) {
+			metas.emplace(slot(mf, *t, 0).value, mf);
+		}
+	}
+	std::unordered_set<void *>                reported;
+	std::unordered_map<void *, struct fact *> records;
+	for (struct fact *er = first_fact(exploration_report_); er;
+	     er             = next_fact(exploration_report_, er)) {
+		void *name = slot(er, exploration_report_, ER_NAME).value;
+		if (is_symbol(slot(er, exploration_report_, ER_CORRECTLY_REPORTED), "TRUE")) {
+			reported.insert(name);
+		}
+		if (is_symbol(slot(er, exploration_report_, ER_RTYPE), "RECORD")) {
+			records.emplace(name, er);
+		}
+	}
+
+	for (struct fact *mf = first_fact(machine_); mf; mf = next_fact(machine_, mf)) {
+		const struct field &name = slot(mf, machine_, M_NAME);
+		if (!team_color.empty() && team_color != to_string(slot(mf, machine_, M_TEAM))) {
+			continue;
+		}
+		auto l = lights.find(name.value);
+		if (l == lights.end()) {
+			continue;
+		}
+		auto         meta_it = metas.find(name.value);
+		struct fact *meta    = meta_it != metas.end() ? meta_it->second : NULL;
+
+		llsf_msgs::Machine *m     = mi->add_machines();
+		const char         *mtype = to_string(slot(mf, machine_, M_MTYPE));
+		const char         *state = to_string(slot(mf, machine_, M_STATE));
+
+		m->set_name(to_string(name));
+		const std::vector<long long> &tags = machine_tags(to_string(name));
+		if (!tags.empty()) {
+			m->set_input_tag(tags[0]);
+			m->set_output_tag(tags[1]);
+		}
+		m->set_type(mtype);
+		set_enum(m, &llsf_msgs::Machine::set_team_color, slot(mf, machine_, M_TEAM));
+		if (production && meta && strcmp(mtype, "RS") == 0) {
+			const struct field &colors = slot(meta, rs_meta_, RS_AVAILABLE_COLORS);
+			for (long i = 0; i < mf_length(colors); ++i) {
+				set_enum(m, &llsf_msgs::Machine::add_ring_colors, mf_nth(colors, i));
+			}
+		}
+		const struct field &zone     = slot(mf, machine_, M_ZONE);
+		const struct field &rotation = slot(mf, machine_, M_ROTATION);
+		if (add_restricted_info || send_positions || reported.count(name.value) > 0) {
+			if (!is_symbol(zone, "TBD")) {
+				set_enum(m, &llsf_msgs::Machine::set_zone, zone);
+			}
+			if (to_integer(rotation) != -1) {
+				set_number(m, &llsf_msgs::Machine::set_rotation, rotation);
+			}
+		}
+		m->set_state(state);
+
+		if (strcmp(mtype, "SS") == 0) {
+			for (struct fact *s = first_fact(shelf_slot_); s; s = next_fact(shelf_slot_, s)) {
+				if (slot(s, shelf_slot_, SSS_NAME).value != name.value) {
+					continue;
+				}
+				llsf_msgs::ShelfSlotInfo *ss       = m->add_status_ss();
+				const struct field       &position = slot(s, shelf_slot_, SSS_POSITION);
+				if (mf_length(position) == 2) {
+					set_number(ss, &llsf_msgs::ShelfSlotInfo::set_shelf, mf_nth(position, 0));
+					set_number(ss, &llsf_msgs::ShelfSlotInfo::set_slot, mf_nth(position, 1));
+				}
+				set_bool(ss, &llsf_msgs::ShelfSlotInfo::set_is_filled, slot(s, shelf_slot_, SSS_IS_FILLED));
+				ss->set_description(to_string(slot(s, shelf_slot_, SSS_DESCRIPTION)));
+			}
+		}
+
+		if (add_restricted_info) {
+			if (meta && strcmp(mtype, "RS") == 0) {
+				m->set_loaded_with(to_integer(slot(meta, rs_meta_, RS_BASES_ADDED))
+				                   - to_integer(slot(meta, rs_meta_, RS_BASES_USED)));
+			}
+			if (meta && strcmp(mtype, "CS") == 0) {
+				m->set_loaded_with(is_symbol(slot(meta, cs_meta_, CS_HAS_RETRIEVED), "TRUE") ? 1 : 0);
+			}
+
+			const struct field &actual_lights = slot(l->second, machine_lights_, ML_ACTUAL_LIGHTS);
+			for (long i = 0; i < mf_length(actual_lights); ++i) {
+				std::string spec = to_string(mf_nth(actual_lights, i));
+				size_t      dash = spec.find('-');
+				if (dash == std::string::npos) {
+					continue;
+				}
+				llsf_msgs::LightSpec *ls = m->add_lights();
+				set_enum(ls, &llsf_msgs::LightSpec::set_color, spec.substr(0, dash).c_str());
+				set_enum(ls, &llsf_msgs::LightSpec::set_state, spec.substr(dash + 1).c_str());
+			}
+
+			if (meta && strcmp(state, "IDLE") != 0 && strcmp(state, "BROKEN") != 0
+			    && strcmp(state, "DOWN") != 0) {
+				if (strcmp(mtype, "BS") == 0) {
+					llsf_msgs::PrepareInstructionBS *pm = m->mutable_instruction_bs();
+					set_enum(pm,
+					         &llsf_msgs::PrepareInstructionBS::set_side,
+					         slot(meta, bs_meta_, BS_CURRENT_SIDE));
+					set_enum(pm,
+					         &llsf_msgs::PrepareInstructionBS::set_color,
+					         slot(meta, bs_meta_, BS_CURRENT_BASE_COLOR));
+				} else if (strcmp(mtype, "DS") == 0) {
+					llsf_msgs::PrepareInstructionDS *pm = m->mutable_instruction_ds();
+					set_number(pm, &llsf_msgs::PrepareInstructionDS::set_gate, slot(meta, ds_meta_, DS_GATE));
+					set_number(pm,
+					           &llsf_msgs::PrepareInstructionDS::set_order_id,
+					           slot(meta, ds_meta_, DS_ORDER_ID));
+				} else if (strcmp(mtype, "SS") == 0) {
+					llsf_msgs::PrepareInstructionSS *pm = m->mutable_instruction_ss();
+					set_enum(pm,
+					         &llsf_msgs::PrepareInstructionSS::set_operation,
+					         slot(meta, ss_meta_, SS_CURRENT_OPERATION));
+					const struct field &shelf_slot = slot(meta, ss_meta_, SS_CURRENT_SHELF_SLOT);
+					if (mf_length(shelf_slot) == 2) {
+						set_number(pm, &llsf_msgs::PrepareInstructionSS::set_shelf, mf_nth(shelf_slot, 0));
+						set_number(pm, &llsf_msgs::PrepareInstructionSS::set_slot, mf_nth(shelf_slot, 1));
+					}
+				} else if (strcmp(mtype, "RS") == 0) {
+					set_enum(m->mutable_instruction_rs(),
+					         &llsf_msgs::PrepareInstructionRS::set_ring_color,
+					         slot(meta, rs_meta_, RS_CURRENT_RING_COLOR));
+				} else if (strcmp(mtype, "CS") == 0) {
+					set_enum(m->mutable_instruction_cs(),
+					         &llsf_msgs::PrepareInstructionCS::set_operation,
+					         slot(meta, cs_meta_, CS_OPERATION_MODE));
+				}
+			}
+		}
+
+		const struct field &pose = slot(mf, machine_, M_POSE);
+		if (non_zero_pose(pose)) {
+			set_pose(m->mutable_pose(), pose, slot(mf, machine_, M_POSE_TIME));
+		}
+
+		if (exploration) {
+			auto r = records.find(name.value);
+			if (r != records.end()) {
+				set_bool(m,
+				         &llsf_msgs::Machine::set_correctly_reported,
+				         slot(r->second, exploration_report_, ER_CORRECTLY_REPORTED));
+				set_enum(m,
+				         &llsf_msgs::Machine::set_exploration_rotation_state,
+				         slot(r->second, exploration_report_, ER_ROTATION_STATE));
+				set_enum(m,
+				         &llsf_msgs::Machine::set_exploration_zone_state,
+				         slot(r->second, exploration_report_, ER_ZONE_STATE));
+			}
+		}
+	}
+	return mi;
+}
+
+/** Build an OrderInfo message of the active orders, like net-create-OrderInfo.
+ * @return message
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::order_info()
+{
+	resolve();
+	std::vector<long long> versions;
+	add_version(versions, order_);
+	add_version(versions, product_processed_);
+	add_version(versions, referee_confirmation_);
+	return cached("OrderInfo", versions, [this]() { return build_order_info(); });
+}
+
+std::shared_ptr<Message>
+BroadcastBuilder::build_order_info()
+{
+	std::shared_ptr<llsf_msgs::OrderInfo> oi = std::make_shared<llsf_msgs::OrderInfo>();
+
+	// deliveries that still await the confirmation of the referee
+	std::unordered_set<long long> required;
+	for (struct fact *rc = first_fact(referee_confirmation_); rc;
+	     rc             = next_fact(referee_confirmation_, rc)) {
+		if (is_symbol(slot(rc, referee_confirmation_, RC_STATE), "REQUIRED")) {
+			required.insert(to_integer(slot(rc, referee_confirmation_, RC_PROCESS_ID)));
+		}
+	}
+	std::vector<struct fact *> unconfirmed;
+	for (struct fact *pp = first_fact(product_processed_); pp;
+	     pp             = next_fact(product_processed_, pp)) {
+		if (is_symbol(slot(pp, product_processed_, PP_CONFIRMED), "FALSE")
+		    && is_symbol(slot(pp, product_processed_, PP_MTYPE), "DS")
+		    && required.count(to_integer(slot(pp, product_processed_, PP_ID))) > 0) {
+			unconfirmed.push_back(pp);
+		}
+	}
+
+	for (struct fact *of = first_fact(order_); of; of = next_fact(order_, of)) {
+		if (!is_symbol(slot(of, order_, O_ACTIVE), "TRUE")) {
+			continue;
+		}
+		llsf_msgs::Order *o  = oi->add_orders();
+		long long         id = to_integer(slot(of, order_, O_ID));
+
+		o->set_id(id);
+		set_enum(o, &llsf_msgs::Order::set_complexity, slot(of, order_, O_COMPLEXITY));
+		set_bool(o, &llsf_msgs::Order::set_competitive, slot(of, order_, O_COMPETITIVE));
+		set_enum(o, &llsf_msgs::Order::set_base_color, slot(of, order_, O_BASE_COLOR));
+		const struct field &ring_colors = slot(of, order_, O_RING_COLORS);
+		for (long i = 0; i < mf_length(ring_colors); ++i) {
+			set_enum(o, &llsf_msgs::Order::add_ring_colors, mf_nth(ring_colors, i));
+		}
+		set_enum(o, &llsf_msgs::Order::set_cap_color, slot(of, order_, O_CAP_COLOR));
+		set_number(o,
+		           &llsf_msgs::Order::set_quantity_requested,
+		           slot(of, order_, O_QUANTITY_REQUESTED));
+		const struct field &delivered = slot(of, order_, O_QUANTITY_DELIVERED);
+		if (mf_length(delivered) == 2) {
+			set_number(o, &llsf_msgs::Order::set_quantity_delivered_cyan, mf_nth(delivered, 0));
+			set_number(o, &llsf_msgs::Order::set_quantity_delivered_magenta, mf_nth(delivered, 1));
+		}
+		set_number(o, &llsf_msgs::Order::set_delivery_gate, slot(of, order_, O_DELIVERY_GATE));
+		const struct field &period = slot(of, order_, O_DELIVERY_PERIOD);
+		if (mf_length(period) == 2) {
+			set_number(o, &llsf_msgs::Order::set_delivery_period_begin, mf_nth(period, 0));
+			set_number(o, &llsf_msgs::Order::set_delivery_period_end, mf_nth(period, 1));
+		}
+
+		for (struct fact *pp : unconfirmed) {
+			if (to_integer(slot(pp, product_processed_, PP_ORDER)) != id) {
+				continue;
+			}
+			llsf_msgs::UnconfirmedDelivery *d = o->add_unconfirmed_deliveries();
+			set_number(d, &llsf_msgs::UnconfirmedDelivery::set_id, slot(pp, product_processed_, PP_ID));
+			set_enum(d, &llsf_msgs::UnconfirmedDelivery::set_team, slot(pp, product_processed_, PP_TEAM));
+			set_game_time(d->mutable_delivery_time(),
+			              to_float(slot(pp, product_processed_, PP_GAME_TIME)));
+		}
+	}
+	return oi;
+}
+
+/** Build a RingInfo message, like net-create-RingInfo.
+ * @return message
+ */
+std::shared_ptr<Message>
+BroadcastBuilder::ring_info()
+{
+	resolve();
+	std::vector<long long> versions;
+	add_version(versions, ring_spec_);
+	return cached("RingInfo", versions, [this]() { return build_ring_info(); });
+}
+
+std::shared_ptr<Message>
+BroadcastBuilder::build_ring_info()
+{
+	std::shared_ptr<llsf_msgs::RingInfo> ri = std::make_shared<llsf_msgs::RingInfo>();
+	for (struct fact *rs = first_fact(ring_spec_); rs; rs = next_fact(ring_spec_, rs)) {
+		llsf_msgs::Ring *r = ri->add_rings();
+		set_enum(r, &llsf_msgs::Ring::set_ring_color, slot(rs, ring_spec_, RSP_COLOR));
+		set_number(r, &llsf_msgs::Ring::set_raw_material, slot(rs, ring_spec_, RSP_REQ_BASES));
+	}
+	return ri;
+}
+
+} // end of namespace rcll
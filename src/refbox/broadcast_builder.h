@@ -0,0 +1,142 @@
+
+/***************************************************************************
+ *  broadcast_builder.h - LLSF RefBox native builders of periodic messages
+ *
+ *  Created: Sun Oct 18 23:58:12 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LLSF_REFBOX_BROADCAST_BUILDER_H_
+#define __LLSF_REFBOX_BROADCAST_BUILDER_H_
+
+#include <google/protobuf/message.h>
+
+#include <clipsmm.h>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct fact;
+struct field;
+struct deftemplate;
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+class BroadcastBuilder
+{
+public:
+	BroadcastBuilder(CLIPS::Environment *env);
+
+	std::shared_ptr<google::protobuf::Message> game_state();
+	std::shared_ptr<google::protobuf::Message> robot_info(double time, bool pub_pose);
+	std::shared_ptr<google::protobuf::Message> machine_info(const std::string &team_color,
+	                                                        bool               add_restricted_info);
+	std::shared_ptr<google::protobuf::Message> order_info();
+	std::shared_ptr<google::protobuf::Message> ring_info();
+
+	void set_cache_enabled(bool enabled);
+	void clear_cache();
+
+	/** Get the number of messages that were served from the cache.
+	 * @return number of cache hits */
+	unsigned long
+	cache_hits() const
+	{
+		return cache_hits_;
+	}
+
+	/** Get the number of messages that had to be built.
+	 * @return number of cache misses */
+	unsigned long
+	cache_misses() const
+	{
+		return cache_misses_;
+	}
+
+private:
+	/** Deftemplate and indexes of the slots that are read. */
+	struct Template
+	{
+		struct deftemplate *tmpl;  ///< deftemplate
+		std::vector<int>    slots; ///< slot indexes in the order of the resolved names
+	};
+
+	/** Message built from the facts of the given versions. */
+	struct CacheEntry
+	{
+		std::vector<long long>                     versions; ///< versions of the facts read
+		std::shared_ptr<google::protobuf::Message> msg;      ///< message built from them
+	};
+
+	void resolve();
+	void resolve_template(Template &t, const char *name, std::initializer_list<const char *> slots);
+
+	struct fact        *first_fact(const Template &t) const;
+	struct fact        *next_fact(const Template &t, struct fact *f) const;
+	const struct field &slot(struct fact *f, const Template &t, int s) const;
+	bool                global(const char *name, struct field &value) const;
+	void                add_version(std::vector<long long> &versions, const Template &t) const;
+
+	const std::vector<long long> &machine_tags(const char *name);
+
+	std::shared_ptr<google::protobuf::Message> build_robot_info(double time, bool pub_pose);
+	std::shared_ptr<google::protobuf::Message> build_machine_info(const std::string &team_color,
+	                                                              bool add_restricted_info);
+	std::shared_ptr<google::protobuf::Message> build_order_info();
+	std::shared_ptr<google::protobuf::Message> build_ring_info();
+
+	std::shared_ptr<google::protobuf::Message>
+	cached(const std::string                                          &key,
+	       const std::vector<long long>                               &versions,
+	       std::function<std::shared_ptr<google::protobuf::Message>()> build);
+
+	CLIPS::Environment                            *env_;
+	bool                                           resolved_;
+	bool                                           cache_enabled_;
+	std::map<std::string, CacheEntry>              cache_;
+	unsigned long                                  cache_hits_;
+	unsigned long                                  cache_misses_;
+	std::map<std::string, std::vector<long long>> machine_tags_;
+
+	Template gamestate_;
+	Template time_info_;
+	Template robot_;
+	Template machine_;
+	Template machine_lights_;
+	Template bs_meta_;
+	Template cs_meta_;
+	Template rs_meta_;
+	Template ds_meta_;
+	Template ss_meta_;
+	Template shelf_slot_;
+	Template exploration_report_;
+	Template send_mps_positions_;
+	Template ring_spec_;
+	Template order_;
+	Template product_processed_;
+	Template referee_confirmation_;
+};
+
+} // end of namespace rcll
+
+#endif
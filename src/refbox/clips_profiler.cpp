@@ -0,0 +1,228 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  clips_profiler.cpp - LLSF RefBox CLIPS rule and function profiler
+ *
+ *  Created: Sun Oct 18 20:31:17 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "clips_profiler.h"
+
+#include <clips/clips.h>
+#include <clips/proflfun.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <utility>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+/** @class ClipsProfiler "clips_profiler.h"
+ * Profiler for the CLIPS rule engine.
+ * Replaces running the engine with run(), which fires one activation at a
+ * time and measures the time spent per rule, including the pattern matching
+ * caused by the rule's actions. Deffunction calls are counted by the
+ * construct profiler built into CLIPS and collected once per engine run,
+ * after the run's time has been taken.
+ * All methods must be called with the CLIPS mutex locked.
+ */
+
+typedef std::chrono::steady_clock ProfileClock;
+
+static void
+add_sample(ClipsProfiler::Stats &stats, double duration, uint64_t count = 1)
+{
+	stats.count += count;
+	stats.total += duration;
+	stats.max = std::max(stats.max, duration / count);
+}
+
+/** Constructor.
+ * Enables the construct profiler of the environment.
+ * @param env CLIPS environment to profile
+ */
+ClipsProfiler::ClipsProfiler(CLIPS::Environment *env)
+: env_(env), histogram_(histogram_bounds().size() + 1, 0)
+{
+	env_->evaluate("(profile constructs)");
+	update_functions();
+	functions_.clear();
+}
+
+/** Destructor. */
+ClipsProfiler::~ClipsProfiler()
+{
+	env_->evaluate("(profile off)");
+}
+
+/** Upper bounds of the run duration histogram buckets.
+ * @return bucket bounds in seconds
+ */
+const std::vector<double> &
+ClipsProfiler::histogram_bounds()
+{
+	static const std::vector<double> bounds =
+	  {0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2};
+	return bounds;
+}
+
+/** Run the engine until the agenda is empty.
+ * Equivalent to CLIPS::Environment::run(), but records the time of each
+ * rule firing.
+ * @return number of fired rules
+ */
+long
+ClipsProfiler::run()
+{
+	void *env   = env_->cobj();
+	long  fired = 0;
+
+	ProfileClock::time_point start = ProfileClock::now();
+	void                    *act;
+	while ((act = EnvGetNextActivation(env, NULL)) != NULL) {
+		std::string rule = EnvGetActivationName(env, act);
+
+		ProfileClock::time_point      t = ProfileClock::now();
+		long                          n = EnvRun(env, 1);
+		std::chrono::duration<double> d = ProfileClock::now() - t;
+		if (n == 0) {
+			break;
+		}
+		fired += n;
+		add_sample(rules_[rule], d.count());
+		if (EnvGetHaltExecution(env)) {
+			break;
+		}
+	}
+	std::chrono::duration<double> d = ProfileClock::now() - start;
+
+	add_sample(runs_, d.count());
+	const std::vector<double> &bounds = histogram_bounds();
+	histogram_[std::lower_bound(bounds.begin(), bounds.end(), d.count()) - bounds.begin()] += 1;
+
+	// scanning all deffunctions is not part of the measured run
+	update_functions();
+	return fired;
+}
+
+/** Attribute deffunction calls since the last update. */
+void
+ClipsProfiler::update_functions()
+{
+	void *env = env_->cobj();
+	for (void *df = EnvGetNextDeffunction(env, NULL); df != NULL;
+	     df       = EnvGetNextDeffunction(env, df)) {
+		struct constructHeader      *header = static_cast<struct constructHeader *>(df);
+		struct constructProfileInfo *info   = static_cast<struct constructProfileInfo *>(
+		  TestUserData(ProfileFunctionData(env)->ProfileDataID, header->usrData));
+		if (!info) {
+			continue;
+		}
+		FunctionCounters &last  = function_counters_[df];
+		long              calls = info->numberOfEntries - last.calls;
+		if (calls > 0) {
+			add_sample(functions_[EnvGetDeffunctionName(env, df)],
+			           info->totalWithChildrenTime - last.time,
+			           calls);
+		}
+		last.calls = info->numberOfEntries;
+		last.time  = info->totalWithChildrenTime;
+	}
+}
+
+/** Reset all statistics. */
+void
+ClipsProfiler::reset()
+{
+	rules_.clear();
+	functions_.clear();
+	runs_ = Stats();
+	std::fill(histogram_.begin(), histogram_.end(), 0);
+}
+
+static void
+write_stats(std::ostream                                      &out,
+            const std::map<std::string, ClipsProfiler::Stats> &stats,
+            const char                                        *max_label)
+{
+	std::vector<std::pair<std::string, ClipsProfiler::Stats>> sorted(stats.begin(), stats.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+		return a.second.total > b.second.total;
+	});
+
+	char line[256];
+	snprintf(line,
+	         sizeof(line),
+	         "%-56s %10s %12s %10s %14s\n",
+	         "Name",
+	         "Count",
+	         "Total [ms]",
+	         "Mean [ms]",
+	         max_label);
+	out << line;
+	for (const auto &s : sorted) {
+		snprintf(line,
+		         sizeof(line),
+		         "%-56s %10llu %12.3f %10.4f %14.4f\n",
+		         s.first.c_str(),
+		         (unsigned long long)s.second.count,
+		         s.second.total * 1000.,
+		         s.second.count > 0 ? s.second.total * 1000. / s.second.count : 0.,
+		         s.second.max * 1000.);
+		out << line;
+	}
+}
+
+/** Write a human readable report.
+ * @param out stream to write to
+ */
+void
+ClipsProfiler::write_report(std::ostream &out) const
+{
+	char line[256];
+	snprintf(line,
+	         sizeof(line),
+	         "Engine runs: %llu, total %.3f ms, mean %.4f ms, max %.4f ms\n",
+	         (unsigned long long)runs_.count,
+	         runs_.total * 1000.,
+	         runs_.count > 0 ? runs_.total * 1000. / runs_.count : 0.,
+	         runs_.max * 1000.);
+	out << line << "\nRun time histogram\n";
+
+	const std::vector<double> &bounds = histogram_bounds();
+	for (size_t i = 0; i < histogram_.size(); ++i) {
+		if (i < bounds.size()) {
+			snprintf(line, sizeof(line), "  <= %8.1f ms", bounds[i] * 1000.);
+		} else {
+			snprintf(line, sizeof(line), "   > %8.1f ms", bounds.back() * 1000.);
+		}
+		out << line << "  " << histogram_[i] << "\n";
+	}
+
+	out << "\nRules\n";
+	write_stats(out, rules_, "Max [ms]");
+	out << "\nDeffunctions\n";
+	write_stats(out, functions_, "Max mean [ms]");
+}
+
+} // end of namespace rcll
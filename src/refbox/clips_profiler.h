@@ -0,0 +1,114 @@
+
+/***************************************************************************
+ *  clips_profiler.h - LLSF RefBox CLIPS rule and function profiler
+ *
+ *  Created: Sun Oct 18 20:31:17 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LLSF_REFBOX_CLIPS_PROFILER_H_
+#define __LLSF_REFBOX_CLIPS_PROFILER_H_
+
+#include <clipsmm.h>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+class ClipsProfiler
+{
+public:
+	/** Execution statistics of a rule, a function, or the engine runs. */
+	struct Stats
+	{
+		uint64_t count = 0;  ///< number of firings, calls, or runs
+		double   total = 0.; ///< cumulative time in seconds
+		double   max   = 0.; ///< maximum time in seconds
+	};
+
+	ClipsProfiler(CLIPS::Environment *env);
+	~ClipsProfiler();
+
+	long run();
+	void reset();
+	void write_report(std::ostream &out) const;
+
+	/** Get statistics per defrule.
+	 * @return rule name to statistics map */
+	const std::map<std::string, Stats> &
+	rules() const
+	{
+		return rules_;
+	}
+
+	/** Get statistics per deffunction.
+	 * CLIPS only provides cumulative times, therefore the maximum is not that
+	 * of a single call, but the largest mean call duration within an engine run.
+	 * @return deffunction name to statistics map */
+	const std::map<std::string, Stats> &
+	functions() const
+	{
+		return functions_;
+	}
+
+	/** Get statistics of the engine runs.
+	 * @return statistics of all calls to run() */
+	const Stats &
+	runs() const
+	{
+		return runs_;
+	}
+
+	/** Get histogram of run durations.
+	 * Bucket i counts runs not longer than histogram_bounds()[i], the last
+	 * bucket counts all longer runs.
+	 * @return number of runs per bucket */
+	const std::vector<uint64_t> &
+	run_histogram() const
+	{
+		return histogram_;
+	}
+
+	static const std::vector<double> &histogram_bounds();
+
+private:
+	void update_functions();
+
+	/** Profiling counters of a deffunction at the last update. */
+	struct FunctionCounters
+	{
+		long   calls;
+		double time;
+	};
+
+	CLIPS::Environment                *env_;
+	std::map<std::string, Stats>       rules_;
+	std::map<std::string, Stats>       functions_;
+	std::map<void *, FunctionCounters> function_counters_;
+	Stats                              runs_;
+	std::vector<uint64_t>              histogram_;
+};
+
+} // end of namespace rcll
+
+#endif
@@ -0,0 +1,224 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  history_store.cpp - LLSF RefBox storage for finished history records
+ *
+ *  Created: Sun Oct 18 23:41:27 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "history_store.h"
+
+#include <core/exception.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+/** @class HistoryStore "history_store.h"
+ * Append-only storage for history records that are no longer needed by the
+ * game rules, e.g., superseded machine or robot states.
+ * Keeping them as facts would make every pattern match and fact query on
+ * the history templates slower the longer the game runs. Instead, the rules
+ * hand over the serialized record and retract the fact, and the report
+ * generation reads the records back.
+ * Record data is kept in memory up to a limit. Beyond that, all records in
+ * memory are appended to a spill file and only their index remains in
+ * memory. Without spill file, all records are kept in memory.
+ */
+
+/** Constructor.
+ * @param max_memory maximum number of bytes of record data to keep in memory
+ * @param spill_file file to spill records to, an existing file is replaced,
+ * empty to keep all records in memory
+ */
+HistoryStore::HistoryStore(size_t max_memory, const std::string &spill_file)
+: num_records_(0), max_memory_(max_memory), memory_(0), spill_filename_(spill_file), spill_size_(0)
+{
+}
+
+/** Destructor.
+ * Removes the spill file. */
+HistoryStore::~HistoryStore()
+{
+	clear();
+}
+
+/** Append a record.
+ * @param kind kind of the record, e.g., machine_history
+ * @param time time of the record, used to order records of the same kind
+ * @param data serialized record
+ * @param size size of data in bytes
+ * @exception Exception thrown if the spill file cannot be written
+ */
+void
+HistoryStore::append(const std::string &kind, int64_t time, const char *data, size_t size)
+{
+	records_[kind].push_back(Record{time, std::string(data, size), 0, (uint32_t)size, false});
+	num_records_ += 1;
+	memory_ += size;
+	if (!spill_filename_.empty() && memory_ > max_memory_) {
+		spill();
+	}
+}
+
+/** Get records of a kind.
+ * @param kind kind of records to get
+ * @param records upon return contains the records ordered by time, records
+ * of the same time in the order they were appended
+ * @param from number of records to skip in the order they were appended,
+ * e.g., the count() at the time of the last call to get only new records
+ * @param times if not NULL, upon return contains the time of each record
+ * @exception Exception thrown if the spill file cannot be read
+ */
+void
+HistoryStore::get(const std::string        &kind,
+                  std::vector<std::string> &records,
+                  size_t                    from,
+                  std::vector<int64_t>     *times)
+{
+	records.clear();
+	if (times) {
+		times->clear();
+	}
+	auto k = records_.find(kind);
+	if (k == records_.end() || from >= k->second.size()) {
+		return;
+	}
+
+	std::vector<const Record *> sorted;
+	sorted.reserve(k->second.size() - from);
+	for (size_t i = from; i < k->second.size(); ++i) {
+		sorted.push_back(&k->second[i]);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Record *a, const Record *b) {
+		return a->time < b->time;
+	});
+
+	records.reserve(sorted.size());
+	for (const Record *r : sorted) {
+		if (times) {
+			times->push_back(r->time);
+		}
+		if (!r->spilled) {
+			records.push_back(r->data);
+			continue;
+		}
+		std::string data(r->size, '\0');
+		spill_.seekg(r->offset);
+		spill_.read(&data[0], data.size());
+		if (!spill_) {
+			spill_.clear();
+			throw fawkes::Exception("Failed to read history record from %s", spill_filename_.c_str());
+		}
+		records.push_back(std::move(data));
+	}
+}
+
+/** Get the number of records of a kind.
+ * @param kind kind of records
+ * @return number of records appended since the kind was last cleared
+ */
+size_t
+HistoryStore::count(const std::string &kind) const
+{
+	auto k = records_.find(kind);
+	return k != records_.end() ? k->second.size() : 0;
+}
+
+/** Remove all records of a kind.
+ * The space in the spill file is only reclaimed once all kinds are cleared.
+ * @param kind kind of records to remove
+ */
+void
+HistoryStore::clear(const std::string &kind)
+{
+	auto k = records_.find(kind);
+	if (k == records_.end()) {
+		return;
+	}
+	for (const Record &r : k->second) {
+		if (!r.spilled) {
+			memory_ -= r.size;
+		}
+	}
+	num_records_ -= k->second.size();
+	records_.erase(k);
+	if (records_.empty()) {
+		clear();
+	}
+}
+
+/** Remove all records, e.g., when a new game report is started.
+ * The spill file is removed, it is created again when needed. */
+void
+HistoryStore::clear()
+{
+	records_.clear();
+	num_records_ = 0;
+	memory_      = 0;
+	spill_size_  = 0;
+	if (spill_.is_open()) {
+		spill_.close();
+		std::remove(spill_filename_.c_str());
+	}
+}
+
+void
+HistoryStore::spill()
+{
+	if (!spill_.is_open()) {
+		spill_.open(spill_filename_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!spill_) {
+			throw fawkes::Exception("Failed to open history spill file %s", spill_filename_.c_str());
+		}
+	}
+
+	// write everything first, records are only dropped from memory on success
+	spill_.seekp(spill_size_);
+	for (const auto &k : records_) {
+		for (const Record &r : k.second) {
+			if (!r.spilled) {
+				spill_.write(r.data.data(), r.data.size());
+			}
+		}
+	}
+	spill_.flush();
+	if (!spill_) {
+		spill_.clear();
+		throw fawkes::Exception("Failed to write history spill file %s", spill_filename_.c_str());
+	}
+
+	for (auto &k : records_) {
+		for (Record &r : k.second) {
+			if (!r.spilled) {
+				r.offset  = spill_size_;
+				r.spilled = true;
+				spill_size_ += r.size;
+				std::string().swap(r.data);
+			}
+		}
+	}
+	memory_ = 0;
+}
+
+} // end of namespace rcll
@@ -0,0 +1,100 @@
+
+/***************************************************************************
+ *  history_store.h - LLSF RefBox storage for finished history records
+ *
+ *  Created: Sun Oct 18 23:41:27 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LLSF_REFBOX_HISTORY_STORE_H_
+#define __LLSF_REFBOX_HISTORY_STORE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+class HistoryStore
+{
+public:
+	HistoryStore(size_t max_memory, const std::string &spill_file = "");
+	~HistoryStore();
+
+	void append(const std::string &kind, int64_t time, const char *data, size_t size);
+	void   get(const std::string        &kind,
+	           std::vector<std::string> &records,
+	           size_t                    from  = 0,
+	           std::vector<int64_t>     *times = NULL);
+	size_t count(const std::string &kind) const;
+	void   clear(const std::string &kind);
+	void   clear();
+
+	/** Get the number of stored records.
+	 * @return number of records of all kinds */
+	size_t
+	num_records() const
+	{
+		return num_records_;
+	}
+
+	/** Get the number of bytes of record data held in memory.
+	 * @return bytes in memory */
+	size_t
+	memory_usage() const
+	{
+		return memory_;
+	}
+
+	/** Get the number of bytes spilled to disk.
+	 * @return bytes in the spill file */
+	uint64_t
+	spilled() const
+	{
+		return spill_size_;
+	}
+
+private:
+	/** Single record, its data is either in memory or in the spill file. */
+	struct Record
+	{
+		int64_t     time;
+		std::string data;
+		uint64_t    offset;
+		uint32_t    size;
+		bool        spilled;
+	};
+
+	void spill();
+
+	std::map<std::string, std::vector<Record>> records_;
+	size_t                                     num_records_;
+	size_t                                     max_memory_;
+	size_t                                     memory_;
+	std::string                                spill_filename_;
+	std::fstream                               spill_;
+	uint64_t                                   spill_size_;
+};
+
+} // end of namespace rcll
+
+#endif
@@ -0,0 +1,318 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  input_log.cpp - LLSF RefBox record and replay of rule engine inputs
+ *
+ *  Created: Sun Oct 18 22:48:06 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#include "input_log.h"
+
+#include <core/exception.h>
+
+#include <cstring>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+/* File format, all numbers in host byte order:
+ *   header:  8 byte magic, int64 start time [usec], uint64 seed
+ *   record:  uint8 type, int64 time [usec], uint32 payload size, payload
+ * Payload by type:
+ *   TICK:    empty
+ *   FACT:    fact
+ *   EVAL:    expression
+ *   MESSAGE: uint8 client type, int64 client ID, uint16 component ID,
+ *            uint16 message type, uint16 port, string host,
+ *            string type name, serialized message until the end
+ *   CALL:    string function name, uint32 number of values, values as
+ *            uint8 CLIPS type followed by int64, double, or string
+ * Strings are stored as uint32 length followed by the characters.
+ */
+
+static const char   MAGIC[8]    = {'R', 'C', 'L', 'L', 'I', 'N', 'P', 1};
+static const size_t RECORD_HEAD = sizeof(uint8_t) + sizeof(int64_t) + sizeof(uint32_t);
+
+template <typename T>
+static void
+put(std::string &buf, T v)
+{
+	buf.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+static void
+put_string(std::string &buf, const std::string &s)
+{
+	put<uint32_t>(buf, s.size());
+	buf.append(s);
+}
+
+template <typename T>
+static T
+get(const std::string &buf, size_t &pos)
+{
+	if (pos + sizeof(T) > buf.size()) {
+		throw fawkes::Exception("Malformed input log record");
+	}
+	T v;
+	memcpy(&v, buf.data() + pos, sizeof(T));
+	pos += sizeof(T);
+	return v;
+}
+
+static std::string
+get_string(const std::string &buf, size_t &pos)
+{
+	uint32_t size = get<uint32_t>(buf, pos);
+	if (pos + size > buf.size()) {
+		throw fawkes::Exception("Malformed input log record");
+	}
+	std::string s = buf.substr(pos, size);
+	pos += size;
+	return s;
+}
+
+static int64_t
+to_usec(fawkes::VirtualClock::time_point t)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+static fawkes::VirtualClock::time_point
+from_usec(int64_t usec)
+{
+	return fawkes::VirtualClock::time_point(
+	  std::chrono::duration_cast<fawkes::VirtualClock::duration>(std::chrono::microseconds(usec)));
+}
+
+/** @class InputLogWriter "input_log.h"
+ * Append-only log of all inputs of the rule engine.
+ * Together with the configuration and the CLIPS files, the recorded inputs
+ * determine the course of a game, which can thus be replayed offline, e.g.,
+ * to profile a game that caused tick overruns.
+ * Records are buffered and written to disk at each tick, a log of a refbox
+ * that was killed ends with the last complete tick.
+ */
+
+/** Constructor.
+ * @param filename file to write to, an existing file is replaced
+ * @param start clock time at the start of the game
+ * @param seed seed of the random number generator of the rule engine
+ * @exception Exception thrown if the file cannot be opened
+ */
+InputLogWriter::InputLogWriter(const std::string               &filename,
+                               fawkes::VirtualClock::time_point start,
+                               uint64_t                         seed)
+: out_(filename, std::ios::binary | std::ios::trunc), seed_(seed), num_records_(0)
+{
+	if (!out_) {
+		throw fawkes::Exception("Failed to open input log %s", filename.c_str());
+	}
+	std::string header(MAGIC, sizeof(MAGIC));
+	put<int64_t>(header, to_usec(start));
+	put<uint64_t>(header, seed);
+	out_.write(header.data(), header.size());
+	out_.flush();
+}
+
+/** Append a record.
+ * @param record record to write
+ * @exception Exception thrown if a call result contains a value that
+ * cannot be recorded
+ */
+void
+InputLogWriter::write(const InputLogRecord &record)
+{
+	buf_.clear();
+	put<uint8_t>(buf_, record.type);
+	put<int64_t>(buf_, to_usec(record.time));
+	put<uint32_t>(buf_, 0);
+
+	switch (record.type) {
+	case InputLogRecord::TICK: break;
+	case InputLogRecord::FACT:
+	case InputLogRecord::EVAL: buf_.append(record.text); break;
+	case InputLogRecord::MESSAGE:
+		put<uint8_t>(buf_, record.client_type);
+		put<int64_t>(buf_, record.client_id);
+		put<uint16_t>(buf_, record.comp_id);
+		put<uint16_t>(buf_, record.msg_type);
+		put<uint16_t>(buf_, record.port);
+		put_string(buf_, record.host);
+		put_string(buf_, record.text);
+		buf_.append(record.data);
+		break;
+	case InputLogRecord::CALL:
+		put_string(buf_, record.text);
+		put<uint32_t>(buf_, record.values.size());
+		for (const CLIPS::Value &v : record.values) {
+			put<uint8_t>(buf_, v.type());
+			switch (v.type()) {
+			case CLIPS::TYPE_INTEGER: put<int64_t>(buf_, v.as_integer()); break;
+			case CLIPS::TYPE_FLOAT: put<double>(buf_, v.as_float()); break;
+			case CLIPS::TYPE_SYMBOL:
+			case CLIPS::TYPE_STRING:
+			case CLIPS::TYPE_INSTANCE_NAME: put_string(buf_, v.as_string()); break;
+			default:
+				throw fawkes::Exception("Cannot record value of type %i returned by %s",
+				                        v.type(),
+				                        record.text.c_str());
+			}
+		}
+		break;
+	}
+
+	uint32_t size = buf_.size() - RECORD_HEAD;
+	memcpy(&buf_[RECORD_HEAD - sizeof(uint32_t)], &size, sizeof(size));
+	out_.write(buf_.data(), buf_.size());
+	if (record.type == InputLogRecord::TICK) {
+		out_.flush();
+	}
+	num_records_ += 1;
+}
+
+/** @class InputLogReader "input_log.h"
+ * Reader for logs written by InputLogWriter.
+ */
+
+/** Constructor.
+ * @param filename file to read
+ * @exception Exception thrown if the file cannot be opened or is no input log
+ */
+InputLogReader::InputLogReader(const std::string &filename)
+: in_(filename, std::ios::binary), truncated_(false), has_peeked_(false)
+{
+	if (!in_) {
+		throw fawkes::Exception("Failed to open input log %s", filename.c_str());
+	}
+	std::string header(sizeof(MAGIC) + sizeof(int64_t) + sizeof(uint64_t), '\0');
+	in_.read(&header[0], header.size());
+	if ((size_t)in_.gcount() != header.size() || memcmp(header.data(), MAGIC, sizeof(MAGIC)) != 0) {
+		throw fawkes::Exception("%s is not an input log", filename.c_str());
+	}
+	size_t pos = sizeof(MAGIC);
+	start_     = from_usec(get<int64_t>(header, pos));
+	seed_      = get<uint64_t>(header, pos);
+}
+
+/** Read the next record.
+ * @param record upon return contains the next record
+ * @return true if a record was read, false at the end of the log
+ * @exception Exception thrown if the record is malformed
+ */
+bool
+InputLogReader::next(InputLogRecord &record)
+{
+	if (has_peeked_) {
+		has_peeked_ = false;
+		record      = std::move(peeked_);
+		return true;
+	}
+	return read(record);
+}
+
+/** Read the result of a function call.
+ * Functions with external state, e.g., the machine placing generator, are
+ * called while the rule engine runs. Their results are recorded and taken
+ * from the log instead of calling them when replaying.
+ * @param name name of the called function
+ * @param values upon return contains the recorded result
+ * @return true if the next record is the result of the given function,
+ * false otherwise, i.e., the replay diverged from the recorded game
+ */
+bool
+InputLogReader::next_call(const std::string &name, CLIPS::Values &values)
+{
+	if (!has_peeked_) {
+		has_peeked_ = read(peeked_);
+	}
+	if (!has_peeked_ || peeked_.type != InputLogRecord::CALL || peeked_.text != name) {
+		return false;
+	}
+	has_peeked_ = false;
+	values      = std::move(peeked_.values);
+	return true;
+}
+
+bool
+InputLogReader::read(InputLogRecord &record)
+{
+	std::string head(RECORD_HEAD, '\0');
+	in_.read(&head[0], head.size());
+	if (in_.gcount() == 0) {
+		return false;
+	}
+	if ((size_t)in_.gcount() != head.size()) {
+		truncated_ = true;
+		return false;
+	}
+	size_t pos  = 0;
+	record.type = (InputLogRecord::Type)get<uint8_t>(head, pos);
+	record.time = from_usec(get<int64_t>(head, pos));
+
+	std::string buf(get<uint32_t>(head, pos), '\0');
+	in_.read(&buf[0], buf.size());
+	if ((size_t)in_.gcount() != buf.size()) {
+		truncated_ = true;
+		return false;
+	}
+
+	pos = 0;
+	switch (record.type) {
+	case InputLogRecord::TICK: break;
+	case InputLogRecord::FACT:
+	case InputLogRecord::EVAL: record.text = std::move(buf); break;
+	case InputLogRecord::MESSAGE:
+		record.client_type = get<uint8_t>(buf, pos);
+		record.client_id   = get<int64_t>(buf, pos);
+		record.comp_id     = get<uint16_t>(buf, pos);
+		record.msg_type    = get<uint16_t>(buf, pos);
+		record.port        = get<uint16_t>(buf, pos);
+		record.host        = get_string(buf, pos);
+		record.text        = get_string(buf, pos);
+		record.data        = buf.substr(pos);
+		break;
+	case InputLogRecord::CALL: {
+		record.text = get_string(buf, pos);
+		record.values.clear();
+		uint32_t n = get<uint32_t>(buf, pos);
+		for (uint32_t i = 0; i < n; ++i) {
+			CLIPS::Type type = (CLIPS::Type)get<uint8_t>(buf, pos);
+			switch (type) {
+			case CLIPS::TYPE_INTEGER:
+				record.values.push_back(CLIPS::Value((long int)get<int64_t>(buf, pos)));
+				break;
+			case CLIPS::TYPE_FLOAT: record.values.push_back(CLIPS::Value(get<double>(buf, pos))); break;
+			case CLIPS::TYPE_SYMBOL:
+			case CLIPS::TYPE_STRING:
+			case CLIPS::TYPE_INSTANCE_NAME:
+				record.values.push_back(CLIPS::Value(get_string(buf, pos), type));
+				break;
+			default: throw fawkes::Exception("Malformed input log record");
+			}
+		}
+	} break;
+	default: throw fawkes::Exception("Unknown input log record type %i", record.type);
+	}
+	return true;
+}
+
+} // end of namespace rcll
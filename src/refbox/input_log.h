@@ -0,0 +1,144 @@
+
+/***************************************************************************
+ *  input_log.h - LLSF RefBox record and replay of rule engine inputs
+ *
+ *  Created: Sun Oct 18 22:48:06 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+#ifndef __LLSF_REFBOX_INPUT_LOG_H_
+#define __LLSF_REFBOX_INPUT_LOG_H_
+
+#include <utils/time/virtual_clock.h>
+
+#include <clipsmm.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace rcll {
+#if 0 /* just to make Emacs auto-indent happy */
+}
+#endif
+
+/** Single input of the rule engine. */
+struct InputLogRecord
+{
+	/** Kind of input. */
+	typedef enum {
+		TICK    = 1, ///< current time asserted and rule engine run
+		FACT    = 2, ///< fact asserted for an event, e.g., MPS feedback
+		EVAL    = 3, ///< expression evaluated for an event
+		MESSAGE = 4, ///< received protobuf message
+		CALL    = 5  ///< result of a function with external state
+	} Type;
+
+	Type                             type; ///< kind of input
+	fawkes::VirtualClock::time_point time; ///< time of the input
+	/** Fact, expression, function name, or message type name. */
+	std::string text;
+
+	uint8_t        client_type; ///< message: kind of sender
+	int64_t        client_id;   ///< message: server client or peer ID
+	uint16_t       comp_id;     ///< message: component ID
+	uint16_t       msg_type;    ///< message: message type
+	std::string    host;        ///< message: sender host
+	unsigned short port;        ///< message: sender port
+	std::string    data;        ///< message: serialized message
+
+	CLIPS::Values values; ///< call: result of the function
+};
+
+class InputLogWriter
+{
+public:
+	InputLogWriter(const std::string               &filename,
+	               fawkes::VirtualClock::time_point start,
+	               uint64_t                         seed);
+
+	void write(const InputLogRecord &record);
+
+	/** Get number of written records.
+	 * @return number of records */
+	uint64_t
+	num_records() const
+	{
+		return num_records_;
+	}
+
+	/** Get the seed of the random number generator of the recorded game.
+	 * @return seed */
+	uint64_t
+	seed() const
+	{
+		return seed_;
+	}
+
+private:
+	std::ofstream out_;
+	std::string   buf_;
+	uint64_t      seed_;
+	uint64_t      num_records_;
+};
+
+class InputLogReader
+{
+public:
+	InputLogReader(const std::string &filename);
+
+	bool next(InputLogRecord &record);
+	bool next_call(const std::string &name, CLIPS::Values &values);
+
+	/** Get the clock time at the start of the recording.
+	 * @return start time */
+	fawkes::VirtualClock::time_point
+	start_time() const
+	{
+		return start_;
+	}
+
+	/** Get the seed of the random number generator of the recorded game.
+	 * @return seed */
+	uint64_t
+	seed() const
+	{
+		return seed_;
+	}
+
+	/** Check if the log ends with an incomplete record.
+	 * This happens if the recording refbox was killed.
+	 * @return true if the last record was incomplete */
+	bool
+	truncated() const
+	{
+		return truncated_;
+	}
+
+private:
+	bool read(InputLogRecord &record);
+
+	std::ifstream                    in_;
+	fawkes::VirtualClock::time_point start_;
+	uint64_t                         seed_;
+	bool                             truncated_;
+	bool                             has_peeked_;
+	InputLogRecord                   peeked_;
+};
+
+} // end of namespace rcll
+
+#endif
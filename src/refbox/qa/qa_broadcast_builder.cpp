@@ -0,0 +1,308 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_broadcast_builder.cpp - QA for the native builders of periodic messages
+ *
+ *  Created: Sun Oct 18 16:05:37 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+/// @cond QA
+
+#include "../broadcast_builder.h"
+
+#include <core/exception.h>
+#include <core/threading/mutex.h>
+#include <protobuf_clips/communicator.h>
+
+#include <chrono>
+#include <clipsmm.h>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace rcll;
+
+typedef std::shared_ptr<google::protobuf::Message> MessagePtr;
+
+static bool              ok      = true;
+static BroadcastBuilder *builder = NULL;
+
+// Stand-ins for the config functions of the refbox, used by the defglobals
+static const char *CONFIG_FUNCTIONS[] = {
+  "(deffunction config-get-int (?path)"
+  "  (switch ?path"
+  "    (case \"/llsfrb/game/field/width\" then (return 7))"
+  "    (case \"/llsfrb/game/field/height\" then (return 8))"
+  "    (default (return 0))))",
+  "(deffunction config-get-bool (?path) (return TRUE))"};
+
+static const char *FIXTURE[] = {
+  "(gamestate (state RUNNING) (phase PRODUCTION) (points 42 17) (teams \"Carologistics\" \"\"))",
+  "(time-info (game-time 123.25) (cont-time 130.5))",
+  "(send-mps-positions (phases SETUP))",
+
+  "(robot (number 1) (team \"Carologistics\") (team-color CYAN) (name \"R-1\")"
+  "  (host \"10.0.0.1\") (last-seen 100 250000) (pose 1.5 2.25 0.5) (pose-time 100 1000))",
+  "(robot (number 2) (team \"Carologistics\") (team-color CYAN) (name \"R-2\")"
+  "  (host \"10.0.0.2\") (last-seen 101 0) (state MAINTENANCE)"
+  "  (maintenance-start-time 110.0) (maintenance-cycles 1))",
+  "(robot (number 1) (team \"GRIPS\") (team-color MAGENTA) (name \"G-1\")"
+  "  (host \"10.0.1.1\") (last-seen 99 500))",
+  "(robot (number 3) (team \"\") (team-color nil) (name \"unknown\") (host \"10.0.2.1\")"
+  "  (last-seen 98 0))",
+
+  "(machine (name C-BS) (team CYAN) (mtype BS) (state PREPARED) (zone C_Z11) (rotation 90)"
+  "  (pose 0.5 4.5 1.57) (pose-time 10 20))",
+  "(machine (name C-CS1) (team CYAN) (mtype CS) (state PROCESSING) (zone C_Z35) (rotation 0))",
+  "(machine (name C-RS1) (team CYAN) (mtype RS) (state PREPARED) (zone C_Z44) (rotation 270))",
+  "(machine (name C-DS) (team CYAN) (mtype DS) (state PREPARED) (zone C_Z52) (rotation 180))",
+  "(machine (name C-SS) (team CYAN) (mtype SS) (state PREPARED) (zone C_Z67) (rotation 45))",
+  "(machine (name M-BS) (team MAGENTA) (mtype BS) (state IDLE))",
+  "(machine (name M-CS2) (team MAGENTA) (mtype CS) (state BROKEN) (rotation 135))",
+  "(machine (name M-RS2) (team MAGENTA) (mtype RS) (state IDLE) (zone M_Z23))",
+
+  "(machine-lights (name C-BS) (actual-lights GREEN-ON YELLOW-BLINK))",
+  "(machine-lights (name C-CS1) (actual-lights YELLOW-ON))",
+  "(machine-lights (name C-RS1))",
+  "(machine-lights (name C-DS) (actual-lights RED-BLINK))",
+  "(machine-lights (name C-SS) (actual-lights GREEN-BLINK))",
+  "(machine-lights (name M-CS2) (actual-lights RED-ON))",
+  "(machine-lights (name M-RS2) (actual-lights GREEN-ON))",
+
+  "(bs-meta (name C-BS) (current-side OUTPUT) (current-base-color BASE_RED))",
+  "(cs-meta (name C-CS1) (operation-mode MOUNT_CAP) (has-retrieved TRUE))",
+  "(cs-meta (name M-CS2) (operation-mode RETRIEVE_CAP))",
+  "(rs-meta (name C-RS1) (current-ring-color RING_GREEN) (available-colors RING_GREEN RING_YELLOW)"
+  "  (bases-added 3) (bases-used 1))",
+  "(rs-meta (name M-RS2) (current-ring-color RING_BLUE))",
+  "(ds-meta (name C-DS) (gate 2) (order-id 5))",
+  "(ss-meta (name C-SS) (current-operation RETRIEVE) (current-shelf-slot 3 1))",
+  "(machine-ss-shelf-slot (name C-SS) (position 3 1) (is-filled TRUE)"
+  "  (description \"BASE_RED CAP_GREY\"))",
+  "(machine-ss-shelf-slot (name C-SS) (position 4 2))",
+
+  "(exploration-report (rtype RECORD) (name C-CS1) (correctly-reported TRUE)"
+  "  (zone-state CORRECT_REPORT) (rotation-state WRONG_REPORT))",
+  "(exploration-report (rtype RECORD) (name M-CS2) (correctly-reported FALSE)"
+  "  (zone-state WRONG_REPORT))",
+  "(exploration-report (rtype INCOMING) (name C-RS1) (correctly-reported TRUE))",
+
+  "(ring-spec (color RING_BLUE))",
+  "(ring-spec (color RING_GREEN) (req-bases 1))",
+  "(ring-spec (color RING_YELLOW) (req-bases 2))",
+
+  "(order (id 1) (complexity C1) (base-color BASE_RED) (ring-colors RING_BLUE)"
+  "  (cap-color CAP_GREY) (quantity-delivered 1 0) (delivery-period 300 600) (delivery-gate 2)"
+  "  (active TRUE))",
+  "(order (id 2) (complexity C0) (competitive TRUE) (base-color BASE_BLACK) (cap-color CAP_BLACK)"
+  "  (quantity-requested 2) (active TRUE))",
+  "(order (id 3) (complexity C3) (base-color BASE_SILVER)"
+  "  (ring-colors RING_BLUE RING_GREEN RING_YELLOW) (cap-color CAP_BLACK))",
+  "(product-processed (id 501) (game-time 250.5) (team CYAN) (mtype DS) (order 1))",
+  "(product-processed (id 502) (game-time 260.0) (team MAGENTA) (mtype DS) (order 1))",
+  "(product-processed (id 503) (game-time 270.75) (team CYAN) (mtype DS) (order 2)"
+  "  (confirmed TRUE))",
+  "(referee-confirmation (process-id 501) (state REQUIRED))",
+  "(referee-confirmation (process-id 503) (state REQUIRED))"};
+
+static CLIPS::Value
+net_build(std::function<MessagePtr()> build)
+{
+	try {
+		return CLIPS::Value(new MessagePtr(build()));
+	} catch (fawkes::Exception &e) {
+		printf("FAILED: %s\n", e.what_no_backtrace());
+		ok = false;
+		return CLIPS::Value(new MessagePtr());
+	}
+}
+
+static CLIPS::Value
+net_build_game_state()
+{
+	return net_build([]() { return builder->game_state(); });
+}
+
+static CLIPS::Value
+net_build_robot_info(double time, std::string pub_pose)
+{
+	return net_build([time, &pub_pose]() { return builder->robot_info(time, pub_pose == "TRUE"); });
+}
+
+static CLIPS::Value
+net_build_machine_info(std::string team_color, std::string add_restricted_info)
+{
+	return net_build([&team_color, &add_restricted_info]() {
+		return builder->machine_info(team_color == "nil" ? "" : team_color,
+		                             add_restricted_info == "TRUE");
+	});
+}
+
+static CLIPS::Value
+net_build_order_info()
+{
+	return net_build([]() { return builder->order_info(); });
+}
+
+static CLIPS::Value
+net_build_ring_info()
+{
+	return net_build([]() { return builder->ring_info(); });
+}
+
+/** Evaluate an expression returning a message and serialize the message. */
+static std::string
+serialize(CLIPS::Environment &env, const std::string &expr)
+{
+	CLIPS::Values rv = env.evaluate(expr);
+	std::string   data;
+	if (rv.size() == 1 && rv[0].type() == CLIPS::TYPE_EXTERNAL_ADDRESS) {
+		MessagePtr *m = static_cast<MessagePtr *>(rv[0].as_address());
+		if (*m) {
+			(*m)->SerializePartialToString(&data);
+		}
+		delete m;
+	}
+	return data;
+}
+
+static void
+compare(CLIPS::Environment &env,
+        const std::string  &what,
+        const std::string  &rules_expr,
+        const std::string  &native_expr)
+{
+	std::string rules  = serialize(env, rules_expr);
+	std::string native = serialize(env, native_expr);
+	// a second time, from the cache
+	std::string cached = serialize(env, native_expr);
+	if (rules.empty() || rules != native || native != cached) {
+		printf("FAILED: %s differs, rules %zu bytes, native %zu bytes, cached %zu bytes\n",
+		       what.c_str(),
+		       rules.size(),
+		       native.size(),
+		       cached.size());
+		ok = false;
+	}
+}
+
+static const char *TYPES[] = {"GameState", "RobotInfo", "MachineInfo", "OrderInfo", "RingInfo"};
+
+static void
+test_parity(CLIPS::Environment &env)
+{
+	for (const char *phase : {"SETUP", "EXPLORATION", "PRODUCTION"}) {
+		env.evaluate(std::string("(do-for-fact ((?gs gamestate)) TRUE (modify ?gs (phase ") + phase
+		             + "))");
+		for (const char *type : TYPES) {
+			compare(env,
+			        std::string(type) + " in " + phase,
+			        std::string("(net-create-periodic ") + type + " FALSE)",
+			        std::string("(net-create-periodic ") + type + " TRUE)");
+		}
+		for (const char *team : {"CYAN", "MAGENTA"}) {
+			compare(env,
+			        std::string("broadcast MachineInfo ") + team + " in " + phase,
+			        std::string("(net-create-broadcast-MachineInfo ") + team + ")",
+			        std::string("(net-build-MachineInfo ") + team + " FALSE)");
+		}
+	}
+}
+
+static void
+bench(CLIPS::Environment &env, unsigned int iterations)
+{
+	builder->set_cache_enabled(false);
+	for (const char *type : TYPES) {
+		double rate[2];
+		for (int native = 0; native < 2; ++native) {
+			auto start = std::chrono::steady_clock::now();
+			env.evaluate(std::string("(net-bench-build ") + type + (native ? " TRUE " : " FALSE ")
+			             + std::to_string(iterations) + ")");
+			std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+			rate[native]                    = d.count() > 0. ? iterations / d.count() : 0.;
+		}
+		printf("%-11s native %9.0f msg/s, rules %9.0f msg/s, %5.1f times faster\n",
+		       type,
+		       rate[1],
+		       rate[0],
+		       rate[0] > 0. ? rate[1] / rate[0] : 0.);
+	}
+	builder->set_cache_enabled(true);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+	CLIPS::Environment env;
+	fawkes::Mutex      env_mutex;
+
+	std::vector<std::string>                  proto_path = {SHAREDIR "/msgs/rcll-protobuf-msgs"};
+	protobuf_clips::ClipsProtobufCommunicator pb_comm(&env, env_mutex, proto_path);
+	BroadcastBuilder                          broadcast_builder(&env);
+	builder = &broadcast_builder;
+
+	env.add_function("net-build-GameState",
+	                 sigc::slot<CLIPS::Value>(sigc::ptr_fun(&net_build_game_state)));
+	env.add_function("net-build-RobotInfo",
+	                 sigc::slot<CLIPS::Value, double, std::string>(
+	                   sigc::ptr_fun(&net_build_robot_info)));
+	env.add_function("net-build-MachineInfo",
+	                 sigc::slot<CLIPS::Value, std::string, std::string>(
+	                   sigc::ptr_fun(&net_build_machine_info)));
+	env.add_function("net-build-OrderInfo",
+	                 sigc::slot<CLIPS::Value>(sigc::ptr_fun(&net_build_order_info)));
+	env.add_function("net-build-RingInfo",
+	                 sigc::slot<CLIPS::Value>(sigc::ptr_fun(&net_build_ring_info)));
+	for (const char *function : CONFIG_FUNCTIONS) {
+		env.build(function);
+	}
+
+	// only the files needed to build messages are loaded, errors about
+	// rules referring to constructs of the other files are expected
+	for (const char *file :
+	     {"globals.clp", "facts.clp", "utils.clp", "time.clp", "priorities.clp", "net.clp"}) {
+		if (env.load(std::string(SHAREDIR "/games/rcll/") + file) == 0) {
+			printf("FAILED: cannot load %s\n", file);
+			return 1;
+		}
+	}
+	// the rule-based builders to compare with, not part of the game
+	if (env.load(QADIR "/net_reference.clp") == 0) {
+		printf("FAILED: cannot load net_reference.clp\n");
+		return 1;
+	}
+	for (const char *fact : FIXTURE) {
+		env.evaluate(std::string("(assert ") + fact + ")");
+	}
+
+	test_parity(env);
+	if (ok) {
+		bench(env, iterations);
+	}
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/// @endcond
@@ -0,0 +1,173 @@
+
+// Licensed under GPLv2. See LICENSE file. Copyright TC of the RoboCup Logistics League
+
+/***************************************************************************
+ *  qa_history_store.cpp - QA for the history record store
+ *
+ *  Created: Sun Oct 18 14:22:51 2026
+ *  Copyright  2026  TC of the RoboCup Logistics League
+ *
+ ****************************************************************************/
+
+/*  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  Read the full text in the LICENSE.GPL file in the doc directory.
+ */
+
+/// @cond QA
+
+#include "../history_store.h"
+
+#include <core/exception.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace rcll;
+
+#define RECORD_SIZE 40
+#define NUM_RECORDS 100
+#define MAX_MEMORY (5 * RECORD_SIZE)
+
+static bool ok = true;
+
+static void
+expect(bool condition, const char *what)
+{
+	if (!condition) {
+		printf("FAILED: %s\n", what);
+		ok = false;
+	}
+}
+
+static std::string
+record(int i)
+{
+	std::string data = "record " + std::to_string(i) + " ";
+	data.resize(RECORD_SIZE, '.');
+	return data;
+}
+
+static void
+append(HistoryStore &store, const std::string &kind, int64_t time, int i)
+{
+	std::string data = record(i);
+	store.append(kind, time, data.data(), data.size());
+}
+
+static void
+test_order()
+{
+	HistoryStore store(MAX_MEMORY);
+
+	// appended out of order of time, 1 and 3 share a time
+	append(store, "a", 30, 0);
+	append(store, "a", 10, 1);
+	append(store, "b", 5, 2);
+	append(store, "a", 20, 3);
+	append(store, "a", 10, 4);
+
+	std::vector<std::string> records;
+	std::vector<int64_t>     times;
+	store.get("a", records, 0, &times);
+	expect(store.count("a") == 4 && store.count("b") == 1, "count per kind");
+	expect(records == std::vector<std::string>({record(1), record(4), record(3), record(0)}),
+	       "records ordered by time, equal times in order of appending");
+	expect(times == std::vector<int64_t>({10, 10, 20, 30}), "times of the records");
+
+	store.get("a", records, 2);
+	expect(records == std::vector<std::string>({record(4), record(3)}),
+	       "from skips records in order of appending");
+	store.get("a", records, 4);
+	expect(records.empty(), "from beyond the end");
+	store.get("c", records);
+	expect(records.empty(), "unknown kind");
+
+	// without spill file, everything stays in memory
+	for (int i = 5; i < NUM_RECORDS; ++i) {
+		append(store, "a", i, i);
+	}
+	expect(store.spilled() == 0, "no spilling without spill file");
+	expect(store.memory_usage() == NUM_RECORDS * RECORD_SIZE, "all records in memory");
+}
+
+static void
+test_spill(const std::string &spill_file)
+{
+	HistoryStore store(MAX_MEMORY, spill_file);
+
+	bool bounded = true;
+	for (int i = 0; i < NUM_RECORDS; ++i) {
+		append(store, i % 2 ? "a" : "b", NUM_RECORDS - i, i);
+		bounded = bounded && store.memory_usage() <= MAX_MEMORY;
+	}
+	expect(bounded, "memory bounded by max memory");
+	expect(store.spilled() > 0, "records spilled");
+	expect(store.spilled() + store.memory_usage() == NUM_RECORDS * RECORD_SIZE,
+	       "each record either spilled or in memory");
+	expect(store.num_records() == NUM_RECORDS, "number of records");
+
+	// records come back from both, the spill file and memory, in order of time
+	std::vector<std::string> records;
+	store.get("a", records);
+	bool in_order = records.size() == NUM_RECORDS / 2;
+	for (size_t i = 0; in_order && i < records.size(); ++i) {
+		in_order = records[i] == record(NUM_RECORDS - 1 - 2 * i);
+	}
+	expect(in_order, "spilled records read back in order of time");
+
+	store.get("b", records, NUM_RECORDS / 2 - 2);
+	expect(records == std::vector<std::string>({record(NUM_RECORDS - 2), record(NUM_RECORDS - 4)}),
+	       "from on spilled records");
+
+	// clearing one kind keeps the other
+	store.clear("a");
+	store.get("b", records);
+	expect(store.count("a") == 0 && records.size() == NUM_RECORDS / 2, "clear one kind");
+	expect(store.spilled() > 0, "spill file kept while records remain");
+
+	// clearing all kinds truncates the spill file, which is then reused
+	store.clear("b");
+	expect(store.num_records() == 0 && store.memory_usage() == 0 && store.spilled() == 0,
+	       "clear all kinds");
+	expect(access(spill_file.c_str(), F_OK) != 0, "spill file removed on clear");
+	for (int i = 0; i < 2 * NUM_RECORDS; ++i) {
+		append(store, "a", i, i);
+	}
+	store.get("a", records);
+	expect(records.size() == 2 * NUM_RECORDS && records.front() == record(0)
+	         && records.back() == record(2 * NUM_RECORDS - 1),
+	       "spill file reused after clear");
+	expect(store.spilled() + store.memory_usage() == 2 * NUM_RECORDS * RECORD_SIZE,
+	       "spill file only holds the new records");
+}
+
+int
+main(int argc, char **argv)
+{
+	std::string spill_file = "/tmp/qa_history_store_" + std::to_string(getpid()) + ".bin";
+	try {
+		test_order();
+		test_spill(spill_file);
+		expect(access(spill_file.c_str(), F_OK) != 0, "spill file removed with the store");
+	} catch (fawkes::Exception &e) {
+		printf("FAILED: %s\n", e.what_no_backtrace());
+		ok = false;
+	}
+	remove(spill_file.c_str());
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/// @endcond
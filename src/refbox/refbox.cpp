@@ -40,6 +40,8 @@
 #include "refbox.h"
 
 #include "clips_logger.h"
+#include "broadcast_builder.h"
+#include "clips_profiler.h"
 #include "msgs/ProductColor.pb.h"
 
 #include <config/yaml.h>
@@ -77,9 +79,14 @@ namespace fs = boost::filesystem;
 #	include <logging/websocket.h>
 #endif
 
+#include <algorithm>
 #include <boost/bind/bind.hpp>
 #include <boost/format.hpp>
+#include <clips/clips.h>
+#include <cmath>
+#include <cstdarg>
 #include <cstdlib>
+#include <ctime>
 #include <sstream>
 
 #if __GNUC__ && __GNUC__ < 8
@@ -102,19 +109,20 @@ namespace ph = boost::placeholders;
 #	include <bsoncxx/document/value.hpp>
 #	include <bsoncxx/exception/exception.hpp>
 #	include <bsoncxx/json.hpp>
+#	include <bsoncxx/types/bson_value/view.hpp>
 #	include <mongocxx/client.hpp>
 #	include <mongocxx/exception/operation_exception.hpp>
+#	include <mongodb_log/mongodb_bulk_writer.h>
 #	include <mongodb_log/mongodb_log_logger.h>
 #	include <mongodb_log/mongodb_log_protobuf.h>
 #endif
 
+#include <netcomm/service_discovery/dummy_service_browser.h>
+#include <netcomm/service_discovery/dummy_service_publisher.h>
 #include <netcomm/utils/resolver.h>
 #ifdef HAVE_AVAHI
 #	include <netcomm/dns-sd/avahi_thread.h>
 #	include <netcomm/service_discovery/service.h>
-#else
-#	include <netcomm/service_discovery/dummy_service_browser.h>
-#	include <netcomm/service_discovery/dummy_service_publisher.h>
 #endif
 
 #include <memory>
@@ -148,6 +156,26 @@ handle_signal(int signum)
 }
 #endif
 
+/** Replace $time in a file name by the current local time.
+ * @param filename file name pattern
+ * @return file name
+ */
+static std::string
+expand_time_var(std::string filename)
+{
+	std::string time_var = "$time";
+	size_t      pos      = filename.find(time_var);
+	if (pos != std::string::npos) {
+		char      timestr[32];
+		time_t    now = time(NULL);
+		struct tm now_tm;
+		localtime_r(&now, &now_tm);
+		strftime(timestr, sizeof(timestr), "%Y-%m-%d_%H-%M-%S", &now_tm);
+		filename.replace(pos, time_var.length(), timestr);
+	}
+	return filename;
+}
+
 /** @class LLSFRefBox "refbox.h"
  * LLSF referee box main application.
  * @author Tim Niemueller
@@ -161,12 +189,62 @@ LLSFRefBox::LLSFRefBox(int argc, char **argv)
 : clips_mutex_(fawkes::Mutex::RECURSIVE), timer_(io_service_)
 {
 	read_config(argc, argv);
+	init();
 
+	std::stringstream refbox_call;
+	for (int i = 0; i < argc; ++i)
+		refbox_call << " " << argv[i];
+	logger_->log_info("RefBox", "%s (%i args)", refbox_call.str().c_str(), argc);
+}
+
+/** Constructor for embedding the refbox.
+ * The refbox does not read command line arguments, but uses the given
+ * configuration, which must not be shared with other instances. Instead of
+ * calling run(), an embedding application may drive the refbox by calling
+ * tick() and control it with evaluate().
+ * @param config configuration to use
+ */
+LLSFRefBox::LLSFRefBox(std::shared_ptr<Configuration> config)
+: config_(config), clips_mutex_(fawkes::Mutex::RECURSIVE), timer_(io_service_)
+{
+	init();
+}
+
+/** Initialize the refbox from the configuration. */
+void
+LLSFRefBox::init()
+{
 	pb_comm_ = NULL;
 
 	cfg_clips_dir_ = std::string(SHAREDIR) + "/games/rcll/";
 
 	cfg_timer_interval_ = config_->get_uint("/llsfrb/clips/timer-interval");
+	cfg_event_driven_   = config_->get_bool_or_default("/llsfrb/clips/event-driven", false);
+	cfg_max_timer_interval_ =
+	  config_->get_uint_or_default("/llsfrb/clips/max-timer-interval", cfg_timer_interval_);
+	cfg_clips_profile_file_ =
+	  config_->get_string_or_default("/llsfrb/clips/profile/file", "clips-profile_$time.log");
+	cfg_clips_profile_interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	  std::chrono::duration<float>(
+	    config_->get_float_or_default("/llsfrb/clips/profile/publish-interval", 5.)));
+
+	fawkes::VirtualClock::time_point start       = std::chrono::system_clock::now();
+	std::string                      replay_file =
+	  config_->get_string_or_default("/llsfrb/input-log/replay", "");
+	if (!replay_file.empty()) {
+		// replay as fast as possible and without network, from the recorded time on
+		replay_log_ = std::make_unique<InputLogReader>(replay_file);
+		start       = replay_log_->start_time();
+		detach_from_network(*config_);
+		config_->set_bool("/llsfrb/simulation/virtual-time/enable", true);
+		cfg_event_driven_ = false;
+	}
+	clock_ = std::make_unique<fawkes::VirtualClock>(
+	  config_->get_bool_or_default("/llsfrb/simulation/virtual-time/enable", false), start);
+	cfg_virtual_time_factor_ =
+	  config_->get_float_or_default("/llsfrb/simulation/virtual-time/real-time-factor", 0.);
+	timer_step_    = cfg_timer_interval_;
+	timer_pending_ = false;
 
 	log_level_ = Logger::LL_INFO;
 	try {
@@ -190,32 +268,62 @@ LLSFRefBox::LLSFRefBox(int argc, char **argv)
 		logger_->add_logger(new FileLogger(logfile.c_str(), log_level_));
 	} catch (fawkes::Exception &e) {
 	} // ignored, use default
+
+	if (replay_log_) {
+		logger_->log_info("RefBox", "Replaying inputs from %s", replay_file.c_str());
+	} else if (config_->get_bool_or_default("/llsfrb/input-log/enable", false)) {
+		std::string file = expand_time_var(
+		  config_->get_string_or_default("/llsfrb/input-log/file", "refbox-inputs_$time.bin"));
+		fawkes::VirtualClock::time_point now = clock_->now();
+		uint64_t                         seed =
+		  std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+		input_log_ = std::make_unique<InputLogWriter>(file, now, seed);
+		logger_->log_info("RefBox", "Recording inputs to %s", file.c_str());
+	}
+
 	clips_ = std::make_shared<CLIPS::Environment>();
 	setup_clips();
 
-	std::stringstream refbox_call;
-	for (int i = 0; i < argc; ++i)
-		refbox_call << " " << argv[i];
-	logger_->log_info("RefBox", "%s (%i args)", refbox_call.str().c_str(), argc);
+	if (clock_->enabled()) {
+		if (cfg_virtual_time_factor_ > 0.) {
+			logger_->log_info("RefBox",
+			                  "Running on virtual time, %.1f times faster than real time",
+			                  cfg_virtual_time_factor_);
+		} else {
+			logger_->log_info("RefBox", "Running on virtual time, as fast as possible");
+		}
+	}
 
 	setup_protobuf_comm();
+	setup_clips_broadcast_builder();
 
 #ifdef HAVE_WEBSOCKETS
-	//launch websocket backend and add websocket logger
-	backend_ = new websocket::Backend(logger_.get(),
-	                                  clips_,
-	                                  clips_mutex_,
-	                                  io_service_,
-	                                  config_->get_uint("/llsfrb/websocket/port"),
-	                                  config_->get_bool("/llsfrb/websocket/ws-mode"),
-	                                  config_->get_bool("/llsfrb/websocket/allow-control-all"));
-	logger_->add_logger(new WebsocketLogger(backend_->get_data(), log_level_));
+	//launch websocket backend and add websocket logger, unless detached from the network
+	backend_ = NULL;
+	if (config_->get_uint_or_default("/llsfrb/websocket/port", 0) > 0) {
+		backend_ = new websocket::Backend(
+		  logger_.get(),
+		  clips_,
+		  clips_mutex_,
+		  config_->get_uint("/llsfrb/websocket/port"),
+		  config_->get_bool("/llsfrb/websocket/ws-mode"),
+		  config_->get_bool("/llsfrb/websocket/allow-control-all"),
+		  config_->get_uint_or_default("/llsfrb/websocket/max-client-queue", 1024),
+		  config_->get_bool_or_default("/llsfrb/websocket/delta-updates", false),
+		  config_->get_float_or_default("/llsfrb/websocket/max-update-rate", 0.));
+		logger_->add_logger(new WebsocketLogger(backend_->get_data(), log_level_));
+	}
 #endif
 	mps_placing_generator_ = std::shared_ptr<mps_placing_clips::MPSPlacingGenerator>(
 	  new mps_placing_clips::MPSPlacingGenerator(clips_.get(), clips_mutex_));
+	if (input_log_ || replay_log_) {
+		setup_clips_input_log();
+	}
 
 #ifdef HAVE_WEBSOCKETS
-	setup_clips_websocket();
+	if (backend_) {
+		setup_clips_websocket();
+	}
 #endif
 
 #ifdef HAVE_MONGODB
@@ -234,17 +342,49 @@ LLSFRefBox::LLSFRefBox(int argc, char **argv)
 
 		clips_logger_->add_logger(new MongoDBLogLogger(cfg_mongodb_hostport_, mdb_clips_log));
 
-		mongodb_protobuf_ = std::make_unique<MongoDBLogProtobuf>(cfg_mongodb_hostport_, mdb_protobuf);
+		unsigned int pb_buffer_size =
+		  config_->get_uint_or_default("/llsfrb/mongodb/protobuf-log/buffer-size", 4096);
+		unsigned int pb_batch_size =
+		  config_->get_uint_or_default("/llsfrb/mongodb/protobuf-log/batch-size", 256);
+		MongoDBLogProtobuf::OverflowPolicy pb_policy = MongoDBLogProtobuf::DROP_OLDEST;
+		try {
+			pb_policy = MongoDBLogProtobuf::parse_overflow_policy(
+			  config_->get_string_or_default("/llsfrb/mongodb/protobuf-log/overflow-policy",
+			                                 "drop-oldest"));
+		} catch (fawkes::Exception &e) {
+			logger_->log_warn("MongoDB", "%s, using drop-oldest", e.what_no_backtrace());
+		}
+		mongodb_protobuf_ = std::make_unique<MongoDBLogProtobuf>(
+		  cfg_mongodb_hostport_, mdb_protobuf, pb_buffer_size, pb_batch_size, pb_policy);
 
 		client_   = mongocxx::client{mongocxx::uri{"mongodb://" + cfg_mongodb_hostport_}};
 		database_ = client_["rcll"];
 
+		unsigned int write_queue_size =
+		  config_->get_uint_or_default("/llsfrb/mongodb/write-queue/max-size", 4096);
+		unsigned int write_batch_size =
+		  config_->get_uint_or_default("/llsfrb/mongodb/write-queue/batch-size", 512);
+		mongodb_writer_ = std::make_unique<MongoDBBulkWriter>(
+		  cfg_mongodb_hostport_, "rcll", logger_.get(), write_queue_size, write_batch_size);
+
+		// a relative spill file is placed in the temporary directory, not the working directory
+		std::string spill_file = expand_time_var(
+		  config_->get_string_or_default("/llsfrb/mongodb/history-store/spill-file", ""));
+		if (!spill_file.empty() && stdfs::path(spill_file).is_relative()) {
+			spill_file = (stdfs::temp_directory_path() / spill_file).string();
+		}
+		history_store_ = std::make_unique<HistoryStore>(
+		  config_->get_uint_or_default("/llsfrb/mongodb/history-store/max-memory", 4096) * 1024,
+		  spill_file);
+
 		setup_clips_mongodb();
 
-		pb_comm_->server()->signal_received().connect(
-		  boost::bind(&LLSFRefBox::handle_server_client_msg, this, ph::_1, ph::_2, ph::_3, ph::_4));
-		pb_comm_->server()->signal_receive_failed().connect(
-		  boost::bind(&LLSFRefBox::handle_server_client_fail, this, ph::_1, ph::_2, ph::_3, ph::_4));
+		if (pb_comm_->server()) {
+			pb_comm_->server()->signal_received().connect(
+			  boost::bind(&LLSFRefBox::handle_server_client_msg, this, ph::_1, ph::_2, ph::_3, ph::_4));
+			pb_comm_->server()->signal_receive_failed().connect(
+			  boost::bind(&LLSFRefBox::handle_server_client_fail, this, ph::_1, ph::_2, ph::_3, ph::_4));
+		}
 
 		pb_comm_->signal_server_sent().connect(
 		  boost::bind(&LLSFRefBox::handle_server_sent_msg, this, ph::_1, ph::_2));
@@ -272,23 +412,27 @@ LLSFRefBox::LLSFRefBox(int argc, char **argv)
 	std::shared_ptr<fawkes::ServiceBrowser>      service_browser;
 	std::unique_ptr<fawkes::NetworkNameResolver> nnresolver;
 
-#ifdef HAVE_AVAHI
 	unsigned int refbox_port = config_->get_uint("/llsfrb/comm/server-port");
-	avahi_thread_            = std::make_shared<AvahiThread>();
-	service_publisher        = avahi_thread_;
-	service_browser          = avahi_thread_;
-	avahi_thread_->start();
-	nnresolver      = std::make_unique<fawkes::NetworkNameResolver>(avahi_thread_.get());
-	refbox_service_ = std::make_unique<fawkes::NetworkService>(nnresolver.get(),
-	                                                           "RefBox on %h",
-	                                                           "_refbox._tcp",
-	                                                           refbox_port);
-	avahi_thread_->publish_service(refbox_service_.get());
-#else
-	service_publisher = std::make_unique<fawkes::DummyServicePublisher>();
-	service_browser   = std::make_unique<fawkes::DummyServiceBrowser>();
-	nnresolver        = std::make_unique<fawkes::NetworkNameResolver>();
+#ifdef HAVE_AVAHI
+	// without server, e.g., when detached from the network, there is nothing to publish
+	if (refbox_port > 0) {
+		avahi_thread_     = std::make_shared<AvahiThread>();
+		service_publisher = avahi_thread_;
+		service_browser   = avahi_thread_;
+		avahi_thread_->start();
+		nnresolver      = std::make_unique<fawkes::NetworkNameResolver>(avahi_thread_.get());
+		refbox_service_ = std::make_unique<fawkes::NetworkService>(nnresolver.get(),
+		                                                           "RefBox on %h",
+		                                                           "_refbox._tcp",
+		                                                           refbox_port);
+		avahi_thread_->publish_service(refbox_service_.get());
+	}
 #endif
+	if (!service_publisher) {
+		service_publisher = std::make_unique<fawkes::DummyServicePublisher>();
+		service_browser   = std::make_unique<fawkes::DummyServiceBrowser>();
+		nnresolver        = std::make_unique<fawkes::NetworkNameResolver>();
+	}
 
 	// gather all yaml files that one could choose from
 	std::vector<std::string> all_yaml_files;
@@ -315,55 +459,159 @@ LLSFRefBox::~LLSFRefBox()
 	timer_.cancel();
 
 #ifdef HAVE_AVAHI
-	avahi_thread_->cancel();
-	avahi_thread_->join();
+	if (avahi_thread_) {
+		avahi_thread_->cancel();
+		avahi_thread_->join();
+	}
 #endif
 
 	//std::lock_guard<std::recursive_mutex> lock(clips_mutex_);
 	{
 		fawkes::MutexLocker lock(&clips_mutex_);
+		pb_comm_->process_inbound_events();
 		clips_->assert_fact("(finalize)");
 		clips_->refresh_agenda();
 		clips_->run();
 
+		clips_profile_dump();
+		clips_profiler_.reset();
 		finalize_clips_logger(clips_->cobj());
 	}
+	{
+		ClipsProtobufCommunicator::InboundStats s = pb_comm_->inbound_stats();
+		logger_->log_info("RefBox",
+		                  "Inbound events: %llu processed, max queue %zu, max latency %lld us, "
+		                  "%zu messages live (max %zu)",
+		                  (unsigned long long)s.processed,
+		                  s.max_queue_depth,
+		                  (long long)s.max_latency.count(),
+		                  s.live_messages,
+		                  s.max_live_messages);
+	}
+	if (input_log_) {
+		logger_->log_info("RefBox",
+		                  "Input log: %llu records",
+		                  (unsigned long long)input_log_->num_records());
+		input_log_.reset();
+	}
 	mps_placing_generator_.reset();
+#ifdef HAVE_MONGODB
+	if (mongodb_writer_) {
+		// write all pending operations, e.g., the game report, before taking the stats
+		mongodb_writer_->close();
+		MongoDBBulkWriter::Stats s = mongodb_writer_->stats();
+		mongodb_writer_.reset();
+		logger_->log_info("MongoDB",
+		                  "Writer: %llu ops in %llu batches, %llu written, %llu failed, "
+		                  "%llu dropped, max queue %zu, max latency %lld us, %llu producer waits",
+		                  (unsigned long long)s.enqueued,
+		                  (unsigned long long)s.batches,
+		                  (unsigned long long)s.written,
+		                  (unsigned long long)s.failed,
+		                  (unsigned long long)s.dropped,
+		                  s.max_queue_depth,
+		                  (long long)s.max_latency.count(),
+		                  (unsigned long long)s.producer_waits);
+	}
+	if (history_store_) {
+		logger_->log_info("MongoDB",
+		                  "History store: %zu records, %zu bytes in memory, %llu bytes spilled",
+		                  history_store_->num_records(),
+		                  history_store_->memory_usage(),
+		                  (unsigned long long)history_store_->spilled());
+		history_store_.reset();
+	}
+	if (mongodb_protobuf_) {
+		// write all buffered messages before taking the stats
+		mongodb_protobuf_->close();
+		MongoDBLogProtobuf::Stats s = mongodb_protobuf_->stats();
+		mongodb_protobuf_.reset();
+		logger_->log_info("MongoDB",
+		                  "Protobuf log: %llu captured, %llu written, %llu dropped, %llu failed, "
+		                  "max buffered %zu, %llu producer waits",
+		                  (unsigned long long)s.captured,
+		                  (unsigned long long)s.written,
+		                  (unsigned long long)s.dropped,
+		                  (unsigned long long)s.failed,
+		                  s.max_depth,
+		                  (unsigned long long)s.blocked);
+	}
+#endif
 #ifdef HAVE_WEBSOCKETS
 	delete backend_;
 #endif
+	// the communicator removes its functions and message tracker from the
+	// environment, destroy it first
+	pb_comm_.reset();
 	logger_.reset();
 	clips_logger_.reset();
 	config_.reset();
 	clips_.reset();
 	mps_.clear();
-	pb_comm_.reset();
 
 	// Delete all global objects allocated by libprotobuf
 }
 
-/** Read yaml configurations based on given command line options.
- * @param argc number of arguments passed
- * @param argv array of arguments
+/** Get the default configuration files.
+ * Each folder of the configuration directory holds a default file, which
+ * can be replaced by a command line option named after the folder.
+ * @return map from command line option, e.g., cfg-mps, to default file
  */
-void
-LLSFRefBox::read_config(int argc, char **argv)
+std::map<std::string, std::string>
+LLSFRefBox::default_config_files()
 {
-	// key: cfg option, value: path to file
-	std::map<std::string, std::string> cfg_files_to_include;
-	std::vector<std::string>           gen_options_str;
-	// collect folders and default files
+	std::map<std::string, std::string> cfg_files;
 	for (auto &p : fs::directory_iterator(CONFDIR)) {
 		if (fs::is_directory(p.status())) {
 			std::string cfg_opt = "cfg-" + p.path().filename().string();
 			std::string default_cfg =
 			  p.path().string() + "/default_" + p.path().filename().string() + ".yaml";
 			if (fs::exists(fs::path(default_cfg))) {
-				cfg_files_to_include[cfg_opt] = default_cfg;
-				gen_options_str.push_back(cfg_opt);
+				cfg_files[cfg_opt] = default_cfg;
 			}
 		}
 	}
+	return cfg_files;
+}
+
+/** Detach a refbox configuration from the network.
+ * Disables the controller server, all peers, and the websocket backend by
+ * setting their ports to zero, e.g., to run several games in one process or
+ * to replay a game. Without server, the refbox is not published via Avahi.
+ * @param config configuration to modify
+ */
+void
+LLSFRefBox::detach_from_network(Configuration &config)
+{
+	std::vector<std::string>                      port_paths;
+	std::shared_ptr<Configuration::ValueIterator> v(config.search("/llsfrb/comm/"));
+	while (v->next()) {
+		std::string path = v->path();
+		if (v->is_uint() && path.size() >= 4 && path.compare(path.size() - 4, 4, "port") == 0) {
+			port_paths.push_back(path);
+		}
+	}
+	for (const std::string &path : port_paths) {
+		config.set_uint(path.c_str(), 0);
+	}
+	if (config.exists("/llsfrb/websocket/port")) {
+		config.set_uint("/llsfrb/websocket/port", 0);
+	}
+}
+
+/** Read yaml configurations based on given command line options.
+ * @param argc number of arguments passed
+ * @param argv array of arguments
+ */
+void
+LLSFRefBox::read_config(int argc, char **argv)
+{
+	// key: cfg option, value: path to file
+	std::map<std::string, std::string> cfg_files_to_include = default_config_files();
+	std::vector<std::string>           gen_options_str;
+	for (const auto &cfg_file : cfg_files_to_include) {
+		gen_options_str.push_back(cfg_file.first);
+	}
 	// Populate generated options, stuck to raw arrays as the char arrays within
 	// the option struct can be invalidated through smart containers
 	option generated_options[cfg_files_to_include.size()];
@@ -377,6 +625,7 @@ LLSFRefBox::read_config(int argc, char **argv)
 	std::vector<option> static_options = {{"no-default-cfg", 0, 0, 0},
 	                                      {"cfg-custom", 1, 0, 0},
 	                                      {"dump-cfg", 0, 0, 0},
+	                                      {"replay", 1, 0, 0},
 	                                      {0, 0, 0, 0}}; // null terminate options
 	option              options[cfg_files_to_include.size() + static_options.size()];
 	// Prepare ArgumentParser
@@ -410,6 +659,8 @@ LLSFRefBox::read_config(int argc, char **argv)
 		  "  --cfg-custom <yaml-file>     : load an additional <yaml-file> (loaded last)\n";
 		help_message += "  --dump-cfg <yaml-file>       : write the configuration file (required to "
 		                "use some of the companion tools)\n";
+		help_message += "  --replay <file>              : replay the inputs recorded to <file>, see "
+		                "llsfrb/input-log\n";
 		printf("--- RefBox customization options ---\n%s", help_message.c_str());
 		exit(1);
 	}
@@ -453,6 +704,9 @@ include:
 		generated_cfg_file << "---\n";
 		generated_cfg_file.close();
 	}
+	if (argp.arg("replay")) {
+		config_->set_string("/llsfrb/input-log/replay", argp.arg("replay"));
+	}
 	std::shared_ptr<Configuration::ValueIterator> v(config_->search("llsfrb"));
 }
 
@@ -493,6 +747,37 @@ LLSFRefBox::setup_protobuf_comm()
 		pb_comm_ = std::make_unique<ClipsProtobufCommunicator>(clips_.get(), clips_mutex_, proto_dirs);
 	}
 
+	pb_comm_->set_clock(clock_.get());
+	if (config_->get_bool_or_default("/llsfrb/clips/message-arena/enable", false)) {
+		pb_comm_->enable_message_arena(
+		  config_->get_uint_or_default("/llsfrb/clips/message-arena/initial-block-size", 65536));
+	}
+	pb_comm_->signal_inbound_event().connect(boost::bind(&LLSFRefBox::request_clips_run, this));
+	if (input_log_) {
+		pb_comm_->signal_inbound_message().connect(
+		  [this](const ClipsProtobufCommunicator::InboundMessage &m) {
+			  InputLogRecord r;
+			  r.type        = InputLogRecord::MESSAGE;
+			  r.time        = std::chrono::system_clock::from_time_t(m.rcvd_at.tv_sec)
+			                  + std::chrono::microseconds(m.rcvd_at.tv_usec);
+			  r.client_type = m.client_type;
+			  r.client_id   = m.client_id;
+			  r.comp_id     = m.comp_id;
+			  r.msg_type    = m.msg_type;
+			  r.host        = m.endpoint.first;
+			  r.port        = m.endpoint.second;
+			  r.text        = m.msg->GetTypeName();
+			  m.msg->SerializeToString(&r.data);
+			  record_input(r);
+		  });
+		pb_comm_->signal_inbound_fact().connect([this](const std::string &fact) {
+			InputLogRecord r;
+			r.type = InputLogRecord::FACT;
+			r.time = clock_->now();
+			r.text = fact;
+			record_input(r);
+		});
+	}
 	pb_comm_->enable_server(config_->get_uint("/llsfrb/comm/server-port"));
 
 	MessageRegister &mr_server = pb_comm_->message_register();
@@ -553,9 +838,15 @@ LLSFRefBox::setup_clips()
 	clips_->add_function("config-get-int",
 	                     sigc::slot<CLIPS::Value, std::string>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_config_get_int)));
+	clips_->add_function("clips-profile-dump",
+	                     sigc::slot<void>(sigc::mem_fun(*this, &LLSFRefBox::clips_profile_dump)));
 	clips_->add_function("print-fact-list",
 	                     sigc::slot<void, CLIPS::Values, CLIPS::Values>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_print_fact_list)));
+	clips_->add_function(
+	  "print-history-fact-list",
+	  sigc::slot<void, std::string, CLIPS::Values, CLIPS::Values, CLIPS::Values>(
+	    sigc::mem_fun(*this, &LLSFRefBox::clips_print_history_fact_list)));
 
 	clips_->add_function("mps-move-conveyor",
 	                     sigc::slot<void, std::string, std::string, std::string>(
@@ -624,8 +915,6 @@ LLSFRefBox::setup_clips()
 	clips_->add_function("reconfigure-machine",
 	                     sigc::slot<void, std::string>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_add_machine)));
-
-	clips_->signal_periodic().connect(sigc::mem_fun(*this, &LLSFRefBox::handle_clips_periodic));
 }
 
 void
@@ -638,32 +927,20 @@ LLSFRefBox::start_clips()
 		throw fawkes::Exception("Failed to initialize CLIPS environment, batch file failed.");
 	}
 
-	clips_->assert_fact("(init)");
-	clips_->refresh_agenda();
-	clips_->run();
-}
-
-void
-LLSFRefBox::handle_clips_periodic()
-{
-	std::queue<int>                                    to_erase;
-	std::map<long int, CLIPS::Fact::pointer>::iterator f;
-
-	for (f = clips_msg_facts_.begin(); f != clips_msg_facts_.end(); ++f) {
-		if (f->second->refcount() == 1) {
-			//logger_->log_info("RefBox", "Fact %li can be erased", f->second->index());
-			to_erase.push(f->first);
-		}
+	if (input_log_ || replay_log_) {
+		// random decisions of a replayed game must match the recorded ones
+		uint64_t seed = replay_log_ ? replay_log_->seed() : input_log_->seed();
+		clips_->evaluate("(seed " + std::to_string(seed) + ")");
 	}
-	while (!to_erase.empty()) {
-		long int              index = to_erase.front();
-		CLIPS::Fact::pointer &f     = clips_msg_facts_[index];
-		CLIPS::Value          v     = f->slot_value("ptr")[0];
-		void                 *ptr   = v.as_address();
-		delete static_cast<std::shared_ptr<google::protobuf::Message> *>(ptr);
-		clips_msg_facts_.erase(index);
-		to_erase.pop();
+
+	if (config_->get_bool_or_default("/llsfrb/clips/profile/enable", false)) {
+		logger_->log_info("RefBox", "Profiling CLIPS rules and functions");
+		clips_profiler_ = std::make_unique<ClipsProfiler>(clips_.get());
 	}
+
+	clips_->assert_fact("(init)");
+	clips_->refresh_agenda();
+	run_clips_engine();
 }
 
 CLIPS::Values
@@ -671,7 +948,7 @@ LLSFRefBox::clips_now()
 {
 	CLIPS::Values  rv;
 	struct timeval tv;
-	gettimeofday(&tv, 0);
+	clock_->get_time(&tv);
 	rv.push_back(tv.tv_sec);
 	rv.push_back(tv.tv_usec);
 	return rv;
@@ -717,6 +994,66 @@ LLSFRefBox::clips_print_fact_list(CLIPS::Values facts, CLIPS::Values fields)
 	if (facts.size() == 0) {
 		return;
 	}
+	std::vector<std::string>              columns;
+	std::vector<std::vector<std::string>> rows;
+	if (fact_list_rows(facts, fields, columns, rows)) {
+		print_table(columns, rows);
+	}
+}
+
+/** Print a history as a formatted table.
+ * Like print-fact-list, but the table starts with the superseded records
+ * of the history store, which are no longer facts, in order of time.
+ * @param kind kind of history, e.g., machine_history
+ * @param facts A multifield of fact indices of the latest records
+ * @param fields A multifield of field names of the history template
+ * @param match A multifield of field names and values, only stored records
+ *              with these values are printed, e.g., (create$ name C-BS)
+ */
+void
+LLSFRefBox::clips_print_history_fact_list(std::string   kind,
+                                          CLIPS::Values facts,
+                                          CLIPS::Values fields,
+                                          CLIPS::Values match)
+{
+	std::vector<std::string>              columns;
+	std::vector<std::vector<std::string>> rows;
+	for (const auto &field : fields) {
+		columns.push_back(clips_value_to_string(field));
+	}
+#ifdef HAVE_MONGODB
+	if (history_store_) {
+		history_rows(kind, columns, match, rows);
+	}
+#endif
+	if (facts.size() > 0) {
+		std::vector<std::string>              fact_columns;
+		std::vector<std::vector<std::string>> fact_rows;
+		if (!fact_list_rows(facts, fields, fact_columns, fact_rows)) {
+			return;
+		}
+		columns = fact_columns;
+		std::move(fact_rows.begin(), fact_rows.end(), std::back_inserter(rows));
+	}
+	if (!rows.empty() && !columns.empty()) {
+		print_table(columns, rows);
+	}
+}
+
+/** Get the rows of a fact list table.
+ * @param facts fact indices of facts of the same template
+ * @param fields field names to print, all fields of the template if empty
+ * @param columns upon return contains the printed field names
+ * @param rows upon return contains one row per fact, each cell holds the
+ * values of a field followed by a space
+ * @return true on success, false if the facts could not be retrieved
+ */
+bool
+LLSFRefBox::fact_list_rows(CLIPS::Values                         &facts,
+                           CLIPS::Values                         &fields,
+                           std::vector<std::string>              &columns,
+                           std::vector<std::vector<std::string>> &rows)
+{
 	MutexLocker           lock(&clips_mutex_);
 	std::vector<long int> fact_indices;
 	try {
@@ -739,41 +1076,56 @@ LLSFRefBox::clips_print_fact_list(CLIPS::Values facts, CLIPS::Values fields)
 			} else {
 				if (fact_template->name() != fact->get_template()->name()) {
 					logger_->log_error("print-fact-list", "Expected facts from exactly one template");
-					return;
+					return false;
 				}
 			}
 		}
 		fact = fact->next();
 	}
 
-	std::map<std::string, size_t> slot_value_length;
-	std::vector<std::string>      slot_names;
-
+	columns.clear();
 	for (const auto &field : fields) {
-		slot_names.push_back(clips_value_to_string(field));
+		columns.push_back(clips_value_to_string(field));
 	}
-	if (slot_names.size() == 0) {
-		slot_names = fact_template->slot_names();
-	}
-
-	for (auto slot_name : slot_names) {
-		slot_value_length.emplace(slot_name, 0);
+	if (columns.size() == 0 && fact_template) {
+		columns = fact_template->slot_names();
 	}
 
+	rows.clear();
 	for (const auto &f : fact_indices) {
 		auto elem = retrieved_facts.find(f);
-		if (elem != retrieved_facts.end()) {
-			for (const auto &slot_name : slot_names) {
-				size_t slot_val_length = 0;
-				for (const auto &val : elem->second->slot_value(slot_name)) {
-					slot_val_length += clips_value_to_string(val).size() + 1;
-				}
-				slot_value_length[slot_name] =
-				  std::max({slot_value_length[slot_name], slot_val_length, slot_name.size()});
-			}
-		} else {
+		if (elem == retrieved_facts.end()) {
 			logger_->log_error("print-fact-list", "Expected fact-index %s");
-			return;
+			return false;
+		}
+		std::vector<std::string> row;
+		for (const auto &slot_name : columns) {
+			std::string slot_str;
+			for (const auto &val : elem->second->slot_value(slot_name)) {
+				slot_str += clips_value_to_string(val) + " ";
+			}
+			row.push_back(slot_str);
+		}
+		rows.push_back(std::move(row));
+	}
+	return true;
+}
+
+/** Print a table to the CLIPS log.
+ * @param columns column names
+ * @param rows rows with one cell per column
+ */
+void
+LLSFRefBox::print_table(const std::vector<std::string>              &columns,
+                        const std::vector<std::vector<std::string>> &rows)
+{
+	std::vector<size_t> width;
+	for (const auto &column : columns) {
+		width.push_back(column.size());
+	}
+	for (const auto &row : rows) {
+		for (size_t i = 0; i < width.size() && i < row.size(); ++i) {
+			width[i] = std::max(width[i], row[i].size());
 		}
 	}
 
@@ -781,24 +1133,19 @@ LLSFRefBox::clips_print_fact_list(CLIPS::Values facts, CLIPS::Values fields)
 	table_header << " | ";
 	std::stringstream table_sep;
 	table_sep << "---";
-	for (auto &slot_name : slot_names) {
-		table_header << std::left << std::setw(slot_value_length[slot_name]) << std::setfill(' ')
-		             << slot_name << " | ";
-		table_sep << std::left << std::setw(slot_value_length[slot_name]) << std::setfill('-') << "-"
+	for (size_t i = 0; i < columns.size(); ++i) {
+		table_header << std::left << std::setw(width[i]) << std::setfill(' ') << columns[i] << " | ";
+		table_sep << std::left << std::setw(width[i]) << std::setfill('-') << "-"
 		          << "---";
 	}
 	clips_logger_->log_info("C", table_header.str().c_str());
 	clips_logger_->log_info("C", table_sep.str().c_str());
-	for (auto &fact_id : fact_indices) {
+	for (const auto &cells : rows) {
 		std::stringstream row;
 		row << " | ";
-		for (auto &slot_name : slot_names) {
-			std::string slot_str;
-			for (const auto &val : retrieved_facts[fact_id]->slot_value(slot_name)) {
-				slot_str += clips_value_to_string(val) + " ";
-			}
-			row << std::left << std::setw(slot_value_length[slot_name]) << std::setfill(' ') << slot_str
-			    << " | ";
+		for (size_t i = 0; i < columns.size(); ++i) {
+			row << std::left << std::setw(width[i]) << std::setfill(' ')
+			    << (i < cells.size() ? cells[i] : "") << " | ";
 		}
 		clips_logger_->log_info("C", row.str().c_str());
 	}
@@ -813,9 +1160,21 @@ LLSFRefBox::clips_load_config(std::string cfg_prefix)
 	}
 }
 
+/** Assert a configuration value as confval fact.
+ * Replaces the confval fact of the same path, if any. Must be called with
+ * the CLIPS mutex locked.
+ * @param v configuration value
+ * @param input true if the value was changed by an external event, e.g.,
+ * from the frontend, in which case the change is recorded as input
+ */
 void
-LLSFRefBox::clips_assert_confval(std::shared_ptr<Configuration::ValueIterator> v)
+LLSFRefBox::clips_assert_confval(std::shared_ptr<Configuration::ValueIterator> v, bool input)
 {
+	if (input && replay_log_) {
+		logger_->log_warn("RefBox", "Ignoring change of %s while replaying", v->path());
+		return;
+	}
+
 	std::string type  = "";
 	std::string value = v->get_as_string();
 
@@ -851,22 +1210,33 @@ LLSFRefBox::clips_assert_confval(std::shared_ptr<Configuration::ValueIterator> v
 		fact = fact->next();
 	}
 
+	std::string confval;
 	if (v->is_list()) {
 		//logger_->log_info("RefBox", "(confval (path \"%s\") (type %s) (is-list TRUE) (list-value %s))",
 		//       v->path(), type.c_str(), value.c_str());
-		clips_->assert_fact_f("(confval (path \"%s\") (type %s) (is-list TRUE) (list-value %s))",
-		                      v->path(),
-		                      type.c_str(),
-		                      value.c_str());
+		confval = boost::str(boost::format("(confval (path \"%s\") (type %s) (is-list TRUE) "
+		                                   "(list-value %s))")
+		                     % v->path() % type % value);
 	} else {
 		//logger_->log_info("RefBox", "(confval (path \"%s\") (type %s) (value %s))",
 		//       v->path(), type.c_str(), value.c_str());
-		clips_->assert_fact_f("(confval (path \"%s\") (type %s) (value %s))",
-		                      v->path(),
-		                      type.c_str(),
-		                      value.c_str());
+		confval = boost::str(boost::format("(confval (path \"%s\") (type %s) (value %s))") % v->path()
+		                     % type % value);
 	}
+	if (input && input_log_) {
+		InputLogRecord r;
+		r.type = InputLogRecord::EVAL;
+		r.time = clock_->now();
+		r.text = boost::str(
+		  boost::format("(do-for-fact ((?c confval)) (eq ?c:path \"%s\") (retract ?c))") % v->path());
+		record_input(r);
+		r.type = InputLogRecord::FACT;
+		r.text = confval;
+		record_input(r);
+	}
+	clips_->assert_fact(confval);
 }
+
 CLIPS::Value
 LLSFRefBox::clips_config_path_exists(std::string path)
 {
@@ -993,7 +1363,8 @@ LLSFRefBox::clips_mps_deliver(std::string machine)
 		station->conveyor_move(rcll::mps_comm::Machine::ConveyorDirection::FORWARD,
 		                       rcll::mps_comm::Machine::MPSSensor::OUTPUT);
 		MutexLocker lock(&clips_mutex_);
-		clips_->assert_fact_f("(mps-feedback mps-deliver success %s)", machine.c_str());
+		clips_assert_input_f("(mps-feedback mps-deliver success %s)", machine.c_str());
+		request_clips_run();
 		return true;
 	});
 
@@ -1400,6 +1771,9 @@ LLSFRefBox::setup_clips_mongodb()
 	clips_->add_function("mongodb-replace",
 	                     sigc::slot<void, std::string, void *, CLIPS::Value>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_mongodb_replace)));
+	clips_->add_function("mongodb-update-push",
+	                     sigc::slot<void, std::string, void *, void *, CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_mongodb_update_push)));
 	clips_->add_function("mongodb-query",
 	                     sigc::slot<CLIPS::Value, std::string, void *>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_mongodb_query)));
@@ -1429,6 +1803,18 @@ LLSFRefBox::setup_clips_mongodb()
 	clips_->add_function("bson-get-time",
 	                     sigc::slot<CLIPS::Values, void *, std::string>(
 	                       sigc::mem_fun(*this, &LLSFRefBox::clips_bson_get_time)));
+	clips_->add_function("history-store",
+	                     sigc::slot<void, std::string, CLIPS::Values, void *>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_history_store)));
+	clips_->add_function("history-array-append",
+	                     sigc::slot<void, void *, std::string, int, CLIPS::Values>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_history_array_append)));
+	clips_->add_function("history-count",
+	                     sigc::slot<CLIPS::Value, std::string>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_history_count)));
+	clips_->add_function("history-clear",
+	                     sigc::slot<void, std::string>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_history_clear)));
 
 	clips_->build("(deffacts have-feature-mongodb (have-feature MongoDB))");
 }
@@ -1644,18 +2030,24 @@ LLSFRefBox::clips_mongodb_insert(std::string collection, void *bson)
 
 	auto b = static_cast<document *>(bson);
 
-	try {
-		database_[collection].insert_one(b->view());
-	} catch (mongocxx::operation_exception &e) {
-		logger_->log_warn("MongoDB", "Insert failed: %s", e.what());
-	}
+	// the builder remains owned by CLIPS, the writer gets its own copy
+	mongodb_writer_->insert(collection, bsoncxx::document::value{b->view()});
 }
 
+/** Queue an update of a single document.
+ * @param collection collection to update
+ * @param doc fields to set
+ * @param query query selecting the document, JSON string or BSON document
+ * @param upsert true to insert the document if the query does not match
+ * @param push arrays whose elements are appended to the array fields of the
+ * same name, e.g., to add new entries to a large document incrementally
+ */
 void
 LLSFRefBox::mongodb_update(std::string                   &collection,
                            const bsoncxx::document::view &doc,
                            CLIPS::Value                  &query,
-                           bool                           upsert)
+                           bool                           upsert,
+                           const bsoncxx::document::view &push)
 {
 	if (!cfg_mongodb_enabled_) {
 		logger_->log_warn("MongoDB", "Update requested while MongoDB disabled");
@@ -1664,25 +2056,41 @@ LLSFRefBox::mongodb_update(std::string                   &collection,
 
 	try {
 		document update_doc{};
-		update_doc.append(kvp("$set", bsoncxx::builder::concatenate(doc)));
+		if (!doc.empty()) {
+			update_doc.append(kvp("$set", bsoncxx::builder::concatenate(doc)));
+		}
+		document push_doc{};
+		for (const bsoncxx::document::element &e : push) {
+			if (e.type() == bsoncxx::type::k_array && !e.get_array().value.empty()) {
+				push_doc.append(
+				  kvp(e.key(), [&](bsoncxx::builder::basic::sub_document each) {
+					  each.append(kvp("$each", e.get_array().value));
+				  }));
+			}
+		}
+		if (!push_doc.view().empty()) {
+			update_doc.append(kvp("$push", push_doc.view()));
+		}
+		if (update_doc.view().empty()) {
+			return;
+		}
 		if (query.type() == CLIPS::TYPE_STRING) {
-			auto query_doc = bsoncxx::from_json(query.as_string());
-			database_[collection].update_one(query_doc.view(),
-			                                 update_doc.view(),
-			                                 mongocxx::options::update().upsert(upsert));
+			mongodb_writer_->update(collection,
+			                        bsoncxx::from_json(query.as_string()),
+			                        update_doc.extract(),
+			                        upsert);
 		} else if (query.type() == CLIPS::TYPE_EXTERNAL_ADDRESS) {
 			auto query_doc = static_cast<document *>(query.as_address());
-			database_[collection].update_one(query_doc->view(),
-			                                 update_doc.view(),
-			                                 mongocxx::options::update().upsert(upsert));
+			mongodb_writer_->update(collection,
+			                        bsoncxx::document::value{query_doc->view()},
+			                        update_doc.extract(),
+			                        upsert);
 		} else {
 			logger_->log_warn("MongoDB", "Invalid query, must be string or BSON document");
 			return;
 		}
 	} catch (bsoncxx::exception &e) {
 		logger_->log_warn("MongoDB", "Compiling query failed: %s", e.what());
-	} catch (mongocxx::operation_exception &e) {
-		logger_->log_warn("MongoDB", "Insert failed: %s", e.what());
 	}
 }
 
@@ -1709,6 +2117,27 @@ LLSFRefBox::clips_mongodb_update(std::string collection, void *bson, CLIPS::Valu
 	mongodb_update(collection, doc->view(), query, false);
 }
 
+/** Update a document by setting some fields and appending to array fields.
+ * @param collection collection to update
+ * @param bson fields to set
+ * @param bson_push arrays to append to the array fields of the same name
+ * @param query query selecting the document, JSON string or BSON document
+ */
+void
+LLSFRefBox::clips_mongodb_update_push(std::string  collection,
+                                      void        *bson,
+                                      void        *bson_push,
+                                      CLIPS::Value query)
+{
+	auto doc      = static_cast<document *>(bson);
+	auto push_doc = static_cast<document *>(bson_push);
+	if (!doc || !push_doc) {
+		logger_->log_warn("MongoDB", "Invalid BSON Obj Builder passed");
+		return;
+	}
+	mongodb_update(collection, doc->view(), query, false, push_doc->view());
+}
+
 void
 LLSFRefBox::clips_mongodb_replace(std::string collection, void *bson, CLIPS::Value query)
 {
@@ -1728,6 +2157,9 @@ LLSFRefBox::clips_mongodb_query_sort(std::string collection, void *bson, void *b
 
 	auto doc = static_cast<document *>(bson);
 
+	// make sure queued writes are visible to the query
+	mongodb_writer_->flush();
+
 	mongocxx::options::find opts{};
 	if (bson_sort) {
 		opts.sort(static_cast<document *>(bson_sort)->view());
@@ -1952,6 +2384,211 @@ LLSFRefBox::clips_bson_get_time(void *bson, std::string field_name)
 	return rv;
 }
 
+/** Move a finished history record out of working memory.
+ * The caller retracts the history fact afterwards, the record is read back
+ * with history-array-append when writing the game report.
+ * @param kind kind of history, e.g., machine_history
+ * @param time time of the record as sec and usec
+ * @param bson document of the record, remains owned by the caller
+ */
+void
+LLSFRefBox::clips_history_store(std::string kind, CLIPS::Values time, void *bson)
+{
+	auto doc = static_cast<document *>(bson);
+	if (!doc) {
+		logger_->log_warn("MongoDB", "history-store: invalid BSON Obj Builder passed");
+		return;
+	}
+	int64_t t = 0;
+	if (time.size() == 2 && time[0].type() == CLIPS::TYPE_INTEGER
+	    && time[1].type() == CLIPS::TYPE_INTEGER) {
+		t = (int64_t)time[0].as_integer() * 1000000 + time[1].as_integer();
+	}
+	bsoncxx::document::view view = doc->view();
+	try {
+		history_store_->append(kind, t, reinterpret_cast<const char *>(view.data()), view.length());
+	} catch (Exception &e) {
+		logger_->log_error("MongoDB", "history-store: %s", e.what_no_backtrace());
+	}
+}
+
+/** Get the time of a history record.
+ * @param view document of the record
+ * @return time of the record in usec, 0 if it has no time
+ */
+static int64_t
+history_record_time(const bsoncxx::document::view &view)
+{
+	auto integer = [](const bsoncxx::array::element &e) -> int64_t {
+		switch (e.type()) {
+		case bsoncxx::type::k_int32: return e.get_int32();
+		case bsoncxx::type::k_int64: return e.get_int64();
+		default: return 0;
+		}
+	};
+	for (const bsoncxx::document::element &e : view) {
+		if (e.key().compare("time") != 0) {
+			continue;
+		}
+		if (e.type() == bsoncxx::type::k_date) {
+			return e.get_date().to_int64() * 1000;
+		} else if (e.type() == bsoncxx::type::k_array) {
+			bsoncxx::array::view time = e.get_array();
+			if (time[0] && time[1]) {
+				return integer(time[0]) * 1000000 + integer(time[1]);
+			}
+		}
+	}
+	return 0;
+}
+
+/** Get the values of a BSON element as they are printed for facts.
+ * @param e element to convert
+ * @return values of the element followed by a space each
+ */
+static std::string
+bson_element_to_string(const bsoncxx::types::bson_value::view &e)
+{
+	switch (e.type()) {
+	case bsoncxx::type::k_double: return std::to_string(e.get_double()) + " ";
+	case bsoncxx::type::k_utf8: return e.get_string().value.to_string() + " ";
+	case bsoncxx::type::k_bool: return e.get_bool() ? "TRUE " : "FALSE ";
+	case bsoncxx::type::k_int32: return std::to_string(e.get_int32()) + " ";
+	case bsoncxx::type::k_int64: return std::to_string(e.get_int64()) + " ";
+	case bsoncxx::type::k_array: {
+		std::string rv;
+		for (const bsoncxx::array::element &a : e.get_array().value) {
+			rv += bson_element_to_string(a.get_value());
+		}
+		return rv;
+	}
+	default: return "";
+	}
+}
+
+/** Append the stored records of a history to a BSON array.
+ * The stored records are merged with the given latest records, such that
+ * the array is in order of time. Of records with the same time, stored
+ * records come first.
+ * @param array array to append to
+ * @param kind kind of history, e.g., machine_history
+ * @param from number of records to skip, e.g., the history-count at the
+ * last update of the game report to only append new records
+ * @param latest documents of the latest records, which are still facts,
+ * they remain owned by the caller
+ */
+void
+LLSFRefBox::clips_history_array_append(void         *array,
+                                       std::string   kind,
+                                       int           from,
+                                       CLIPS::Values latest)
+{
+	auto                     array_doc = static_cast<bsoncxx::builder::basic::array *>(array);
+	std::vector<std::string> records;
+	std::vector<int64_t>     times;
+	try {
+		history_store_->get(kind, records, std::max(0, from), &times);
+	} catch (Exception &e) {
+		logger_->log_error("MongoDB", "history-array-append: %s", e.what_no_backtrace());
+		records.clear();
+		times.clear();
+	}
+
+	std::vector<std::pair<int64_t, bsoncxx::document::view>> latest_docs;
+	for (const CLIPS::Value &v : latest) {
+		auto doc = static_cast<document *>(v.as_address());
+		if (!doc) {
+			logger_->log_warn("MongoDB", "history-array-append: invalid BSON Obj Builder passed");
+			continue;
+		}
+		latest_docs.emplace_back(history_record_time(doc->view()), doc->view());
+	}
+	std::stable_sort(latest_docs.begin(), latest_docs.end(), [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+
+	size_t l = 0;
+	for (size_t r = 0; r < records.size(); ++r) {
+		for (; l < latest_docs.size() && latest_docs[l].first < times[r]; ++l) {
+			array_doc->append(latest_docs[l].second);
+		}
+		array_doc->append(
+		  bsoncxx::document::view(reinterpret_cast<const uint8_t *>(records[r].data()),
+		                          records[r].size()));
+	}
+	for (; l < latest_docs.size(); ++l) {
+		array_doc->append(latest_docs[l].second);
+	}
+}
+
+/** Get the rows of the stored records of a history for a table.
+ * @param kind kind of history, e.g., machine_history
+ * @param columns field names of the history template, one cell per field
+ * @param match field names and values, only records with these values are
+ * added
+ * @param rows rows to append to, in order of time
+ */
+void
+LLSFRefBox::history_rows(const std::string                     &kind,
+                         const std::vector<std::string>        &columns,
+                         const CLIPS::Values                   &match,
+                         std::vector<std::vector<std::string>> &rows)
+{
+	// records are stored as created by mongodb-fact-to-bson
+	auto key = [](std::string field) {
+		std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+		std::replace(field.begin(), field.end(), '-', '_');
+		return field;
+	};
+	auto field_value = [](const bsoncxx::document::view &doc, const std::string &key) {
+		auto e = doc.find(key);
+		return e != doc.end() ? bson_element_to_string(e->get_value()) : std::string();
+	};
+
+	std::vector<std::string> records;
+	try {
+		history_store_->get(kind, records);
+	} catch (Exception &e) {
+		logger_->log_error("MongoDB", "print-history-fact-list: %s", e.what_no_backtrace());
+		return;
+	}
+	for (const std::string &r : records) {
+		bsoncxx::document::view doc(reinterpret_cast<const uint8_t *>(r.data()), r.size());
+		bool                    matches = true;
+		for (size_t i = 0; matches && i + 1 < match.size(); i += 2) {
+			matches = field_value(doc, key(clips_value_to_string(match[i])))
+			          == clips_value_to_string(match[i + 1]) + " ";
+		}
+		if (!matches) {
+			continue;
+		}
+		std::vector<std::string> row;
+		for (const std::string &column : columns) {
+			row.push_back(field_value(doc, key(column)));
+		}
+		rows.push_back(std::move(row));
+	}
+}
+
+/** Get the number of stored records of a history.
+ * @param kind kind of history, e.g., machine_history
+ * @return number of records
+ */
+CLIPS::Value
+LLSFRefBox::clips_history_count(std::string kind)
+{
+	return CLIPS::Value((long long int)history_store_->count(kind));
+}
+
+/** Remove the stored records of a history, e.g., when a new report is started.
+ * @param kind kind of history, e.g., machine_history
+ */
+void
+LLSFRefBox::clips_history_clear(std::string kind)
+{
+	history_store_->clear(kind);
+}
+
 #endif
 
 /** Start the timer for another run. */
@@ -1959,7 +2596,40 @@ void
 LLSFRefBox::start_timer()
 {
 	timer_last_ = boost::posix_time::microsec_clock::local_time();
-	timer_.expires_from_now(boost::posix_time::milliseconds(cfg_timer_interval_));
+	arm_timer(cfg_timer_interval_);
+}
+
+/** Arm the timer for the next tick.
+ * On virtual time, the virtual clock is advanced by the given interval when
+ * the tick is due. The real time to wait for it is the interval divided by
+ * the configured real time factor, or none at all if the factor is zero.
+ * If a tick is pending that is due no later, it is kept instead. Runs
+ * triggered by events therefore never discard the time already waited for
+ * the pending tick, which would stop the virtual clock during a steady
+ * stream of events.
+ * @param interval_ms time until the next tick in milliseconds
+ */
+void
+LLSFRefBox::arm_timer(unsigned int interval_ms)
+{
+	boost::posix_time::time_duration wait;
+	if (!clock_->enabled()) {
+		wait = boost::posix_time::milliseconds(interval_ms);
+	} else if (cfg_virtual_time_factor_ > 0.) {
+		wait = boost::posix_time::microseconds((long)(interval_ms * 1000. / cfg_virtual_time_factor_));
+	} else {
+		wait = boost::posix_time::microseconds(0);
+	}
+	boost::posix_time::ptime expiry =
+	  boost::asio::time_traits<boost::posix_time::ptime>::now() + wait;
+	if (timer_pending_ && timer_.expires_at() <= expiry) {
+		return;
+	}
+
+	// re-arming cancels a pending wait, its handler is called with operation_aborted
+	timer_step_    = interval_ms;
+	timer_pending_ = true;
+	timer_.expires_at(expiry);
 	timer_.async_wait(boost::bind(&LLSFRefBox::handle_timer, this, boost::asio::placeholders::error));
 }
 
@@ -1970,6 +2640,7 @@ void
 LLSFRefBox::handle_timer(const boost::system::error_code &error)
 {
 	if (!error) {
+		timer_pending_ = false;
 		/*
     boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
     long ms = (now - timer_last_).total_milliseconds();
@@ -1978,19 +2649,159 @@ LLSFRefBox::handle_timer(const boost::system::error_code &error)
 
 		//sps_read_rfids();
 
-		{
-			//std::lock_guard<std::recursive_mutex> lock(clips_mutex_);
-			fawkes::MutexLocker lock(&clips_mutex_);
+		if (cfg_event_driven_) {
+			if (clock_->enabled()) {
+				// runs mockup machine operations that finish within the step
+				clock_->advance(std::chrono::milliseconds(timer_step_));
+			}
+			run_clips();
+			return;
+		}
 
-			clips_->assert_fact("(time (now))");
-			clips_->refresh_agenda();
-			clips_->run();
+		tick();
+
+		if (clock_->enabled()) {
+			arm_timer(cfg_timer_interval_);
+		} else {
+			timer_pending_ = true;
+			timer_.expires_at(timer_.expires_at() + boost::posix_time::milliseconds(cfg_timer_interval_));
+			timer_.async_wait(
+			  boost::bind(&LLSFRefBox::handle_timer, this, boost::asio::placeholders::error));
 		}
+	}
+}
+
+/** Run a single iteration of the main loop.
+ * Processes received messages, asserts the current time, and runs the CLIPS
+ * engine. On virtual time, the clock is advanced by the timer interval
+ * first. Called periodically by run(), unless event-driven, or by an
+ * application embedding the refbox.
+ */
+void
+LLSFRefBox::tick()
+{
+	if (clock_->enabled()) {
+		// runs mockup machine operations that finish within the step
+		clock_->advance(std::chrono::milliseconds(cfg_timer_interval_));
+	}
+
+	//std::lock_guard<std::recursive_mutex> lock(clips_mutex_);
+	fawkes::MutexLocker lock(&clips_mutex_);
+
+	pb_comm_->process_inbound_events();
+	clips_assert_time();
+	clips_->refresh_agenda();
+	run_clips_engine();
+}
+
+/** Evaluate a CLIPS expression.
+ * Allows an application embedding the refbox to control the game, e.g., by
+ * asserting the facts that the corresponding controller messages would.
+ * @param expression CLIPS expression to evaluate
+ * @return result of the evaluation
+ */
+CLIPS::Values
+LLSFRefBox::evaluate(const std::string &expression)
+{
+	fawkes::MutexLocker lock(&clips_mutex_);
+	return clips_->evaluate(expression);
+}
+
+/** Request the CLIPS engine to run because a fact has been asserted.
+ * May be called from any thread, the run is executed in the main loop.
+ * Multiple requests before the engine runs result in a single run.
+ */
+void
+LLSFRefBox::request_clips_run()
+{
+	if (!cfg_event_driven_) {
+		return;
+	}
+	if (!clips_run_requested_.exchange(true)) {
+		boost::asio::post(io_service_, boost::bind(&LLSFRefBox::run_clips, this));
+	}
+}
+
+/** Run the CLIPS engine until the agenda is empty.
+ * If profiling is enabled, the run is profiled and the profile is
+ * published periodically. Messages created by the rules during the run are
+ * freed afterwards if the message arena is enabled. Must be called with the
+ * CLIPS mutex locked.
+ */
+void
+LLSFRefBox::run_clips_engine()
+{
+	if (!clips_profiler_) {
+		MessageArenaScope arena(pb_comm_.get());
+		clips_->run();
+		return;
+	}
+
+	{
+		MessageArenaScope arena(pb_comm_.get());
+		clips_profiler_->run();
+	}
+#ifdef HAVE_WEBSOCKETS
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (backend_ && now - clips_profile_published_ >= cfg_clips_profile_interval_) {
+		clips_profile_published_ = now;
+		websocket_publish_clips_profile();
+	}
+#endif
+}
 
-		timer_.expires_at(timer_.expires_at() + boost::posix_time::milliseconds(cfg_timer_interval_));
-		timer_.async_wait(
-		  boost::bind(&LLSFRefBox::handle_timer, this, boost::asio::placeholders::error));
+/** Write the CLIPS profile to the configured file.
+ * Called by the game rules when the game is over, and on shutdown.
+ * Does nothing if profiling is disabled.
+ */
+void
+LLSFRefBox::clips_profile_dump()
+{
+	if (!clips_profiler_) {
+		return;
 	}
+
+	std::string   filename = expand_time_var(cfg_clips_profile_file_);
+	std::ofstream out(filename);
+	if (!out) {
+		logger_->log_warn("RefBox", "Failed to write CLIPS profile to %s", filename.c_str());
+		return;
+	}
+	clips_profiler_->write_report(out);
+	logger_->log_info("RefBox", "Wrote CLIPS profile to %s", filename.c_str());
+}
+
+/** Run the CLIPS engine and schedule the next timer tick.
+ * The next tick is due when the next periodic signal needs to be sent,
+ * but at most after the configured maximum timer interval.
+ */
+void
+LLSFRefBox::run_clips()
+{
+	unsigned int next_ms = cfg_max_timer_interval_;
+	{
+		fawkes::MutexLocker lock(&clips_mutex_);
+		clips_run_requested_ = false;
+
+		pb_comm_->process_inbound_events();
+		clips_assert_time();
+		clips_->refresh_agenda();
+		run_clips_engine();
+
+		if (EnvFindDeffunction(clips_->cobj(), "net-next-signal-timeout")) {
+			CLIPS::Values rv = clips_->evaluate("(net-next-signal-timeout)");
+			if (rv.size() == 1
+			    && (rv[0].type() == CLIPS::TYPE_FLOAT || rv[0].type() == CLIPS::TYPE_INTEGER)) {
+				double timeout =
+				  rv[0].type() == CLIPS::TYPE_FLOAT ? rv[0].as_float() : (double)rv[0].as_integer();
+				if (timeout >= 0.) {
+					next_ms = std::min(next_ms, (unsigned int)std::ceil(timeout * 1000.));
+				}
+			}
+		}
+	}
+
+	arm_timer(std::max(1u, next_ms));
 }
 
 void
@@ -2023,6 +2834,10 @@ LLSFRefBox::clips_add_machine(const std::string &machine_name)
 			connection_string = config_->get_string((cfg_prefix + "connection").c_str());
 		} catch (Exception &e) {
 		}
+		if (replay_log_) {
+			// the machine feedback is replayed from the input log
+			connection_string = "mockup";
+		}
 
 		std::string log_path = "";
 		try {
@@ -2040,24 +2855,27 @@ LLSFRefBox::clips_add_machine(const std::string &machine_name)
 			log_path += "/" + log_suffix;
 		}
 
-		MachineFactory mps_factory(config_);
+		MachineFactory mps_factory(config_, clock_.get());
 		auto           mps =
 		  mps_factory.create_machine(machine_name, mpstype, mpsip, port, log_path, connection_string);
 		mps->register_ready_callback([this, machine_name](bool ready) {
 			fawkes::MutexLocker clips_lock(&clips_mutex_);
-			clips_->assert_fact_f("(mps-status-feedback %s READY %s)",
-			                      machine_name.c_str(),
-			                      ready ? "TRUE" : "FALSE");
+			clips_assert_mps_feedback(machine_name,
+			                          "READY",
+			                          ClipsFactBuilder::Atom::symbol(ready ? "TRUE" : "FALSE"));
+			request_clips_run();
 		});
 		mps->register_busy_callback([this, machine_name](bool busy) {
 			fawkes::MutexLocker clips_lock(&clips_mutex_);
-			clips_->assert_fact_f("(mps-status-feedback %s BUSY %s)",
-			                      machine_name.c_str(),
-			                      busy ? "TRUE" : "FALSE");
+			clips_assert_mps_feedback(machine_name,
+			                          "BUSY",
+			                          ClipsFactBuilder::Atom::symbol(busy ? "TRUE" : "FALSE"));
+			request_clips_run();
 		});
 		mps->register_barcode_callback([this, machine_name](unsigned long barcode) {
 			fawkes::MutexLocker clips_lock(&clips_mutex_);
-			clips_->assert_fact_f("(mps-status-feedback %s BARCODE %u)", machine_name.c_str(), barcode);
+			clips_assert_mps_feedback(machine_name, "BARCODE", ClipsFactBuilder::Atom::integer(barcode));
+			request_clips_run();
 		});
 		if (mpstype == "RS") {
 			RingStation *rs = dynamic_cast<RingStation *>(mps.get());
@@ -2066,15 +2884,291 @@ LLSFRefBox::clips_add_machine(const std::string &machine_name)
 			}
 			rs->register_slide_callback([this, machine_name](unsigned int counter) {
 				fawkes::MutexLocker clips_lock(&clips_mutex_);
-				clips_->assert_fact_f("(mps-status-feedback %s SLIDE-COUNTER %u)",
-				                      machine_name.c_str(),
-				                      counter);
+				clips_assert_mps_feedback(machine_name,
+				                          "SLIDE-COUNTER",
+				                          ClipsFactBuilder::Atom::integer(counter));
+				request_clips_run();
 			});
 		}
 		mps_[machine_name] = std::move(mps);
 	}
 }
 
+/** Assert the current time as time fact.
+ * Equivalent to (assert (time (now))), but without parsing the fact.
+ * Must be called with the CLIPS mutex locked.
+ */
+void
+LLSFRefBox::clips_assert_time()
+{
+	fawkes::VirtualClock::time_point now = clock_->now();
+	if (input_log_) {
+		InputLogRecord r;
+		r.type = InputLogRecord::TICK;
+		r.time = now;
+		record_input(r);
+	}
+
+	if (!time_fact_) {
+		if (!EnvFindDeftemplate(clips_->cobj(), "time")) {
+			clips_->assert_fact("(time (now))");
+			return;
+		}
+		time_fact_.reset(new ClipsFactBuilder(clips_.get(), "time"));
+	}
+	struct timeval tv;
+	fawkes::VirtualClock::to_timeval(now, &tv);
+	time_fact_
+	  ->set_fields({ClipsFactBuilder::Atom::integer(tv.tv_sec),
+	                ClipsFactBuilder::Atom::integer(tv.tv_usec)})
+	  .assert_fact();
+}
+
+/** Assert MPS status feedback fact.
+ * Must be called with the CLIPS mutex locked.
+ * @param machine_name name of the machine
+ * @param feedback kind of feedback, e.g., READY or BARCODE
+ * @param value feedback value
+ */
+void
+LLSFRefBox::clips_assert_mps_feedback(const std::string     &machine_name,
+                                      const char            *feedback,
+                                      ClipsFactBuilder::Atom value)
+{
+	if (replay_log_) {
+		// feedback of the mockup machines, the recorded feedback is replayed instead
+		return;
+	}
+	if (input_log_) {
+		InputLogRecord r;
+		r.type = InputLogRecord::FACT;
+		r.time = clock_->now();
+		r.text =
+		  "(mps-status-feedback " + machine_name + " " + feedback + " " + value.to_string() + ")";
+		record_input(r);
+	}
+	if (!mps_feedback_fact_) {
+		if (!EnvFindDeftemplate(clips_->cobj(), "mps-status-feedback")) {
+			logger_->log_warn("RefBox",
+			                  "No rules for mps-status-feedback, dropping %s feedback of %s",
+			                  feedback,
+			                  machine_name.c_str());
+			return;
+		}
+		mps_feedback_fact_.reset(new ClipsFactBuilder(clips_.get(), "mps-status-feedback"));
+	}
+	mps_feedback_fact_
+	  ->set_fields({ClipsFactBuilder::Atom::symbol(machine_name.c_str()),
+	                ClipsFactBuilder::Atom::symbol(feedback),
+	                value})
+	  .assert_fact();
+}
+
+/** Append a record to the input log.
+ * Must be called with the CLIPS mutex locked.
+ * @param record record to append
+ */
+void
+LLSFRefBox::record_input(const InputLogRecord &record)
+{
+	try {
+		input_log_->write(record);
+	} catch (Exception &e) {
+		logger_->log_warn("RefBox", "Failed to record input: %s", e.what_no_backtrace());
+	}
+}
+
+/** Assert a fact for an external event.
+ * The fact is recorded to the input log. When replaying, the event cannot
+ * have happened in the recorded game and the fact is dropped.
+ * Must be called with the CLIPS mutex locked.
+ * @param format format string for the fact, see printf
+ */
+void
+LLSFRefBox::clips_assert_input_f(const char *format, ...)
+{
+	va_list arg;
+	va_start(arg, format);
+	char *fact_cstr;
+	int   rv = vasprintf(&fact_cstr, format, arg);
+	va_end(arg);
+	if (rv == -1) {
+		logger_->log_error("RefBox", "Failed to format fact %s", format);
+		return;
+	}
+	std::string fact(fact_cstr);
+	free(fact_cstr);
+
+	if (replay_log_) {
+		logger_->log_warn("RefBox", "Ignoring %s while replaying", fact.c_str());
+		return;
+	}
+	if (input_log_) {
+		InputLogRecord r;
+		r.type = InputLogRecord::FACT;
+		r.time = clock_->now();
+		r.text = fact;
+		record_input(r);
+	}
+	clips_->assert_fact(fact);
+}
+
+/** Route the functions of the machine placing generator through the input log.
+ * The generator searches the field layout in a thread, hence when and with
+ * which result it finishes depends on the machine it runs on. The results
+ * polled by the game rules are recorded, and taken from the log on replay.
+ */
+void
+LLSFRefBox::setup_clips_input_log()
+{
+	fawkes::MutexLocker lock(&clips_mutex_);
+
+	clips_->remove_function("mps-generator-running");
+	clips_->add_function("mps-generator-running",
+	                     sigc::slot<CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_mps_generator_running)));
+	clips_->remove_function("mps-generator-field-generated");
+	clips_->add_function("mps-generator-field-generated",
+	                     sigc::slot<CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_mps_generator_field_generated)));
+	clips_->remove_function("mps-generator-get-generated-field");
+	clips_->add_function("mps-generator-get-generated-field",
+	                     sigc::slot<CLIPS::Values>(
+	                       sigc::mem_fun(*this,
+	                                     &LLSFRefBox::clips_mps_generator_get_generated_field)));
+}
+
+/** Call a function with external state through the input log.
+ * When recording, the result of the call is recorded. When replaying, the
+ * recorded result is returned instead of calling the function.
+ * @param name name of the function, used to match the recorded results
+ * @param call function to call
+ * @return result of the function
+ */
+CLIPS::Values
+LLSFRefBox::input_log_call(const char *name, std::function<CLIPS::Values()> call)
+{
+	CLIPS::Values rv;
+	if (replay_log_) {
+		if (replay_log_->next_call(name, rv)) {
+			return rv;
+		}
+		logger_->log_warn("RefBox", "Replay diverged, %s was not called in the recorded game", name);
+	}
+	rv = call();
+	if (input_log_) {
+		InputLogRecord r;
+		r.type   = InputLogRecord::CALL;
+		r.time   = clock_->now();
+		r.text   = name;
+		r.values = rv;
+		record_input(r);
+	}
+	return rv;
+}
+
+CLIPS::Value
+LLSFRefBox::clips_mps_generator_running()
+{
+	CLIPS::Values rv = input_log_call("mps-generator-running", [this]() {
+		return CLIPS::Values{mps_placing_generator_->generate_running()};
+	});
+	return rv.empty() ? CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL) : rv[0];
+}
+
+CLIPS::Value
+LLSFRefBox::clips_mps_generator_field_generated()
+{
+	CLIPS::Values rv = input_log_call("mps-generator-field-generated", [this]() {
+		return CLIPS::Values{mps_placing_generator_->field_layout_generated()};
+	});
+	return rv.empty() ? CLIPS::Value("FALSE", CLIPS::TYPE_SYMBOL) : rv[0];
+}
+
+CLIPS::Values
+LLSFRefBox::clips_mps_generator_get_generated_field()
+{
+	return input_log_call("mps-generator-get-generated-field",
+	                      [this]() { return mps_placing_generator_->get_generated_field(); });
+}
+
+void
+LLSFRefBox::setup_clips_broadcast_builder()
+{
+	fawkes::MutexLocker lock(&clips_mutex_);
+
+	broadcast_builder_ = std::make_unique<BroadcastBuilder>(clips_.get());
+	clips_->add_function("net-build-GameState",
+	                     sigc::slot<CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_net_build_game_state)));
+	clips_->add_function("net-build-RobotInfo",
+	                     sigc::slot<CLIPS::Value, double, std::string>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_net_build_robot_info)));
+	clips_->add_function("net-build-MachineInfo",
+	                     sigc::slot<CLIPS::Value, std::string, std::string>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_net_build_machine_info)));
+	clips_->add_function("net-build-OrderInfo",
+	                     sigc::slot<CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_net_build_order_info)));
+	clips_->add_function("net-build-RingInfo",
+	                     sigc::slot<CLIPS::Value>(
+	                       sigc::mem_fun(*this, &LLSFRefBox::clips_net_build_ring_info)));
+}
+
+/** Build a message with the broadcast builder for CLIPS.
+ * Like pb-create, an empty message pointer is returned on failure, which
+ * pb-send and pb-broadcast refuse to send.
+ * @param type message type for logging
+ * @param build function building the message
+ * @return pointer to the message
+ */
+CLIPS::Value
+LLSFRefBox::clips_net_build(const char                                                 *type,
+                            std::function<std::shared_ptr<google::protobuf::Message>()> build)
+{
+	try {
+		return CLIPS::Value(new std::shared_ptr<google::protobuf::Message>(build()));
+	} catch (std::exception &e) {
+		logger_->log_warn("RefBox", "Failed to build %s: %s", type, e.what());
+		return CLIPS::Value(new std::shared_ptr<google::protobuf::Message>());
+	}
+}
+
+CLIPS::Value
+LLSFRefBox::clips_net_build_game_state()
+{
+	return clips_net_build("GameState", [this]() { return broadcast_builder_->game_state(); });
+}
+
+CLIPS::Value
+LLSFRefBox::clips_net_build_robot_info(double time, std::string pub_pose)
+{
+	return clips_net_build("RobotInfo", [this, time, &pub_pose]() {
+		return broadcast_builder_->robot_info(time, pub_pose == "TRUE");
+	});
+}
+
+CLIPS::Value
+LLSFRefBox::clips_net_build_machine_info(std::string team_color, std::string add_restricted_info)
+{
+	return clips_net_build("MachineInfo", [this, &team_color, &add_restricted_info]() {
+		return broadcast_builder_->machine_info(team_color == "nil" ? "" : team_color,
+		                                        add_restricted_info == "TRUE");
+	});
+}
+
+CLIPS::Value
+LLSFRefBox::clips_net_build_order_info()
+{
+	return clips_net_build("OrderInfo", [this]() { return broadcast_builder_->order_info(); });
+}
+
+CLIPS::Value
+LLSFRefBox::clips_net_build_ring_info()
+{
+	return clips_net_build("RingInfo", [this]() { return broadcast_builder_->ring_info(); });
+}
+
 /** Handle operating system signal.
  * @param error error code
  * @param signum signal number
@@ -2101,6 +3195,11 @@ LLSFRefBox::handle_signal(const boost::system::error_code &error, int signum)
 int
 LLSFRefBox::run()
 {
+	if (replay_log_) {
+		replay();
+		return 0;
+	}
+
 #if BOOST_ASIO_VERSION >= 100601
 	// Construct a signal set registered for process termination.
 	boost::asio::signal_set signals(io_service_, SIGINT, SIGTERM, SIGUSR1);
@@ -2124,7 +3223,144 @@ LLSFRefBox::run()
 	return return_code_;
 }
 
+/** Replay a recorded game.
+ * Feeds the recorded inputs to the rule engine in order, advancing the
+ * virtual clock to the time of each input, and runs the engine for each
+ * recorded tick. Reports the time taken by the ticks at the end, the
+ * replay is thus suitable to profile and debug a game offline.
+ */
+void
+LLSFRefBox::replay()
+{
+	typedef std::chrono::steady_clock ReplayClock;
+	ReplayClock::duration             overrun = std::chrono::milliseconds(cfg_timer_interval_);
+	ReplayClock::duration             total(0), max(0);
+	unsigned long long                num_ticks = 0, num_overruns = 0, max_tick = 0;
+	InputLogRecord                    r;
+
+	while (replay_log_->next(r)) {
+		clock_->advance_to(r.time);
+		fawkes::MutexLocker lock(&clips_mutex_);
+		switch (r.type) {
+		case InputLogRecord::TICK: {
+			ReplayClock::time_point start = ReplayClock::now();
+			clips_assert_time();
+			clips_->refresh_agenda();
+			run_clips_engine();
+			ReplayClock::duration d = ReplayClock::now() - start;
+			num_ticks += 1;
+			total += d;
+			if (d > max) {
+				max      = d;
+				max_tick = num_ticks;
+			}
+			if (d > overrun) {
+				num_overruns += 1;
+			}
+		} break;
+		case InputLogRecord::FACT: clips_->assert_fact(r.text); break;
+		case InputLogRecord::EVAL: clips_->evaluate(r.text); break;
+		case InputLogRecord::MESSAGE:
+			try {
+				ClipsProtobufCommunicator::InboundMessage m;
+				m.msg = pb_comm_->message_register().new_message_for(r.text);
+				if (!m.msg->ParseFromString(r.data)) {
+					throw Exception("Failed to parse recorded %s", r.text.c_str());
+				}
+				m.endpoint    = std::make_pair(r.host, r.port);
+				m.comp_id     = r.comp_id;
+				m.msg_type    = r.msg_type;
+				m.client_type = (ClipsProtobufCommunicator::ClientType)r.client_type;
+				m.client_id   = r.client_id;
+				fawkes::VirtualClock::to_timeval(r.time, &m.rcvd_at);
+				pb_comm_->assert_message(m);
+			} catch (std::exception &e) {
+				logger_->log_warn("RefBox", "Failed to replay %s: %s", r.text.c_str(), e.what());
+			}
+			break;
+		case InputLogRecord::CALL:
+			logger_->log_warn("RefBox", "Replay diverged, %s was not called", r.text.c_str());
+			break;
+		}
+	}
+
+	auto to_ms = [](ReplayClock::duration d) {
+		return std::chrono::duration<double, std::milli>(d).count();
+	};
+	logger_->log_info("RefBox",
+	                  "Replayed %llu ticks, avg %.3f ms, max %.3f ms (tick %llu), %llu over %u ms",
+	                  num_ticks,
+	                  num_ticks > 0 ? to_ms(total) / num_ticks : 0.,
+	                  to_ms(max),
+	                  max_tick,
+	                  num_overruns,
+	                  cfg_timer_interval_);
+	if (replay_log_->truncated()) {
+		logger_->log_warn("RefBox", "Input log ends with an incomplete record");
+	}
+}
+
 #ifdef HAVE_WEBSOCKETS
+/** Send the CLIPS profile to the websocket clients.
+ * Rules and deffunctions are sorted by cumulative time, times are given
+ * in milliseconds.
+ */
+void
+LLSFRefBox::websocket_publish_clips_profile()
+{
+	rapidjson::Document                 d;
+	rapidjson::Document::AllocatorType &alloc = d.GetAllocator();
+	d.SetObject();
+	d.AddMember("level", "clips", alloc);
+	d.AddMember("type", "clips-profile", alloc);
+
+	auto stats_object = [&alloc](const ClipsProfiler::Stats &stats, const char *max_key = "max") {
+		rapidjson::Value o(rapidjson::kObjectType);
+		o.AddMember("count", rapidjson::Value((uint64_t)stats.count), alloc);
+		o.AddMember("total", stats.total * 1000., alloc);
+		o.AddMember(rapidjson::StringRef(max_key), stats.max * 1000., alloc);
+		return o;
+	};
+	auto stats_array = [&](const std::map<std::string, ClipsProfiler::Stats> &m,
+	                       const char                                        *max_key) {
+		std::vector<std::pair<std::string, ClipsProfiler::Stats>> sorted(m.begin(), m.end());
+		std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+			return a.second.total > b.second.total;
+		});
+		rapidjson::Value a(rapidjson::kArrayType);
+		for (const auto &s : sorted) {
+			rapidjson::Value o = stats_object(s.second, max_key);
+			o.AddMember("name", rapidjson::Value(s.first.c_str(), alloc), alloc);
+			a.PushBack(o, alloc);
+		}
+		return a;
+	};
+
+	rapidjson::Value content(rapidjson::kObjectType);
+	content.AddMember("runs", stats_object(clips_profiler_->runs()), alloc);
+
+	rapidjson::Value             histogram(rapidjson::kArrayType);
+	const std::vector<double>   &bounds = ClipsProfiler::histogram_bounds();
+	const std::vector<uint64_t> &counts = clips_profiler_->run_histogram();
+	for (size_t i = 0; i < counts.size(); ++i) {
+		rapidjson::Value bucket(rapidjson::kObjectType);
+		if (i < bounds.size()) {
+			bucket.AddMember("le", bounds[i] * 1000., alloc);
+		} else {
+			bucket.AddMember("le", rapidjson::Value(rapidjson::kNullType), alloc);
+		}
+		bucket.AddMember("count", rapidjson::Value((uint64_t)counts[i]), alloc);
+		histogram.PushBack(bucket, alloc);
+	}
+	content.AddMember("histogram", histogram, alloc);
+	content.AddMember("rules", stats_array(clips_profiler_->rules(), "max"), alloc);
+	// deffunction maxima are per engine run means, see ClipsProfiler::functions()
+	content.AddMember("functions", stats_array(clips_profiler_->functions(), "max_mean"), alloc);
+	d.AddMember("content", content, alloc);
+
+	backend_->get_data()->log_push(d);
+}
+
 /** Setup websocket related CLIPS functions. */
 void
 LLSFRefBox::setup_clips_websocket()
@@ -2206,8 +3442,9 @@ LLSFRefBox::setup_clips_websocket()
 			std::shared_ptr<Configuration::ValueIterator> v(tmp_config.search("/"));
 			fawkes::MutexLocker                           clips_lock(&clips_mutex_);
 			while (v->next()) {
-				clips_assert_confval(v);
+				clips_assert_confval(v, true);
 			}
+			request_clips_run();
 		} else {
 			logger_->log_error("Websocket",
 			                   "Received invalid config preset (%s, %s)",
@@ -2217,15 +3454,18 @@ LLSFRefBox::setup_clips_websocket()
 	};
 	backend_->get_data()->clips_set_gamestate = [this](std::string state_string) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(net-SetGameState %s)", state_string.c_str());
+		clips_assert_input_f("(net-SetGameState %s)", state_string.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_set_gamephase = [this](std::string phase_string) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(net-SetGamePhase %s)", phase_string.c_str());
+		clips_assert_input_f("(net-SetGamePhase %s)", phase_string.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_randomize_field = [this]() {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(net-RandomizeField)");
+		clips_assert_input_f("(net-RandomizeField)");
+		request_clips_run();
 	};
 	backend_->get_data()->clips_set_confval = [this](std::string path, std::string value) {
 		std::string type = config_->get_type(path);
@@ -2300,7 +3540,8 @@ LLSFRefBox::setup_clips_websocket()
 		}
 		std::shared_ptr<Configuration::ValueIterator> v(config_->search(path.c_str()));
 		if (v->valid()) {
-			clips_assert_confval(v);
+			clips_assert_confval(v, true);
+			request_clips_run();
 		} else {
 			logger_->log_error("Websocket", "Failed to find config ", path.c_str());
 		}
@@ -2308,66 +3549,76 @@ LLSFRefBox::setup_clips_websocket()
 	backend_->get_data()->clips_set_teamname = [this](std::string color_string,
 	                                                  std::string name_string) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(net-SetTeamName %s \"%s\")", color_string.c_str(), name_string.c_str());
+		clips_assert_input_f("(net-SetTeamName %s \"%s\")", color_string.c_str(), name_string.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_confirm_delivery =
 	  [this](int delivery_id, bool correctness, int order_id, std::string team_color) {
 		  fawkes::MutexLocker clips_lock(&clips_mutex_);
-		  clips_->assert_fact_f("(order-ConfirmDelivery %d %s %d %s)",
-		                        delivery_id,
-		                        correctness ? "TRUE" : "FALSE",
-		                        order_id,
-		                        team_color.c_str());
+		  clips_assert_input_f("(order-ConfirmDelivery %d %s %d %s)",
+		                       delivery_id,
+		                       correctness ? "TRUE" : "FALSE",
+		                       order_id,
+		                       team_color.c_str());
+		  request_clips_run();
 	  };
 	backend_->get_data()->clips_set_order_delivered = [this](std::string team_color, int order_id) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(order-SetOrderDelivered %s %d)", team_color.c_str(), order_id);
+		clips_assert_input_f("(order-SetOrderDelivered %s %d)", team_color.c_str(), order_id);
+		request_clips_run();
 	};
 	backend_->get_data()->clips_production_machine_add_base = [this](std::string mname) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(production-MachineAddBase %s)", mname.c_str());
+		clips_assert_input_f("(production-MachineAddBase %s)", mname.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_set_machine_pose =
 	  [this](std::string name, int rotation, std::string zone) {
 		  fawkes::MutexLocker clips_lock(&clips_mutex_);
-		  clips_->assert_fact_f("(production-SetMachinePose %s %i %s)",
-		                        name.c_str(),
-		                        rotation,
-		                        zone.c_str());
+		  clips_assert_input_f("(production-SetMachinePose %s %i %s)",
+		                       name.c_str(),
+		                       rotation,
+		                       zone.c_str());
+		  request_clips_run();
 	  };
 	backend_->get_data()->clips_production_set_machine_state = [this](std::string mname,
 	                                                                  std::string state) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(production-SetMachineState %s %s)", mname.c_str(), state.c_str());
+		clips_assert_input_f("(production-SetMachineState %s %s)", mname.c_str(), state.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_production_set_machine_work_status =
 	  [this](std::string mname, bool busy, bool ready) {
 		  fawkes::MutexLocker clips_lock(&clips_mutex_);
-		  clips_->assert_fact_f("(mps-status-feedback %s BUSY %s)",
-		                        mname.c_str(),
-		                        busy ? "TRUE" : "FALSE");
-		  clips_->assert_fact_f("(mps-status-feedback %s READY %s)",
-		                        mname.c_str(),
-		                        ready ? "TRUE" : "FALSE");
+		  clips_assert_input_f("(mps-status-feedback %s BUSY %s)",
+		                       mname.c_str(),
+		                       busy ? "TRUE" : "FALSE");
+		  clips_assert_input_f("(mps-status-feedback %s READY %s)",
+		                       mname.c_str(),
+		                       ready ? "TRUE" : "FALSE");
+		  request_clips_run();
 	  };
 	backend_->get_data()->clips_robot_set_robot_maintenance =
 	  [this](int robot_number, std::string team_color, bool maintenance) {
 		  fawkes::MutexLocker clips_lock(&clips_mutex_);
-		  clips_->assert_fact_f("(robot-SetRobotMaintenance %d %s %s)",
-		                        robot_number,
-		                        team_color.c_str(),
-		                        maintenance ? "TRUE" : "FALSE");
+		  clips_assert_input_f("(robot-SetRobotMaintenance %d %s %s)",
+		                       robot_number,
+		                       team_color.c_str(),
+		                       maintenance ? "TRUE" : "FALSE");
+		  request_clips_run();
 	  };
 	backend_->get_data()->clips_reset_machine = [this](std::string machine_name) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(reset-machine %s)", machine_name.c_str());
+		clips_assert_input_f("(reset-machine %s)", machine_name.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_production_reset_machine_by_team = [this](std::string machine_name,
 	                                                                      std::string team_color) {
 		fawkes::MutexLocker clips_lock(&clips_mutex_);
-		clips_->assert_fact_f("(ws-reset-machine-message %s %s)",
-		                      machine_name.c_str(),
-		                      team_color.c_str());
+		clips_assert_input_f("(ws-reset-machine-message %s %s)",
+		                     machine_name.c_str(),
+		                     team_color.c_str());
+		request_clips_run();
 	};
 	backend_->get_data()->clips_add_points_team = [this](int         points,
 	                                                     std::string team_color,
@@ -2377,13 +3628,14 @@ LLSFRefBox::setup_clips_websocket()
 		if ((team_color == "CYAN" || team_color == "MAGENTA")
 		    && (phase == "EXPLORATION" || phase == "PRODUCTION")) {
 			fawkes::MutexLocker clips_lock(&clips_mutex_);
-			clips_->assert_fact_f(
+			clips_assert_input_f(
 			  "(points (points %d) (team %s) (game-time %f) (phase %s) (reason \"%s\"))",
 			  points,
 			  team_color.c_str(),
 			  game_time,
 			  phase.c_str(),
 			  reason.c_str());
+			request_clips_run();
 		} else {
 			logger_->log_error("Websocket",
 			                   ": Received invalid points, expected team-color CYAN|MAGENTA and phase "
@@ -38,6 +38,8 @@
 #ifndef __LLSF_REFBOX_REFBOX_H_
 #define __LLSF_REFBOX_REFBOX_H_
 
+#include "input_log.h"
+
 #include <config/yaml.h>
 #include <core/threading/mutex.h>
 #include <core/threading/mutex_locker.h>
@@ -45,16 +47,22 @@
 #include <google/protobuf/message.h>
 #include <logging/logger.h>
 #include <mps_comm/machine.h>
+#include <protobuf_clips/fact_builder.h>
 #include <protobuf_comm/server.h>
 #include <utils/llsf/machines.h>
+#include <utils/time/virtual_clock.h>
 
 #ifdef HAVE_WEBSOCKETS
 #	include <websocket/backend.h>
 #endif
 
+#include <atomic>
 #include <boost/asio.hpp>
+#include <chrono>
 #include <clipsmm.h>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <unordered_map>
 
@@ -74,9 +82,12 @@ class WebviewRestApiManager;
 } // namespace fawkes
 
 #ifdef HAVE_MONGODB
+#	include "history_store.h"
+
 #	include <mongocxx/database.hpp>
 #	include <mongocxx/client.hpp>
 class MongoDBLogProtobuf;
+class MongoDBBulkWriter;
 #endif
 
 namespace rcll {
@@ -86,6 +97,8 @@ namespace rcll {
 
 class Configuration;
 class MultiLogger;
+class ClipsProfiler;
+class BroadcastBuilder;
 class WebviewServer;
 class ClipsRestApi;
 
@@ -93,24 +106,53 @@ class LLSFRefBox
 {
 public:
 	LLSFRefBox(int argc, char **argv);
+	LLSFRefBox(std::shared_ptr<Configuration> config);
 	~LLSFRefBox();
 
-	int run();
+	int           run();
+	void          tick();
+	CLIPS::Values evaluate(const std::string &expression);
+
+	static std::map<std::string, std::string> default_config_files();
+	static void                               detach_from_network(Configuration &config);
 
 	void                 handle_signal(const boost::system::error_code &error, int signum);
 	static constexpr int RESTART_CODE = 42;
 
 private: // methods
+	void init();
 	void read_config(int argc, char **argv);
 
 	void start_timer();
+	void arm_timer(unsigned int interval_ms);
 	void handle_timer(const boost::system::error_code &error);
+	void request_clips_run();
+	void run_clips();
+	void run_clips_engine();
+	void replay();
+
+	void          setup_clips_input_log();
+	void          record_input(const InputLogRecord &record);
+	void          clips_assert_input_f(const char *format, ...);
+	CLIPS::Values input_log_call(const char *name, std::function<CLIPS::Values()> call);
+	CLIPS::Value  clips_mps_generator_running();
+	CLIPS::Value  clips_mps_generator_field_generated();
+	CLIPS::Values clips_mps_generator_get_generated_field();
 
 	void setup_protobuf_comm();
 
+	void         setup_clips_broadcast_builder();
+	CLIPS::Value clips_net_build(const char                                                 *type,
+	                             std::function<std::shared_ptr<google::protobuf::Message>()> build);
+	CLIPS::Value clips_net_build_game_state();
+	CLIPS::Value clips_net_build_robot_info(double time, std::string pub_pose);
+	CLIPS::Value clips_net_build_machine_info(std::string team_color,
+	                                          std::string add_restricted_info);
+	CLIPS::Value clips_net_build_order_info();
+	CLIPS::Value clips_net_build_ring_info();
+
 	void start_clips();
 	void setup_clips();
-	void handle_clips_periodic();
 	void setup_clips_mongodb();
 
 	CLIPS::Values clips_now();
@@ -120,6 +162,11 @@ private: // methods
 	CLIPS::Value  clips_config_get_bool(std::string path);
 	CLIPS::Value  clips_config_get_int(std::string path);
 	void          clips_add_machine(const std::string &machine_name);
+	void          clips_profile_dump();
+	void          clips_assert_time();
+	void          clips_assert_mps_feedback(const std::string                     &machine_name,
+	                                        const char                            *feedback,
+	                                        protobuf_clips::ClipsFactBuilder::Atom value);
 
 	bool mutex_future_ready(const std::string &name);
 
@@ -138,11 +185,16 @@ private: // methods
 	void         clips_mongodb_upsert(std::string collection, void *bson, CLIPS::Value query);
 	void         clips_mongodb_update(std::string collection, void *bson, CLIPS::Value query);
 	void         clips_mongodb_replace(std::string collection, void *bson, CLIPS::Value query);
+	void         clips_mongodb_update_push(std::string  collection,
+	                                       void        *bson,
+	                                       void        *bson_push,
+	                                       CLIPS::Value query);
 	void         clips_mongodb_insert(std::string collection, void *bson);
 	void         mongodb_update(std::string                   &collection,
 	                            const bsoncxx::document::view &doc,
 	                            CLIPS::Value                  &query,
-	                            bool                           upsert);
+	                            bool                           upsert,
+	                            const bsoncxx::document::view &push = bsoncxx::document::view());
 	CLIPS::Value clips_mongodb_query_sort(std::string collection, void *bson, void *bson_sort);
 	CLIPS::Value clips_mongodb_query(std::string collection, void *bson);
 	//	CLIPS::Value  clips_mongodb_cursor_more(void *cursor);
@@ -152,9 +204,28 @@ private: // methods
 	CLIPS::Value  clips_bson_get(void *bson, std::string field_name);
 	CLIPS::Values clips_bson_get_array(void *bson, std::string field_name);
 	CLIPS::Values clips_bson_get_time(void *bson, std::string field_name);
+	void          clips_history_store(std::string kind, CLIPS::Values time, void *bson);
+	void
+	clips_history_array_append(void *array, std::string kind, int from, CLIPS::Values latest);
+	CLIPS::Value  clips_history_count(std::string kind);
+	void          clips_history_clear(std::string kind);
+	void          history_rows(const std::string                     &kind,
+	                           const std::vector<std::string>        &columns,
+	                           const CLIPS::Values                   &match,
+	                           std::vector<std::vector<std::string>> &rows);
 #endif
 
 	void clips_print_fact_list(CLIPS::Values facts, CLIPS::Values fields);
+	void clips_print_history_fact_list(std::string   kind,
+	                                   CLIPS::Values facts,
+	                                   CLIPS::Values fields,
+	                                   CLIPS::Values match);
+	bool fact_list_rows(CLIPS::Values                         &facts,
+	                    CLIPS::Values                         &fields,
+	                    std::vector<std::string>              &columns,
+	                    std::vector<std::vector<std::string>> &rows);
+	void print_table(const std::vector<std::string>              &columns,
+	                 const std::vector<std::vector<std::string>> &rows);
 
 	void clips_mps_move_conveyor(std::string machine,
 	                             std::string goal_position,
@@ -223,28 +294,48 @@ private: // members
 	Logger::LogLevel                                        log_level_;
 	std::shared_ptr<mps_placing_clips::MPSPlacingGenerator> mps_placing_generator_;
 
+	// declared before the components using it, which are destroyed first
+	std::unique_ptr<fawkes::VirtualClock> clock_;
+	float                                 cfg_virtual_time_factor_;
+
 	fawkes::Mutex                                                       clips_mutex_;
 	std::shared_ptr<CLIPS::Environment>                                 clips_;
 	std::unordered_map<std::string, std::unique_ptr<mps_comm::Machine>> mps_;
 	std::unique_ptr<protobuf_clips::ClipsProtobufCommunicator>          pb_comm_;
-	std::map<long int, CLIPS::Fact::pointer>                            clips_msg_facts_;
+	std::unique_ptr<protobuf_clips::ClipsFactBuilder>                   time_fact_;
+	std::unique_ptr<protobuf_clips::ClipsFactBuilder>                   mps_feedback_fact_;
+	std::unique_ptr<BroadcastBuilder>                                   broadcast_builder_;
 
 	std::map<std::string, std::future<bool>> mutex_futures_;
 
 	boost::asio::io_service     io_service_;
 	boost::asio::deadline_timer timer_;
 	boost::posix_time::ptime    timer_last_;
+	unsigned int                timer_step_;
+	bool                        timer_pending_;
 
 	unsigned int                  cfg_timer_interval_;
+	bool                          cfg_event_driven_;
+	unsigned int                  cfg_max_timer_interval_;
+	std::atomic<bool>             clips_run_requested_{false};
 	std::string                   cfg_clips_dir_;
 	llsf_utils::MachineAssignment cfg_machine_assignment_;
 
+	std::unique_ptr<ClipsProfiler>        clips_profiler_;
+	std::string                           cfg_clips_profile_file_;
+	std::chrono::steady_clock::duration   cfg_clips_profile_interval_;
+	std::chrono::steady_clock::time_point clips_profile_published_;
+
+	std::unique_ptr<InputLogWriter> input_log_;
+	std::unique_ptr<InputLogReader> replay_log_;
+
 #ifdef HAVE_WEBSOCKETS
 	websocket::Backend *backend_;
 	void                setup_clips_websocket();
+	void                websocket_publish_clips_profile();
 #endif
 
-	void clips_assert_confval(std::shared_ptr<Configuration::ValueIterator> v);
+	void clips_assert_confval(std::shared_ptr<Configuration::ValueIterator> v, bool input = false);
 
 #ifdef HAVE_AVAHI
 	std::shared_ptr<fawkes::AvahiThread>    avahi_thread_;
@@ -255,6 +346,8 @@ private: // members
 	bool                                cfg_mongodb_enabled_;
 	std::string                         cfg_mongodb_hostport_;
 	std::unique_ptr<MongoDBLogProtobuf> mongodb_protobuf_;
+	std::unique_ptr<MongoDBBulkWriter>  mongodb_writer_;
+	std::unique_ptr<HistoryStore>       history_store_;
 	mongocxx::client                    client_;
 	mongocxx::database                  database_;
 #endif
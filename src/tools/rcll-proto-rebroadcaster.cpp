@@ -45,7 +45,6 @@
 #include <mutex>
 #include <string>
 
-using namespace protobuf_comm;
 using namespace fawkes;
 
 std::string cfg_file_;